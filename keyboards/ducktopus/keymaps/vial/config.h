@@ -11,6 +11,74 @@
 #define TAPPING_TERM 0
 #define TAP_CODE_DELAY 10
 
+// the RP2040 has no FPU
+#define HEURISTIC_TAP_HOLD_FIXED_POINT
+
+// times the float and fixed point heuristics in cycles, when
+// host/hid_kernel_bench asks for it
+// #define HEURISTIC_TAP_HOLD_KERNEL_BENCH
+
+// readable with host/hid_latency
+#define HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+
+// off until host/hid_capture turns it on (and left out of the build, as with
+// VIAL_INSECURE any program that can open the hidraw device could turn it on
+// and read the positions, i.e. the text, of what is typed)
+// #define KEYSTROKE_CAPTURE_ENABLE
+
+// the Vial keymap in RAM, for the lookups in other layers of keymap.c
+#define KEYMAP_MIRROR_ENABLE
+
+// the keycode of every key with the layers that are on now (off, as nothing in
+// keymap.c looks up another key on the active layers yet)
+// #define EFFECTIVE_KEYMAP_ENABLE
+
+// counts the calls and SysTick cycles of the process_record handlers of
+// keymap.c, readable with host/hid_record_handlers (it costs two SysTick reads
+// per call, so it's off unless you are profiling)
+// #define RECORD_HANDLER_STATS
+
+// how long the stages of the scan loop take in us (and the scan rate),
+// readable with host/hid_scan_profiler or on the console with CONSOLE_ENABLE
+// #define SCAN_PROFILER_ENABLE
+
+// all zero until host/bigram_table writes learned ones
+#define HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS
+// the tap hold keys of keymap.c: I, A, E, Ö, Esc, Space, Enter (left) and
+// N, R, T, dot, Del, Backspace (right)
+#define HEURISTIC_TAP_HOLD_BIGRAM_POSITIONS { \
+    {.row = 2, .col = 2}, {.row = 2, .col = 3}, {.row = 2, .col = 4}, {.row = 3, .col = 2}, \
+    {.row = 5, .col = 1}, {.row = 5, .col = 3}, {.row = 5, .col = 4}, \
+    {.row = 8, .col = 1}, {.row = 8, .col = 2}, {.row = 8, .col = 3}, {.row = 9, .col = 3}, \
+    {.row = 11, .col = 1}, {.row = 11, .col = 2}, \
+}
+// BIGRAM_EEPROM_SIZE of the 13 positions above (472), plus room for the
+// runtime coefficients (108) and adaptive biases (7) that go after them. The
+// VIA magic and the Vial keymap come after the user datablock, so every change
+// of its size resets the keymap once. It's reserved once instead of growing
+// with each of them.
+#define EECONFIG_USER_DATA_SIZE (472 + 108 + 7)
+
+// the compiled in ones until host/hid_coefficients writes others, in the
+// EEPROM after the bigram offsets (BIGRAM_EEPROM_SIZE of the 13 positions
+// above)
+#define HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS
+#define HEURISTIC_TAP_HOLD_COEFFICIENTS_EEPROM_OFFSET 472
+
+// learned from Backspace corrections, after the coefficients (off until the
+// step, decay and correction window are calibrated with replay -a)
+// #define HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+#define HEURISTIC_TAP_HOLD_ADAPTIVE_EEPROM_OFFSET (472 + 108)
+
+// a candidate next to the live heuristics, readable with host/hid_shadow (off,
+// as the default candidate decides like the live fixed point path, override
+// the shadow_ functions with the one to try first)
+// #define HEURISTIC_TAP_HOLD_SHADOW
+
+// chooses tap for every same side pair until host/same_side_table trains it,
+// see also choose_when_next_to_heuristic_tap_hold_on_same_side in keymap.c
+#define HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL
+
 /* use this without: Vial
 #ifndef TAPPING_TERM_PER_KEY
     #define TAPPING_TERM_PER_KEY
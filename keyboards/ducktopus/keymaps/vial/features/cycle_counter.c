@@ -0,0 +1,36 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <stdbool.h>
+
+#include "cycle_counter.h"
+
+#        ifdef __arm__
+#include <ch.h>
+
+static bool is_started = false;
+
+static void start_cycle_counter(void) {
+    is_started = true;
+    // ChibiOS may already use it for its tick, otherwise it counts freely
+    if (SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) return;
+    SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+
+uint32_t read_cycle_counter(void) {
+    if (!is_started) start_cycle_counter();
+    return SysTick->VAL;
+}
+
+
+uint32_t get_cycles_between(uint32_t start, uint32_t end) {
+    // it counts down to 0 and starts again at LOAD
+    return start >= end ? start - end : start + SysTick->LOAD + 1 - end;
+}
+#        else
+uint32_t get_cycles_between(uint32_t start, uint32_t end) {
+    return end - start;
+}
+#        endif
@@ -0,0 +1,16 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Counts CPU cycles for the profiling features. On ARM, it's SysTick, which
+// is started free running at the CPU clock if ChibiOS doesn't use it. It's
+// 24 bit and counts down to 0 from LOAD, so only spans shorter than a tick of
+// ChibiOS (or about 0.13 s at 125 MHz) are measured right.
+
+#pragma once
+
+#include <stdint.h>
+
+// Without SysTick, the build has to provide this (the host one reads the TSC).
+uint32_t read_cycle_counter(void);
+
+// the cycles from start to end, both read with read_cycle_counter
+uint32_t get_cycles_between(uint32_t start, uint32_t end);
@@ -0,0 +1,39 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "eeprom.h"
+#include "eeprom_block.h"
+
+
+static void fill_header(const void* data, uint16_t size, const uint8_t* tag, uint8_t* header) {
+    uint8_t checksum = 0;
+    const uint8_t* bytes = (const uint8_t*) data;
+    for (uint16_t i = 0; i < size; ++i) {
+        // rotate, so swapped bytes change it too
+        checksum = (uint8_t) ((checksum << 1 | checksum >> 7) ^ bytes[i]);
+    }
+
+    memcpy(header, tag, CHECKED_BLOCK_TAG_SIZE);
+    header[CHECKED_BLOCK_TAG_SIZE] = checksum;
+}
+
+
+bool load_checked_block(const uint8_t* addr, void* data, uint16_t size, const uint8_t tag[CHECKED_BLOCK_TAG_SIZE]) {
+    uint8_t stored_header[CHECKED_BLOCK_HEADER_SIZE];
+    eeprom_read_block(stored_header, addr, sizeof(stored_header));
+    eeprom_read_block(data, addr + CHECKED_BLOCK_HEADER_SIZE, size);
+
+    uint8_t header[CHECKED_BLOCK_HEADER_SIZE];
+    fill_header(data, size, tag, header);
+    return memcmp(header, stored_header, sizeof(header)) == 0;
+}
+
+
+void save_checked_block(uint8_t* addr, const void* data, uint16_t size, const uint8_t tag[CHECKED_BLOCK_TAG_SIZE]) {
+    uint8_t header[CHECKED_BLOCK_HEADER_SIZE];
+    fill_header(data, size, tag, header);
+
+    eeprom_update_block(data, addr + CHECKED_BLOCK_HEADER_SIZE, size);
+    eeprom_update_block(header, addr, sizeof(header));
+}
@@ -0,0 +1,24 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// A block of the EEPROM (e.g. a table in the user datablock) behind a header
+// of a tag and a checksum of the block. The tag is the version and two bytes
+// of the layout (e.g. counts or sizes) of what the block holds, so a header
+// that doesn't match means the block was never saved, or saved by a build
+// with another layout, or only partly written. The caller then falls back to
+// its defaults.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHECKED_BLOCK_TAG_SIZE    3
+#define CHECKED_BLOCK_HEADER_SIZE (CHECKED_BLOCK_TAG_SIZE + 1)
+
+// Reads size bytes from behind the header at addr into data. Returns false, if
+// the header doesn't match the tag and what was read (data still holds it).
+bool load_checked_block(const uint8_t* addr, void* data, uint16_t size, const uint8_t tag[CHECKED_BLOCK_TAG_SIZE]);
+
+// Writes data and then the header, so the block only matches once all of it
+// was written.
+void save_checked_block(uint8_t* addr, const void* data, uint16_t size, const uint8_t tag[CHECKED_BLOCK_TAG_SIZE]);
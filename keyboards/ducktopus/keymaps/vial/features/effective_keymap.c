@@ -0,0 +1,121 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        ifdef EFFECTIVE_KEYMAP_ENABLE
+
+#include "effective_keymap.h"
+#        ifdef VIA_ENABLE
+#include "via.h"
+#        endif
+#        ifdef VIAL_ENABLE
+#include "dynamic_keymap.h"
+#        ifdef KEYMAP_MIRROR_ENABLE
+#include "keymap_mirror.h"
+#        endif
+#        else
+#include "keymap_introspection.h"
+#        endif
+
+static uint16_t keycodes[MATRIX_ROWS][MATRIX_COLS];
+static uint8_t layers[MATRIX_ROWS][MATRIX_COLS];
+
+// layer_state | default_layer_state, kept even while not resolved
+static layer_state_t resolved_state = 0;
+static bool is_resolved = false;
+
+
+static uint16_t get_keycode_in_layer(uint8_t layer, uint8_t row, uint8_t col) {
+#        if defined(VIAL_ENABLE) && defined(KEYMAP_MIRROR_ENABLE)
+    return keymap_mirror_get_keycode(layer, row, col);
+#        elif defined(VIAL_ENABLE)
+    return dynamic_keymap_get_keycode(layer, row, col);
+#        else
+    return keycode_at_keymap_location(layer, row, col);
+#        endif
+}
+
+
+static uint8_t get_layer_count(void) {
+#        ifdef VIAL_ENABLE
+    return DYNAMIC_KEYMAP_LAYER_COUNT;
+#        else
+    return keymap_layer_count();
+#        endif
+}
+
+
+// like layer_switch_get_layer: the highest layer that is on where the key isn't
+// transparent, or else layer 0
+static void resolve_key(uint8_t row, uint8_t col) {
+    for (int8_t layer = (int8_t) get_layer_count() - 1; layer >= 0; --layer) {
+        if (!(resolved_state & ((layer_state_t) 1 << layer))) continue;
+
+        const uint16_t keycode = get_keycode_in_layer((uint8_t) layer, row, col);
+        if (keycode != KC_TRNS) {
+            keycodes[row][col] = keycode;
+            layers[row][col] = (uint8_t) layer;
+            return;
+        }
+    }
+    keycodes[row][col] = get_keycode_in_layer(0, row, col);
+    layers[row][col] = 0;
+}
+
+
+static void resolve_all_keys(void) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            resolve_key(row, col);
+        }
+    }
+    is_resolved = true;
+}
+
+
+void update_effective_keymap(layer_state_t state) {
+    const layer_state_t changed = state ^ resolved_state;
+    resolved_state = state;
+    if (!is_resolved || changed == 0) return;
+
+    // a key keeps its keycode if nothing changed at or above the layer it was
+    // resolved on (that layer is still on, and none above it was turned on)
+    const uint8_t highest_changed = get_highest_layer(changed);
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            if (layers[row][col] <= highest_changed) resolve_key(row, col);
+        }
+    }
+}
+
+
+uint16_t get_effective_keycode(uint8_t row, uint8_t col) {
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return KC_NO;
+    if (!is_resolved) resolve_all_keys();
+    return keycodes[row][col];
+}
+
+
+uint8_t get_effective_layer(uint8_t row, uint8_t col) {
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return 0;
+    if (!is_resolved) resolve_all_keys();
+    return layers[row][col];
+}
+
+
+#        ifdef VIA_ENABLE
+void update_effective_keymap_before_via_command(const uint8_t* data, uint8_t length) {
+    if (length < 1) return;
+
+    switch (data[0]) {
+        case id_dynamic_keymap_set_keycode:
+        case id_dynamic_keymap_set_buffer:
+        case id_dynamic_keymap_reset:
+        case id_eeprom_reset:
+            // VIA hasn't written the change yet, so wait for the next lookup
+            is_resolved = false;
+            return;
+    }
+}
+#        endif
+
+
+#        endif // EFFECTIVE_KEYMAP_ENABLE
@@ -0,0 +1,37 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// The keycode every key has with the layers that are on right now, resolved
+// through transparent keys the way layer_switch_get_layer does, so looking it
+// up is a single array index no matter how many layers are on.
+//
+// It's updated whenever the layer state or the default layer state changes.
+// Only the keys whose layer it was resolved on (or a layer below it) changed
+// are resolved again. After the keymap is changed by a VIA command, all of it
+// is resolved again on the next lookup. With KEYMAP_MIRROR_ENABLE, it's
+// resolved from the RAM copy of the Vial keymap.
+//
+// QMK itself still resolves the key of every key event (layer_switch_get_layer
+// can't be replaced from a keymap). This is for the code of the keymap that
+// needs the keycode of another key, like get_event_keycode would give it.
+//
+// It takes 3 bytes of RAM per key (216 with the 72 keys of the Ducktopus).
+
+#pragma once
+
+#include "quantum.h"
+
+// Call this with the state layer_state_set_user returns, combined with
+// default_layer_state, and the same for default_layer_state_set_user.
+void update_effective_keymap(layer_state_t state);
+
+// the keycode a press of the key would have right now
+uint16_t get_effective_keycode(uint8_t row, uint8_t col);
+
+// the layer that keycode is on
+uint8_t get_effective_layer(uint8_t row, uint8_t col);
+
+#        ifdef VIA_ENABLE
+// Call this at the start of via_command_kb (after the keymap mirror), with
+// every command. It never handles one.
+void update_effective_keymap_before_via_command(const uint8_t* data, uint8_t length);
+#        endif
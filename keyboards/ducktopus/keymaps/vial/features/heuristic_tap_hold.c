@@ -2,123 +2,176 @@
 
 #        if !defined(NO_ACTION_TAPPING)
 
-#include "heuristic_tap_hold.h"
-
-
-// The value here was chosen, because most zero overlap non-mod presses
-// in the data set have shorter durations.
-#define MS_MAX_OVERLAP              358
-#define MS_MAX_DUR                32767
+#include <string.h>
 
+#include "heuristic_tap_hold.h"
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+#include "heuristic_tap_hold_latency.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_TYPING_RHYTHM
+#include "heuristic_tap_hold_rhythm.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS
+#include "heuristic_tap_hold_bigrams.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+#include "heuristic_tap_hold_shadow.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+#include "heuristic_tap_hold_adaptive.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL
+#include "heuristic_tap_hold_same_side.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS
+#include "heuristic_tap_hold_coefficients.h"
+
+// with the coefficients written over raw HID
+#undef estimate_min_overlap_for_hold_in_ms
+#undef estimate_hold_when_wrapped
+#undef estimate_hold_when_two_down
+#define estimate_min_overlap_for_hold_in_ms estimate_min_overlap_for_hold_in_ms_runtime
+#define estimate_hold_when_wrapped          estimate_hold_when_wrapped_runtime
+#define estimate_hold_when_two_down         estimate_hold_when_two_down_runtime
+#        endif
 
+// room for at least one tap hold key and the key after it
+_Static_assert(HEURISTIC_TAP_HOLD_QUEUE_SIZE >= 2 && HEURISTIC_TAP_HOLD_QUEUE_SIZE <= 255,
+               "HEURISTIC_TAP_HOLD_QUEUE_SIZE must be between 2 and 255");
+_Static_assert(HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE >= 1 && HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE <= 255,
+               "HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE must be between 1 and 255");
+
+
+// A tap hold key or the key pressed after it, in the order they were pressed.
+// The first undecided one is the heuristic tap hold key, the one after it
+// (if any) is the next key. Tap hold keys stay queued until they are
+// released, so we know whether to release them as tap or hold. Other keys
+// leave the queue as soon as the tap hold key before them was decided.
+typedef struct {
+    keyrecord_t record;
+    uint16_t keycode;
+    uint32_t press_timer;
+    int16_t ms_between_prev_release_and_press;
+    uint8_t mods;
+    bool prev_was_mod;
+    bool was_held_instantly;
+    tap_hold_decision_options decision;
+} queued_key_t;
+
+static queued_key_t queue[HEURISTIC_TAP_HOLD_QUEUE_SIZE];
+static uint8_t queue_count = 0;
 
-static tap_hold_decision_options tap_hold_decision = UNDECIDED;
 static bool is_processing_record_due_to_us = false;
 static uint16_t ms_min_overlap_for_hold_estimate = 0;
 
-static bool ms_between_prev_release_and_this_press_was_set = false;
+// of the heuristic tap hold key, see get_max_overlap_in_ms
+static uint16_t ms_max_overlap = MS_MAX_OVERLAP;
 
-static uint16_t ms_between_prev_release_and_this_press = 0;
 static int16_t ms_between_prev_release_and_heuristic_tap_hold_press = 0;
 
-static uint16_t ms_prev_release_timer = 0;
-static uint16_t ms_heuristic_tap_hold_press_timer = 0;
-static uint16_t ms_overlap_timer = 0;
-static uint16_t ms_next_to_heuristic_tap_hold_press_to_release_timer = 0;
+// 32-bit, so they don't wrap around while a key is held or between presses
+static uint32_t ms_prev_release_timer = 0;
+static uint32_t ms_heuristic_tap_hold_press_timer = 0;
+static uint32_t ms_overlap_timer = 0;
+static uint32_t ms_next_to_heuristic_tap_hold_press_to_release_timer = 0;
+
+// when heuristic_tap_hold_task has to do something next
+static uint32_t ms_task_deadline = 0;
 
 static bool prev_was_mod = false;
 static bool prev_to_heuristic_tap_hold_was_mod = false;
 static bool heuristic_tap_hold_is_on_left = false;
 
-static uint16_t heuristic_tap_hold_keycode = KC_NO;
-static keyrecord_t heuristic_tap_hold_record;
-static uint8_t heuristic_tap_hold_mods = 0;
-static bool heuristic_tap_hold_keycode_was_held_instantly = false;
-
-static uint16_t next_to_heuristic_tap_hold_keycode = KC_NO;
-static keyrecord_t next_to_heuristic_tap_hold_record;
-static uint8_t next_to_heuristic_tap_hold_mods = 0;
 static uint16_t ms_between_heuristic_tap_hold_press_and_next_press = 0;
 
 static uint16_t prev_heuristic_tap_hold_keycode = KC_NO;
 static tap_hold_decision_options prev_tap_hold_decision = UNDECIDED;
 
 
-static void reset_heuristic_tap_hold(void) {
-    tap_hold_decision = UNDECIDED;
-    ms_min_overlap_for_hold_estimate = 0;
-    ms_between_prev_release_and_this_press_was_set = false;
+#define IS_TAP_HOLD_KEYCODE(kc) (IS_QK_MOD_TAP(kc) || IS_QK_LAYER_TAP(kc))
 
-    heuristic_tap_hold_keycode = KC_NO;
-    heuristic_tap_hold_record = (keyrecord_t){0};
-    heuristic_tap_hold_mods = 0;
-    heuristic_tap_hold_keycode_was_held_instantly = false;
 
-    next_to_heuristic_tap_hold_keycode = KC_NO;
-    next_to_heuristic_tap_hold_record = (keyrecord_t){0};
-    next_to_heuristic_tap_hold_mods = 0;
+// the first undecided key is always a tap hold key, as other keys are only
+// queued after one
+static queued_key_t* get_heuristic_tap_hold(void) {
+    for (uint8_t i = 0; i < queue_count; ++i) {
+        if (queue[i].decision == UNDECIDED) return &queue[i];
+    }
+    return NULL;
 }
 
 
-static uint16_t calculate_min_overlap_for_hold_in_ms(void) {
-    // a MIN(MS_MAX_DUR is not necessary here due to the tap hold task
-    const float prev_up_th_down_dur = (float) ms_between_prev_release_and_heuristic_tap_hold_press;
+// decided keys are always in front of the heuristic tap hold key
+static queued_key_t* get_next_to_heuristic_tap_hold(queued_key_t* heuristic_tap_hold) {
+    return heuristic_tap_hold + 1 < queue + queue_count ? heuristic_tap_hold + 1 : NULL;
+}
 
-    const float th_down_next_down_dur = (float) ms_between_heuristic_tap_hold_press_and_next_press;
 
-    const float guess = ABS(MAX(
-            -prev_up_th_down_dur,
-            MAX(
-                3.0614197f,
-                MAX(
-                    1386.7545166f,
-                    -136.1621093f * prev_up_th_down_dur - 315.5284118f
-                ) - MAX(prev_up_th_down_dur, 325.5094909f) -
-                    6.4232006f * th_down_next_down_dur +
-                    302.9532165f
-            )
-    ));
+static queued_key_t* find_queued_key(uint16_t keycode) {
+    for (uint8_t i = 0; i < queue_count; ++i) {
+        if (queue[i].keycode == keycode) return &queue[i];
+    }
+    return NULL;
+}
+
 
-    return MIN(MS_MAX_OVERLAP, MAX(1, (uint16_t) guess));
+static queued_key_t* add_to_queue(const queued_key_t* key) {
+    queue[queue_count] = * key;
+    return &queue[queue_count++];
 }
 
 
-__attribute__((weak)) bool should_choose_hold_when_next_to_heuristic_tap_hold_is_wrapped(void) {
-    const float next_dur = (float) timer_elapsed(
-            ms_next_to_heuristic_tap_hold_press_to_release_timer);
+static void remove_from_queue(queued_key_t* key) {
+    const uint8_t index = key - queue;
+    memmove(key, key + 1, (queue_count - index - 1) * sizeof(queued_key_t));
+    --queue_count;
+}
 
-    const float prev_up_th_down_dur = (float) ms_between_prev_release_and_heuristic_tap_hold_press;
-    const float th_down_next_down_dur = (float) ms_between_heuristic_tap_hold_press_and_next_press;
 
-    const float th_down_next_down_dur_reciprocal = SD(1.0f, th_down_next_down_dur);
+static uint16_t calculate_min_overlap_for_hold_in_ms(void) {
+    // a MIN(MS_MAX_DUR is not necessary here due to the tap hold task
+    return estimate_min_overlap_for_hold_in_ms(
+            ms_between_prev_release_and_heuristic_tap_hold_press,
+            ms_between_heuristic_tap_hold_press_and_next_press);
+}
 
-    const float non_zero_divisor = MAX(
-             1.1125613f + 558.6079711f * th_down_next_down_dur_reciprocal,
-             MAX(
-                 110.8752517f,
-                 MAX(1.1125613f, -5.7630343f * prev_up_th_down_dur - 184.2279510f) * -prev_up_th_down_dur
-             ) + SD(4170.0205078f, next_dur) - 179.2697753f
-     );
 
-    const float guess = MAX(prev_up_th_down_dur * 0.6423792f, 23.4521789f) / (
-            542.2182617f * th_down_next_down_dur_reciprocal * non_zero_divisor
-    );
+// separate from the estimate, so host/evolve can replace that on its own
+static uint16_t calculate_min_overlap_for_hold_of_pair_in_ms(queued_key_t* heuristic_tap_hold, queued_key_t* next) {
+    uint16_t estimate = calculate_min_overlap_for_hold_in_ms();
 
-    return guess > 0.5f || guess < -0.5f;
+#        ifdef HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS
+    estimate = offset_min_overlap_for_hold(estimate, heuristic_tap_hold->record.event.key, next->record.event.key);
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+    estimate = bias_min_overlap_for_hold(estimate);
+#        endif
+    return estimate;
 }
 
-__attribute__((weak)) bool should_choose_hold_when_two_down_after_heuristic_tap_hold(void) {
-    const float prev_up_th_down_dur = (float) ms_between_prev_release_and_heuristic_tap_hold_press;
-    const float th_down_next_down_dur = (float) ms_between_heuristic_tap_hold_press_and_next_press;
-    const float prev_is_mod = (float) prev_to_heuristic_tap_hold_was_mod;
 
-    const float guess = (
-            ABS(-0.0297553f * prev_up_th_down_dur - 9.2836914f) +
-                (0.2559899f + prev_is_mod * (0.0180325f * MAX(-prev_up_th_down_dur, 17.5247516f))) *
-                th_down_next_down_dur
-    ) / (MAX(-prev_up_th_down_dur, 14.0228700f) * -9.2638397f);
+// of the wrap and two down heuristics, which see the next key pressed later
+// than it was, if they learned to hold more
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+#define GET_TH_DOWN_NEXT_DOWN_DUR(bias) \
+    bias_th_down_next_down_dur(bias, ms_between_heuristic_tap_hold_press_and_next_press)
+#        else
+#define GET_TH_DOWN_NEXT_DOWN_DUR(bias) ms_between_heuristic_tap_hold_press_and_next_press
+#        endif
+
 
-    return guess > 0.5f || guess < -0.5f;
+__attribute__((weak)) bool should_choose_hold_when_next_to_heuristic_tap_hold_is_wrapped(void) {
+    return estimate_hold_when_wrapped(
+            ms_between_prev_release_and_heuristic_tap_hold_press,
+            GET_TH_DOWN_NEXT_DOWN_DUR(ADAPTIVE_BIAS_WRAPPED),
+            timer_elapsed32(ms_next_to_heuristic_tap_hold_press_to_release_timer));
+}
+
+__attribute__((weak)) bool should_choose_hold_when_two_down_after_heuristic_tap_hold(void) {
+    return estimate_hold_when_two_down(
+            ms_between_prev_release_and_heuristic_tap_hold_press,
+            GET_TH_DOWN_NEXT_DOWN_DUR(ADAPTIVE_BIAS_TWO_DOWN),
+            prev_to_heuristic_tap_hold_was_mod);
 }
 
 
@@ -135,13 +188,22 @@ uint16_t get_tap_keycode(uint16_t keycode) {
 bool prev_chose_tap_and_was_same_tap_hold(void) {
     return (
            prev_tap_hold_decision == CHOSE_TAP &&
-           prev_heuristic_tap_hold_keycode == heuristic_tap_hold_keycode
+           prev_heuristic_tap_hold_keycode == get_heuristic_tap_hold_keycode()
    );
 }
 
 
 uint16_t get_heuristic_tap_hold_keycode(void) {
-    return heuristic_tap_hold_keycode;
+    const queued_key_t* heuristic_tap_hold = get_heuristic_tap_hold();
+    if (heuristic_tap_hold != NULL) return heuristic_tap_hold->keycode;
+
+    // all queued keys were decided, so this is the one decided last
+    return queue_count > 0 ? queue[queue_count - 1].keycode : KC_NO;
+}
+
+
+bool is_heuristic_tap_hold_queue_empty(void) {
+    return queue_count == 0;
 }
 
 
@@ -150,10 +212,23 @@ __attribute__((weak)) bool should_choose_tap_when_pressed_very_long_without_anot
 }
 
 
+#        ifdef HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL
+tap_hold_decision_options choose_by_same_side_model(void) {
+    return estimate_same_side_decision(
+            ms_between_prev_release_and_heuristic_tap_hold_press,
+            ms_between_heuristic_tap_hold_press_and_next_press);
+}
+#        endif
+
+
 __attribute__((weak)) tap_hold_decision_options choose_when_next_to_heuristic_tap_hold_on_same_side(
         keyrecord_t* record, uint16_t keycode, bool is_left) {
+#        ifdef HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL
+    return choose_by_same_side_model();
+#        else
     // by default, we only allow hold if the next key is on the other side
     return CHOSE_TAP;
+#        endif
 }
 
 
@@ -162,6 +237,20 @@ __attribute__((weak)) bool should_hold_instantly(void) {
 }
 
 
+__attribute__((weak)) uint16_t get_max_overlap_in_ms(void) {
+#        ifdef HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS
+    return get_heuristic_tap_hold_coefficients()->max_overlap_ms;
+#        else
+    return MS_MAX_OVERLAP;
+#        endif
+}
+
+
+__attribute__((weak)) bool should_decide_overlap_early(int8_t confidence) {
+    return ABS(confidence) >= HEURISTIC_TAP_HOLD_EARLY_COMMIT_CONFIDENCE;
+}
+
+
 // thanks to u/pgetreuer
 bool is_on_left_hand(keyrecord_t* record) {
     keypos_t pos = record->event.key;
@@ -183,6 +272,189 @@ static void process_record_with_new_time(keyrecord_t* record) {
 }
 
 
+#define WITH_TEMP_MODS_ADDED(mods, ...) \
+    do { \
+        const uint8_t _real_mods = get_mods(); \
+        add_mods(mods); \
+        { __VA_ARGS__ } \
+        set_mods(_real_mods); \
+    } while (0)
+
+
+#define WITH_TEMP_MODS(mods, ...) \
+    do { \
+        const uint8_t _real_mods = get_mods(); \
+        set_mods(mods); \
+        { __VA_ARGS__ } \
+        set_mods(_real_mods); \
+    } while (0)
+
+
+// Delayed output
+//
+// Some key presses have to be visible to the OS for TAP_CODE_DELAY before what
+// comes after them is sent. Instead of stalling matrix scanning (and with it
+// the split transport) in wait_ms, everything after such a delay is queued
+// and sent by heuristic_tap_hold_task once the delay has passed. Key events
+// that QMK would otherwise handle in the meantime are queued too, so the OS
+// gets all of them in the order they happened.
+typedef enum {
+    OUTPUT_RECORD,
+    OUTPUT_CODE,
+    OUTPUT_DELAY,
+} output_kind_t;
+
+typedef struct {
+    keyrecord_t record; // for OUTPUT_CODE, only event.pressed is used
+    uint16_t code;
+    uint8_t mods_to_add;
+    output_kind_t kind;
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+    // for OUTPUT_RECORD, the path whose latency it is (DECISION_PATH_COUNT for
+    // none), recorded once it was sent
+    tap_hold_decision_path latency_path;
+    uint32_t press_timer;
+#        endif
+} queued_output_t;
+
+static queued_output_t output_queue[HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE];
+static uint8_t output_queue_start = 0;
+static uint8_t output_queue_count = 0;
+
+// started when the delay at the front of the output queue was reached
+static uint32_t ms_output_delay_timer = 0;
+
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+// the path that decided the key before the pressed one, which QMK handles, so
+// its latency can be recorded once it's sent
+static tap_hold_decision_path latency_path_of_press = DECISION_PATH_COUNT;
+#        endif
+
+
+static void send_output(queued_output_t* output) {
+    switch (output->kind) {
+        case OUTPUT_RECORD:
+            if (output->mods_to_add == 0) {
+                // a hold registers mods, which must not be undone here
+                process_record_with_new_time(& output->record);
+            } else {
+                WITH_TEMP_MODS_ADDED(output->mods_to_add, {
+                    process_record_with_new_time(& output->record);
+                });
+            }
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+            if (output->latency_path != DECISION_PATH_COUNT) {
+                record_heuristic_tap_hold_latency(output->latency_path, timer_elapsed32(output->press_timer));
+            }
+#        endif
+            break;
+        case OUTPUT_CODE:
+            if (output->record.event.pressed) {
+                register_code16(output->code);
+            } else {
+                unregister_code16(output->code);
+            }
+            break;
+        case OUTPUT_DELAY:
+            // the delay only starts once everything before it was sent
+            send_keyboard_report();
+            ms_output_delay_timer = timer_read32();
+            break;
+    }
+}
+
+
+static uint16_t get_ms_left_of_output_delay(void) {
+#        if TAP_CODE_DELAY > 0
+    const uint32_t ms_elapsed = timer_elapsed32(ms_output_delay_timer);
+    return ms_elapsed < TAP_CODE_DELAY ? TAP_CODE_DELAY - ms_elapsed : 0;
+#        else
+    // delays are never queued then
+    return 0;
+#        endif
+}
+
+
+// Sends queued outputs until it reaches a delay that hasn't passed yet.
+static void send_due_outputs(void) {
+    while (output_queue_count > 0) {
+        if (output_queue[output_queue_start].kind == OUTPUT_DELAY) {
+            if (get_ms_left_of_output_delay() > 0) return;
+        } else {
+            send_output(& output_queue[output_queue_start]);
+        }
+
+        output_queue_start = (output_queue_start + 1) % HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE;
+        --output_queue_count;
+
+        if (output_queue_count > 0 && output_queue[output_queue_start].kind == OUTPUT_DELAY) {
+            send_output(& output_queue[output_queue_start]);
+        }
+    }
+}
+
+
+static void queue_output(queued_output_t output) {
+    if (output_queue_count == 0 && output.kind != OUTPUT_DELAY) {
+        // nothing has to be sent before it
+        send_output(& output);
+        return;
+    }
+
+    while (output_queue_count == HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE) {
+        // rare, so just stall like before (the front is always a delay here)
+        const uint16_t ms_left = get_ms_left_of_output_delay();
+        if (ms_left > 0) wait_ms(ms_left);
+        send_due_outputs();
+    }
+
+    const uint8_t index = (output_queue_start + output_queue_count) % HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE;
+    output_queue[index] = output;
+    if (output_queue_count++ == 0) {
+        // this is a delay, which starts right away
+        send_output(& output_queue[index]);
+    }
+}
+
+
+// If latency_path isn't DECISION_PATH_COUNT, the time since press_timer is
+// recorded as its latency once the record is sent, which may be after a delay
+// in the output queue.
+static void send_record_of_path(keyrecord_t* record, uint8_t mods_to_add, tap_hold_decision_path latency_path,
+                                uint32_t press_timer) {
+    queued_output_t output = {.record = * record, .mods_to_add = mods_to_add, .kind = OUTPUT_RECORD};
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+    output.latency_path = latency_path;
+    output.press_timer = press_timer;
+#        endif
+    queue_output(output);
+}
+
+
+static void send_record(keyrecord_t* record, uint8_t mods_to_add) {
+    send_record_of_path(record, mods_to_add, DECISION_PATH_COUNT, 0);
+}
+
+
+static void send_code(uint16_t code, bool pressed) {
+    queued_output_t output = {.code = code, .kind = OUTPUT_CODE};
+    output.record.event.pressed = pressed;
+    queue_output(output);
+}
+
+
+// Possibly wait, so that to the OS the keys sent so far seem to have been
+// pressed for at least a millisecond (otherwise OSes / apps might ignore
+// presses), before the ones after it are sent.
+static void delay_output(void) {
+#        if TAP_CODE_DELAY > 0
+    queue_output((queued_output_t) {.kind = OUTPUT_DELAY});
+#        else
+    send_keyboard_report();
+#        endif
+}
+
+
 // this is similar to tap_code16
 /*
 static void process_tap_record(keyrecord_t* record, bool is_tap_hold) {
@@ -205,31 +477,32 @@ static void process_tap_record(keyrecord_t* record, bool is_tap_hold) {
 */
 
 
-static void process_register_record(keyrecord_t* record) {
+static void process_register_record(keyrecord_t* record, uint8_t mods_to_add, tap_hold_decision_path latency_path,
+                                    uint32_t press_timer) {
     record->event.pressed = true;
-    process_record_with_new_time(record);
+    send_record_of_path(record, mods_to_add, latency_path, press_timer);
 }
 
 
 static void process_register_record_as_hold(keyrecord_t* record) {
     record->tap.count = 0;
     record->event.pressed = true;
-    process_record_with_new_time(record);
+    send_record(record, 0);
 }
 
 
 static void process_unregister_record_as_hold(keyrecord_t* record) {
     record->tap.count = 0;
     record->event.pressed = false;
-    process_record_with_new_time(record);
+    send_record(record, 0);
 }
 
 
-static void process_register_record_as_tap(keyrecord_t* record) {
+static void process_register_record_as_tap(keyrecord_t* record, uint8_t mods_to_add) {
     record->tap.interrupted = true;
     record->tap.count = 1;
     record->event.pressed = true;
-    process_record_with_new_time(record);
+    send_record(record, mods_to_add);
 }
 
 
@@ -237,129 +510,255 @@ static void process_unregister_record_as_tap(keyrecord_t* record) {
     record->tap.interrupted = true;
     record->tap.count = 1;
     record->event.pressed = false;
-    process_record_with_new_time(record);
+    send_record(record, 0);
 }
 
 
-#define IS_TAP_HOLD_KEYCODE(kc) (IS_QK_MOD_TAP(kc) || IS_QK_LAYER_TAP(kc))
+static void start_heuristic_tap_hold(queued_key_t* heuristic_tap_hold) {
+    ms_heuristic_tap_hold_press_timer = heuristic_tap_hold->press_timer;
+    ms_between_prev_release_and_heuristic_tap_hold_press = heuristic_tap_hold->ms_between_prev_release_and_press;
+    prev_to_heuristic_tap_hold_was_mod = heuristic_tap_hold->prev_was_mod;
+    heuristic_tap_hold_is_on_left = is_on_left_hand(& heuristic_tap_hold->record);
+    ms_min_overlap_for_hold_estimate = 0;
 
+    const uint16_t max_overlap = get_max_overlap_in_ms();
+    ms_max_overlap = max_overlap < 1 ? 1 : MIN(max_overlap, MS_MAX_OVERLAP);
 
-static void choose_heuristic_hold(void) {
-    tap_hold_decision = CHOSE_HOLD;
-    if (!heuristic_tap_hold_keycode_was_held_instantly) {
-        process_register_record_as_hold(& heuristic_tap_hold_record);
+    if (should_hold_instantly()) {
+        heuristic_tap_hold->was_held_instantly = true;
+        process_register_record_as_hold(& heuristic_tap_hold->record);
     }
-    if (next_to_heuristic_tap_hold_keycode == KC_NO) return;
+}
 
-    const bool is_tap_hold = IS_TAP_HOLD_KEYCODE(next_to_heuristic_tap_hold_keycode);
-    if (is_tap_hold) {
-        process_register_record_as_tap(& next_to_heuristic_tap_hold_record);
-    } else {
-        process_register_record(& next_to_heuristic_tap_hold_record);
+
+// The heuristic tap hold key was decided, so the key after it can be sent. If
+// that is a tap hold key too, it becomes the next heuristic tap hold key
+// instead. Returns true, if a key was sent.
+static bool send_next_to_heuristic_tap_hold(
+        queued_key_t* heuristic_tap_hold, tap_hold_decision_path path, bool should_add_its_mods) {
+    queued_key_t* next = get_next_to_heuristic_tap_hold(heuristic_tap_hold);
+    if (next == NULL) return false;
+
+    if (IS_TAP_HOLD_KEYCODE(next->keycode)) {
+        start_heuristic_tap_hold(next);
+        return false;
     }
 
-    // in many situations the key registered here, will directly be released,
-    // so possibly wait, so that to the OS the key seems to have been pressed
-    // for at least a millisecond (otherwise OSes / apps might ignore presses)
-    send_keyboard_report();
-#        if TAP_CODE_DELAY > 0
-    wait_ms(TAP_CODE_DELAY);
-#        endif
+    process_register_record(& next->record, should_add_its_mods ? next->mods : 0, path, next->press_timer);
+    remove_from_queue(next);
+    return true;
 }
 
 
-#define WITH_TEMP_MODS_ADDED(mods, ...) \
-    do { \
-        const uint8_t _real_mods = get_mods(); \
-        add_mods(mods); \
-        { __VA_ARGS__ } \
-        set_mods(_real_mods); \
-    } while (0)
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+static void record_adaptive_decision_of(queued_key_t* heuristic_tap_hold, tap_hold_decision_path path, bool is_hold) {
+    const queued_key_t* next = get_next_to_heuristic_tap_hold(heuristic_tap_hold);
+    record_adaptive_decision(path, is_hold, heuristic_tap_hold->keycode, heuristic_tap_hold->record.event.key,
+                             next != NULL ? &next->record.event.key : NULL);
+}
+#        endif
 
 
-#define WITH_TEMP_MODS(mods, ...) \
-    do { \
-        const uint8_t _real_mods = get_mods(); \
-        set_mods(mods); \
-        { __VA_ARGS__ } \
-        set_mods(_real_mods); \
-    } while (0)
+// The decision is stored after the record was sent, so that while QMK
+// processes it, this is still the heuristic tap hold key (unless the record
+// has to wait for a delay).
+static void choose_heuristic_hold(queued_key_t* heuristic_tap_hold, tap_hold_decision_path path) {
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+    record_adaptive_decision_of(heuristic_tap_hold, path, true);
+#        endif
+    if (!heuristic_tap_hold->was_held_instantly) {
+        process_register_record_as_hold(& heuristic_tap_hold->record);
+    }
+    heuristic_tap_hold->decision = CHOSE_HOLD;
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+    record_shadow_tap_hold_resolution(heuristic_tap_hold->record.event.key, true);
+#        endif
 
+    if (!send_next_to_heuristic_tap_hold(heuristic_tap_hold, path, false)) return;
 
-static void choose_heuristic_tap(void) {
-    if (heuristic_tap_hold_keycode_was_held_instantly) {
-        // to nullify modifiers acting on their own (e.g. ALT)
-        tap_code16(KC_F24);
-        process_unregister_record_as_hold(& heuristic_tap_hold_record);
-        send_keyboard_report();
-    }
+    // in many situations the key registered here, will directly be released
+    delay_output();
+}
 
-    tap_hold_decision = CHOSE_TAP;
-    WITH_TEMP_MODS_ADDED(heuristic_tap_hold_mods, {
-        process_register_record_as_tap(& heuristic_tap_hold_record);
-    });
-    send_keyboard_report();
 
-    if (next_to_heuristic_tap_hold_keycode == KC_NO) {
-        // we want to only wait once, if possible
-#        if TAP_CODE_DELAY > 0
-        wait_ms(TAP_CODE_DELAY);
+static void choose_heuristic_tap(queued_key_t* heuristic_tap_hold, tap_hold_decision_path path) {
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+    record_adaptive_decision_of(heuristic_tap_hold, path, false);
 #        endif
-        return;
+    if (heuristic_tap_hold->was_held_instantly) {
+        // to nullify modifiers acting on their own (e.g. ALT)
+        send_code(KC_F24, true);
+        delay_output();
+        send_code(KC_F24, false);
+        process_unregister_record_as_hold(& heuristic_tap_hold->record);
     }
 
-    const bool is_tap_hold = IS_TAP_HOLD_KEYCODE(next_to_heuristic_tap_hold_keycode);
-    WITH_TEMP_MODS_ADDED(next_to_heuristic_tap_hold_mods, {
-        if (is_tap_hold) {
-            process_register_record_as_tap(& next_to_heuristic_tap_hold_record);
-        } else {
-            process_register_record(& next_to_heuristic_tap_hold_record);
-        }
-    });
-
-    send_keyboard_report();
-#        if TAP_CODE_DELAY > 0
-    wait_ms(TAP_CODE_DELAY);
+    process_register_record_as_tap(& heuristic_tap_hold->record, heuristic_tap_hold->mods);
+    heuristic_tap_hold->decision = CHOSE_TAP;
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+    record_shadow_tap_hold_resolution(heuristic_tap_hold->record.event.key, false);
 #        endif
+
+    // we want to only delay once, if possible
+    send_next_to_heuristic_tap_hold(heuristic_tap_hold, path, true);
+    delay_output();
 }
 
 
-static int has_next_key_and_it_was_held_longer_than_estimate(void) {
-    return (next_to_heuristic_tap_hold_keycode != KC_NO &&
-            timer_elapsed(ms_overlap_timer) > ms_min_overlap_for_hold_estimate);
+static int has_next_key_and_it_was_held_longer_than_estimate(queued_key_t* heuristic_tap_hold) {
+    return (get_next_to_heuristic_tap_hold(heuristic_tap_hold) != NULL &&
+            timer_elapsed32(ms_overlap_timer) > ms_min_overlap_for_hold_estimate);
 }
 
 
-static void finish_heuristic_tap_hold(void) {
-    if (tap_hold_decision == UNDECIDED) {
-        if (has_next_key_and_it_was_held_longer_than_estimate()) {
-            choose_heuristic_hold();
+static void finish_tap_hold(queued_key_t* tap_hold) {
+    if (tap_hold->decision == UNDECIDED) {
+        // only the heuristic tap hold key can still be undecided here
+        const bool is_hold = has_next_key_and_it_was_held_longer_than_estimate(tap_hold);
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+        record_shadow_overlap_decision(DECIDED_BY_OVERLAP, is_hold, true);
+#        endif
+        if (is_hold) {
+            choose_heuristic_hold(tap_hold, DECIDED_BY_OVERLAP);
         } else {
-            choose_heuristic_tap();
+            choose_heuristic_tap(tap_hold, DECIDED_BY_OVERLAP);
         }
     }
 
-    if (tap_hold_decision == CHOSE_TAP) {
-        process_unregister_record_as_tap(& heuristic_tap_hold_record);
+    if (tap_hold->decision == CHOSE_TAP) {
+        process_unregister_record_as_tap(& tap_hold->record);
         // prev_was_mod is already correct in this case (true if MODIFIER)
-    } else if (tap_hold_decision == CHOSE_HOLD) {
+    } else {
         // other keys are unregistered whenever the user actually releases the key
-        process_unregister_record_as_hold(& heuristic_tap_hold_record);
+        process_unregister_record_as_hold(& tap_hold->record);
         // have to update this, because when it was first set, we hadn't made a choice yet
         prev_was_mod = true;
     }
 
-    prev_heuristic_tap_hold_keycode = heuristic_tap_hold_keycode;
-    prev_tap_hold_decision = tap_hold_decision;
-    reset_heuristic_tap_hold();
+    prev_heuristic_tap_hold_keycode = tap_hold->keycode;
+    prev_tap_hold_decision = tap_hold->decision;
+    remove_from_queue(tap_hold);
 }
 
 
-bool process_heuristic_tap_hold(uint16_t keycode, keyrecord_t *record) {
-    if (is_processing_record_due_to_us || !IS_KEYEVENT(record->event)) return true;
+// Returns true, if QMK should handle the key press as usual.
+static bool process_press(queued_key_t* key) {
+    // Deciding the heuristic tap hold key can make the next key the new
+    // heuristic tap hold key, so this is repeated at most once per queued key.
+    while (true) {
+        queued_key_t* heuristic_tap_hold = get_heuristic_tap_hold();
+
+        if (heuristic_tap_hold == NULL) {
+            if (!IS_TAP_HOLD_KEYCODE(key->keycode)) {
+                // let QMK handle normal key presses
+                return true;
+            }
+
+            if (queue_count == HEURISTIC_TAP_HOLD_QUEUE_SIZE) {
+                // too many tap hold keys are held already
+                process_register_record_as_tap(& key->record, 0);
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+                record_shadow_tap_hold_resolution(key->record.event.key, false);
+#        endif
+                return false;
+            }
+
+            // new heuristic tap hold is starting
+            start_heuristic_tap_hold(add_to_queue(key));
+            return false;
+        }
+
+        if (get_next_to_heuristic_tap_hold(heuristic_tap_hold) != NULL) {
+            // this is the second key after the heuristic tap hold key was pressed
+            const bool is_hold = should_choose_hold_when_two_down_after_heuristic_tap_hold();
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+            record_shadow_decision(DECIDED_BY_TWO_DOWN, is_hold, shadow_hold_when_two_down(
+                    ms_between_prev_release_and_heuristic_tap_hold_press,
+                    ms_between_heuristic_tap_hold_press_and_next_press,
+                    prev_to_heuristic_tap_hold_was_mod));
+#        endif
+            if (is_hold) {
+                choose_heuristic_hold(heuristic_tap_hold, DECIDED_BY_TWO_DOWN);
+            } else {
+                choose_heuristic_tap(heuristic_tap_hold, DECIDED_BY_TWO_DOWN);
+            }
+            continue;
+        }
+
+        if (queue_count == HEURISTIC_TAP_HOLD_QUEUE_SIZE) {
+            // there is no room for the next key, so decide as if it had been released
+            choose_heuristic_tap(heuristic_tap_hold, DECIDED_BY_OVERLAP);
+            continue;
+        }
 
+        // this is the first key after the tap hold key
+        const bool is_left = is_on_left_hand(& key->record);
+        ms_between_heuristic_tap_hold_press_and_next_press = (uint16_t) (key->press_timer - ms_heuristic_tap_hold_press_timer);
+
+        tap_hold_decision_options choice = UNDECIDED;
+        if (is_left == heuristic_tap_hold_is_on_left) {
+            choice = choose_when_next_to_heuristic_tap_hold_on_same_side(& key->record, key->keycode, is_left);
+        }
+
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+        if (choice != UNDECIDED) record_shadow_decision(DECIDED_BY_SAME_SIDE, choice == CHOSE_HOLD, choice == CHOSE_HOLD);
+#        endif
+
+        if (choice == CHOSE_TAP) {
+            choose_heuristic_tap(heuristic_tap_hold, DECIDED_BY_SAME_SIDE);
+        } else if (choice == CHOSE_HOLD) {
+            choose_heuristic_hold(heuristic_tap_hold, DECIDED_BY_SAME_SIDE);
+        } else {
+            add_to_queue(key);
+
+            ms_overlap_timer = key->press_timer;
+            ms_min_overlap_for_hold_estimate = calculate_min_overlap_for_hold_of_pair_in_ms(heuristic_tap_hold, key);
+            ms_next_to_heuristic_tap_hold_press_to_release_timer = key->press_timer;
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+            start_shadow_overlap(ms_between_prev_release_and_heuristic_tap_hold_press,
+                                 ms_between_heuristic_tap_hold_press_and_next_press,
+                                 heuristic_tap_hold->record.event.key, key->record.event.key, key->press_timer);
+#        endif
+
+            const int8_t confidence = estimate_overlap_confidence(
+                    ms_between_heuristic_tap_hold_press_and_next_press, ms_min_overlap_for_hold_estimate, ms_max_overlap);
+            if (!should_decide_overlap_early(confidence)) return false;
+
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+            record_shadow_overlap_decision(DECIDED_BY_CONFIDENCE, confidence > 0, false);
+#        endif
+
+            // the next key is queued, so it is sent like after any other decision
+            if (confidence > 0) {
+                choose_heuristic_hold(heuristic_tap_hold, DECIDED_BY_CONFIDENCE);
+            } else {
+                choose_heuristic_tap(heuristic_tap_hold, DECIDED_BY_CONFIDENCE);
+            }
+            return false;
+        }
+
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+        // recorded once it's sent (a tap hold key will be decided on its own)
+        if (!IS_TAP_HOLD_KEYCODE(key->keycode)) latency_path_of_press = DECIDED_BY_SAME_SIDE;
+#        endif
+    }
+}
+
+
+// Returns true, if QMK should handle the key event as usual.
+static bool process_key_event(uint16_t keycode, keyrecord_t *record) {
     const bool is_pressed = record->event.pressed;
 
+#        ifdef HEURISTIC_TAP_HOLD_TYPING_RHYTHM
+    record_typing_rhythm(record->event.key, is_pressed, timer_read32());
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+    record_shadow_key_event(keycode, record, timer_read32());
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+    record_adaptive_key_event(keycode, record, timer_read32());
+#        endif
+
     if (is_pressed && keycode != prev_heuristic_tap_hold_keycode) {
         // We want this to always be reset on any key press that is not the
         // current tap hold key. That way, we can detect when a tap hold key
@@ -384,6 +783,28 @@ bool process_heuristic_tap_hold(uint16_t keycode, keyrecord_t *record) {
     const bool is_layer_tap = IS_QK_LAYER_TAP(keycode);
     const bool is_tap_hold = is_mod_tap || is_layer_tap;
 
+    if (is_pressed) {
+        queued_key_t key = {
+            .record = * record,
+            .keycode = keycode,
+            .press_timer = timer_read32(),
+            .mods = get_mods(),
+            .prev_was_mod = prev_was_mod,
+            .decision = UNDECIDED,
+        };
+
+        const uint32_t ms_since_prev_release = timer_elapsed32(ms_prev_release_timer);
+        key.ms_between_prev_release_and_press = MIN(MS_MAX_DUR, ms_since_prev_release);
+
+        if (ms_since_prev_release >= MS_MAX_DUR) {
+            // enough time has passed between presses that this is not relevant anymore
+            prev_heuristic_tap_hold_keycode = KC_NO;
+            prev_tap_hold_decision = UNDECIDED;
+        }
+
+        return process_press(& key);
+    }
+
     uint16_t tap_of_keycode_or_keycode = keycode;
     if (is_mod_tap) {
         tap_of_keycode_or_keycode = QK_MOD_TAP_GET_TAP_KEYCODE(keycode);
@@ -391,181 +812,175 @@ bool process_heuristic_tap_hold(uint16_t keycode, keyrecord_t *record) {
         tap_of_keycode_or_keycode = QK_LAYER_TAP_GET_TAP_KEYCODE(keycode);
     }
 
-    if (!is_pressed) {
-        // released - we set these now, so we don't have to do it every time we return
-        ms_prev_release_timer = timer_read();
+    // released - we set these now, so we don't have to do it every time we return
+    ms_prev_release_timer = timer_read32();
 
-        // two cases:
-        // 1. tap hold 1 up, tap hold 2 down
-        // 2. tap hold 2 down, tap hold 1 up -> currently not supported (tap hold 2 will be tap)
-        const bool prev_held = prev_tap_hold_decision == CHOSE_HOLD;
-        const bool is_hold = is_tap_hold && (prev_held || record->tap.count == 0);
-        prev_was_mod = is_hold || IS_MODIFIER_KEYCODE(tap_of_keycode_or_keycode);
-
-        ms_between_prev_release_and_this_press = 0;
-        ms_between_prev_release_and_this_press_was_set = false;
-    }
+    const bool prev_held = prev_tap_hold_decision == CHOSE_HOLD;
+    const bool is_hold = is_tap_hold && (prev_held || record->tap.count == 0);
+    prev_was_mod = is_hold || IS_MODIFIER_KEYCODE(tap_of_keycode_or_keycode);
 
-    bool heuristic_tap_hold_found = heuristic_tap_hold_keycode != KC_NO;
+    queued_key_t* tap_hold = is_tap_hold ? find_queued_key(keycode) : NULL;
 
-    // While the heuristic tap hold is pressed, all other tap holds presses and
-    // releases must become taps. See Limitation 1.
-    if (!is_pressed && is_tap_hold &&
-            (!heuristic_tap_hold_found ||
-                (keycode != heuristic_tap_hold_keycode && keycode != next_to_heuristic_tap_hold_keycode))
-    ) {
+    if (is_tap_hold && tap_hold == NULL) {
+        // it was pressed while the queue was full, so it was a tap
         process_unregister_record_as_tap(record);
         return false;
     }
 
-    if (is_pressed && is_tap_hold && !heuristic_tap_hold_found) {
-        // new heuristic tap hold is starting
-        ms_heuristic_tap_hold_press_timer = timer_read();
-
-        heuristic_tap_hold_keycode = keycode;
-        heuristic_tap_hold_record = * record;
-        heuristic_tap_hold_mods = get_mods();
-        heuristic_tap_hold_is_on_left = is_on_left_hand(record);
+    queued_key_t* heuristic_tap_hold = get_heuristic_tap_hold();
+    if (heuristic_tap_hold != NULL) {
+        queued_key_t* next = get_next_to_heuristic_tap_hold(heuristic_tap_hold);
+        if (next != NULL && keycode == next->keycode) {
+            // completely wrapped (CTRL down, V down, V up, CTRL up) by the heuristic tap hold key
+            const bool is_hold = should_choose_hold_when_next_to_heuristic_tap_hold_is_wrapped();
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+            record_shadow_decision(DECIDED_BY_WRAP, is_hold, shadow_hold_when_wrapped(
+                    ms_between_prev_release_and_heuristic_tap_hold_press,
+                    ms_between_heuristic_tap_hold_press_and_next_press,
+                    timer_elapsed32(ms_next_to_heuristic_tap_hold_press_to_release_timer)));
+#        endif
+            if (is_hold) {
+                choose_heuristic_hold(heuristic_tap_hold, DECIDED_BY_WRAP);
+            } else {
+                choose_heuristic_tap(heuristic_tap_hold, DECIDED_BY_WRAP);
+            }
+        }
+    }
 
-        prev_to_heuristic_tap_hold_was_mod = prev_was_mod;
+    if (tap_hold != NULL) {
+        // if it was the next key, deciding the key before made it the
+        // heuristic tap hold key, so it is still queued at the same place
+        finish_tap_hold(tap_hold);
+    }
 
-        if (ms_between_prev_release_and_this_press_was_set) {
-            // As timer_read is a 16-bit timer, it will wrap around every
-            // 65536 milliseconds. To avoid incorrect values (and cap the
-            // duration), we set a boolean in matrix_scan_user.
-            ms_between_prev_release_and_heuristic_tap_hold_press = ms_between_prev_release_and_this_press;
-        } else {
-            ms_between_prev_release_and_heuristic_tap_hold_press = timer_elapsed(ms_prev_release_timer);
+    heuristic_tap_hold = get_heuristic_tap_hold();
+    if (heuristic_tap_hold != NULL) {
+        queued_key_t* next = get_next_to_heuristic_tap_hold(heuristic_tap_hold);
+        if (next == NULL) {
+            // pressed down before heuristic tap hold and now released
+            ms_between_prev_release_and_heuristic_tap_hold_press = -MIN(
+                    MS_MAX_DUR,
+                    timer_elapsed32(ms_heuristic_tap_hold_press_timer)
+            );
+
+            // prev_was_mod will be from the current event, as it is set on every release
+            prev_to_heuristic_tap_hold_was_mod = prev_was_mod;
+        } else if (IS_TAP_HOLD_KEYCODE(next->keycode)) {
+            // the same for the next key, in case it becomes the heuristic tap hold key
+            next->ms_between_prev_release_and_press = -MIN(MS_MAX_DUR, timer_elapsed32(next->press_timer));
+            next->prev_was_mod = prev_was_mod;
         }
+    }
+
+    return !is_tap_hold;
+}
+
+
+static void set_earlier_deadline(uint32_t* deadline, uint32_t candidate) {
+    if (TIMER_DIFF_32(*deadline, candidate) < UINT32_MAX / 2) *deadline = candidate;
+}
+
+
+// Called whenever the state changed, so that heuristic_tap_hold_task only
+// has to compare the time to one deadline, until one of its timers runs out.
+static void update_task_deadline(void) {
+    // effectively never (12 days), but it's harmless if the task runs then
+    uint32_t deadline = timer_read32() + UINT32_MAX / 4;
 
-        if (should_hold_instantly()) {
-            heuristic_tap_hold_keycode_was_held_instantly = true;
-            process_register_record_as_hold(record);
+    queued_key_t* heuristic_tap_hold = get_heuristic_tap_hold();
+    if (heuristic_tap_hold != NULL) {
+        // see decide_heuristic_tap_hold_if_held_long_enough
+        set_earlier_deadline(&deadline, ms_heuristic_tap_hold_press_timer + ms_max_overlap + 1);
+        if (get_next_to_heuristic_tap_hold(heuristic_tap_hold) != NULL) {
+            set_earlier_deadline(&deadline, ms_overlap_timer + ms_min_overlap_for_hold_estimate + 1);
         }
+    }
 
-        return false;
+    if (output_queue_count > 0) {
+        // the front is always a delay that hasn't passed yet
+        set_earlier_deadline(&deadline, ms_output_delay_timer + TAP_CODE_DELAY);
     }
 
-    if (!heuristic_tap_hold_found) {
-        return true;
+    ms_task_deadline = deadline;
+}
+
+
+bool process_heuristic_tap_hold(uint16_t keycode, keyrecord_t *record) {
+    if (is_processing_record_due_to_us || !IS_KEYEVENT(record->event)) return true;
+
+    // The event may arrive before matrix_scan_user got to run in this
+    // millisecond. Make the choices it would have made first, so the
+    // heuristics never see durations longer than ms_max_overlap.
+    heuristic_tap_hold_task();
+
+    bool should_qmk_handle_it = process_key_event(keycode, record);
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+    const tap_hold_decision_path latency_path = latency_path_of_press;
+    latency_path_of_press = DECISION_PATH_COUNT;
+#        else
+    const tap_hold_decision_path latency_path = DECISION_PATH_COUNT;
+#        endif
+    if (should_qmk_handle_it && output_queue_count > 0) {
+        // QMK would handle it before the queued outputs are sent
+        send_record_of_path(record, 0, latency_path, timer_read32());
+        should_qmk_handle_it = false;
+    }
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+    else if (should_qmk_handle_it && latency_path != DECISION_PATH_COUNT) {
+        // QMK sends it right away
+        record_heuristic_tap_hold_latency(latency_path, 0);
     }
+#        endif
 
-    // heuristic tap hold key was pressed before
-    if (is_pressed) {
-        if (tap_hold_decision == UNDECIDED) {
-            if (next_to_heuristic_tap_hold_keycode == KC_NO) {
-                // this is the first key after the tap hold key
-                const bool is_left = is_on_left_hand(record);
-
-                tap_hold_decision_options choice = UNDECIDED;
-                if (is_left == heuristic_tap_hold_is_on_left) {
-                    choice = choose_when_next_to_heuristic_tap_hold_on_same_side(record, keycode, is_left);
-                }
-
-                if (choice == CHOSE_TAP) {
-                    choose_heuristic_tap();
-                } else if (choice == CHOSE_HOLD) {
-                    choose_heuristic_hold();
-                } else {
-                    ms_overlap_timer = timer_read();
-                    next_to_heuristic_tap_hold_keycode = keycode;
-                    next_to_heuristic_tap_hold_record = * record;
-                    next_to_heuristic_tap_hold_mods = get_mods();
-
-                    ms_between_heuristic_tap_hold_press_and_next_press = timer_elapsed(
-                            ms_heuristic_tap_hold_press_timer);
-                    ms_min_overlap_for_hold_estimate = calculate_min_overlap_for_hold_in_ms();
-                    ms_next_to_heuristic_tap_hold_press_to_release_timer = timer_read();
-
-                    return false;
-                }
-            } else {
-                // this is the second (or later) key after the heuristic tap hold key was pressed
-                if (should_choose_hold_when_two_down_after_heuristic_tap_hold()) {
-                    choose_heuristic_hold();
-                } else {
-                    choose_heuristic_tap();
-                }
-            }
-        }
+    update_task_deadline();
+    return should_qmk_handle_it;
+}
 
-        if (is_tap_hold) {
-            // See Limitation 1
-            process_register_record_as_tap(record);
-            return false;
-        }
 
-        // let QMK handle normal key presses
+static bool decide_heuristic_tap_hold_if_held_long_enough(queued_key_t* heuristic_tap_hold) {
+    if (has_next_key_and_it_was_held_longer_than_estimate(heuristic_tap_hold)) {
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+        record_shadow_overlap_decision(DECIDED_BY_OVERLAP, true, false);
+#        endif
+        choose_heuristic_hold(heuristic_tap_hold, DECIDED_BY_OVERLAP);
         return true;
     }
 
-    // released
-    if (tap_hold_decision == UNDECIDED && keycode == next_to_heuristic_tap_hold_keycode) {
-        // completely wrapped (CTRL down, V down, V up, CTRL up) by the heuristic tap hold key
-        if (should_choose_hold_when_next_to_heuristic_tap_hold_is_wrapped()) {
-            choose_heuristic_hold();
-        } else {
-            choose_heuristic_tap();
-        }
-    } else if (next_to_heuristic_tap_hold_keycode == KC_NO) {
-        // pressed down before heuristic tap hold and now released
-        ms_between_prev_release_and_heuristic_tap_hold_press = -MIN(
-                MS_MAX_DUR,
-                timer_elapsed(ms_heuristic_tap_hold_press_timer)
-        );
-
-        // prev_was_mod will be from the current event, as it is set on every release
-        prev_to_heuristic_tap_hold_was_mod = prev_was_mod;
-    }
+    if (timer_elapsed32(ms_heuristic_tap_hold_press_timer) <= ms_max_overlap) return false;
 
-    if (is_tap_hold) {
-        if (keycode == heuristic_tap_hold_keycode) {
-            finish_heuristic_tap_hold();
-        } else {
-            // See Limitation 1
-            process_unregister_record_as_tap(record);
+    // heuristic tap hold key has been held too long
+    if (get_next_to_heuristic_tap_hold(heuristic_tap_hold) == NULL) {
+        // no other key has been pressed
+        if (should_choose_tap_when_pressed_very_long_without_another_key()) {
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+            record_shadow_decision(DECIDED_BY_TIMEOUT, false, false);
+#        endif
+            choose_heuristic_tap(heuristic_tap_hold, DECIDED_BY_TIMEOUT);
+            return true;
         }
-        return false;
     }
 
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+    record_shadow_decision(DECIDED_BY_TIMEOUT, true, true);
+#        endif
+    choose_heuristic_hold(heuristic_tap_hold, DECIDED_BY_TIMEOUT);
     return true;
 }
 
 
 void heuristic_tap_hold_task(void) {
-    if (!ms_between_prev_release_and_this_press_was_set &&
-        timer_elapsed(ms_prev_release_timer) >= MS_MAX_DUR
-    ) {
-        // prev release timer has been held too long
-        ms_between_prev_release_and_this_press_was_set = true;
-        ms_between_prev_release_and_this_press = MS_MAX_DUR;
-
-        // enough time has passed between presses that this is not relevant anymore
-        prev_heuristic_tap_hold_keycode = KC_NO;
-        prev_tap_hold_decision = UNDECIDED;
-    }
-
-    if (heuristic_tap_hold_keycode == KC_NO || tap_hold_decision != UNDECIDED) {
-        return;
-    }
-
-    if (has_next_key_and_it_was_held_longer_than_estimate()) {
-        choose_heuristic_hold();
-        return;
+    // most of the time, nothing is due
+    if (!timer_expired32(timer_read32(), ms_task_deadline)) return;
+
+    // a decision can make the next key the new heuristic tap hold key, which
+    // may have been held long enough already
+    queued_key_t* heuristic_tap_hold;
+    while ((heuristic_tap_hold = get_heuristic_tap_hold()) != NULL &&
+            decide_heuristic_tap_hold_if_held_long_enough(heuristic_tap_hold)) {
     }
 
-    if (timer_elapsed(ms_heuristic_tap_hold_press_timer) > MS_MAX_OVERLAP) {
-        // heuristic tap hold key has been held too long
-        if (next_to_heuristic_tap_hold_keycode == KC_NO) {
-            // no other key has been pressed
-            if (should_choose_tap_when_pressed_very_long_without_another_key()) {
-                choose_heuristic_tap();
-                return;
-            }
-        }
-
-        choose_heuristic_hold();
-    }
+    send_due_outputs();
+    update_task_deadline();
 }
 
 
@@ -3,26 +3,44 @@
 #pragma once
 
 #include "quantum.h"
+#include "heuristic_tap_hold_kernels.h"
 
-typedef enum {
-    UNDECIDED,
-    CHOSE_TAP,
-    CHOSE_HOLD
-} tap_hold_decision_options;
-
-#if !defined(MIN)
-#    define MIN(x, y) (((x) < (y)) ? (x) : (y))
+// How many keys can be queued at once: the tap hold keys that are held (up to
+// one undecided), plus the key after the undecided one. When it is full, new
+// tap hold keys are taps, like before they could be held together.
+#if !defined(HEURISTIC_TAP_HOLD_QUEUE_SIZE)
+#    define HEURISTIC_TAP_HOLD_QUEUE_SIZE 8
 #endif
 
-#if !defined(MAX)
-#    define MAX(x, y) (((x) > (y)) ? (x) : (y))
+// How many key events can wait for TAP_CODE_DELAY to pass, instead of stalling
+// the keyboard in wait_ms. When it is full, we wait like before.
+#if !defined(HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE)
+#    define HEURISTIC_TAP_HOLD_OUTPUT_QUEUE_SIZE 16
 #endif
 
-#if !defined(ABS)
-#    define ABS(x) (((x) < 0) ? -(x) : (x))
+// How sure (in percent) the overlap heuristic has to be, to decide as soon as
+// the next key is pressed instead of waiting for the overlap (see
+// estimate_overlap_confidence). Above 100, the default, it always waits.
+#if !defined(HEURISTIC_TAP_HOLD_EARLY_COMMIT_CONFIDENCE)
+#    define HEURISTIC_TAP_HOLD_EARLY_COMMIT_CONFIDENCE 101
 #endif
 
-#define SD(x, y) (((y) == 0) ? (x) : ((x) / (y)))
+typedef enum {
+    UNDECIDED,
+    CHOSE_TAP,
+    CHOSE_HOLD
+} tap_hold_decision_options;
+
+// what decided the heuristic tap hold key
+typedef enum {
+    DECIDED_BY_OVERLAP,    // overlap estimate (also when it was released first)
+    DECIDED_BY_WRAP,       // the next key was wrapped
+    DECIDED_BY_TWO_DOWN,   // a second key was pressed after the next key
+    DECIDED_BY_TIMEOUT,    // held longer than get_max_overlap_in_ms
+    DECIDED_BY_SAME_SIDE,  // choose_when_next_to_heuristic_tap_hold_on_same_side
+    DECIDED_BY_CONFIDENCE, // the overlap heuristic was sure enough right away
+    DECISION_PATH_COUNT
+} tap_hold_decision_path;
 
 // utility functions
 //=============================================================================
@@ -30,6 +48,7 @@ bool prev_chose_tap_and_was_same_tap_hold(void);
 uint16_t get_heuristic_tap_hold_keycode(void);
 uint16_t get_tap_keycode(uint16_t keycode);
 bool is_on_left_hand(keyrecord_t* record);
+bool is_heuristic_tap_hold_queue_empty(void);
 
 // configure the heuristic tap hold
 //=============================================================================
@@ -42,7 +61,7 @@ bool should_choose_hold_when_next_to_heuristic_tap_hold_is_wrapped(void);
 // We use another heuristic for cases such as C(KC_E) down, T down, A down
 bool should_choose_hold_when_two_down_after_heuristic_tap_hold(void);
 
-// When a tap hold key is held longer than MS_MAX_OVERLAP, this is called.
+// When a tap hold key is held longer than get_max_overlap_in_ms, this is called.
 // If True is returned, we choose tap, else hold.
 //
 // By default, this will only return true if the previous key was also a tap
@@ -54,9 +73,40 @@ bool should_choose_tap_when_pressed_very_long_without_another_key(void);
 
 // This is only called if the next key is on the same side as the tap hold key.
 // The supplied arguments are all for the next key (its keycode and so on).
+// UNDECIDED lets the heuristics decide like for a next key on the other side.
+//
+// By default, this is CHOSE_TAP, or with HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL
+// what choose_by_same_side_model returns.
 tap_hold_decision_options choose_when_next_to_heuristic_tap_hold_on_same_side(
         keyrecord_t* record, uint16_t keycode, bool is_left);
 
+#if defined(HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL)
+// The trained decision for the next key on the same side (see
+// heuristic_tap_hold_same_side.h), so an override of the function above can
+// fall back to it.
+tap_hold_decision_options choose_by_same_side_model(void);
+#endif
+
+// The tap hold key is decided once it was held this long (see
+// should_choose_tap_when_pressed_very_long_without_another_key). It is asked
+// whenever a tap hold key starts to be decided, so it can depend on how fast
+// one types right now (see heuristic_tap_hold_rhythm.h). The heuristics were
+// made for durations up to MS_MAX_OVERLAP, so longer ones are cut to it.
+//
+// By default, this is MS_MAX_OVERLAP, or the max overlap written over raw HID
+// with HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS.
+uint16_t get_max_overlap_in_ms(void);
+
+// When the next key is pressed (on the other side), the overlap heuristic
+// would wait to see how long the tap hold key stays down with it. The
+// confidence is how sure it is already, from -100 (tap) to 100 (hold). If
+// true is returned, it decides right away: hold if the confidence is
+// positive, else tap.
+//
+// By default, this is true if the confidence is at least
+// HEURISTIC_TAP_HOLD_EARLY_COMMIT_CONFIDENCE percent either way.
+bool should_decide_overlap_early(int8_t confidence);
+
 // You can check the current tap hold key code in this function and decide if
 // you want to return true. This is useful for cases where the hold needs to be
 // active directly (e.g. ctrl + scroll wheel on your mouse)
@@ -0,0 +1,324 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS) && !defined(NO_ACTION_TAPPING)
+
+#include <string.h>
+
+#include "eeprom_block.h"
+#include "heuristic_tap_hold_adaptive.h"
+
+_Static_assert(HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS >= 1 &&
+                       HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS <= HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS,
+               "HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS must be between 1 and the max bias");
+_Static_assert(HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS <= 127,
+               "HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS must fit into a signed byte");
+_Static_assert(HEURISTIC_TAP_HOLD_ADAPTIVE_EEPROM_OFFSET + ADAPTIVE_EEPROM_SIZE <= EECONFIG_USER_DATA_SIZE,
+               "EECONFIG_USER_DATA_SIZE is too small for the adaptive biases");
+
+#define EEPROM_ADDR (EECONFIG_USER_DATABLOCK + HEURISTIC_TAP_HOLD_ADAPTIVE_EEPROM_OFFSET)
+
+// how far a correction has come
+typedef enum {
+    CORRECTION_NONE,
+    CORRECTION_AFTER_TAP,         // a Backspace has to be the next press
+    CORRECTION_BACKSPACE_PRESSED, // a tap hold Backspace, which has to be tapped
+    CORRECTION_AFTER_BACKSPACE,   // more of them, or the tap hold key again
+    CORRECTION_RETYPED_TAP,       // its decision has to be a hold
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_RETYPED_HOLDS
+    CORRECTION_AFTER_HOLD,        // the tap hold key has to be the next press
+    CORRECTION_RETYPED_HOLD,      // its decision has to be a tap with the same next key
+    CORRECTION_RETYPED_ALONE,     // it was tapped alone, so the next key has to be the next press
+#        endif
+} correction_stage_t;
+
+static int8_t biases[ADAPTIVE_BIAS_COUNT];
+static int8_t saved_biases[ADAPTIVE_BIAS_COUNT];
+static uint16_t corrections_to_hold[ADAPTIVE_BIAS_COUNT];
+static uint16_t corrections_to_tap[ADAPTIVE_BIAS_COUNT];
+
+static uint16_t decisions_since_decay = 0;
+static uint32_t last_save_time = 0;
+static bool was_loaded = false;
+
+static const uint8_t eeprom_tag[] = {ADAPTIVE_HID_VERSION, ADAPTIVE_BIAS_COUNT,
+                                     HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS};
+
+// the decision that may be corrected
+static struct {
+    keypos_t tap_hold;
+    keypos_t next;
+    keypos_t backspace;     // while CORRECTION_BACKSPACE_PRESSED
+    uint32_t time;          // of the decision, or the last Backspace after it
+    uint16_t keycode;       // of the tap hold key, which has to be retyped
+    adaptive_bias_t bias;
+    correction_stage_t stage;
+} correction;
+
+
+static adaptive_bias_t get_bias_of_path(tap_hold_decision_path path) {
+    switch (path) {
+        case DECIDED_BY_OVERLAP:
+        case DECIDED_BY_CONFIDENCE:
+            return ADAPTIVE_BIAS_OVERLAP;
+        case DECIDED_BY_WRAP:
+            return ADAPTIVE_BIAS_WRAPPED;
+        case DECIDED_BY_TWO_DOWN:
+            return ADAPTIVE_BIAS_TWO_DOWN;
+        default:
+            // the timeout and same side paths have nothing to learn
+            return ADAPTIVE_BIAS_COUNT;
+    }
+}
+
+
+static bool is_same_key(keypos_t a, keypos_t b) {
+    return a.row == b.row && a.col == b.col;
+}
+
+
+void load_heuristic_tap_hold_adaptive_biases(void) {
+    // the max bias is part of the tag, so all of them are in range
+    was_loaded = load_checked_block(EEPROM_ADDR, biases, sizeof(biases), eeprom_tag);
+    if (!was_loaded) memset(biases, 0, sizeof(biases));
+    memcpy(saved_biases, biases, sizeof(biases));
+    last_save_time = timer_read32();
+}
+
+
+static void save_biases(void) {
+    save_checked_block(EEPROM_ADDR, biases, sizeof(biases), eeprom_tag);
+    memcpy(saved_biases, biases, sizeof(biases));
+    last_save_time = timer_read32();
+}
+
+
+static bool is_saved(void) {
+    return memcmp(biases, saved_biases, sizeof(biases)) == 0;
+}
+
+
+int8_t get_heuristic_tap_hold_adaptive_bias(adaptive_bias_t bias) {
+    return biases[bias];
+}
+
+
+uint16_t bias_min_overlap_for_hold(uint16_t estimate) {
+    const int16_t biased = (int16_t) estimate - biases[ADAPTIVE_BIAS_OVERLAP];
+    return MIN(MAX(biased, 1), MS_MAX_OVERLAP);
+}
+
+
+// never beyond MS_MAX_OVERLAP, as the fixed point heuristics are only exact up to it
+uint16_t bias_th_down_next_down_dur(adaptive_bias_t bias, uint16_t th_down_next_down_dur) {
+    const int16_t biased = (int16_t) th_down_next_down_dur + biases[bias];
+    return MIN(MAX(biased, 0), MS_MAX_OVERLAP);
+}
+
+
+static void increment(uint16_t* count) {
+    if (*count < UINT16_MAX) ++*count;
+}
+
+
+// direction is 1 for more holds and -1 for more taps
+static void learn(adaptive_bias_t bias, int8_t direction) {
+    const int16_t nudged = biases[bias] + direction * HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS;
+    biases[bias] = (int8_t) MIN(MAX(nudged, -HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS),
+                                HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS);
+    increment(direction > 0 ? &corrections_to_hold[bias] : &corrections_to_tap[bias]);
+}
+
+
+static void decay(void) {
+    if (++decisions_since_decay < HEURISTIC_TAP_HOLD_ADAPTIVE_DECAY_DECISIONS) return;
+    decisions_since_decay = 0;
+
+    for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i) {
+        if (biases[i] > 0) {
+            --biases[i];
+        } else if (biases[i] < 0) {
+            ++biases[i];
+        }
+    }
+}
+
+
+static bool is_correction_in_time(uint32_t time) {
+    return time - correction.time <= HEURISTIC_TAP_HOLD_ADAPTIVE_CORRECTION_MS;
+}
+
+
+void heuristic_tap_hold_adaptive_task(void) {
+    // not while a key waits for its decision, as writing the EEPROM can take
+    // milliseconds
+    if (!is_heuristic_tap_hold_queue_empty()) return;
+
+    if (timer_elapsed32(last_save_time) >= HEURISTIC_TAP_HOLD_ADAPTIVE_SAVE_INTERVAL_MS) {
+        // batched, so the EEPROM is written at most once per interval
+        if (!is_saved()) save_biases();
+        last_save_time = timer_read32();
+    }
+}
+
+
+// A tap hold Backspace (e.g. LT(SYMB, KC_BSPC)) may be pressed for its layer
+// or mod, so it only counts once record_adaptive_decision knows it was tapped.
+static void press_backspace(keypos_t key, uint16_t keycode, uint32_t time) {
+    if (IS_QK_MOD_TAP(keycode) || IS_QK_LAYER_TAP(keycode)) {
+        correction.stage = CORRECTION_BACKSPACE_PRESSED;
+        correction.backspace = key;
+    } else {
+        correction.stage = CORRECTION_AFTER_BACKSPACE;
+    }
+    correction.time = time;
+}
+
+
+// on another layer, the same key is a different one
+static bool is_retyped_key(keypos_t key, uint16_t keycode) {
+    return is_same_key(key, correction.tap_hold) && keycode == correction.keycode;
+}
+
+
+void record_adaptive_key_event(uint16_t keycode, keyrecord_t* record, uint32_t time) {
+    if (!record->event.pressed || correction.stage == CORRECTION_NONE) return;
+
+    const keypos_t key = record->event.key;
+    const bool is_backspace = get_tap_keycode(keycode) == KC_BSPC;
+    const bool is_in_time = is_correction_in_time(time);
+
+    switch (correction.stage) {
+        case CORRECTION_AFTER_TAP:
+        case CORRECTION_AFTER_BACKSPACE:
+            if (is_in_time && is_backspace) {
+                press_backspace(key, keycode, time);
+            } else if (correction.stage == CORRECTION_AFTER_BACKSPACE && is_in_time && is_retyped_key(key, keycode)) {
+                correction.stage = CORRECTION_RETYPED_TAP;
+            } else {
+                correction.stage = CORRECTION_NONE;
+            }
+            break;
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_RETYPED_HOLDS
+        case CORRECTION_AFTER_HOLD:
+            correction.stage = is_in_time && is_retyped_key(key, keycode) ? CORRECTION_RETYPED_HOLD : CORRECTION_NONE;
+            break;
+        case CORRECTION_RETYPED_ALONE:
+            if (is_in_time && is_same_key(key, correction.next)) learn(correction.bias, -1);
+            correction.stage = CORRECTION_NONE;
+            break;
+#        endif
+        default:
+            // waiting for the decision of the tap hold Backspace or the
+            // retyped tap hold key
+            break;
+    }
+}
+
+
+void record_adaptive_decision(tap_hold_decision_path path, bool is_hold, uint16_t keycode, keypos_t tap_hold,
+                              const keypos_t* next) {
+    const uint32_t time = timer_read32();
+
+    if (correction.stage == CORRECTION_BACKSPACE_PRESSED && is_same_key(tap_hold, correction.backspace)) {
+        if (!is_hold && is_correction_in_time(time)) {
+            correction.stage = CORRECTION_AFTER_BACKSPACE;
+            correction.time = time;
+            return;
+        }
+        // held for its layer or mod, which may be a decision to learn from itself
+        correction.stage = CORRECTION_NONE;
+    }
+
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_RETYPED_HOLDS
+    const bool is_retyped = correction.stage == CORRECTION_RETYPED_TAP || correction.stage == CORRECTION_RETYPED_HOLD;
+#        else
+    const bool is_retyped = correction.stage == CORRECTION_RETYPED_TAP;
+#        endif
+    if (is_retyped && is_same_key(tap_hold, correction.tap_hold)) {
+        const bool is_in_time = is_correction_in_time(time);
+        const correction_stage_t stage = correction.stage;
+        correction.stage = CORRECTION_NONE;
+
+        if (stage == CORRECTION_RETYPED_TAP && is_hold && is_in_time) {
+            learn(correction.bias, 1);
+        }
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_RETYPED_HOLDS
+        else if (stage == CORRECTION_RETYPED_HOLD && !is_hold && is_in_time) {
+            if (next == NULL) {
+                // the next key comes after it this time
+                correction.stage = CORRECTION_RETYPED_ALONE;
+                correction.time = time;
+            } else if (is_same_key(*next, correction.next)) {
+                learn(correction.bias, -1);
+            }
+        }
+#        endif
+    }
+
+    const adaptive_bias_t bias = get_bias_of_path(path);
+    if (bias == ADAPTIVE_BIAS_COUNT || next == NULL) return;
+    decay();
+
+    // a decision that can be corrected
+    correction.tap_hold = tap_hold;
+    correction.next = *next;
+    correction.time = time;
+    correction.keycode = keycode;
+    correction.bias = bias;
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_RETYPED_HOLDS
+    correction.stage = is_hold ? CORRECTION_AFTER_HOLD : CORRECTION_AFTER_TAP;
+#        else
+    correction.stage = is_hold ? CORRECTION_NONE : CORRECTION_AFTER_TAP;
+#        endif
+}
+
+
+bool process_heuristic_tap_hold_adaptive_command(uint8_t* data, uint8_t length) {
+    if (length < 32 || data[0] != HEURISTIC_TAP_HOLD_ADAPTIVE_HID_ID) return false;
+
+    switch (data[1]) {
+        case ADAPTIVE_HID_INFO:
+            data[2] = ADAPTIVE_HID_VERSION;
+            data[3] = ADAPTIVE_BIAS_COUNT;
+            data[4] = HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS;
+            data[5] = HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS;
+            data[6] = was_loaded;
+            data[7] = is_saved();
+            return true;
+
+        case ADAPTIVE_HID_READ: {
+            data[2] = ADAPTIVE_BIAS_COUNT;
+            uint8_t* out = data + 3;
+            for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i) {
+                *out++ = (uint8_t) biases[i];
+            }
+            for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i) {
+                *out++ = corrections_to_hold[i] & 0xFF;
+                *out++ = corrections_to_hold[i] >> 8;
+            }
+            for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i) {
+                *out++ = corrections_to_tap[i] & 0xFF;
+                *out++ = corrections_to_tap[i] >> 8;
+            }
+            return true;
+        }
+
+        case ADAPTIVE_HID_RESET:
+            memset(biases, 0, sizeof(biases));
+            memset(corrections_to_hold, 0, sizeof(corrections_to_hold));
+            memset(corrections_to_tap, 0, sizeof(corrections_to_tap));
+            correction.stage = CORRECTION_NONE;
+            if (data[2]) save_biases();
+            return true;
+
+        case ADAPTIVE_HID_SAVE:
+            save_biases();
+            return true;
+    }
+
+    data[1] = ADAPTIVE_HID_ERROR;
+    return true;
+}
+
+
+#        endif // HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS && !NO_ACTION_TAPPING
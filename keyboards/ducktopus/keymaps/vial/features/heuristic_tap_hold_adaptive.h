@@ -0,0 +1,125 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Biases of the heuristics that are learned while typing, from corrections:
+//
+// - a tap followed by Backspace (as the first key pressed after it), and the
+//   same tap hold key pressed again after the Backspaces (on the same layer)
+//   and held this time, means it should have been a hold. A tap hold Backspace
+//   (e.g. LT(SYMB, KC_BSPC)) only counts if it was tapped.
+// - with HEURISTIC_TAP_HOLD_ADAPTIVE_RETYPED_HOLDS, a hold followed by the
+//   same tap hold key pressed again (as the first key after it) and tapped
+//   with the same next key this time, means it should have been a tap (off by
+//   default, as that's also how e.g. a shortcut followed by its letters is
+//   typed, so it can't tell a correction from intent)
+//
+// Each one moves the bias of the heuristic that made the first decision by
+// HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS, up to HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS
+// either way, and every HEURISTIC_TAP_HOLD_ADAPTIVE_DECAY_DECISIONS decisions
+// each bias goes back by 1 ms, so a bias only stays if the corrections keep
+// coming. A bias is in ms: the overlap estimate is shortened by it, and the
+// wrap and two down heuristics see the next key as pressed that much later
+// (which both turn into holds). Positive biases mean more holds.
+//
+// The biases are kept in RAM and loaded from the user datablock of the EEPROM
+// at start up. Changes are saved at most every
+// HEURISTIC_TAP_HOLD_ADAPTIVE_SAVE_INTERVAL_MS by
+// heuristic_tap_hold_adaptive_task (once no tap hold key is waiting for its
+// decision), so learning barely wears the EEPROM and never delays a key, but
+// what was learned since the last save is lost when the keyboard is unplugged.
+
+#pragma once
+
+#include "eeprom_block.h"
+#include "heuristic_tap_hold.h"
+
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_STEP_MS 4
+#endif
+
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_MAX_BIAS_MS 40
+#endif
+
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_DECAY_DECISIONS)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_DECAY_DECISIONS 256
+#endif
+
+// how soon after the decision (or the last Backspace) the correction has to
+// come, to count
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_CORRECTION_MS)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_CORRECTION_MS 1500
+#endif
+
+// 10 minutes
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_SAVE_INTERVAL_MS)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_SAVE_INTERVAL_MS 600000
+#endif
+
+// where the biases start within the user datablock of the EEPROM, e.g. after
+// the coefficients
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_EEPROM_OFFSET)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_EEPROM_OFFSET 0
+#endif
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(HEURISTIC_TAP_HOLD_ADAPTIVE_HID_ID)
+#    define HEURISTIC_TAP_HOLD_ADAPTIVE_HID_ID 0xF6
+#endif
+
+// which heuristic a bias belongs to
+typedef enum {
+    ADAPTIVE_BIAS_OVERLAP,  // also of the confidence path
+    ADAPTIVE_BIAS_WRAPPED,
+    ADAPTIVE_BIAS_TWO_DOWN,
+    ADAPTIVE_BIAS_COUNT
+} adaptive_bias_t;
+
+// a checked block (see eeprom_block.h) tagged with the version, bias count and
+// max bias
+#define ADAPTIVE_EEPROM_SIZE (CHECKED_BLOCK_HEADER_SIZE + ADAPTIVE_BIAS_COUNT)
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:  request  [id, 0]
+//          response [id, 0, version, bias count, step ms, max bias ms, was loaded, is saved]
+//   read:  request  [id, 1]
+//          response [id, 1, n, n biases (int8), n corrections to hold, n corrections to tap]
+//   reset: request  [id, 2, should save]
+//          response [id, 2]
+//   save:  request  [id, 3]
+//          response [id, 3]
+//
+// The corrections are uint16 counts since start up. Reset sets the biases and
+// counts to 0, save writes the biases to the EEPROM right away (e.g. before
+// unplugging).
+#define ADAPTIVE_HID_VERSION 1
+
+enum {
+    ADAPTIVE_HID_INFO = 0,
+    ADAPTIVE_HID_READ = 1,
+    ADAPTIVE_HID_RESET = 2,
+    ADAPTIVE_HID_SAVE = 3,
+    ADAPTIVE_HID_ERROR = 0xFF,
+};
+
+// Call this once at start up (e.g. from keyboard_post_init_user).
+void load_heuristic_tap_hold_adaptive_biases(void);
+
+// Call this from housekeeping_task_user, it saves the biases when it's time.
+void heuristic_tap_hold_adaptive_task(void);
+
+// in ms, positive means more holds
+int8_t get_heuristic_tap_hold_adaptive_bias(adaptive_bias_t bias);
+
+// Called by heuristic_tap_hold.c: the inputs of the heuristics with the bias
+// applied, and every physical key event and every decision to learn from. next
+// is NULL if the tap hold key was decided before another key was pressed.
+uint16_t bias_min_overlap_for_hold(uint16_t estimate);
+uint16_t bias_th_down_next_down_dur(adaptive_bias_t bias, uint16_t th_down_next_down_dur);
+void record_adaptive_key_event(uint16_t keycode, keyrecord_t* record, uint32_t time);
+void record_adaptive_decision(tap_hold_decision_path path, bool is_hold, uint16_t keycode, keypos_t tap_hold,
+                              const keypos_t* next);
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// an adaptive bias command, in which case data holds the response.
+bool process_heuristic_tap_hold_adaptive_command(uint8_t* data, uint8_t length);
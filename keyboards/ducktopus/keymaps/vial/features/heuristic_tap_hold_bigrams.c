@@ -0,0 +1,136 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS) && !defined(NO_ACTION_TAPPING)
+
+#include <string.h>
+
+#include "eeprom_block.h"
+#include "heuristic_tap_hold_bigrams.h"
+
+static const keypos_t positions[] = HEURISTIC_TAP_HOLD_BIGRAM_POSITIONS;
+#define POSITION_COUNT (sizeof(positions) / sizeof(positions[0]))
+
+_Static_assert(POSITION_COUNT >= 1 && POSITION_COUNT <= 255,
+               "HEURISTIC_TAP_HOLD_BIGRAM_POSITIONS must have between 1 and 255 positions");
+_Static_assert(HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT <= 255, "the matrix is too large for the bigram offsets");
+_Static_assert(HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS >= 1 && HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS <= 255,
+               "HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS must be between 1 and 255");
+_Static_assert(MATRIX_ROWS <= 16 && MATRIX_COLS <= 16, "positions must fit into a byte");
+_Static_assert(BIGRAM_EEPROM_SIZE(POSITION_COUNT) <= EECONFIG_USER_DATA_SIZE,
+               "EECONFIG_USER_DATA_SIZE is too small for the bigram offsets");
+
+#define NO_SLOT 0xFF
+
+#define BIGRAM_HID_HEADER_SIZE 5
+#define BIGRAM_HID_MAX_OFFSETS (32 - BIGRAM_HID_HEADER_SIZE)
+
+
+// the row of the table of each position, so a lookup never has to search
+static uint8_t slot_at[MATRIX_ROWS][MATRIX_COLS];
+
+static int8_t offsets[POSITION_COUNT][HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT];
+static bool was_loaded = false;
+
+static const uint8_t eeprom_tag[] = {BIGRAM_HID_VERSION, POSITION_COUNT, HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT};
+
+
+static uint8_t get_next_index(keypos_t next) {
+#        ifdef SPLIT_KEYBOARD
+    return (next.row % (MATRIX_ROWS / 2)) * MATRIX_COLS + next.col;
+#        else
+    return next.row * MATRIX_COLS + next.col;
+#        endif
+}
+
+
+void load_heuristic_tap_hold_bigram_offsets(void) {
+    memset(slot_at, NO_SLOT, sizeof(slot_at));
+    for (uint8_t i = 0; i < POSITION_COUNT; ++i) {
+        slot_at[positions[i].row][positions[i].col] = i;
+    }
+
+    // after the positions changed, there's no table
+    was_loaded = load_checked_block(HEURISTIC_TAP_HOLD_BIGRAM_EEPROM_ADDR, offsets, sizeof(offsets), eeprom_tag);
+    if (!was_loaded) memset(offsets, 0, sizeof(offsets));
+}
+
+
+static void save_offsets(void) {
+    save_checked_block(HEURISTIC_TAP_HOLD_BIGRAM_EEPROM_ADDR, offsets, sizeof(offsets), eeprom_tag);
+}
+
+
+uint16_t offset_min_overlap_for_hold(uint16_t estimate, keypos_t tap_hold, keypos_t next) {
+    const uint8_t slot = slot_at[tap_hold.row][tap_hold.col];
+    if (slot == NO_SLOT) return estimate;
+
+#        ifdef SPLIT_KEYBOARD
+    // see HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT
+    if ((tap_hold.row < MATRIX_ROWS / 2) == (next.row < MATRIX_ROWS / 2)) return estimate;
+#        endif
+
+    const int16_t offset = offsets[slot][get_next_index(next)] * HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS;
+    const int16_t shifted = (int16_t) estimate + offset;
+    return shifted < 1 ? 1 : MIN(shifted, MS_MAX_OVERLAP);
+}
+
+
+// Checks the position index and range of a read or write, and limits n to
+// what fits into a packet.
+static bool is_valid_range(const uint8_t* data, uint8_t* n) {
+    const uint8_t slot = data[2];
+    const uint8_t first = data[3];
+    if (slot >= POSITION_COUNT || first >= HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT) return false;
+
+    *n = MIN(*n, MIN(BIGRAM_HID_MAX_OFFSETS, HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT - first));
+    return true;
+}
+
+
+bool process_heuristic_tap_hold_bigram_command(uint8_t* data, uint8_t length) {
+    if (length < BIGRAM_HID_HEADER_SIZE + BIGRAM_HID_MAX_OFFSETS || data[0] != HEURISTIC_TAP_HOLD_BIGRAM_HID_ID) {
+        return false;
+    }
+
+    uint8_t n = BIGRAM_HID_MAX_OFFSETS;
+    switch (data[1]) {
+        case BIGRAM_HID_INFO:
+            data[2] = BIGRAM_HID_VERSION;
+            data[3] = POSITION_COUNT;
+            data[4] = HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT;
+            data[5] = HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS;
+            data[6] = was_loaded;
+            return true;
+        case BIGRAM_HID_POSITIONS: {
+            const uint8_t first = data[2];
+            if (first >= POSITION_COUNT) break;
+
+            n = MIN(n, POSITION_COUNT - first);
+            data[3] = n;
+            for (uint8_t i = 0; i < n; ++i) {
+                data[4 + i] = positions[first + i].row << 4 | positions[first + i].col;
+            }
+            return true;
+        }
+        case BIGRAM_HID_READ:
+            if (!is_valid_range(data, &n)) break;
+            data[4] = n;
+            memcpy(data + BIGRAM_HID_HEADER_SIZE, &offsets[data[2]][data[3]], n);
+            return true;
+        case BIGRAM_HID_WRITE:
+            n = data[4];
+            if (!is_valid_range(data, &n)) break;
+            data[4] = n;
+            memcpy(&offsets[data[2]][data[3]], data + BIGRAM_HID_HEADER_SIZE, n);
+            return true;
+        case BIGRAM_HID_SAVE:
+            save_offsets();
+            return true;
+    }
+
+    data[1] = BIGRAM_HID_ERROR;
+    return true;
+}
+
+
+#        endif // HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS && !NO_ACTION_TAPPING
@@ -0,0 +1,90 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Learned offsets of the overlap estimate per pair of the tap hold key and the
+// key after it (e.g. rolls inward naturally overlap longer than outward ones).
+// Only the positions in HEURISTIC_TAP_HOLD_BIGRAM_POSITIONS can be tap hold
+// keys, so the table has one row of HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT
+// offsets for each of them and nothing for the others. Each offset is one
+// signed byte in units of HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS.
+//
+// The table is kept in RAM and loaded from the user datablock of the EEPROM at
+// start up, so it can be relearned from captured typing (see
+// host/bigram_table) and written over raw HID without flashing.
+
+#pragma once
+
+#include "eeprom_block.h"
+#include "heuristic_tap_hold.h"
+
+// The matrix positions ({row, col}) of the keys that can be tap hold keys,
+// e.g. of LAYOUT_5x6 in keymap.c. At most 255.
+#if !defined(HEURISTIC_TAP_HOLD_BIGRAM_POSITIONS)
+#    error "HEURISTIC_TAP_HOLD_BIGRAM_POSITIONS must list the positions of the tap hold keys"
+#endif
+
+#if !defined(HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS)
+#    define HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS 2
+#endif
+
+// where the table starts in the EEPROM
+#if !defined(HEURISTIC_TAP_HOLD_BIGRAM_EEPROM_ADDR)
+#    define HEURISTIC_TAP_HOLD_BIGRAM_EEPROM_ADDR EECONFIG_USER_DATABLOCK
+#endif
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(HEURISTIC_TAP_HOLD_BIGRAM_HID_ID)
+#    define HEURISTIC_TAP_HOLD_BIGRAM_HID_ID 0xF3
+#endif
+
+// The overlap heuristic is only asked when the next key is on the other half,
+// so only its position within that half matters.
+#ifdef SPLIT_KEYBOARD
+#    define HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT (MATRIX_ROWS / 2 * MATRIX_COLS)
+#else
+#    define HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT (MATRIX_ROWS * MATRIX_COLS)
+#endif
+
+// a checked block (see eeprom_block.h) tagged with the version, position count
+// and next count
+#define BIGRAM_EEPROM_SIZE(position_count) \
+    (CHECKED_BLOCK_HEADER_SIZE + (position_count) * HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT)
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:      request  [id, 0]
+//              response [id, 0, version, position count, next count, unit ms, was loaded]
+//   positions: request  [id, 1, first]
+//              response [id, 1, first, n, n positions (row << 4 | col)]
+//   read:      request  [id, 2, position index, first next]
+//              response [id, 2, position index, first next, n, n offsets]
+//   write:     request  [id, 3, position index, first next, n, n offsets]
+//              response [id, 3, position index, first next, n]
+//   save:      request  [id, 4]
+//              response [id, 4]
+//
+// The next key's index is row * MATRIX_COLS + col within its half. Offsets are
+// signed bytes. Writes only change the RAM, save writes the table to the
+// EEPROM. was_loaded is 1, if the table was loaded from the EEPROM at start up
+// (else it was all zero, e.g. after flashing). An unknown index is an error,
+// too.
+#define BIGRAM_HID_VERSION 1
+
+enum {
+    BIGRAM_HID_INFO = 0,
+    BIGRAM_HID_POSITIONS = 1,
+    BIGRAM_HID_READ = 2,
+    BIGRAM_HID_WRITE = 3,
+    BIGRAM_HID_SAVE = 4,
+    BIGRAM_HID_ERROR = 0xFF,
+};
+
+// Call this once at start up (e.g. from keyboard_post_init_user).
+void load_heuristic_tap_hold_bigram_offsets(void);
+
+// The estimate plus the learned offset of this pair, still between 1 and
+// MS_MAX_OVERLAP. Called by heuristic_tap_hold.c for the next key.
+uint16_t offset_min_overlap_for_hold(uint16_t estimate, keypos_t tap_hold, keypos_t next);
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a bigram command, in which case data holds the response.
+bool process_heuristic_tap_hold_bigram_command(uint8_t* data, uint8_t length);
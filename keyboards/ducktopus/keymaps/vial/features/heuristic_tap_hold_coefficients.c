@@ -0,0 +1,182 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS) && !defined(NO_ACTION_TAPPING)
+
+#include <string.h>
+
+#include "eeprom_block.h"
+#include "heuristic_tap_hold_coefficients.h"
+
+_Static_assert(sizeof(float) == 4, "coefficients are sent as 4 byte floats");
+_Static_assert(sizeof(heuristic_tap_hold_coefficients_t) <= 255, "the coefficients are too large for the header");
+_Static_assert(HEURISTIC_TAP_HOLD_COEFFICIENTS_EEPROM_OFFSET + COEFFICIENTS_EEPROM_SIZE <= EECONFIG_USER_DATA_SIZE,
+               "EECONFIG_USER_DATA_SIZE is too small for the coefficients");
+
+#define EEPROM_ADDR (EECONFIG_USER_DATABLOCK + HEURISTIC_TAP_HOLD_COEFFICIENTS_EEPROM_OFFSET)
+
+#define COEFFICIENTS_HID_HEADER_SIZE 4
+#define COEFFICIENTS_HID_MAX_VALUES  ((32 - COEFFICIENTS_HID_HEADER_SIZE) / 4)
+
+// the index of the max overlap in an apply response
+#define MAX_OVERLAP_INDEX HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT
+
+
+static const heuristic_tap_hold_coefficients_t default_coefficients = {
+        .overlap = DEFAULT_OVERLAP_COEFFICIENTS,
+        .wrapped = DEFAULT_WRAPPED_COEFFICIENTS,
+        .two_down = DEFAULT_TWO_DOWN_COEFFICIENTS,
+        .max_overlap_ms = MS_MAX_OVERLAP,
+};
+
+static heuristic_tap_hold_coefficients_t coefficients;
+// what writes go to, until apply
+static heuristic_tap_hold_coefficients_t staged;
+
+// so the compiled in heuristics can be used for the defaults
+static bool is_default = true;
+static bool was_loaded = false;
+
+static const uint8_t eeprom_tag[] = {COEFFICIENTS_HID_VERSION, sizeof(heuristic_tap_hold_coefficients_t),
+                                     HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT};
+
+
+static float* get_coefficient(heuristic_tap_hold_coefficients_t* set, uint8_t index) {
+    if (index < OVERLAP_COEFFICIENT_COUNT) return &set->overlap[index];
+    index -= OVERLAP_COEFFICIENT_COUNT;
+    if (index < WRAPPED_COEFFICIENT_COUNT) return &set->wrapped[index];
+    return &set->two_down[index - WRAPPED_COEFFICIENT_COUNT];
+}
+
+
+// The index of the first invalid value, or 0xFF. NaN fails both comparisons.
+static uint8_t find_invalid_value(heuristic_tap_hold_coefficients_t* set) {
+    for (uint8_t i = 0; i < HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT; ++i) {
+        const float c = *get_coefficient(set, i);
+        if (!(c >= -HEURISTIC_TAP_HOLD_MAX_COEFFICIENT && c <= HEURISTIC_TAP_HOLD_MAX_COEFFICIENT)) return i;
+    }
+    if (set->max_overlap_ms < 1 || set->max_overlap_ms > MS_MAX_OVERLAP) return MAX_OVERLAP_INDEX;
+    return 0xFF;
+}
+
+
+static void use_coefficients(const heuristic_tap_hold_coefficients_t* set) {
+    coefficients = *set;
+    staged = *set;
+    is_default = memcmp(coefficients.overlap, default_coefficients.overlap, sizeof(coefficients.overlap)) == 0 &&
+                 memcmp(coefficients.wrapped, default_coefficients.wrapped, sizeof(coefficients.wrapped)) == 0 &&
+                 memcmp(coefficients.two_down, default_coefficients.two_down, sizeof(coefficients.two_down)) == 0;
+}
+
+
+void load_heuristic_tap_hold_coefficients(void) {
+    heuristic_tap_hold_coefficients_t stored;
+
+    // after the struct changed, the defaults are used, and the values are
+    // checked again, in case the limits changed since it was saved
+    was_loaded = load_checked_block(EEPROM_ADDR, &stored, sizeof(stored), eeprom_tag) &&
+                 find_invalid_value(&stored) == 0xFF;
+    use_coefficients(was_loaded ? &stored : &default_coefficients);
+}
+
+
+static void save_coefficients(void) {
+    save_checked_block(EEPROM_ADDR, &coefficients, sizeof(coefficients), eeprom_tag);
+}
+
+
+const heuristic_tap_hold_coefficients_t* get_heuristic_tap_hold_coefficients(void) {
+    return &coefficients;
+}
+
+
+uint16_t estimate_min_overlap_for_hold_in_ms_runtime(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur) {
+    if (is_default) return estimate_min_overlap_for_hold_in_ms(prev_up_th_down_dur, th_down_next_down_dur);
+    return estimate_min_overlap_for_hold_in_ms_with(coefficients.overlap, prev_up_th_down_dur, th_down_next_down_dur);
+}
+
+
+bool estimate_hold_when_wrapped_runtime(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur) {
+    if (is_default) return estimate_hold_when_wrapped(prev_up_th_down_dur, th_down_next_down_dur, next_dur);
+    return estimate_hold_when_wrapped_with(coefficients.wrapped, prev_up_th_down_dur, th_down_next_down_dur, next_dur);
+}
+
+
+bool estimate_hold_when_two_down_runtime(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod) {
+    if (is_default) return estimate_hold_when_two_down(prev_up_th_down_dur, th_down_next_down_dur, prev_is_mod);
+    return estimate_hold_when_two_down_with(coefficients.two_down, prev_up_th_down_dur, th_down_next_down_dur,
+                                            prev_is_mod);
+}
+
+
+// Checks the range of a read or write, and limits n to what fits into a packet.
+static bool is_valid_range(uint8_t first, uint8_t* n) {
+    if (first >= HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT) return false;
+
+    *n = MIN(*n, MIN(COEFFICIENTS_HID_MAX_VALUES, HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT - first));
+    return true;
+}
+
+
+bool process_heuristic_tap_hold_coefficients_command(uint8_t* data, uint8_t length) {
+    if (length < 32 || data[0] != HEURISTIC_TAP_HOLD_COEFFICIENTS_HID_ID) return false;
+
+    uint8_t n = COEFFICIENTS_HID_MAX_VALUES;
+    switch (data[1]) {
+        case COEFFICIENTS_HID_INFO:
+            data[2] = COEFFICIENTS_HID_VERSION;
+            data[3] = OVERLAP_COEFFICIENT_COUNT;
+            data[4] = WRAPPED_COEFFICIENT_COUNT;
+            data[5] = TWO_DOWN_COEFFICIENT_COUNT;
+            data[6] = MS_MAX_OVERLAP & 0xFF;
+            data[7] = MS_MAX_OVERLAP >> 8;
+            data[8] = coefficients.max_overlap_ms & 0xFF;
+            data[9] = coefficients.max_overlap_ms >> 8;
+            data[10] = was_loaded;
+            data[11] = is_default;
+            return true;
+        case COEFFICIENTS_HID_READ:
+            if (!is_valid_range(data[2], &n)) break;
+            data[3] = n;
+            for (uint8_t i = 0; i < n; ++i) {
+                const float* c = get_coefficient(&coefficients, data[2] + i);
+                memcpy(data + COEFFICIENTS_HID_HEADER_SIZE + i * sizeof(float), c, sizeof(float));
+            }
+            return true;
+        case COEFFICIENTS_HID_WRITE:
+            n = data[3];
+            if (!is_valid_range(data[2], &n)) break;
+            data[3] = n;
+            for (uint8_t i = 0; i < n; ++i) {
+                float* c = get_coefficient(&staged, data[2] + i);
+                memcpy(c, data + COEFFICIENTS_HID_HEADER_SIZE + i * sizeof(float), sizeof(float));
+            }
+            return true;
+        case COEFFICIENTS_HID_APPLY: {
+            staged.max_overlap_ms = (uint16_t) (data[2] | data[3] << 8);
+            const bool should_save = data[4];
+
+            const uint8_t invalid = find_invalid_value(&staged);
+            if (invalid != 0xFF) {
+                staged = coefficients;
+                data[2] = 1;
+                data[3] = invalid;
+                return true;
+            }
+
+            use_coefficients(&staged);
+            if (should_save) save_coefficients();
+            data[2] = 0;
+            return true;
+        }
+        case COEFFICIENTS_HID_RESET:
+            use_coefficients(&default_coefficients);
+            if (data[2]) save_coefficients();
+            return true;
+    }
+
+    data[1] = COEFFICIENTS_HID_ERROR;
+    return true;
+}
+
+
+#        endif // HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS && !NO_ACTION_TAPPING
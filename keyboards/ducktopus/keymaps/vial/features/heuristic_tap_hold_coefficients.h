@@ -0,0 +1,98 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// The coefficients of the three heuristics (see heuristic_tap_hold_kernels.h)
+// and the timeout of the overlap, changeable at runtime over raw HID, e.g. to
+// try newly tuned ones without flashing. They are kept in RAM and loaded from
+// the user datablock of the EEPROM at start up, so a decision never touches
+// the EEPROM.
+//
+// As long as they are the compiled in defaults, the heuristics are computed
+// like without this (e.g. in fixed point). Any other set is computed with
+// the float _with versions, which needs soft float on MCUs without an FPU.
+
+#pragma once
+
+#include "eeprom_block.h"
+#include "heuristic_tap_hold.h"
+#include "heuristic_tap_hold_kernels.h"
+
+// where the coefficients start within the user datablock of the EEPROM, e.g.
+// after the bigram offsets
+#if !defined(HEURISTIC_TAP_HOLD_COEFFICIENTS_EEPROM_OFFSET)
+#    define HEURISTIC_TAP_HOLD_COEFFICIENTS_EEPROM_OFFSET 0
+#endif
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(HEURISTIC_TAP_HOLD_COEFFICIENTS_HID_ID)
+#    define HEURISTIC_TAP_HOLD_COEFFICIENTS_HID_ID 0xF4
+#endif
+
+// Sets with a coefficient that isn't finite or of a larger magnitude than this
+// are rejected, so no product of one with a duration can overflow a float.
+#if !defined(HEURISTIC_TAP_HOLD_MAX_COEFFICIENT)
+#    define HEURISTIC_TAP_HOLD_MAX_COEFFICIENT 1e6f
+#endif
+
+#define HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT \
+    (OVERLAP_COEFFICIENT_COUNT + WRAPPED_COEFFICIENT_COUNT + TWO_DOWN_COEFFICIENT_COUNT)
+
+typedef struct {
+    float overlap[OVERLAP_COEFFICIENT_COUNT];
+    float wrapped[WRAPPED_COEFFICIENT_COUNT];
+    float two_down[TWO_DOWN_COEFFICIENT_COUNT];
+    // what get_max_overlap_in_ms returns by default, 1 to MS_MAX_OVERLAP
+    uint16_t max_overlap_ms;
+} heuristic_tap_hold_coefficients_t;
+
+// a checked block (see eeprom_block.h) tagged with the version, size and
+// coefficient count
+#define COEFFICIENTS_EEPROM_SIZE (CHECKED_BLOCK_HEADER_SIZE + sizeof(heuristic_tap_hold_coefficients_t))
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:   request  [id, 0]
+//           response [id, 0, version, overlap count, wrapped count, two down count,
+//                     MS_MAX_OVERLAP (2), max overlap ms (2), was loaded, is default]
+//   read:   request  [id, 1, first]
+//           response [id, 1, first, n, n coefficients]
+//   write:  request  [id, 2, first, n, n coefficients]
+//           response [id, 2, first, n]
+//   apply:  request  [id, 3, max overlap ms (2), should save]
+//           response [id, 3, 0] or [id, 3, 1, index of the first invalid value]
+//   reset:  request  [id, 4, should save]
+//           response [id, 4]
+//
+// Coefficients are indexed in the order of the struct (overlap, wrapped, two
+// down) and sent as IEEE 754 floats, at most 7 per packet. Reads return the
+// set in use. Writes only go to a second set, which apply checks as a whole:
+// if every coefficient and the max overlap (index
+// HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT) are valid, it is used from then on
+// (and saved to the EEPROM, if should_save is 1), else the written values are
+// dropped and nothing changes. Reset goes back to the compiled in defaults.
+// was_loaded is 1, if the set was loaded from the EEPROM at start up. An
+// unknown index is an error, too.
+#define COEFFICIENTS_HID_VERSION 1
+
+enum {
+    COEFFICIENTS_HID_INFO = 0,
+    COEFFICIENTS_HID_READ = 1,
+    COEFFICIENTS_HID_WRITE = 2,
+    COEFFICIENTS_HID_APPLY = 3,
+    COEFFICIENTS_HID_RESET = 4,
+    COEFFICIENTS_HID_ERROR = 0xFF,
+};
+
+// Call this once at start up (e.g. from keyboard_post_init_user).
+void load_heuristic_tap_hold_coefficients(void);
+
+const heuristic_tap_hold_coefficients_t* get_heuristic_tap_hold_coefficients(void);
+
+// The heuristics with the coefficients in use. heuristic_tap_hold.c calls
+// these instead of the compiled in ones.
+uint16_t estimate_min_overlap_for_hold_in_ms_runtime(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+bool estimate_hold_when_wrapped_runtime(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur);
+bool estimate_hold_when_two_down_runtime(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod);
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a coefficients command, in which case data holds the response.
+bool process_heuristic_tap_hold_coefficients_command(uint8_t* data, uint8_t length);
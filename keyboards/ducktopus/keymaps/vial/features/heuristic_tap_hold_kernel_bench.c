@@ -0,0 +1,159 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        ifdef HEURISTIC_TAP_HOLD_KERNEL_BENCH
+
+#include <string.h>
+
+#include "heuristic_tap_hold_kernel_bench.h"
+#include "heuristic_tap_hold_kernels.h"
+#include "cycle_counter.h"
+
+#        ifdef __arm__
+#include <ch.h>
+#        endif
+
+typedef struct {
+    int16_t p;
+    uint16_t t;
+    uint16_t n;
+    bool m;
+} kernel_input_t;
+
+typedef uint32_t (*kernel_fn_t)(const kernel_input_t* in);
+
+
+static uint32_t call_none(const kernel_input_t* in) {
+    return in->t;
+}
+
+static uint32_t call_overlap_float(const kernel_input_t* in) {
+    return estimate_min_overlap_for_hold_in_ms_float(in->p, in->t);
+}
+
+static uint32_t call_overlap_fixed(const kernel_input_t* in) {
+    return estimate_min_overlap_for_hold_in_ms_fixed(in->p, in->t);
+}
+
+static uint32_t call_overlap_table(const kernel_input_t* in) {
+    return estimate_min_overlap_for_hold_in_ms_table(in->p, in->t);
+}
+
+static uint32_t call_wrapped_float(const kernel_input_t* in) {
+    return estimate_hold_when_wrapped_float(in->p, in->t, in->n);
+}
+
+static uint32_t call_wrapped_fixed(const kernel_input_t* in) {
+    return estimate_hold_when_wrapped_fixed(in->p, in->t, in->n);
+}
+
+static uint32_t call_two_down_float(const kernel_input_t* in) {
+    return estimate_hold_when_two_down_float(in->p, in->t, in->m);
+}
+
+static uint32_t call_two_down_fixed(const kernel_input_t* in) {
+    return estimate_hold_when_two_down_fixed(in->p, in->t, in->m);
+}
+
+
+static const struct {
+    kernel_fn_t call;
+    const char* name;
+} kernels[KERNEL_BENCH_KERNEL_COUNT] = {
+    [KERNEL_BENCH_NONE]           = {call_none, "none"},
+    [KERNEL_BENCH_OVERLAP_FLOAT]  = {call_overlap_float, "ovl_flt"},
+    [KERNEL_BENCH_OVERLAP_FIXED]  = {call_overlap_fixed, "ovl_fix"},
+    [KERNEL_BENCH_OVERLAP_TABLE]  = {call_overlap_table, "ovl_tab"},
+    [KERNEL_BENCH_WRAPPED_FLOAT]  = {call_wrapped_float, "wrp_flt"},
+    [KERNEL_BENCH_WRAPPED_FIXED]  = {call_wrapped_fixed, "wrp_fix"},
+    [KERNEL_BENCH_TWO_DOWN_FLOAT] = {call_two_down_float, "two_flt"},
+    [KERNEL_BENCH_TWO_DOWN_FIXED] = {call_two_down_fixed, "two_fix"},
+};
+
+// so the calls can't be optimized away
+static volatile uint32_t sink;
+
+
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, so every kernel gets the same inputs
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+// like host/kernels bench: mostly short gaps before the tap hold press, sometimes long
+static kernel_input_t get_next_input(uint32_t* state) {
+    const uint32_t r = next_random(state);
+    const int32_t gap = (r & 7) == 0 ? (int32_t) (r >> 16) % MS_MAX_DUR : (int32_t) (r >> 16) % 600 - MS_MAX_OVERLAP;
+    kernel_input_t in = {.p = (int16_t) gap};
+    in.t = (uint16_t) (next_random(state) % (MS_MAX_OVERLAP + 1));
+    in.n = (uint16_t) (next_random(state) % (MS_MAX_OVERLAP + 1));
+    in.m = next_random(state) & 1;
+    return in;
+}
+
+
+static uint32_t time_call(kernel_fn_t call, const kernel_input_t* in) {
+#        ifdef __arm__
+    chSysLock();
+#        endif
+    const uint32_t start = read_cycle_counter();
+    sink += call(in);
+    const uint32_t cycles = get_cycles_between(start, read_cycle_counter());
+#        ifdef __arm__
+    chSysUnlock();
+#        endif
+    return cycles;
+}
+
+
+static void write_u32(uint8_t* out, uint32_t value) {
+    for (uint8_t byte = 0; byte < 4; ++byte) out[byte] = (value >> (8 * byte)) & 0xFF;
+}
+
+
+static bool run_kernel(uint8_t* data) {
+    const uint8_t kernel = data[2];
+    if (kernel >= KERNEL_BENCH_KERNEL_COUNT) return false;
+
+    uint32_t state = 0x12345678;
+    uint64_t cycles = 0;
+    uint32_t max_cycles = 0;
+    for (uint16_t i = 0; i < KERNEL_BENCH_CALLS; ++i) {
+        const kernel_input_t in = get_next_input(&state);
+        const uint32_t call_cycles = time_call(kernels[kernel].call, &in);
+        cycles += call_cycles;
+        if (call_cycles > max_cycles) max_cycles = call_cycles;
+    }
+
+    data[3] = 0;
+    write_u32(data + 4, KERNEL_BENCH_CALLS);
+    write_u32(data + 8, (uint32_t) cycles);
+    write_u32(data + 12, (uint32_t) (cycles >> 32));
+    write_u32(data + 16, max_cycles);
+    memset(data + 20, 0, 4);
+    strncpy((char*) data + 24, kernels[kernel].name, 8);
+    return true;
+}
+
+
+bool process_heuristic_tap_hold_kernel_bench_command(uint8_t* data, uint8_t length) {
+    if (length < 32 || data[0] != HEURISTIC_TAP_HOLD_KERNEL_BENCH_HID_ID) return false;
+
+    switch (data[1]) {
+        case KERNEL_BENCH_HID_INFO:
+            data[2] = KERNEL_BENCH_HID_VERSION;
+            data[3] = KERNEL_BENCH_KERNEL_COUNT;
+            return true;
+
+        case KERNEL_BENCH_HID_RUN:
+            if (run_kernel(data)) return true;
+            break;
+    }
+
+    data[1] = KERNEL_BENCH_HID_ERROR;
+    return true;
+}
+
+#        endif // HEURISTIC_TAP_HOLD_KERNEL_BENCH
@@ -0,0 +1,56 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Times the float, fixed point and table versions of the heuristics (see
+// heuristic_tap_hold_kernels.h) on the keyboard itself, in CPU cycles of
+// cycle_counter.h, so the fixed point versions can be compared where they
+// matter: on an MCU without an FPU. Each call is timed on its own, with
+// interrupts off, over the same pseudo random inputs for every kernel, like
+// the ones host/kernels bench uses. The first kernel calls nothing, which is
+// the overhead to subtract from the others.
+//
+// Define HEURISTIC_TAP_HOLD_KERNEL_BENCH to build it in. It only runs when
+// asked to over raw HID (see host/hid_kernel_bench), a few ms per kernel.
+
+#pragma once
+
+#include "quantum.h"
+
+#define KERNEL_BENCH_CALLS 256
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(HEURISTIC_TAP_HOLD_KERNEL_BENCH_HID_ID)
+#    define HEURISTIC_TAP_HOLD_KERNEL_BENCH_HID_ID 0xF9
+#endif
+
+enum kernel_bench_kernel {
+    KERNEL_BENCH_NONE,
+    KERNEL_BENCH_OVERLAP_FLOAT,
+    KERNEL_BENCH_OVERLAP_FIXED,
+    KERNEL_BENCH_OVERLAP_TABLE,
+    KERNEL_BENCH_WRAPPED_FLOAT,
+    KERNEL_BENCH_WRAPPED_FIXED,
+    KERNEL_BENCH_TWO_DOWN_FLOAT,
+    KERNEL_BENCH_TWO_DOWN_FIXED,
+    KERNEL_BENCH_KERNEL_COUNT
+};
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:  request  [id, 0]
+//          response [id, 0, version, kernel count]
+//   run:   request  [id, 1, kernel]
+//          response [id, 1, kernel, 0, calls (4), cycles (8), max cycles (4),
+//                    0 (4), name (8, padded with 0)]
+//
+// The cycles are the sum over all calls. An unknown kernel is an error, too.
+#define KERNEL_BENCH_HID_VERSION 1
+
+enum {
+    KERNEL_BENCH_HID_INFO = 0,
+    KERNEL_BENCH_HID_RUN = 1,
+    KERNEL_BENCH_HID_ERROR = 0xFF,
+};
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a kernel bench command, in which case data holds the response.
+bool process_heuristic_tap_hold_kernel_bench_command(uint8_t* data, uint8_t length);
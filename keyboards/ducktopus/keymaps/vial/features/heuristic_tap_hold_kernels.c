@@ -0,0 +1,271 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include "heuristic_tap_hold_kernels.h"
+
+// the fixed versions rely on this, so their products fit into 64 bits
+_Static_assert(MS_MAX_OVERLAP <= 1023, "MS_MAX_OVERLAP is too large for the fixed point heuristics");
+
+
+// float (reference)
+//=============================================================================
+float estimate_min_overlap_for_hold_inner_float(int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms) {
+    const float prev_up_th_down_dur = (float) prev_up_th_down_dur_ms;
+
+    const float th_down_next_down_dur = (float) th_down_next_down_dur_ms;
+
+    return MAX(
+            1386.7545166f,
+            -136.1621093f * prev_up_th_down_dur - 315.5284118f
+        ) - MAX(prev_up_th_down_dur, 325.5094909f) -
+            6.4232006f * th_down_next_down_dur +
+            302.9532165f;
+}
+
+
+uint16_t estimate_min_overlap_for_hold_in_ms_float(int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms) {
+    const float prev_up_th_down_dur = (float) prev_up_th_down_dur_ms;
+    const float inner = estimate_min_overlap_for_hold_inner_float(prev_up_th_down_dur_ms, th_down_next_down_dur_ms);
+
+    const float guess = ABS(MAX(
+            -prev_up_th_down_dur,
+            MAX(3.0614197f, inner)
+    ));
+
+    // clamp before converting, as a guess >= 65536 would wrap around
+    return MAX(1, (uint16_t) MIN((float) MS_MAX_OVERLAP, guess));
+}
+
+
+bool estimate_hold_when_wrapped_float(int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms, uint16_t next_dur_ms) {
+    const float next_dur = (float) next_dur_ms;
+
+    const float prev_up_th_down_dur = (float) prev_up_th_down_dur_ms;
+    const float th_down_next_down_dur = (float) th_down_next_down_dur_ms;
+
+    const float th_down_next_down_dur_reciprocal = SD(1.0f, th_down_next_down_dur);
+
+    const float non_zero_divisor = MAX(
+             1.1125613f + 558.6079711f * th_down_next_down_dur_reciprocal,
+             MAX(
+                 110.8752517f,
+                 MAX(1.1125613f, -5.7630343f * prev_up_th_down_dur - 184.2279510f) * -prev_up_th_down_dur
+             ) + SD(4170.0205078f, next_dur) - 179.2697753f
+     );
+
+    const float guess = MAX(prev_up_th_down_dur * 0.6423792f, 23.4521789f) / (
+            542.2182617f * th_down_next_down_dur_reciprocal * non_zero_divisor
+    );
+
+    return guess > 0.5f || guess < -0.5f;
+}
+
+
+bool estimate_hold_when_two_down_float(int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms, bool prev_is_mod_flag) {
+    const float prev_up_th_down_dur = (float) prev_up_th_down_dur_ms;
+    const float th_down_next_down_dur = (float) th_down_next_down_dur_ms;
+    const float prev_is_mod = (float) prev_is_mod_flag;
+
+    const float guess = (
+            ABS(-0.0297553f * prev_up_th_down_dur - 9.2836914f) +
+                (0.2559899f + prev_is_mod * (0.0180325f * MAX(-prev_up_th_down_dur, 17.5247516f))) *
+                th_down_next_down_dur
+    ) / (MAX(-prev_up_th_down_dur, 14.0228700f) * -9.2638397f);
+
+    return guess > 0.5f || guess < -0.5f;
+}
+
+
+// coefficients
+//=============================================================================
+uint16_t estimate_min_overlap_for_hold_in_ms_with(const float* c, int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms) {
+    const float p = (float) prev_up_th_down_dur_ms;
+    const float t = (float) th_down_next_down_dur_ms;
+
+    const float inner = MAX(c[0], c[1] * p + c[2]) - MAX(p, c[3]) + c[4] * t + c[5];
+    const float guess = ABS(MAX(-p, MAX(c[6], inner)));
+
+    return MAX(1, (uint16_t) MIN((float) MS_MAX_OVERLAP, guess));
+}
+
+
+bool estimate_hold_when_wrapped_with(const float* c, int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms, uint16_t next_dur_ms) {
+    const float p = (float) prev_up_th_down_dur_ms;
+    const float t = (float) th_down_next_down_dur_ms;
+    const float n = (float) next_dur_ms;
+
+    const float r = SD(1.0f, t);
+    const float d = MAX(c[0] + c[1] * r, MAX(c[2], MAX(c[3], c[4] * p + c[5]) * -p) + SD(c[6], n) + c[7]);
+    const float guess = MAX(p * c[8], c[9]) / (c[10] * r * d);
+
+    return guess > 0.5f || guess < -0.5f;
+}
+
+
+bool estimate_hold_when_two_down_with(const float* c, int16_t prev_up_th_down_dur_ms, uint16_t th_down_next_down_dur_ms, bool prev_is_mod_flag) {
+    const float p = (float) prev_up_th_down_dur_ms;
+    const float t = (float) th_down_next_down_dur_ms;
+    const float prev_is_mod = (float) prev_is_mod_flag;
+
+    const float guess = (ABS(c[0] * p + c[1]) + (c[2] + prev_is_mod * (c[3] * MAX(-p, c[4]))) * t) /
+                        (MAX(-p, c[5]) * c[6]);
+
+    return guess > 0.5f || guess < -0.5f;
+}
+
+
+// fixed point
+//=============================================================================
+// The float constants are scaled by 2^21, 2^36 and 2^30 respectively. The
+// divisions are removed by multiplying both sides of the comparisons with the
+// (always positive) divisors.
+//
+// The decisions are those of exact math. Where the guess of the float
+// reference is within float rounding of the decision boundary (a relative
+// ~1e-7), it can land on the other side, so a few such inputs are decided
+// differently (see heuristic_tap_hold_kernels.h).
+
+
+// All constants are exact in Q21, so this matches the float version exactly.
+uint16_t estimate_min_overlap_for_hold_in_ms_fixed(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur) {
+    const int32_t p = prev_up_th_down_dur;
+
+    // the guess is at least -p
+    if (-p >= MS_MAX_OVERLAP) return MS_MAX_OVERLAP;
+
+    const int64_t guess_q21 = MAX(
+            (int64_t) 2908235008,                              // 1386.7545166f
+            (int64_t) -285552640 * p - 661711040               // -136.1621093f * p - 315.5284118f
+    ) - MAX(
+            (int64_t) p << 21,
+            (int64_t) 682642880                                // 325.5094909f
+    ) - (int64_t) 13470428 * th_down_next_down_dur +           // 6.4232006f
+            635338944;                                         // 302.9532165f
+
+    // the float version truncates a positive value (>= 3.0614197f)
+    const int32_t guess = MAX(-p, MAX(3, (int32_t) (guess_q21 >> 21)));
+    return MIN(MS_MAX_OVERLAP, guess);
+}
+
+
+// hold, if 2 * MAX(0.642 p, 23.45) * t > 542.2 * non_zero_divisor
+// with t = MAX(1, th_down_next_down_dur), which is split into one comparison
+// per argument of MAX (both must hold). The factor 2 / 542.2 is folded into
+// the numerator.
+bool estimate_hold_when_wrapped_fixed(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur) {
+    const int64_t p = prev_up_th_down_dur;
+
+    // From here on, the MAX(110.8752517f, ...) part is at least 398, so the
+    // right side is at least 542.2 * (398 - 179.27), while the left side is
+    // at most 2 * 23.45 * 1023. So this is always a tap.
+    if (p <= -34) return false;
+
+    const int64_t t = MAX(1, th_down_next_down_dur);
+    const int64_t n = MAX(1, next_dur);
+
+    const int64_t numerator_q36 = MAX(
+            162827287 * p,                                     // 2 / 542.2182617f * 0.6423792f
+            (int64_t) 5944548828                               // 2 / 542.2182617f * 23.4521789f
+    );
+
+    // 1.1125613f + 558.6079711f / t
+    if (numerator_q36 * t * t <= (int64_t) 76454633472 * t + (int64_t) 38387247480832) {
+        return false;
+    }
+
+    const int64_t inner_q36 = MAX(
+            (int64_t) 76454633472,                             // 1.1125613f
+            -396032704512 * p - (int64_t) 12660048396288       // -5.7630343f * p - 184.2279510f
+    );
+    const int64_t outer_q36 = MAX((int64_t) 7619289284608, inner_q36 * -p); // 110.8752517f
+
+    // outer + 4170.0205078f / n - 179.2697753f
+    if (numerator_q36 * t * n <= (outer_q36 - (int64_t) 12319325159424) * n + (int64_t) 286561627275264) {
+        return false;
+    }
+    return true;
+}
+
+
+// The guess is never positive, so this is a hold, if
+// numerator > 9.2638397f / 2 * MAX(-p, 14.0228700f)
+bool estimate_hold_when_two_down_fixed(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod) {
+    const int64_t p = prev_up_th_down_dur;
+
+    const int64_t offset_q30 = 31949510 * p + (int64_t) 9968287744;     // 0.0297553f * p + 9.2836914f
+
+    int64_t slope_q30 = 274867072;                                      // 0.2559899f
+    if (prev_is_mod) {
+        slope_q30 += MAX(19362250 * -p, (int64_t) 339318623);           // 0.0180325f * MAX(-p, 17.5247516f)
+    }
+
+    const int64_t numerator_q30 = ABS(offset_q30) + slope_q30 * th_down_next_down_dur;
+    const int64_t threshold_q30 = MAX(4973486080 * -p, (int64_t) 69742549064); // 4.6319198f * MAX(-p, 14.0228700f)
+
+    return numerator_q30 > threshold_q30;
+}
+
+
+// table
+//=============================================================================
+#include "heuristic_tap_hold_overlap_table.h"
+
+
+// index of the last knot <= x, but at most count - 2 (so there is a next one)
+static uint8_t find_interval(const int16_t* knots, uint8_t count, int16_t x) {
+    uint8_t low = 0;
+    uint8_t high = count - 1;
+    while (high - low > 1) {
+        const uint8_t mid = (low + high) / 2;
+        if (knots[mid] <= x) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+uint16_t look_up_min_overlap_for_hold_in_ms(const overlap_table_t* table, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur) {
+    const int16_t p = MIN(MAX(prev_up_th_down_dur, table->p_knots[0]), table->p_knots[table->p_count - 1]);
+    const int16_t t = MIN((int16_t) th_down_next_down_dur, table->t_knots[table->t_count - 1]);
+
+    const uint8_t i = find_interval(table->p_knots, table->p_count, p);
+    const uint8_t j = find_interval(table->t_knots, table->t_count, t);
+
+    const int32_t dp = p - table->p_knots[i];
+    const int32_t dt = t - table->t_knots[j];
+    const uint8_t p_shift = table->p_shifts[i];
+
+    const int16_t* row = &table->inners_q3[i * table->t_count + j];
+    const int16_t* next_row = row + table->t_count;
+
+    const int32_t at_t = row[0] + (((next_row[0] - row[0]) * dp) >> p_shift);
+    const int32_t at_next_t = row[1] + (((next_row[1] - row[1]) * dp) >> p_shift);
+    const int32_t inner_q3 = at_t + (((at_next_t - at_t) * dt) >> table->t_shifts[j]);
+
+    // like the fixed version, but with the unclamped prev_up_th_down_dur
+    const int32_t guess = MAX(-(int32_t) prev_up_th_down_dur, MAX(3, inner_q3 >> 3));
+    return MIN(MS_MAX_OVERLAP, guess);
+}
+
+
+uint16_t estimate_min_overlap_for_hold_in_ms_table(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur) {
+    return look_up_min_overlap_for_hold_in_ms(&overlap_table, prev_up_th_down_dur, th_down_next_down_dur);
+}
+
+
+// confidence
+//=============================================================================
+_Static_assert(MS_CONFIDENT_HOLD_WINDOW < MS_CONFIDENT_TAP_WINDOW,
+               "MS_CONFIDENT_HOLD_WINDOW must be less than MS_CONFIDENT_TAP_WINDOW");
+
+int8_t estimate_overlap_confidence(uint16_t th_down_next_down_dur, uint16_t min_overlap_for_hold, uint16_t max_overlap) {
+    const uint16_t ms_until_timeout = th_down_next_down_dur < max_overlap ? max_overlap - th_down_next_down_dur : 0;
+    const uint16_t window = MIN(min_overlap_for_hold, ms_until_timeout);
+
+    if (window <= MS_CONFIDENT_HOLD_WINDOW) return 100;
+    if (window >= MS_CONFIDENT_TAP_WINDOW) return -100;
+    return (int8_t) (100 - 200 * (int32_t) (window - MS_CONFIDENT_HOLD_WINDOW) /
+                           (MS_CONFIDENT_TAP_WINDOW - MS_CONFIDENT_HOLD_WINDOW));
+}
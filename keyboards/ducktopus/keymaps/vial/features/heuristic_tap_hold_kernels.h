@@ -0,0 +1,158 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The value here was chosen, because most zero overlap non-mod presses
+// in the data set have shorter durations.
+#if !defined(MS_MAX_OVERLAP)
+#    define MS_MAX_OVERLAP          358
+#endif
+#define MS_MAX_DUR                32767
+
+#if !defined(MIN)
+#    define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
+#if !defined(MAX)
+#    define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+
+#if !defined(ABS)
+#    define ABS(x) (((x) < 0) ? -(x) : (x))
+#endif
+
+#define SD(x, y) (((y) == 0) ? (x) : ((x) / (y)))
+
+// The three evolved heuristics as pure functions of the measured durations:
+//
+// prev_up_th_down_dur    ms between the previous release and the tap hold
+//                        press (negative if the previous key was released
+//                        after the tap hold key was pressed)
+// th_down_next_down_dur  ms between the tap hold press and the next press
+// next_dur               ms the next key was held (when it was wrapped)
+// prev_is_mod            if the key before the tap hold key was a modifier
+//
+// The _float versions are the reference. The _fixed versions only use integer
+// math, and for every input the state machine can produce (that is
+// -MS_MAX_DUR <= prev_up_th_down_dur <= MS_MAX_DUR and th_down_next_down_dur,
+// next_dur <= MS_MAX_OVERLAP) they decide like exact math would. The overlap
+// estimate is the same as the float one. The wrapped and two down decisions
+// differ only where the float guess is within a relative 1e-6 of the
+// boundary (+-0.5), which float rounding decides either way: 12 of the
+// inputs with the default constants. host/kernels checks this exhaustively.
+//
+// Define HEURISTIC_TAP_HOLD_FIXED_POINT to use the _fixed versions. On MCUs
+// without an FPU (e.g. the RP2040) this avoids soft-float library calls.
+//=============================================================================
+uint16_t estimate_min_overlap_for_hold_in_ms_float(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+bool estimate_hold_when_wrapped_float(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur);
+bool estimate_hold_when_two_down_float(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod);
+
+uint16_t estimate_min_overlap_for_hold_in_ms_fixed(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+bool estimate_hold_when_wrapped_fixed(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur);
+bool estimate_hold_when_two_down_fixed(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod);
+
+// the part of the float overlap estimate that is tabulated below
+float estimate_min_overlap_for_hold_inner_float(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+
+
+// Coefficients
+//
+// The float reference with its constants as coefficients, with
+// p = prev_up_th_down_dur, t = th_down_next_down_dur and n = next_dur:
+//
+// overlap   inner = MAX(c0, c1 * p + c2) - MAX(p, c3) + c4 * t + c5
+//           estimate = MAX(1, (uint16_t) MIN(MS_MAX_OVERLAP, ABS(MAX(-p, MAX(c6, inner)))))
+//           hold, if the overlap is longer than the estimate
+//
+// wrapped   r = SD(1, t)
+//           d = MAX(c0 + c1 * r, MAX(c2, MAX(c3, c4 * p + c5) * -p) + SD(c6, n) + c7)
+//           guess = MAX(p * c8, c9) / (c10 * r * d)
+//
+// two down  guess = (ABS(c0 * p + c1) + (c2 + prev_is_mod * (c3 * MAX(-p, c4))) * t) / (MAX(-p, c5) * c6)
+//
+// For the last two, it's a hold if guess > 0.5 or guess < -0.5. The _with
+// versions do the same float operations in the same order as the reference,
+// so with the DEFAULT_ coefficients they make exactly the same decisions
+// (host/kernels checks this).
+//=============================================================================
+#define OVERLAP_COEFFICIENT_COUNT  7
+#define WRAPPED_COEFFICIENT_COUNT  11
+#define TWO_DOWN_COEFFICIENT_COUNT 7
+
+#define DEFAULT_OVERLAP_COEFFICIENTS \
+    {1386.7545166f, -136.1621093f, -315.5284118f, 325.5094909f, -6.4232006f, 302.9532165f, 3.0614197f}
+#define DEFAULT_WRAPPED_COEFFICIENTS                                                                     \
+    {1.1125613f, 558.6079711f, 110.8752517f, 1.1125613f, -5.7630343f, -184.2279510f, 4170.0205078f,      \
+     -179.2697753f, 0.6423792f, 23.4521789f, 542.2182617f}
+#define DEFAULT_TWO_DOWN_COEFFICIENTS \
+    {-0.0297553f, -9.2836914f, 0.2559899f, 0.0180325f, 17.5247516f, 14.0228700f, -9.2638397f}
+
+uint16_t estimate_min_overlap_for_hold_in_ms_with(const float* c, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+bool estimate_hold_when_wrapped_with(const float* c, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur);
+bool estimate_hold_when_two_down_with(const float* c, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod);
+
+
+// Overlap estimate table
+//
+// The inner part of the overlap estimate at a grid of knots chosen by
+// host/overlap_table, which is bilinearly interpolated and then clamped like
+// the formula. The distance between two neighboring knots is always a power
+// of two, so this needs no division. Inputs outside the first and last knot
+// are clamped, as the result doesn't change there.
+//
+// The generated table (heuristic_tap_hold_overlap_table.h) is never off by
+// more than OVERLAP_TABLE_MAX_ERROR ms. Define
+// HEURISTIC_TAP_HOLD_OVERLAP_TABLE to use it instead of the formula.
+//=============================================================================
+typedef struct {
+    const int16_t* p_knots;    // prev_up_th_down_dur
+    const uint8_t* p_shifts;   // log2 of the distance to the next knot
+    const int16_t* t_knots;    // th_down_next_down_dur
+    const uint8_t* t_shifts;
+    const int16_t* inners_q3;  // p_count rows of t_count values
+    uint8_t p_count;
+    uint8_t t_count;
+} overlap_table_t;
+
+uint16_t look_up_min_overlap_for_hold_in_ms(const overlap_table_t* table, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+uint16_t estimate_min_overlap_for_hold_in_ms_table(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+
+#if defined(HEURISTIC_TAP_HOLD_OVERLAP_TABLE)
+#    define estimate_min_overlap_for_hold_in_ms estimate_min_overlap_for_hold_in_ms_table
+#elif defined(HEURISTIC_TAP_HOLD_FIXED_POINT)
+#    define estimate_min_overlap_for_hold_in_ms estimate_min_overlap_for_hold_in_ms_fixed
+#else
+#    define estimate_min_overlap_for_hold_in_ms estimate_min_overlap_for_hold_in_ms_float
+#endif
+
+#if defined(HEURISTIC_TAP_HOLD_FIXED_POINT)
+#    define estimate_hold_when_wrapped          estimate_hold_when_wrapped_fixed
+#    define estimate_hold_when_two_down         estimate_hold_when_two_down_fixed
+#else
+#    define estimate_hold_when_wrapped          estimate_hold_when_wrapped_float
+#    define estimate_hold_when_two_down         estimate_hold_when_two_down_float
+#endif
+
+
+// Overlap confidence
+//
+// Once the next key was pressed, the overlap heuristic chooses hold if the
+// tap hold key is still down after a window of MIN(estimate, time left until
+// max_overlap), as the timeout holds then anyway, and tap if it is released
+// before. So the shorter the window, the surer hold is, and the longer, the
+// surer tap is. The confidence goes linearly from 100 (hold) for windows up to
+// MS_CONFIDENT_HOLD_WINDOW to -100 (tap) from MS_CONFIDENT_TAP_WINDOW on. It
+// ignores that a wrapped next key is decided by its own heuristic.
+//=============================================================================
+#if !defined(MS_CONFIDENT_HOLD_WINDOW)
+#    define MS_CONFIDENT_HOLD_WINDOW 5
+#endif
+#if !defined(MS_CONFIDENT_TAP_WINDOW)
+#    define MS_CONFIDENT_TAP_WINDOW  (MS_MAX_OVERLAP * 2 / 3)
+#endif
+
+int8_t estimate_overlap_confidence(uint16_t th_down_next_down_dur, uint16_t min_overlap_for_hold, uint16_t max_overlap);
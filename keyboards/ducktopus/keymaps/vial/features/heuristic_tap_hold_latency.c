@@ -0,0 +1,74 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS) && !defined(NO_ACTION_TAPPING)
+
+#include <string.h>
+
+#include "heuristic_tap_hold_latency.h"
+
+_Static_assert(HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT >= 1 && HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT <= 255,
+               "HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT must be between 1 and 255");
+_Static_assert(HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS >= 1 && HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS <= 255,
+               "HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS must be between 1 and 255");
+
+
+#define LATENCY_HID_READ_HEADER_SIZE 5
+
+static uint16_t latency_counts[DECISION_PATH_COUNT][HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT];
+
+
+void record_heuristic_tap_hold_latency(tap_hold_decision_path path, uint32_t ms) {
+    const uint32_t bucket = MIN(ms / HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS, HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT - 1);
+    uint16_t* count = &latency_counts[path][bucket];
+
+    // saturate, so a full bucket doesn't suddenly look empty
+    if (*count < UINT16_MAX) ++*count;
+}
+
+
+static bool read_latency_counts(uint8_t* data, uint8_t length) {
+    const uint8_t path = data[2];
+    const uint8_t first_bucket = data[3];
+    if (path >= DECISION_PATH_COUNT || first_bucket >= HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT) return false;
+
+    const uint8_t n = MIN((length - LATENCY_HID_READ_HEADER_SIZE) / 2,
+                          HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT - first_bucket);
+    data[4] = n;
+
+    uint8_t* out = data + LATENCY_HID_READ_HEADER_SIZE;
+    for (uint8_t i = 0; i < n; ++i) {
+        const uint16_t count = latency_counts[path][first_bucket + i];
+        *out++ = count & 0xFF;
+        *out++ = count >> 8;
+    }
+    return true;
+}
+
+
+bool process_heuristic_tap_hold_latency_command(uint8_t* data, uint8_t length) {
+    // room for the info response and at least one count
+    if (length < LATENCY_HID_READ_HEADER_SIZE + 2 || data[0] != HEURISTIC_TAP_HOLD_LATENCY_HID_ID) return false;
+
+    switch (data[1]) {
+        case LATENCY_HID_INFO:
+            data[2] = LATENCY_HID_VERSION;
+            data[3] = DECISION_PATH_COUNT;
+            data[4] = HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT;
+            data[5] = HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS;
+            return true;
+
+        case LATENCY_HID_READ:
+            if (read_latency_counts(data, length)) return true;
+            break;
+
+        case LATENCY_HID_RESET:
+            memset(latency_counts, 0, sizeof(latency_counts));
+            return true;
+    }
+
+    data[1] = LATENCY_HID_ERROR;
+    return true;
+}
+
+
+#        endif // HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS && !NO_ACTION_TAPPING
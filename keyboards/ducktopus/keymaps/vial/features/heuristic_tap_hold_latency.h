@@ -0,0 +1,48 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Histograms of how long the key after the heuristic tap hold key was held
+// back (from its physical press until it was sent), one per decision path.
+// They are kept in RAM and can be read over raw HID (see host/hid_latency).
+
+#pragma once
+
+#include "heuristic_tap_hold.h"
+
+#if !defined(HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS)
+#    define HEURISTIC_TAP_HOLD_LATENCY_BUCKET_MS 8
+#endif
+
+// the last bucket also counts everything longer
+#if !defined(HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT)
+#    define HEURISTIC_TAP_HOLD_LATENCY_BUCKET_COUNT 48
+#endif
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(HEURISTIC_TAP_HOLD_LATENCY_HID_ID)
+#    define HEURISTIC_TAP_HOLD_LATENCY_HID_ID 0xF1
+#endif
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:  request  [id, 0]
+//          response [id, 0, version, path count, bucket count, bucket ms]
+//   read:  request  [id, 1, path, first bucket]
+//          response [id, 1, path, first bucket, n, n uint16 counts]
+//   reset: request  [id, 2]
+//          response [id, 2]
+//
+// An unknown path is an error, too.
+#define LATENCY_HID_VERSION 1
+
+enum {
+    LATENCY_HID_INFO = 0,
+    LATENCY_HID_READ = 1,
+    LATENCY_HID_RESET = 2,
+    LATENCY_HID_ERROR = 0xFF,
+};
+
+void record_heuristic_tap_hold_latency(tap_hold_decision_path path, uint32_t ms);
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a latency command, in which case data holds the response.
+bool process_heuristic_tap_hold_latency_command(uint8_t* data, uint8_t length);
@@ -0,0 +1,49 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Generated by host/overlap_table (make overlap-table MAX_ERROR=1), do not edit.
+//
+// 19 x 2 knots, 137 bytes. Compared to the formula, the result is off by
+// at most 1 ms for 2290 of the 23527065 inputs the state machine can produce.
+
+#pragma once
+
+#define OVERLAP_TABLE_MAX_ERROR 1
+
+static const int16_t overlap_table_p_knots[] = {-23, -15, -13, -12, -11, -7, 9, 41, 105, 233, 297, 313, 321, 325, 329, 361, 489, 1001, 2025};
+static const uint8_t overlap_table_p_shifts[] = {3, 1, 0, 0, 2, 4, 5, 6, 7, 6, 4, 3, 2, 2, 5, 7, 9, 10};
+
+static const int16_t overlap_table_t_knots[] = {0, 512};
+static const uint8_t overlap_table_t_shifts[] = {9};
+
+// inner * 8, one row per p knot
+static const int16_t overlap_table_inners_q3[] = {
+     22349,  -3960,
+     13635, -12675,
+     11456, -14853,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10914, -15396,
+     10886, -15424,
+     10630, -15680,
+      9606, -16704,
+      5510, -20800,
+     -2682, -28992,
+};
+
+static const overlap_table_t overlap_table = {
+    .p_knots = overlap_table_p_knots,
+    .p_shifts = overlap_table_p_shifts,
+    .t_knots = overlap_table_t_knots,
+    .t_shifts = overlap_table_t_shifts,
+    .inners_q3 = overlap_table_inners_q3,
+    .p_count = 19,
+    .t_count = 2,
+};
@@ -0,0 +1,148 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(HEURISTIC_TAP_HOLD_TYPING_RHYTHM) && !defined(NO_ACTION_TAPPING)
+
+#include "heuristic_tap_hold_rhythm.h"
+
+_Static_assert(TYPING_RHYTHM_WINDOW >= 1 && TYPING_RHYTHM_WINDOW <= 255,
+               "TYPING_RHYTHM_WINDOW must be between 1 and 255");
+_Static_assert(TYPING_RHYTHM_MAX_DOWN >= 1 && TYPING_RHYTHM_MAX_DOWN <= 255,
+               "TYPING_RHYTHM_MAX_DOWN must be between 1 and 255");
+_Static_assert(TYPING_RHYTHM_EMA_SHIFT >= 0 && TYPING_RHYTHM_EMA_SHIFT <= 8,
+               "TYPING_RHYTHM_EMA_SHIFT must be between 0 and 8");
+
+// so the sums of squares fit into 32 bits
+_Static_assert((uint64_t) TYPING_RHYTHM_MAX_INTERVAL_MS * TYPING_RHYTHM_MAX_INTERVAL_MS * TYPING_RHYTHM_WINDOW <= UINT32_MAX,
+               "TYPING_RHYTHM_MAX_INTERVAL_MS is too large for TYPING_RHYTHM_WINDOW");
+_Static_assert((uint64_t) TYPING_RHYTHM_MAX_HOLD_MS * TYPING_RHYTHM_MAX_HOLD_MS * TYPING_RHYTHM_WINDOW <= UINT32_MAX,
+               "TYPING_RHYTHM_MAX_HOLD_MS is too large for TYPING_RHYTHM_WINDOW");
+
+// the EMA is kept in 1/16 ms
+#define EMA_FRACTION_BITS 4
+
+
+// The last values, with their sums kept up to date as the oldest one is
+// replaced, so neither adding one nor reading the mean has to loop.
+typedef struct {
+    uint16_t values[TYPING_RHYTHM_WINDOW];
+    uint32_t sum;
+    uint32_t sum_of_squares;
+    uint8_t next;
+    uint8_t count;
+} window_t;
+
+typedef struct {
+    keypos_t key;
+    uint32_t press_time;
+} down_key_t;
+
+static window_t intervals;
+static window_t holds;
+
+static down_key_t down_keys[TYPING_RHYTHM_MAX_DOWN];
+static uint8_t down_count = 0;
+
+static bool has_prev_press = false;
+static uint32_t prev_press_time = 0;
+static int32_t interval_ema = 0;
+
+
+static void add_to_window(window_t* window, uint16_t value) {
+    if (window->count == TYPING_RHYTHM_WINDOW) {
+        const uint16_t oldest = window->values[window->next];
+        window->sum -= oldest;
+        window->sum_of_squares -= (uint32_t) oldest * oldest;
+    } else {
+        ++window->count;
+    }
+
+    window->values[window->next] = value;
+    window->sum += value;
+    window->sum_of_squares += (uint32_t) value * value;
+    if (++window->next == TYPING_RHYTHM_WINDOW) window->next = 0;
+}
+
+
+static uint16_t get_window_mean(const window_t* window) {
+    return window->count ? window->sum / window->count : 0;
+}
+
+
+// n * sum(x²) - sum(x)² never is negative, but can be larger than 32 bits
+static uint32_t get_window_variance(const window_t* window) {
+    if (window->count == 0) return 0;
+
+    const uint64_t count = window->count;
+    const uint64_t spread = count * window->sum_of_squares - (uint64_t) window->sum * window->sum;
+    return (uint32_t) (spread / (count * count));
+}
+
+
+static down_key_t* find_down_key(keypos_t key) {
+    for (uint8_t i = 0; i < down_count; ++i) {
+        if (down_keys[i].key.row == key.row && down_keys[i].key.col == key.col) return &down_keys[i];
+    }
+    return NULL;
+}
+
+
+static void record_press(keypos_t key, uint32_t time) {
+    const uint32_t interval = time - prev_press_time;
+    if (has_prev_press && interval <= TYPING_RHYTHM_MAX_INTERVAL_MS) {
+        add_to_window(&intervals, interval);
+
+        const int32_t scaled = (int32_t) interval << EMA_FRACTION_BITS;
+        if (intervals.count == 1) {
+            interval_ema = scaled;
+        } else {
+            interval_ema += (scaled - interval_ema) / (1 << TYPING_RHYTHM_EMA_SHIFT);
+        }
+    }
+    has_prev_press = true;
+    prev_press_time = time;
+
+    down_key_t* down_key = find_down_key(key);
+    if (down_key == NULL) {
+        // if too many keys are down, this one isn't measured
+        if (down_count == TYPING_RHYTHM_MAX_DOWN) return;
+        down_key = &down_keys[down_count++];
+    }
+    // else its release got lost
+    *down_key = (down_key_t) {.key = key, .press_time = time};
+}
+
+
+static void record_release(keypos_t key, uint32_t time) {
+    down_key_t* down_key = find_down_key(key);
+    if (down_key == NULL) return;
+
+    const uint32_t duration = time - down_key->press_time;
+    if (duration <= TYPING_RHYTHM_MAX_HOLD_MS) add_to_window(&holds, duration);
+
+    *down_key = down_keys[--down_count];
+}
+
+
+void record_typing_rhythm(keypos_t key, bool pressed, uint32_t time) {
+    if (pressed) {
+        record_press(key, time);
+    } else {
+        record_release(key, time);
+    }
+}
+
+
+typing_rhythm_t get_typing_rhythm(void) {
+    return (typing_rhythm_t) {
+        .interval_count = intervals.count,
+        .interval_mean_ms = get_window_mean(&intervals),
+        .interval_variance = get_window_variance(&intervals),
+        .interval_ema_ms = (uint16_t) ((interval_ema + (1 << (EMA_FRACTION_BITS - 1))) >> EMA_FRACTION_BITS),
+        .hold_count = holds.count,
+        .hold_mean_ms = get_window_mean(&holds),
+        .hold_variance = get_window_variance(&holds),
+    };
+}
+
+
+#        endif // HEURISTIC_TAP_HOLD_TYPING_RHYTHM && !NO_ACTION_TAPPING
@@ -0,0 +1,55 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Rolling statistics of the current typing rhythm: the time between the last
+// key presses and how long the last keys were held, each as mean and variance
+// over a small window, and an exponential moving average of the time between
+// presses. Every key event updates them in constant time with integer math,
+// so the hooks of heuristic_tap_hold.h can look at how fast one types right
+// now (e.g. to shorten get_max_overlap_in_ms when typing fast).
+//
+// Only kept with HEURISTIC_TAP_HOLD_TYPING_RHYTHM.
+
+#pragma once
+
+#include "quantum.h"
+
+// how many of the last intervals and hold durations the window has
+#if !defined(TYPING_RHYTHM_WINDOW)
+#    define TYPING_RHYTHM_WINDOW 16
+#endif
+
+// Longer gaps between presses are pauses, longer presses are holds of
+// modifiers or layers, neither of which says anything about the rhythm, so
+// they are left out.
+#if !defined(TYPING_RHYTHM_MAX_INTERVAL_MS)
+#    define TYPING_RHYTHM_MAX_INTERVAL_MS 1000
+#endif
+#if !defined(TYPING_RHYTHM_MAX_HOLD_MS)
+#    define TYPING_RHYTHM_MAX_HOLD_MS 1000
+#endif
+
+// how many keys can be down at once while their hold durations are measured
+#if !defined(TYPING_RHYTHM_MAX_DOWN)
+#    define TYPING_RHYTHM_MAX_DOWN 8
+#endif
+
+// the newest interval has a weight of 1 / 2^TYPING_RHYTHM_EMA_SHIFT in the average
+#if !defined(TYPING_RHYTHM_EMA_SHIFT)
+#    define TYPING_RHYTHM_EMA_SHIFT 3
+#endif
+
+typedef struct {
+    uint8_t interval_count;      // how many intervals the window has so far
+    uint16_t interval_mean_ms;   // between the last presses
+    uint32_t interval_variance;  // in ms²
+    uint16_t interval_ema_ms;    // lower means faster typing
+    uint8_t hold_count;
+    uint16_t hold_mean_ms;
+    uint32_t hold_variance;
+} typing_rhythm_t;
+
+// Called by heuristic_tap_hold.c for every physical key event.
+void record_typing_rhythm(keypos_t key, bool pressed, uint32_t time);
+
+// The divisions are only done here, so call it when the result is needed.
+typing_rhythm_t get_typing_rhythm(void);
@@ -0,0 +1,25 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include "heuristic_tap_hold_same_side.h"
+#include "heuristic_tap_hold_same_side_table.h"
+
+_Static_assert(sizeof(same_side_table_decisions) == sizeof(same_side_table_p_knots) / sizeof(int16_t) *
+                       (sizeof(same_side_table_t_knots) / sizeof(uint16_t)),
+               "the same side table needs one decision per pair of knots");
+
+
+// The tables have few knots, so a linear search is as fast as any.
+tap_hold_decision_options look_up_same_side_decision(const same_side_table_t* table, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur) {
+    uint8_t i = 0;
+    while (i + 1 < table->p_count && table->p_knots[i + 1] <= prev_up_th_down_dur) ++i;
+
+    uint8_t j = 0;
+    while (j + 1 < table->t_count && table->t_knots[j + 1] <= th_down_next_down_dur) ++j;
+
+    return (tap_hold_decision_options) table->decisions[i * table->t_count + j];
+}
+
+
+tap_hold_decision_options estimate_same_side_decision(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur) {
+    return look_up_same_side_decision(&same_side_table, prev_up_th_down_dur, th_down_next_down_dur);
+}
@@ -0,0 +1,35 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// A model for a next key on the same side as the tap hold key, which is
+// trained from labeled corpora by host/same_side_table instead of always
+// choosing tap. It looks at the same durations as the other heuristics (see
+// heuristic_tap_hold_kernels.h) when the next key is pressed:
+//
+// prev_up_th_down_dur    ms between the previous release and the tap hold
+//                        press
+// th_down_next_down_dur  ms between the tap hold press and the next press
+//
+// The table splits both into cells, and each cell either decides right away
+// (CHOSE_TAP or CHOSE_HOLD, where the corpus was clear enough), or returns
+// UNDECIDED, so the overlap heuristics decide like for a next key on the
+// other side. Inputs outside the first and last knot are in the first and
+// last cell.
+//
+// The generated table (heuristic_tap_hold_same_side_table.h) is looked up by
+// choose_by_same_side_model. Without training data, it has one cell that
+// chooses tap, like before.
+
+#pragma once
+
+#include "heuristic_tap_hold.h"
+
+typedef struct {
+    const int16_t* p_knots;   // prev_up_th_down_dur, each the start of a cell
+    const uint16_t* t_knots;  // th_down_next_down_dur
+    const uint8_t* decisions; // p_count rows of t_count tap_hold_decision_options
+    uint8_t p_count;
+    uint8_t t_count;
+} same_side_table_t;
+
+tap_hold_decision_options look_up_same_side_decision(const same_side_table_t* table, int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+tap_hold_decision_options estimate_same_side_decision(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
@@ -0,0 +1,23 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Generated by host/same_side_table (make same-side-table), do not edit.
+//
+// 1 x 1 knots, 5 bytes, trained on 0 same side samples.
+
+#pragma once
+
+static const int16_t same_side_table_p_knots[] = {-32767};
+static const uint16_t same_side_table_t_knots[] = {0};
+
+// one row per p knot: 0 undecided, 1 tap, 2 hold
+static const uint8_t same_side_table_decisions[] = {
+    1,
+};
+
+static const same_side_table_t same_side_table = {
+    .p_knots = same_side_table_p_knots,
+    .t_knots = same_side_table_t_knots,
+    .decisions = same_side_table_decisions,
+    .p_count = 1,
+    .t_count = 1,
+};
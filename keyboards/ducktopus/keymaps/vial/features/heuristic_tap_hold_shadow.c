@@ -0,0 +1,243 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(HEURISTIC_TAP_HOLD_SHADOW) && !defined(NO_ACTION_TAPPING)
+
+#include <string.h>
+
+#include "heuristic_tap_hold_shadow.h"
+
+#define SHADOW_HID_READ_HEADER_SIZE 4
+
+_Static_assert(SHADOW_HID_READ_HEADER_SIZE + SHADOW_COUNT_FIELDS * 4 <= 32,
+               "the counts of a path must fit into one packet");
+
+static shadow_counts_t shadow_counts[DECISION_PATH_COUNT];
+
+// the overlap question of the current pair, see start_shadow_overlap
+static struct {
+    keypos_t tap_hold;
+    keypos_t next;
+    uint32_t next_press_time;
+    uint16_t min_overlap_for_hold; // of the candidate
+    tap_hold_decision_path path;
+    bool is_started;               // the next key was pressed, nothing was decided yet
+    bool is_pending;               // the live heuristic decided, the candidate not yet
+    bool is_hold;                  // what the live heuristic chose
+} overlap;
+
+// the last decision, if it was a tap and no key was pressed since
+static struct {
+    uint32_t time;
+    tap_hold_decision_path path;
+    bool is_armed;
+    bool shadow_is_hold;
+    bool waits_for_overlap;        // shadow_is_hold is only known once overlap.is_pending is resolved
+} last_tap;
+
+// a tap hold Backspace (e.g. LT(SYMB, KC_BSPC)) pressed right after last_tap,
+// which only counts once it's known to be a tap, not its layer or mod
+static struct {
+    keypos_t key;
+    tap_hold_decision_path path;
+    bool is_pending;
+    bool shadow_is_hold;
+    bool waits_for_overlap;
+} backspace;
+
+
+__attribute__((weak)) uint16_t shadow_min_overlap_for_hold_in_ms(int16_t prev_up_th_down_dur,
+                                                                 uint16_t th_down_next_down_dur) {
+    return estimate_min_overlap_for_hold_in_ms_table(prev_up_th_down_dur, th_down_next_down_dur);
+}
+
+
+__attribute__((weak)) bool shadow_hold_when_wrapped(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur,
+                                                    uint16_t next_dur) {
+    return estimate_hold_when_wrapped_fixed(prev_up_th_down_dur, th_down_next_down_dur, next_dur);
+}
+
+
+__attribute__((weak)) bool shadow_hold_when_two_down(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur,
+                                                     bool prev_is_mod) {
+    return estimate_hold_when_two_down_fixed(prev_up_th_down_dur, th_down_next_down_dur, prev_is_mod);
+}
+
+
+static void increment(uint32_t* count) {
+    if (*count < UINT32_MAX) ++*count;
+}
+
+
+static bool is_same_key(keypos_t a, keypos_t b) {
+    return a.row == b.row && a.col == b.col;
+}
+
+
+static void count_comparison(tap_hold_decision_path path, bool is_hold, bool shadow_is_hold) {
+    shadow_counts_t* counts = &shadow_counts[path];
+    if (is_hold == shadow_is_hold) {
+        increment(&counts->agreed);
+    } else if (shadow_is_hold) {
+        increment(&counts->only_shadow_held);
+    } else {
+        increment(&counts->only_live_held);
+    }
+}
+
+
+static void remember_decision(tap_hold_decision_path path, bool is_hold, bool shadow_is_hold, bool waits_for_overlap) {
+    last_tap.is_armed = !is_hold;
+    last_tap.time = timer_read32();
+    last_tap.path = path;
+    last_tap.shadow_is_hold = shadow_is_hold;
+    last_tap.waits_for_overlap = waits_for_overlap;
+}
+
+
+static void resolve_pending_overlap(bool shadow_is_hold) {
+    overlap.is_pending = false;
+    count_comparison(overlap.path, overlap.is_hold, shadow_is_hold);
+
+    if (last_tap.is_armed && last_tap.waits_for_overlap) {
+        last_tap.shadow_is_hold = shadow_is_hold;
+        last_tap.waits_for_overlap = false;
+    }
+    if (backspace.is_pending && backspace.waits_for_overlap) {
+        backspace.shadow_is_hold = shadow_is_hold;
+        backspace.waits_for_overlap = false;
+    }
+}
+
+
+static void count_backspace(tap_hold_decision_path path, bool shadow_is_hold) {
+    shadow_counts_t* counts = &shadow_counts[path];
+    increment(&counts->backspaced);
+    if (shadow_is_hold) increment(&counts->backspaced_shadow_held);
+}
+
+
+void record_shadow_key_event(uint16_t keycode, keyrecord_t* record, uint32_t time) {
+    const bool is_pressed = record->event.pressed;
+
+    if (overlap.is_pending) {
+        if (time - overlap.next_press_time > overlap.min_overlap_for_hold) {
+            resolve_pending_overlap(true);
+        } else if (!is_pressed &&
+                   (is_same_key(record->event.key, overlap.tap_hold) || is_same_key(record->event.key, overlap.next))) {
+            resolve_pending_overlap(false);
+        }
+    }
+
+    if (!is_pressed) return;
+
+    // if the overlap is still pending, the candidate hasn't chosen hold (yet)
+    if (last_tap.is_armed && get_tap_keycode(keycode) == KC_BSPC &&
+        time - last_tap.time <= HEURISTIC_TAP_HOLD_SHADOW_BACKSPACE_MS) {
+        if (IS_QK_MOD_TAP(keycode) || IS_QK_LAYER_TAP(keycode)) {
+            // see record_shadow_tap_hold_resolution
+            backspace.key = record->event.key;
+            backspace.path = last_tap.path;
+            backspace.shadow_is_hold = last_tap.shadow_is_hold;
+            backspace.waits_for_overlap = last_tap.waits_for_overlap;
+            backspace.is_pending = true;
+        } else {
+            count_backspace(last_tap.path, last_tap.shadow_is_hold);
+        }
+    }
+    last_tap.is_armed = false;
+}
+
+
+void record_shadow_tap_hold_resolution(keypos_t tap_hold, bool is_hold) {
+    if (!backspace.is_pending || !is_same_key(tap_hold, backspace.key)) return;
+    backspace.is_pending = false;
+    if (!is_hold) count_backspace(backspace.path, backspace.shadow_is_hold);
+}
+
+
+void start_shadow_overlap(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, keypos_t tap_hold,
+                          keypos_t next, uint32_t next_press_time) {
+    if (overlap.is_pending) {
+        // only the overlap so far is known
+        resolve_pending_overlap(next_press_time - overlap.next_press_time > overlap.min_overlap_for_hold);
+    }
+
+    overlap.tap_hold = tap_hold;
+    overlap.next = next;
+    overlap.next_press_time = next_press_time;
+    overlap.min_overlap_for_hold = shadow_min_overlap_for_hold_in_ms(prev_up_th_down_dur, th_down_next_down_dur);
+    overlap.is_started = true;
+}
+
+
+void record_shadow_decision(tap_hold_decision_path path, bool is_hold, bool shadow_is_hold) {
+    overlap.is_started = false;
+    count_comparison(path, is_hold, shadow_is_hold);
+    remember_decision(path, is_hold, shadow_is_hold, false);
+}
+
+
+void record_shadow_overlap_decision(tap_hold_decision_path path, bool is_hold, bool has_overlap_ended) {
+    if (!overlap.is_started) return;
+    overlap.is_started = false;
+
+    const bool is_over_estimate = timer_elapsed32(overlap.next_press_time) > overlap.min_overlap_for_hold;
+    if (has_overlap_ended || is_over_estimate) {
+        count_comparison(path, is_hold, is_over_estimate);
+        remember_decision(path, is_hold, is_over_estimate, false);
+        return;
+    }
+
+    // resolved by record_shadow_key_event
+    overlap.path = path;
+    overlap.is_hold = is_hold;
+    overlap.is_pending = true;
+    remember_decision(path, is_hold, false, true);
+}
+
+
+static bool read_shadow_counts(uint8_t* data) {
+    const uint8_t path = data[2];
+    if (path >= DECISION_PATH_COUNT) return false;
+
+    uint32_t values[SHADOW_COUNT_FIELDS];
+    memcpy(values, &shadow_counts[path], sizeof(values));
+    data[3] = SHADOW_COUNT_FIELDS;
+
+    uint8_t* out = data + SHADOW_HID_READ_HEADER_SIZE;
+    for (uint8_t i = 0; i < SHADOW_COUNT_FIELDS; ++i) {
+        for (uint8_t byte = 0; byte < 4; ++byte) {
+            *out++ = (values[i] >> (8 * byte)) & 0xFF;
+        }
+    }
+    return true;
+}
+
+
+bool process_heuristic_tap_hold_shadow_command(uint8_t* data, uint8_t length) {
+    if (length < 32 || data[0] != HEURISTIC_TAP_HOLD_SHADOW_HID_ID) return false;
+
+    switch (data[1]) {
+        case SHADOW_HID_INFO:
+            data[2] = SHADOW_HID_VERSION;
+            data[3] = DECISION_PATH_COUNT;
+            data[4] = SHADOW_COUNT_FIELDS;
+            data[5] = HEURISTIC_TAP_HOLD_SHADOW_BACKSPACE_MS & 0xFF;
+            data[6] = HEURISTIC_TAP_HOLD_SHADOW_BACKSPACE_MS >> 8;
+            return true;
+
+        case SHADOW_HID_READ:
+            if (read_shadow_counts(data)) return true;
+            break;
+
+        case SHADOW_HID_RESET:
+            memset(shadow_counts, 0, sizeof(shadow_counts));
+            return true;
+    }
+
+    data[1] = SHADOW_HID_ERROR;
+    return true;
+}
+
+
+#        endif // HEURISTIC_TAP_HOLD_SHADOW && !NO_ACTION_TAPPING
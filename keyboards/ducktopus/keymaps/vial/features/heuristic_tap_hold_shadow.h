@@ -0,0 +1,97 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Shadow mode: a candidate heuristic is asked every question the live one
+// answers, with the same inputs at the same time, but its answers are only
+// counted, never sent. Per decision path, the counters say how often both
+// agreed and which way they disagreed, and how often a tap was followed by
+// Backspace (the first key pressed after it, within
+// HEURISTIC_TAP_HOLD_SHADOW_BACKSPACE_MS), which usually means it should have
+// been a hold. A tap hold Backspace (e.g. LT(SYMB, KC_BSPC)) only counts once
+// it was tapped, as held it's a layer or mod. They are kept in RAM and can be read over raw HID (see
+// host/hid_shadow).
+//
+// The paths are compared one question at a time: the wrap and two down paths
+// by the candidate's answer to the same question, the overlap and confidence
+// paths by whether the overlap of the pair was longer than the candidate's
+// estimate. For a hold that the live heuristic chose while both keys are still
+// down, that is only known once one of them is released (or the candidate's
+// estimate has passed). So the counters show where the answers differ, not
+// what the candidate would have typed as a whole. The timeout and same side
+// paths aren't heuristics, so the candidate always agrees there, and they
+// are only counted for the Backspace signal.
+//
+// The candidate runs within the same scan, so it has to be as cheap as the
+// live heuristics: integer math and no allocation. By default, it is the
+// overlap estimate table and the fixed point kernels, i.e. what the keyboard
+// would use without the runtime coefficients. With the compiled in
+// coefficients and HEURISTIC_TAP_HOLD_FIXED_POINT, that's the live heuristics
+// themselves, so the counters only say something once the shadow_ functions
+// below are overridden (e.g. with the output of host/evolve, converted to fixed
+// point).
+
+#pragma once
+
+#include "heuristic_tap_hold.h"
+
+// how soon after a tap Backspace counts as correcting it
+#if !defined(HEURISTIC_TAP_HOLD_SHADOW_BACKSPACE_MS)
+#    define HEURISTIC_TAP_HOLD_SHADOW_BACKSPACE_MS 1000
+#endif
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(HEURISTIC_TAP_HOLD_SHADOW_HID_ID)
+#    define HEURISTIC_TAP_HOLD_SHADOW_HID_ID 0xF5
+#endif
+
+// per decision path of the live heuristic, each saturating
+typedef struct {
+    uint32_t agreed;
+    uint32_t only_shadow_held;       // the live heuristic chose tap, the candidate hold
+    uint32_t only_live_held;         // and the other way around
+    uint32_t backspaced;             // taps of the live heuristic followed by Backspace
+    uint32_t backspaced_shadow_held; // of those, the candidate would have held
+} shadow_counts_t;
+
+#define SHADOW_COUNT_FIELDS (sizeof(shadow_counts_t) / sizeof(uint32_t))
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:  request  [id, 0]
+//          response [id, 0, version, path count, field count, backspace ms (2)]
+//   read:  request  [id, 1, path]
+//          response [id, 1, path, n, n uint32 counts]
+//   reset: request  [id, 2]
+//          response [id, 2]
+//
+// The counts are in the order of shadow_counts_t. An unknown path is an error,
+// too.
+#define SHADOW_HID_VERSION 1
+
+enum {
+    SHADOW_HID_INFO = 0,
+    SHADOW_HID_READ = 1,
+    SHADOW_HID_RESET = 2,
+    SHADOW_HID_ERROR = 0xFF,
+};
+
+// the candidate, with the inputs of the kernels (see heuristic_tap_hold_kernels.h)
+uint16_t shadow_min_overlap_for_hold_in_ms(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur);
+bool shadow_hold_when_wrapped(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, uint16_t next_dur);
+bool shadow_hold_when_two_down(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, bool prev_is_mod);
+
+// Called by heuristic_tap_hold.c: for every physical key event, when the next
+// key was pressed (with the inputs of the overlap estimate), and for every
+// decision. For the overlap paths, has_overlap_ended is true if the tap hold
+// key was released.
+void record_shadow_key_event(uint16_t keycode, keyrecord_t* record, uint32_t time);
+void start_shadow_overlap(int16_t prev_up_th_down_dur, uint16_t th_down_next_down_dur, keypos_t tap_hold,
+                          keypos_t next, uint32_t next_press_time);
+void record_shadow_decision(tap_hold_decision_path path, bool is_hold, bool shadow_is_hold);
+void record_shadow_overlap_decision(tap_hold_decision_path path, bool is_hold, bool has_overlap_ended);
+// Also called by heuristic_tap_hold.c, whenever a tap hold key was sent as a
+// tap or a hold. A tap hold Backspace only counts as one, if it was tapped.
+void record_shadow_tap_hold_resolution(keypos_t tap_hold, bool is_hold);
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a shadow command, in which case data holds the response.
+bool process_heuristic_tap_hold_shadow_command(uint8_t* data, uint8_t length);
@@ -0,0 +1,62 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include "keycode_classes.h"
+
+#define HIGH_BYTE(kc) ((kc) >> 8)
+#define LOW_BYTE(kc)  ((kc) & 0xFF)
+
+// every page has to cover whole ranges of keycodes
+_Static_assert(LOW_BYTE(QK_MOD_TAP) == 0 && LOW_BYTE(QK_MOD_TAP_MAX) == 0xFF, "mod taps aren't whole pages");
+_Static_assert(LOW_BYTE(QK_LAYER_TAP) == 0 && LOW_BYTE(QK_LAYER_TAP_MAX) == 0xFF, "layer taps aren't whole pages");
+_Static_assert(LOW_BYTE(QK_LAYER_MOD) == 0 && LOW_BYTE(QK_LAYER_MOD_MAX) == 0xFF, "LM isn't whole pages");
+_Static_assert(HIGH_BYTE(QK_TO) == HIGH_BYTE(QK_LAYER_TAP_TOGGLE_MAX), "the layer keys aren't on one page");
+_Static_assert(LOW_BYTE(LALT(KC_TAB)) == KC_TAB && LOW_BYTE(LSA(KC_TAB)) == KC_TAB, "alt tab isn't modded KC_TAB");
+
+enum {
+    PAGE_NONE,
+    PAGE_BASIC,
+    PAGE_ALT_TAB,
+    PAGE_MOD_TAP,
+    PAGE_LAYER_TAP,
+    PAGE_LAYER_MOD,
+    PAGE_LAYER_KEYS,
+    PAGE_COUNT
+};
+
+static const uint8_t page_of_high_byte[256] = {
+    [0x00]                                                 = PAGE_BASIC,
+    [HIGH_BYTE(LALT(KC_TAB))]                              = PAGE_ALT_TAB,
+    [HIGH_BYTE(LSA(KC_TAB))]                               = PAGE_ALT_TAB,
+    [HIGH_BYTE(QK_MOD_TAP) ... HIGH_BYTE(QK_MOD_TAP_MAX)]     = PAGE_MOD_TAP,
+    [HIGH_BYTE(QK_LAYER_TAP) ... HIGH_BYTE(QK_LAYER_TAP_MAX)] = PAGE_LAYER_TAP,
+    [HIGH_BYTE(QK_LAYER_MOD) ... HIGH_BYTE(QK_LAYER_MOD_MAX)] = PAGE_LAYER_MOD,
+    [HIGH_BYTE(QK_TO)]                                     = PAGE_LAYER_KEYS,
+};
+
+// the classes of a basic keycode (or tap keycode), plus the ones given
+#define BASIC_PAGE(classes) {                                 \
+    [0x00 ... KC_SPACE - 1]  = (classes),                       \
+    [KC_SPACE]               = (classes) | KEYCODE_CLASS_SPACE, \
+    [KC_SPACE + 1 ... 0xFF]  = (classes),                       \
+}
+
+static const uint8_t classes_in_page[PAGE_COUNT][256] = {
+    [PAGE_BASIC]      = BASIC_PAGE(0),
+    [PAGE_ALT_TAB]    = {[KC_TAB] = KEYCODE_CLASS_ALT_TAB},
+    [PAGE_MOD_TAP]    = BASIC_PAGE(KEYCODE_CLASS_TAP_HOLD),
+    [PAGE_LAYER_TAP]  = BASIC_PAGE(KEYCODE_CLASS_TAP_HOLD | KEYCODE_CLASS_LAYER_SWITCH),
+    [PAGE_LAYER_MOD]  = {[0x00 ... 0xFF] = KEYCODE_CLASS_LAYER_SWITCH},
+    [PAGE_LAYER_KEYS] = {
+        [LOW_BYTE(QK_TO) ... LOW_BYTE(QK_TO_MAX)]                             = KEYCODE_CLASS_LAYER_SWITCH,
+        [LOW_BYTE(QK_MOMENTARY) ... LOW_BYTE(QK_MOMENTARY_MAX)]               = KEYCODE_CLASS_LAYER_SWITCH,
+        [LOW_BYTE(QK_DEF_LAYER) ... LOW_BYTE(QK_DEF_LAYER_MAX)]               = KEYCODE_CLASS_LAYER_SWITCH,
+        [LOW_BYTE(QK_TOGGLE_LAYER) ... LOW_BYTE(QK_TOGGLE_LAYER_MAX)]         = KEYCODE_CLASS_LAYER_SWITCH,
+        [LOW_BYTE(QK_ONE_SHOT_LAYER) ... LOW_BYTE(QK_ONE_SHOT_LAYER_MAX)]     = KEYCODE_CLASS_LAYER_SWITCH,
+        [LOW_BYTE(QK_LAYER_TAP_TOGGLE) ... LOW_BYTE(QK_LAYER_TAP_TOGGLE_MAX)] = KEYCODE_CLASS_LAYER_SWITCH,
+    },
+};
+
+
+uint8_t get_keycode_classes(uint16_t keycode) {
+    return classes_in_page[page_of_high_byte[HIGH_BYTE(keycode)]][LOW_BYTE(keycode)];
+}
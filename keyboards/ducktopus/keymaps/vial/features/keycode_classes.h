@@ -0,0 +1,28 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// What the process_record hooks of keymap.c want to know about a keycode, in
+// one byte. process_record_user looks it up once per key event and hands it to
+// the hooks, instead of each of them checking keycode ranges again.
+//
+// The byte comes from a table the compiler fills in: the high byte of the
+// keycode picks one of a few pages of 256 classes, the low byte one of those.
+// It takes 2048 bytes of flash.
+
+#pragma once
+
+#include "quantum.h"
+
+enum keycode_class {
+    // a mod tap or layer tap
+    KEYCODE_CLASS_TAP_HOLD     = 1 << 0,
+    // LT, LM, TO, MO, DF, TG, OSL or TT
+    KEYCODE_CLASS_LAYER_SWITCH = 1 << 1,
+    // LALT(KC_TAB) or LSA(KC_TAB), see process_alt_tab
+    KEYCODE_CLASS_ALT_TAB      = 1 << 2,
+    // it (or its tap keycode) is KC_SPACE, which Caps Word turns into an
+    // underscore
+    KEYCODE_CLASS_SPACE        = 1 << 3,
+};
+
+// the keycode_class flags of the keycode
+uint8_t get_keycode_classes(uint16_t keycode);
@@ -0,0 +1,74 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include "keymap_mirror.h"
+#include "dynamic_keymap.h"
+#include "via.h"
+
+// the byte offsets of VIA's keymap buffer are into this, which is big endian
+static uint16_t keycodes[DYNAMIC_KEYMAP_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
+static bool is_loaded = false;
+
+
+void load_keymap_mirror(void) {
+    for (uint8_t layer = 0; layer < DYNAMIC_KEYMAP_LAYER_COUNT; ++layer) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+            for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+                keycodes[layer][row][col] = dynamic_keymap_get_keycode(layer, row, col);
+            }
+        }
+    }
+    is_loaded = true;
+}
+
+
+uint16_t keymap_mirror_get_keycode(uint8_t layer, uint8_t row, uint8_t col) {
+    if (layer >= DYNAMIC_KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || col >= MATRIX_COLS) return KC_NO;
+    if (!is_loaded) load_keymap_mirror();
+    return keycodes[layer][row][col];
+}
+
+
+// like dynamic_keymap_set_buffer, bytes outside of the keymap are ignored
+static void patch_buffer(uint16_t offset, uint8_t size, const uint8_t* data) {
+    uint16_t* words = &keycodes[0][0][0];
+    for (uint8_t i = 0; i < size; ++i) {
+        const uint32_t byte = (uint32_t) offset + i;
+        if (byte >= KEYMAP_MIRROR_SIZE) return;
+
+        uint16_t* word = &words[byte / 2];
+        if (byte % 2 == 0) {
+            *word = (uint16_t) (data[i] << 8 | (*word & 0xFF));
+        } else {
+            *word = (uint16_t) ((*word & 0xFF00) | data[i]);
+        }
+    }
+}
+
+
+void update_keymap_mirror_before_via_command(const uint8_t* data, uint8_t length) {
+    if (length < 1 || !is_loaded) return;
+
+    switch (data[0]) {
+        case id_dynamic_keymap_set_keycode: {
+            // [id, layer, row, col, keycode (big endian)]
+            if (length < 6) return;
+            const uint8_t layer = data[1], row = data[2], col = data[3];
+            if (layer < DYNAMIC_KEYMAP_LAYER_COUNT && row < MATRIX_ROWS && col < MATRIX_COLS) {
+                keycodes[layer][row][col] = (uint16_t) (data[4] << 8 | data[5]);
+            }
+            return;
+        }
+        case id_dynamic_keymap_set_buffer: {
+            // [id, offset (big endian), size, size bytes]
+            if (length < 4) return;
+            const uint8_t size = MIN(data[3], length - 4);
+            patch_buffer((uint16_t) (data[1] << 8 | data[2]), size, data + 4);
+            return;
+        }
+        case id_dynamic_keymap_reset:
+        case id_eeprom_reset:
+            // VIA hasn't written the new keymap yet
+            is_loaded = false;
+            return;
+    }
+}
@@ -0,0 +1,30 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// A copy of the dynamic keymap of VIA or Vial in RAM, so looking up the
+// keycode of a key on another layer (e.g. while a layer tap key is undecided)
+// is a single array index instead of two EEPROM reads.
+//
+// It's loaded at start up. Every VIA command passes by it before VIA handles
+// it: a keycode or buffer that is written is patched in right away, and after
+// a reset of the keymap or EEPROM, it's loaded again on the next lookup. The
+// keymap must only be changed through VIA commands (dynamic_keymap_set_keycode
+// called from elsewhere isn't seen).
+//
+// It takes KEYMAP_MIRROR_SIZE bytes of RAM (1152 with the 8 layers and 72
+// keys of the Ducktopus).
+
+#pragma once
+
+#include "quantum.h"
+
+#define KEYMAP_MIRROR_SIZE (DYNAMIC_KEYMAP_LAYER_COUNT * MATRIX_ROWS * MATRIX_COLS * sizeof(uint16_t))
+
+// Call this once at start up (e.g. from keyboard_post_init_user).
+void load_keymap_mirror(void);
+
+// like dynamic_keymap_get_keycode
+uint16_t keymap_mirror_get_keycode(uint8_t layer, uint8_t row, uint8_t col);
+
+// Call this at the start of via_command_kb (or raw_hid_receive), with every
+// command. It never handles one, so VIA still has to.
+void update_keymap_mirror_before_via_command(const uint8_t* data, uint8_t length);
@@ -0,0 +1,123 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        if defined(KEYSTROKE_CAPTURE_ENABLE)
+
+#include "keystroke_capture.h"
+
+// the top nibble of 0xF is left for markers
+_Static_assert(MATRIX_ROWS < 15 && MATRIX_COLS <= 16, "positions must fit into a byte");
+_Static_assert(KEYSTROKE_CAPTURE_BUFFER_SIZE >= 32 && KEYSTROKE_CAPTURE_BUFFER_SIZE <= 32768,
+               "KEYSTROKE_CAPTURE_BUFFER_SIZE must be between 32 and 32768");
+
+// position byte, a 32-bit varint and a gap marker with another one
+#define MAX_EVENT_SIZE (1 + 5 + 1 + 5)
+
+#define CAPTURE_HID_HEADER_SIZE 3
+#define CAPTURE_HID_INFO_SIZE   12
+
+
+static uint8_t buffer[KEYSTROKE_CAPTURE_BUFFER_SIZE];
+static uint16_t buffer_start = 0;
+static uint16_t buffer_used = 0;
+
+static bool is_enabled = false;
+static uint32_t ms_prev_event_timer = 0;
+
+// since the last event that fit
+static uint32_t events_dropped_since_last_event = 0;
+static uint32_t events_dropped = 0;
+
+
+static void write_byte(uint8_t byte) {
+    uint16_t index = buffer_start + buffer_used;
+    if (index >= KEYSTROKE_CAPTURE_BUFFER_SIZE) index -= KEYSTROKE_CAPTURE_BUFFER_SIZE;
+
+    buffer[index] = byte;
+    ++buffer_used;
+}
+
+
+static void write_varint(uint32_t value) {
+    while (value >= 0x80) {
+        write_byte((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    write_byte(value);
+}
+
+
+void capture_keystroke(keyrecord_t* record) {
+    if (!is_enabled) return;
+
+    const uint32_t now = timer_read32();
+
+    // always reserve room for the worst case, so an event is never cut off
+    if (KEYSTROKE_CAPTURE_BUFFER_SIZE - buffer_used < MAX_EVENT_SIZE) {
+        ++events_dropped_since_last_event;
+        if (events_dropped < UINT32_MAX) ++events_dropped;
+        return;
+    }
+
+    if (events_dropped_since_last_event > 0) {
+        write_byte(CAPTURE_GAP_MARKER);
+        write_varint(events_dropped_since_last_event);
+        events_dropped_since_last_event = 0;
+    }
+
+    write_byte(record->event.key.row << 4 | record->event.key.col);
+    write_varint((now - ms_prev_event_timer) << 1 | record->event.pressed);
+    ms_prev_event_timer = now;
+}
+
+
+static void drain(uint8_t* data, uint8_t length) {
+    const uint8_t n = MIN(length - CAPTURE_HID_HEADER_SIZE, buffer_used);
+    data[2] = n;
+
+    for (uint8_t i = 0; i < n; ++i) {
+        data[CAPTURE_HID_HEADER_SIZE + i] = buffer[buffer_start];
+        if (++buffer_start == KEYSTROKE_CAPTURE_BUFFER_SIZE) buffer_start = 0;
+    }
+    buffer_used -= n;
+}
+
+
+static void write_uint16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+
+bool process_keystroke_capture_command(uint8_t* data, uint8_t length) {
+    if (length < CAPTURE_HID_INFO_SIZE || data[0] != KEYSTROKE_CAPTURE_HID_ID) return false;
+
+    switch (data[1]) {
+        case CAPTURE_HID_INFO:
+            data[2] = CAPTURE_HID_VERSION;
+            data[3] = is_enabled;
+            write_uint16(data + 4, KEYSTROKE_CAPTURE_BUFFER_SIZE);
+            write_uint16(data + 6, buffer_used);
+            write_uint16(data + 8, events_dropped & 0xFFFF);
+            write_uint16(data + 10, events_dropped >> 16);
+            return true;
+
+        case CAPTURE_HID_SET:
+            if (data[2] && !is_enabled) {
+                // the first event gets the time since capturing started
+                ms_prev_event_timer = timer_read32();
+            }
+            is_enabled = data[2];
+            data[2] = is_enabled;
+            return true;
+
+        case CAPTURE_HID_DRAIN:
+            drain(data, length);
+            return true;
+    }
+
+    data[1] = CAPTURE_HID_ERROR;
+    return true;
+}
+
+
+#        endif // KEYSTROKE_CAPTURE_ENABLE
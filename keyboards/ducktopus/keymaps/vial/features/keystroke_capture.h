@@ -0,0 +1,53 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Opt-in capture of key timings, to collect typing data for the heuristics.
+// Only the matrix position, press or release and the time since the previous
+// event are recorded (no keycodes). They are kept in a RAM ring buffer and
+// drained over raw HID (see host/hid_capture).
+
+#pragma once
+
+#include "quantum.h"
+
+#if !defined(KEYSTROKE_CAPTURE_BUFFER_SIZE)
+#    define KEYSTROKE_CAPTURE_BUFFER_SIZE 4096
+#endif
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(KEYSTROKE_CAPTURE_HID_ID)
+#    define KEYSTROKE_CAPTURE_HID_ID 0xF2
+#endif
+
+// Every event is a position byte (row << 4 | col) followed by a varint (7 bits
+// per byte, least significant first, high bit set if more follow) of
+// ms_since_prev_event << 1 | pressed. If events had to be dropped because the
+// buffer was full, the next event is preceded by CAPTURE_GAP_MARKER and a
+// varint of how many were dropped.
+#define CAPTURE_GAP_MARKER 0xFF
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:  request  [id, 0]
+//          response [id, 0, version, is enabled, buffer size (uint16),
+//                    bytes used (uint16), events dropped (uint32)]
+//   set:   request  [id, 1, enable]
+//          response [id, 1, is enabled]
+//   drain: request  [id, 2]
+//          response [id, 2, n, n bytes of the buffer]
+//
+// The drained bytes are removed from the buffer.
+#define CAPTURE_HID_VERSION 1
+
+enum {
+    CAPTURE_HID_INFO = 0,
+    CAPTURE_HID_SET = 1,
+    CAPTURE_HID_DRAIN = 2,
+    CAPTURE_HID_ERROR = 0xFF,
+};
+
+// Call this for every physical key event (e.g. from pre_process_record_user).
+void capture_keystroke(keyrecord_t* record);
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a capture command, in which case data holds the response.
+bool process_keystroke_capture_command(uint8_t* data, uint8_t length);
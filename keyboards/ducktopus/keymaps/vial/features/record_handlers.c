@@ -0,0 +1,120 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "record_handlers.h"
+#include "keycode_classes.h"
+#        ifdef RECORD_HANDLER_STATS
+#include "cycle_counter.h"
+#        endif
+
+static const record_handler_t* handlers = NULL;
+static uint8_t handler_count = 0;
+
+// bit i: handler i wants every event
+static uint8_t wants_every_event = 0;
+
+_Static_assert(RECORD_HANDLERS_MAX <= 8, "wants_every_event has a bit per handler");
+
+
+void register_record_handlers(const record_handler_t* new_handlers, uint8_t count) {
+    handlers = new_handlers;
+    handler_count = MIN(count, RECORD_HANDLERS_MAX);
+    wants_every_event = 0;
+}
+
+
+void set_record_handler_wants_every_event(uint8_t handler, bool wants) {
+    if (handler >= RECORD_HANDLERS_MAX) return;
+    if (wants) {
+        wants_every_event |= 1 << handler;
+    } else {
+        wants_every_event &= ~(1 << handler);
+    }
+}
+
+
+#        ifdef RECORD_HANDLER_STATS
+static record_handler_stats_t stats[RECORD_HANDLERS_MAX];
+
+
+static void count_call(record_handler_stats_t* handler_stats, uint32_t cycles) {
+    if (handler_stats->calls < UINT32_MAX) handler_stats->calls++;
+    handler_stats->cycles += cycles;
+    if (cycles > handler_stats->max_cycles) handler_stats->max_cycles = cycles;
+}
+#        endif
+
+
+bool process_record_handlers(uint16_t keycode, keyrecord_t* record) {
+    const uint8_t classes = get_keycode_classes(keycode);
+    const uint8_t event = record->event.pressed ? RECORD_EVENT_PRESS : RECORD_EVENT_RELEASE;
+
+    for (uint8_t i = 0; i < handler_count; ++i) {
+        const record_handler_t* handler = &handlers[i];
+        const bool wants_class = handler->classes == 0 || (handler->classes & classes);
+
+        if (!((handler->events & event) && wants_class) && !(wants_every_event & (1 << i))) {
+#        ifdef RECORD_HANDLER_STATS
+            if (stats[i].skips < UINT32_MAX) stats[i].skips++;
+#        endif
+            continue;
+        }
+
+#        ifdef RECORD_HANDLER_STATS
+        const uint32_t start = read_cycle_counter();
+        const bool should_continue = handler->process(keycode, classes, record);
+        count_call(&stats[i], get_cycles_between(start, read_cycle_counter()));
+#        else
+        const bool should_continue = handler->process(keycode, classes, record);
+#        endif
+        if (!should_continue) return false;
+    }
+    return true;
+}
+
+
+#        ifdef RECORD_HANDLER_STATS
+static void write_u32(uint8_t* out, uint32_t value) {
+    for (uint8_t byte = 0; byte < 4; ++byte) out[byte] = (value >> (8 * byte)) & 0xFF;
+}
+
+
+static bool read_stats(uint8_t* data) {
+    const uint8_t handler = data[2];
+    if (handler >= handler_count) return false;
+
+    const record_handler_stats_t* handler_stats = &stats[handler];
+    data[3] = 0;
+    write_u32(data + 4, handler_stats->calls);
+    write_u32(data + 8, handler_stats->skips);
+    write_u32(data + 12, (uint32_t) handler_stats->cycles);
+    write_u32(data + 16, (uint32_t) (handler_stats->cycles >> 32));
+    write_u32(data + 20, handler_stats->max_cycles);
+    strncpy((char*) data + 24, handlers[handler].name, 8);
+    return true;
+}
+
+
+bool process_record_handler_stats_command(uint8_t* data, uint8_t length) {
+    if (length < 32 || data[0] != RECORD_HANDLER_STATS_HID_ID) return false;
+
+    switch (data[1]) {
+        case RECORD_HANDLER_STATS_HID_INFO:
+            data[2] = RECORD_HANDLER_STATS_HID_VERSION;
+            data[3] = handler_count;
+            return true;
+
+        case RECORD_HANDLER_STATS_HID_READ:
+            if (read_stats(data)) return true;
+            break;
+
+        case RECORD_HANDLER_STATS_HID_RESET:
+            memset(stats, 0, sizeof(stats));
+            return true;
+    }
+
+    data[1] = RECORD_HANDLER_STATS_HID_ERROR;
+    return true;
+}
+#        endif // RECORD_HANDLER_STATS
@@ -0,0 +1,86 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Calls the process_record handlers of a keymap one after the other, like a
+// chain of if (!process_x(...)) return false, but only those that care about
+// the key event: each handler says which events (press, release) and which
+// keycode classes (see keycode_classes.h) it wants, and is skipped without
+// being called otherwise. A handler that is waiting for something (e.g. any
+// other key to end what it started) can ask for every event for a while.
+//
+// With RECORD_HANDLER_STATS, it counts per handler how often it was called and
+// skipped and how many cycles its calls took (the longest one, too). They are
+// kept in RAM and can be read over raw HID (see host/hid_record_handlers). The
+// cycles are counted with cycle_counter.h (SysTick on ARM).
+
+#pragma once
+
+#include "quantum.h"
+
+#define RECORD_HANDLERS_MAX 8
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(RECORD_HANDLER_STATS_HID_ID)
+#    define RECORD_HANDLER_STATS_HID_ID 0xF7
+#endif
+
+enum record_event_kind {
+    RECORD_EVENT_PRESS   = 1 << 0,
+    RECORD_EVENT_RELEASE = 1 << 1,
+    RECORD_EVENT_ANY     = RECORD_EVENT_PRESS | RECORD_EVENT_RELEASE,
+};
+
+// Like process_record_user, with the keycode classes of the keycode. Returns
+// false to stop the key event here.
+typedef bool (*record_handler_fn_t)(uint16_t keycode, uint8_t classes, keyrecord_t* record);
+
+typedef struct {
+    record_handler_fn_t process;
+    uint8_t events;   // record_event_kind flags
+    uint8_t classes;  // keycode_class flags, any of them (0 for every keycode)
+    const char* name; // for the stats, at most 8 characters are sent
+} record_handler_t;
+
+// Call this once at start up (e.g. from keyboard_post_init_user), with at most
+// RECORD_HANDLERS_MAX handlers in the order they should be called.
+void register_record_handlers(const record_handler_t* handlers, uint8_t count);
+
+// Call this from process_record_user. Returns false if a handler did.
+bool process_record_handlers(uint16_t keycode, keyrecord_t* record);
+
+// Whether the handler (its index in what was registered) is called for every
+// event, no matter what it asked for.
+void set_record_handler_wants_every_event(uint8_t handler, bool wants_every_event);
+
+#        ifdef RECORD_HANDLER_STATS
+// per handler, each saturating
+typedef struct {
+    uint32_t calls;
+    uint32_t skips;
+    uint64_t cycles;
+    uint32_t max_cycles;
+} record_handler_stats_t;
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:  request  [id, 0]
+//          response [id, 0, version, handler count]
+//   read:  request  [id, 1, handler]
+//          response [id, 1, handler, 0, calls (4), skips (4), cycles (8),
+//                    max cycles (4), name (8, padded with 0)]
+//   reset: request  [id, 2]
+//          response [id, 2]
+//
+// An unknown handler is an error, too.
+#define RECORD_HANDLER_STATS_HID_VERSION 1
+
+enum {
+    RECORD_HANDLER_STATS_HID_INFO = 0,
+    RECORD_HANDLER_STATS_HID_READ = 1,
+    RECORD_HANDLER_STATS_HID_RESET = 2,
+    RECORD_HANDLER_STATS_HID_ERROR = 0xFF,
+};
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a stats command, in which case data holds the response.
+bool process_record_handler_stats_command(uint8_t* data, uint8_t length);
+#        endif
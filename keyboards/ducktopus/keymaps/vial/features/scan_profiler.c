@@ -0,0 +1,176 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#        ifdef SCAN_PROFILER_ENABLE
+
+#include <string.h>
+
+#include "scan_profiler.h"
+
+#        if defined(MCU_RP)
+#include "hardware/structs/timer.h"
+#        endif
+
+static const char* const stage_names[SCAN_STAGE_COUNT] = {
+    [SCAN_STAGE_MATRIX]               = "matrix",
+    [SCAN_STAGE_MATRIX_SCAN_USER]     = "scanuser",
+    [SCAN_STAGE_POINTING_DEVICE_USER] = "pointing",
+    [SCAN_STAGE_LOOP]                 = "loop",
+};
+
+static scan_stage_stats_t stats[SCAN_STAGE_COUNT];
+static uint32_t stage_start_us[SCAN_STAGE_COUNT];
+
+// bit i: stage i was begun and not ended yet
+static uint8_t begun_stages = 0;
+
+_Static_assert(SCAN_STAGE_COUNT <= 8, "begun_stages has a bit per stage");
+
+#        ifdef CONSOLE_ENABLE
+static uint32_t last_print_time = 0;
+#        endif
+
+
+#        if defined(MCU_RP)
+uint32_t read_scan_profiler_us(void) {
+    // the low half of the 64 bit 1 MHz timer, without latching the high one
+    return timer_hw->timerawl;
+}
+#        elif defined(__arm__)
+uint32_t read_scan_profiler_us(void) {
+    return timer_read32() * 1000;
+}
+#        endif
+
+
+static uint8_t get_bucket(uint32_t us) {
+    if (us == 0) return 0;
+    const uint8_t bucket = 32 - __builtin_clz(us);
+    return bucket < SCAN_PROFILER_BUCKETS ? bucket : SCAN_PROFILER_BUCKETS - 1;
+}
+
+
+static void add_duration(scan_stage_stats_t* stage_stats, uint32_t us) {
+    if (stage_stats->count == UINT32_MAX) return;
+
+    if (stage_stats->count == 0 || us < stage_stats->min_us) stage_stats->min_us = us;
+    if (us > stage_stats->max_us) stage_stats->max_us = us;
+    stage_stats->count++;
+    stage_stats->sum_us += us;
+
+    uint32_t* bucket_count = &stage_stats->histogram[get_bucket(us)];
+    if (*bucket_count < UINT32_MAX) (*bucket_count)++;
+}
+
+
+void begin_scan_stage(uint8_t stage) {
+    if (stage >= SCAN_STAGE_COUNT) return;
+    stage_start_us[stage] = read_scan_profiler_us();
+    begun_stages |= 1 << stage;
+}
+
+
+void end_scan_stage(uint8_t stage) {
+    if (stage >= SCAN_STAGE_COUNT || !(begun_stages & (1 << stage))) return;
+    add_duration(&stats[stage], read_scan_profiler_us() - stage_start_us[stage]);
+    begun_stages &= ~(1 << stage);
+}
+
+
+#        ifdef CONSOLE_ENABLE
+static void print_scan_stages_to_console(void) {
+    for (uint8_t stage = 0; stage < SCAN_STAGE_COUNT; ++stage) {
+        const scan_stage_stats_t* stage_stats = &stats[stage];
+        const uint32_t mean_us = stage_stats->count ? stage_stats->sum_us / stage_stats->count : 0;
+        uprintf("scan %-8s %10lu  min %6lu  avg %6lu  max %6lu us\n", stage_names[stage],
+                (unsigned long) stage_stats->count, (unsigned long) stage_stats->min_us, (unsigned long) mean_us,
+                (unsigned long) stage_stats->max_us);
+    }
+
+    const scan_stage_stats_t* loop_stats = &stats[SCAN_STAGE_LOOP];
+    const uint32_t rate = loop_stats->sum_us ? loop_stats->count * 1000000ull / loop_stats->sum_us : 0;
+    uprintf("scan rate %lu per second\n", (unsigned long) rate);
+}
+#        endif
+
+
+void scan_profiler_task(void) {
+    end_scan_stage(SCAN_STAGE_LOOP);
+    // matrix_scan_user didn't end the last one (e.g. on the slave half)
+    begun_stages &= ~(1 << SCAN_STAGE_MATRIX);
+
+#        ifdef CONSOLE_ENABLE
+    if (timer_elapsed32(last_print_time) >= SCAN_PROFILER_CONSOLE_INTERVAL_MS) {
+        last_print_time = timer_read32();
+        print_scan_stages_to_console();
+    }
+#        endif
+
+    // after printing, which isn't part of any loop
+    begin_scan_stage(SCAN_STAGE_LOOP);
+    stage_start_us[SCAN_STAGE_MATRIX] = stage_start_us[SCAN_STAGE_LOOP];
+    begun_stages |= 1 << SCAN_STAGE_MATRIX;
+}
+
+
+static void write_u32(uint8_t* out, uint32_t value) {
+    for (uint8_t byte = 0; byte < 4; ++byte) out[byte] = (value >> (8 * byte)) & 0xFF;
+}
+
+
+static bool read_stage(uint8_t* data) {
+    const uint8_t stage = data[2];
+    if (stage >= SCAN_STAGE_COUNT) return false;
+
+    const scan_stage_stats_t* stage_stats = &stats[stage];
+    data[3] = 0;
+    write_u32(data + 4, stage_stats->count);
+    write_u32(data + 8, stage_stats->min_us);
+    write_u32(data + 12, stage_stats->max_us);
+    write_u32(data + 16, (uint32_t) stage_stats->sum_us);
+    write_u32(data + 20, (uint32_t) (stage_stats->sum_us >> 32));
+    strncpy((char*) data + 24, stage_names[stage], 8);
+    return true;
+}
+
+
+static bool read_histogram(uint8_t* data) {
+    const uint8_t stage = data[2];
+    const uint8_t first_bucket = data[3];
+    if (stage >= SCAN_STAGE_COUNT || first_bucket >= SCAN_PROFILER_BUCKETS) return false;
+
+    for (uint8_t i = 0; i < SCAN_PROFILER_BUCKETS_PER_PACKET; ++i) {
+        const uint8_t bucket = first_bucket + i;
+        write_u32(data + 4 + 4 * i, bucket < SCAN_PROFILER_BUCKETS ? stats[stage].histogram[bucket] : 0);
+    }
+    return true;
+}
+
+
+bool process_scan_profiler_command(uint8_t* data, uint8_t length) {
+    if (length < 32 || data[0] != SCAN_PROFILER_HID_ID) return false;
+
+    switch (data[1]) {
+        case SCAN_PROFILER_HID_INFO:
+            data[2] = SCAN_PROFILER_HID_VERSION;
+            data[3] = SCAN_STAGE_COUNT;
+            data[4] = SCAN_PROFILER_BUCKETS;
+            return true;
+
+        case SCAN_PROFILER_HID_READ:
+            if (read_stage(data)) return true;
+            break;
+
+        case SCAN_PROFILER_HID_HISTOGRAM:
+            if (read_histogram(data)) return true;
+            break;
+
+        case SCAN_PROFILER_HID_RESET:
+            memset(stats, 0, sizeof(stats));
+            return true;
+    }
+
+    data[1] = SCAN_PROFILER_HID_ERROR;
+    return true;
+}
+
+#        endif // SCAN_PROFILER_ENABLE
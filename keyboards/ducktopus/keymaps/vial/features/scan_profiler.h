@@ -0,0 +1,91 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Measures how long the stages of the main loop take, in microseconds of the
+// 1 MHz timer of the RP2040, and keeps the count, min, max, sum and a
+// histogram per stage. The stages are marked by the keymap's hooks:
+//
+//     matrix     from the end of the last loop to matrix_scan_user: reading
+//                and debouncing the matrix and, on the master, the split
+//                transaction with the other half
+//     scanuser   matrix_scan_user
+//     pointing   pointing_device_task_user
+//     loop       one whole loop (housekeeping_task_user to the next one),
+//                which gives the scan rate
+//
+// Without SCAN_PROFILER_ENABLE, none of it is compiled in. The stats can be
+// read over raw HID (see host/hid_scan_profiler), and with CONSOLE_ENABLE they
+// are also printed every SCAN_PROFILER_CONSOLE_INTERVAL_MS.
+
+#pragma once
+
+#include "quantum.h"
+
+#define SCAN_PROFILER_BUCKETS 16
+
+// first byte of the raw HID command, must not be used by VIA or Vial
+#if !defined(SCAN_PROFILER_HID_ID)
+#    define SCAN_PROFILER_HID_ID 0xF8
+#endif
+
+#if !defined(SCAN_PROFILER_CONSOLE_INTERVAL_MS)
+#    define SCAN_PROFILER_CONSOLE_INTERVAL_MS 10000
+#endif
+
+enum scan_stage {
+    SCAN_STAGE_MATRIX,
+    SCAN_STAGE_MATRIX_SCAN_USER,
+    SCAN_STAGE_POINTING_DEVICE_USER,
+    SCAN_STAGE_LOOP,
+    SCAN_STAGE_COUNT
+};
+
+// Bucket 0 counts 0 us, bucket i the durations from 2^(i-1) to 2^i - 1 us, and
+// the last one everything longer. Every number saturates.
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t histogram[SCAN_PROFILER_BUCKETS];
+} scan_stage_stats_t;
+
+// The time, in us. On the RP2040 it's the 1 MHz timer, on other ARM MCUs
+// timer_read32 (so only whole ms), and other builds (the host) provide it.
+uint32_t read_scan_profiler_us(void);
+
+void begin_scan_stage(uint8_t stage);
+// Does nothing, if the stage wasn't begun.
+void end_scan_stage(uint8_t stage);
+
+// Call this at the end of every loop, from housekeeping_task_user. It ends
+// the loop and begins the next one and its matrix stage.
+void scan_profiler_task(void);
+
+// Raw HID protocol (the packet format is in README.md):
+//
+//   info:      request  [id, 0]
+//              response [id, 0, version, stage count, bucket count]
+//   read:      request  [id, 1, stage]
+//              response [id, 1, stage, 0, count (4), min (4), max (4),
+//                        sum (8), name (8, padded with 0)]
+//   histogram: request  [id, 2, stage, first bucket]
+//              response [id, 2, stage, first bucket, 7 buckets (4 each, 0
+//                        after the last)]
+//   reset:     request  [id, 3]
+//              response [id, 3]
+//
+// An unknown stage is an error, too.
+#define SCAN_PROFILER_HID_VERSION 1
+#define SCAN_PROFILER_BUCKETS_PER_PACKET 7
+
+enum {
+    SCAN_PROFILER_HID_INFO = 0,
+    SCAN_PROFILER_HID_READ = 1,
+    SCAN_PROFILER_HID_HISTOGRAM = 2,
+    SCAN_PROFILER_HID_RESET = 3,
+    SCAN_PROFILER_HID_ERROR = 0xFF,
+};
+
+// Call this from via_command_kb (or raw_hid_receive). Returns true, if it was
+// a scan profiler command, in which case data holds the response.
+bool process_scan_profiler_command(uint8_t* data, uint8_t length);
@@ -0,0 +1,90 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "adaptive.h"
+
+
+static const char* const bias_names[ADAPTIVE_BIAS_COUNT] = {
+    [ADAPTIVE_BIAS_OVERLAP] = "overlap",
+    [ADAPTIVE_BIAS_WRAPPED] = "wrap",
+    [ADAPTIVE_BIAS_TWO_DOWN] = "two down",
+};
+
+
+static bool transfer_command(adaptive_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = HEURISTIC_TAP_HOLD_ADAPTIVE_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != HEURISTIC_TAP_HOLD_ADAPTIVE_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "adaptive bias command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+bool read_adaptive_biases(adaptive_transfer_t transfer, void* context, adaptive_biases_t* biases) {
+    uint8_t packet[ADAPTIVE_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, ADAPTIVE_HID_INFO)) return false;
+
+    if (packet[2] != ADAPTIVE_HID_VERSION) {
+        fprintf(stderr, "unsupported adaptive bias protocol version %u\n", packet[2]);
+        return false;
+    }
+    if (packet[3] != ADAPTIVE_BIAS_COUNT) {
+        fprintf(stderr, "the keyboard has %u biases instead of %d\n", packet[3], ADAPTIVE_BIAS_COUNT);
+        return false;
+    }
+
+    memset(biases, 0, sizeof(*biases));
+    biases->step_ms = packet[4];
+    biases->max_bias_ms = packet[5];
+    biases->was_loaded = packet[6];
+    biases->is_saved = packet[7];
+
+    memset(packet, 0, sizeof(packet));
+    if (!transfer_command(transfer, context, packet, ADAPTIVE_HID_READ)) return false;
+    if (packet[2] != ADAPTIVE_BIAS_COUNT) {
+        fprintf(stderr, "invalid adaptive bias response\n");
+        return false;
+    }
+
+    const uint8_t* in = packet + 3;
+    for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i, ++in) {
+        biases->biases[i] = (int8_t) *in;
+    }
+    for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i, in += 2) {
+        biases->corrections_to_hold[i] = (uint16_t) (in[0] | in[1] << 8);
+    }
+    for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i, in += 2) {
+        biases->corrections_to_tap[i] = (uint16_t) (in[0] | in[1] << 8);
+    }
+    return true;
+}
+
+
+void print_adaptive_biases(FILE* file, const adaptive_biases_t* biases) {
+    fprintf(file, "heuristic    bias  corrections to hold  to tap  (ms, positive means more holds)\n");
+    for (uint8_t i = 0; i < ADAPTIVE_BIAS_COUNT; ++i) {
+        fprintf(file, "%-10s %+5d %21u %7u\n", bias_names[i], biases->biases[i], biases->corrections_to_hold[i],
+                biases->corrections_to_tap[i]);
+    }
+    fprintf(file, "(steps of %u ms up to %u ms, %s, %s)\n", biases->step_ms, biases->max_bias_ms,
+            biases->was_loaded ? "loaded from the EEPROM" : "not loaded from the EEPROM",
+            biases->is_saved ? "saved" : "not saved yet");
+}
+
+
+bool reset_adaptive_biases(adaptive_transfer_t transfer, void* context, bool should_save) {
+    uint8_t packet[ADAPTIVE_PACKET_SIZE] = {0};
+    packet[2] = should_save;
+    return transfer_command(transfer, context, packet, ADAPTIVE_HID_RESET);
+}
+
+
+bool save_adaptive_biases(adaptive_transfer_t transfer, void* context) {
+    uint8_t packet[ADAPTIVE_PACKET_SIZE] = {0};
+    return transfer_command(transfer, context, packet, ADAPTIVE_HID_SAVE);
+}
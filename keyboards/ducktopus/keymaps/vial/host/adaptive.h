@@ -0,0 +1,34 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the learned biases of the heuristics over the raw HID protocol
+// described in features/heuristic_tap_hold_adaptive.h.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_adaptive.h"
+
+#define ADAPTIVE_PACKET_SIZE 32
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*adaptive_transfer_t)(uint8_t* packet, void* context);
+
+typedef struct {
+    uint8_t step_ms;
+    uint8_t max_bias_ms;
+    bool was_loaded;
+    bool is_saved;
+    int8_t biases[ADAPTIVE_BIAS_COUNT];
+    uint16_t corrections_to_hold[ADAPTIVE_BIAS_COUNT];
+    uint16_t corrections_to_tap[ADAPTIVE_BIAS_COUNT];
+} adaptive_biases_t;
+
+bool read_adaptive_biases(adaptive_transfer_t transfer, void* context, adaptive_biases_t* biases);
+void print_adaptive_biases(FILE* file, const adaptive_biases_t* biases);
+
+// Back to no bias, saved to the EEPROM if should_save.
+bool reset_adaptive_biases(adaptive_transfer_t transfer, void* context, bool should_save);
+
+// Saves the biases to the EEPROM now, instead of with the next batch.
+bool save_adaptive_biases(adaptive_transfer_t transfer, void* context);
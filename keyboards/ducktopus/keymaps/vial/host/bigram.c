@@ -0,0 +1,227 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "bigram.h"
+
+#define BIGRAM_HID_HEADER_SIZE 5
+#define BIGRAM_HID_MAX_OFFSETS (BIGRAM_PACKET_SIZE - BIGRAM_HID_HEADER_SIZE)
+
+// like the firmware, which has to be built with the same matrix
+typedef struct {
+    uint8_t position_count;
+    uint8_t unit_ms;
+    bool was_loaded;
+    uint8_t positions[255];
+} bigram_info_t;
+
+
+bool load_bigram_table(const char* path, bigram_table_t* table) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    memset(table, 0, sizeof(*table));
+    char line[256];
+    unsigned line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ++line_number;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        unsigned tap_hold_row, tap_hold_col, next_row, next_col;
+        int offset_ms;
+        const int fields = sscanf(line, "%u %u %u %u %d", &tap_hold_row, &tap_hold_col, &next_row, &next_col,
+                                  &offset_ms);
+        if (fields <= 0) continue;
+
+        if (fields != 5 || tap_hold_row >= MATRIX_ROWS || tap_hold_col >= MATRIX_COLS || next_row >= MATRIX_ROWS ||
+            next_col >= MATRIX_COLS || offset_ms < -MS_MAX_OVERLAP || offset_ms > MS_MAX_OVERLAP) {
+            fprintf(stderr, "%s:%u: invalid bigram offset\n", path, line_number);
+            fclose(file);
+            return false;
+        }
+        table->offset_ms[tap_hold_row << 4 | tap_hold_col][next_row << 4 | next_col] = (int16_t) offset_ms;
+    }
+    fclose(file);
+    return true;
+}
+
+
+bool save_bigram_table(const char* path, const bigram_table_t* table) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    fprintf(file, "# tap hold row, col, next row, col, offset of the overlap estimate in ms\n");
+    for (unsigned tap_hold = 0; tap_hold < 256; ++tap_hold) {
+        for (unsigned next = 0; next < 256; ++next) {
+            const int16_t offset_ms = table->offset_ms[tap_hold][next];
+            if (offset_ms == 0) continue;
+            fprintf(file, "%u %u %u %u %d\n", tap_hold >> 4, tap_hold & 0xF, next >> 4, next & 0xF, offset_ms);
+        }
+    }
+
+    if (fclose(file) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+
+static bool transfer_command(bigram_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = HEURISTIC_TAP_HOLD_BIGRAM_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != HEURISTIC_TAP_HOLD_BIGRAM_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "bigram command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+static bool read_info(bigram_transfer_t transfer, void* context, bigram_info_t* info) {
+    uint8_t packet[BIGRAM_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, BIGRAM_HID_INFO)) return false;
+
+    if (packet[2] != BIGRAM_HID_VERSION) {
+        fprintf(stderr, "unsupported bigram protocol version %u\n", packet[2]);
+        return false;
+    }
+    if (packet[4] != HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT) {
+        fprintf(stderr, "the keyboard has %u next positions instead of %u (another matrix?)\n", packet[4],
+                HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT);
+        return false;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->position_count = packet[3];
+    info->unit_ms = packet[5];
+    info->was_loaded = packet[6];
+
+    uint8_t first = 0;
+    while (first < info->position_count) {
+        memset(packet, 0, sizeof(packet));
+        packet[2] = first;
+        if (!transfer_command(transfer, context, packet, BIGRAM_HID_POSITIONS)) return false;
+
+        const uint8_t n = packet[3];
+        if (n == 0 || packet[2] != first) {
+            fprintf(stderr, "invalid bigram positions response\n");
+            return false;
+        }
+        for (uint8_t i = 0; i < n && first < info->position_count; ++i) {
+            info->positions[first++] = packet[4 + i];
+        }
+    }
+    return true;
+}
+
+
+// the inverse of get_next_index in the firmware, for a next key on the other half
+static uint8_t get_next_position(uint8_t tap_hold_position, uint8_t index) {
+    uint8_t row = index / MATRIX_COLS;
+#ifdef SPLIT_KEYBOARD
+    if ((tap_hold_position >> 4) < MATRIX_ROWS / 2) row += MATRIX_ROWS / 2;
+#endif
+    return (uint8_t) (row << 4 | (index % MATRIX_COLS));
+}
+
+
+bool read_bigram_table(bigram_transfer_t transfer, void* context, bigram_table_t* table) {
+    static bigram_info_t info;
+    if (!read_info(transfer, context, &info)) return false;
+
+    memset(table, 0, sizeof(*table));
+    for (uint8_t slot = 0; slot < info.position_count; ++slot) {
+        uint8_t index = 0;
+        while (index < HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT) {
+            uint8_t packet[BIGRAM_PACKET_SIZE] = {0};
+            packet[2] = slot;
+            packet[3] = index;
+            if (!transfer_command(transfer, context, packet, BIGRAM_HID_READ)) return false;
+
+            const uint8_t n = packet[4];
+            if (n == 0 || packet[2] != slot || packet[3] != index) {
+                fprintf(stderr, "invalid bigram response for position %u\n", slot);
+                return false;
+            }
+            for (uint8_t i = 0; i < n && index < HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT; ++i, ++index) {
+                const uint8_t tap_hold = info.positions[slot];
+                const int8_t offset = (int8_t) packet[BIGRAM_HID_HEADER_SIZE + i];
+                table->offset_ms[tap_hold][get_next_position(tap_hold, index)] = (int16_t) (offset * info.unit_ms);
+            }
+        }
+    }
+    return true;
+}
+
+
+static int8_t to_offset(int16_t offset_ms, uint8_t unit_ms) {
+    const int rounded = (offset_ms + (offset_ms < 0 ? -unit_ms : unit_ms) / 2) / unit_ms;
+    return (int8_t) (rounded < INT8_MIN ? INT8_MIN : (rounded > INT8_MAX ? INT8_MAX : rounded));
+}
+
+
+bool write_bigram_table(bigram_transfer_t transfer, void* context, const bigram_table_t* table, bool should_save) {
+    static bigram_info_t info;
+    if (!read_info(transfer, context, &info)) return false;
+
+    bool is_slot[256] = {false};
+    for (uint8_t slot = 0; slot < info.position_count; ++slot) {
+        is_slot[info.positions[slot]] = true;
+    }
+
+    unsigned left_out = 0;
+    for (unsigned tap_hold = 0; tap_hold < 256; ++tap_hold) {
+        for (unsigned next = 0; next < 256; ++next) {
+            if (table->offset_ms[tap_hold][next] == 0) continue;
+
+#ifdef SPLIT_KEYBOARD
+            const bool is_other_half = ((tap_hold >> 4) < MATRIX_ROWS / 2) != ((next >> 4) < MATRIX_ROWS / 2);
+#else
+            const bool is_other_half = true;
+#endif
+            if (!is_slot[tap_hold] || !is_other_half) ++left_out;
+        }
+    }
+    if (left_out > 0) {
+        fprintf(stderr, "left out %u offsets of positions that aren't tap hold keys or on the same half\n",
+                left_out);
+    }
+
+    for (uint8_t slot = 0; slot < info.position_count; ++slot) {
+        uint8_t index = 0;
+        while (index < HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT) {
+            uint8_t packet[BIGRAM_PACKET_SIZE] = {0};
+            const uint8_t n = MIN(BIGRAM_HID_MAX_OFFSETS, HEURISTIC_TAP_HOLD_BIGRAM_NEXT_COUNT - index);
+            packet[2] = slot;
+            packet[3] = index;
+            packet[4] = n;
+            for (uint8_t i = 0; i < n; ++i) {
+                const uint8_t tap_hold = info.positions[slot];
+                const int16_t offset_ms = table->offset_ms[tap_hold][get_next_position(tap_hold, index + i)];
+                packet[BIGRAM_HID_HEADER_SIZE + i] = (uint8_t) to_offset(offset_ms, info.unit_ms);
+            }
+            if (!transfer_command(transfer, context, packet, BIGRAM_HID_WRITE)) return false;
+
+            if (packet[2] != slot || packet[3] != index || packet[4] != n) {
+                fprintf(stderr, "invalid bigram response for position %u\n", slot);
+                return false;
+            }
+            index += n;
+        }
+    }
+
+    if (!should_save) return true;
+    uint8_t packet[BIGRAM_PACKET_SIZE] = {0};
+    return transfer_command(transfer, context, packet, BIGRAM_HID_SAVE);
+}
@@ -0,0 +1,38 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Bigram offset tables (see features/heuristic_tap_hold_bigrams.h) as files
+// and over the raw HID protocol described there.
+//
+// A table file has one offset per line, '#' starts a comment:
+//
+//     <tap hold row> <tap hold col> <next row> <next col> <offset ms>
+//
+// Pairs that aren't in it have no offset. Positions are matrix positions.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_bigrams.h"
+
+#define BIGRAM_PACKET_SIZE 32
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*bigram_transfer_t)(uint8_t* packet, void* context);
+
+// offset_ms[tap hold position][next position], with positions as row << 4 | col
+typedef struct {
+    int16_t offset_ms[256][256];
+} bigram_table_t;
+
+bool load_bigram_table(const char* path, bigram_table_t* table);
+bool save_bigram_table(const char* path, const bigram_table_t* table);
+
+// Replaces the whole table of the keyboard (pairs it can't hold are left out,
+// with a warning) and saves it to the EEPROM, if should_save.
+bool write_bigram_table(bigram_transfer_t transfer, void* context, const bigram_table_t* table, bool should_save);
+
+// What the keyboard uses right now.
+bool read_bigram_table(bigram_transfer_t transfer, void* context, bigram_table_t* table);
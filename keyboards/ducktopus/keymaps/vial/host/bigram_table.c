@@ -0,0 +1,275 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Learns the bigram offsets of the overlap estimate (see
+// features/heuristic_tap_hold_bigrams.h) from labeled corpora, and reads or
+// writes them over raw HID (Linux hidraw).
+//
+//     bigram_table -o bigrams.txt typing.corpus      learn
+//     bigram_table -i bigrams.txt -w /dev/hidrawN    write and save to the EEPROM
+//     bigram_table -r /dev/hidrawN -o current.txt    read what the keyboard uses
+//
+// For every pair of tap hold key and next key (on the other half) with enough
+// overlap samples, it picks the offset that decides the most of them right
+// (the smallest one of equally good ones), if it's right for at least -g
+// samples more than no offset. Accuracy on the samples it learned from is
+// optimistic, so it also prints it for two halves of the samples, each with
+// the offsets learned from the other half.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bigram.h"
+#include "corpus.h"
+#include "hidraw.h"
+#include "samples.h"
+#include "features/heuristic_tap_hold_kernels.h"
+
+#define OFFSET_COUNT 256
+#define NO_OFFSET    128
+
+// samples of the fold are left out while learning and used to evaluate
+#define ALL_SAMPLES -1
+
+typedef struct {
+    uint32_t sample_count;
+    uint32_t correct[OFFSET_COUNT]; // by offset + NO_OFFSET
+} bigram_counts_t;
+
+typedef struct {
+    const heuristic_samples_t* samples;
+    uint16_t* estimates;
+    bigram_counts_t* counts[1 << 16];
+} learner_t;
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-m MIN] [-g GAIN] [-o TABLE] [-w HIDRAW [-n]] CORPUS...\n"
+            "       %s -i TABLE -w HIDRAW [-n]\n"
+            "       %s -r HIDRAW [-o TABLE]\n"
+            "  -m MIN     only pairs with at least this many samples get an offset (default 20)\n"
+            "  -g GAIN    and only if it's right for this many more of them (default 2)\n"
+            "  -o TABLE   write the offsets to this file\n"
+            "  -i TABLE   read the offsets from this file instead of learning them\n"
+            "  -w HIDRAW  replace the offsets of the keyboard and save them to its EEPROM\n"
+            "  -n         don't save them, so they are gone after a restart\n"
+            "  -r HIDRAW  read the offsets the keyboard uses\n",
+            name, name, name);
+    exit(2);
+}
+
+
+// like the firmware: hold, if the overlap lasts longer than the shifted
+// estimate, else whatever ends the overlap decides it (see samples.h)
+static bool is_hold_with_offset(uint16_t estimate, float overlap, const overlap_context_t* context,
+                                int offset_units) {
+    const int shifted = estimate + offset_units * HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS;
+    return overlap > (shifted < 1 ? 1 : MIN(shifted, MS_MAX_OVERLAP)) || context->fallback_is_hold;
+}
+
+
+static bool is_in_fold(size_t sample, int fold) {
+    return fold == ALL_SAMPLES || (int) (sample % 2) == fold;
+}
+
+
+static void count_offsets(learner_t* learner, int left_out_fold) {
+    const sample_set_t* overlap = &learner->samples->overlap;
+    for (size_t i = 0; i < overlap->count; ++i) {
+        if (left_out_fold != ALL_SAMPLES && is_in_fold(i, left_out_fold)) continue;
+
+        const overlap_context_t* context = &learner->samples->overlap_contexts[i];
+        bigram_counts_t* counts = learner->counts[context->bigram];
+        if (counts == NULL) {
+            counts = learner->counts[context->bigram] = calloc(1, sizeof(*counts));
+            if (counts == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+
+        counts->sample_count++;
+        for (int offset = -NO_OFFSET; offset < OFFSET_COUNT - NO_OFFSET; ++offset) {
+            const bool is_hold = is_hold_with_offset(learner->estimates[i], overlap->extra[i], context, offset);
+            counts->correct[offset + NO_OFFSET] += is_hold == overlap->is_hold[i];
+        }
+    }
+}
+
+
+static int choose_offset(const bigram_counts_t* counts, uint32_t min_samples, uint32_t min_gain) {
+    if (counts == NULL || counts->sample_count < min_samples) return 0;
+
+    int best = 0;
+    for (int offset = -NO_OFFSET; offset < OFFSET_COUNT - NO_OFFSET; ++offset) {
+        const uint32_t correct = counts->correct[offset + NO_OFFSET];
+        const uint32_t best_correct = counts->correct[best + NO_OFFSET];
+        if (correct > best_correct || (correct == best_correct && abs(offset) < abs(best))) best = offset;
+    }
+    return counts->correct[best + NO_OFFSET] >= counts->correct[NO_OFFSET] + min_gain ? best : 0;
+}
+
+
+// offsets in units, by bigram, learned without the samples of the fold
+static void learn_offsets(learner_t* learner, int left_out_fold, uint32_t min_samples, uint32_t min_gain,
+                          int8_t* offsets) {
+    for (size_t bigram = 0; bigram < (1 << 16); ++bigram) {
+        free(learner->counts[bigram]);
+        learner->counts[bigram] = NULL;
+    }
+    count_offsets(learner, left_out_fold);
+
+    for (size_t bigram = 0; bigram < (1 << 16); ++bigram) {
+        offsets[bigram] = (int8_t) choose_offset(learner->counts[bigram], min_samples, min_gain);
+    }
+}
+
+
+static void count_correct(const learner_t* learner, const int8_t* offsets, int fold, uint64_t* correct_before,
+                          uint64_t* correct_after, uint64_t* count) {
+    const sample_set_t* overlap = &learner->samples->overlap;
+    for (size_t i = 0; i < overlap->count; ++i) {
+        if (!is_in_fold(i, fold)) continue;
+
+        const uint16_t estimate = learner->estimates[i];
+        const overlap_context_t* context = &learner->samples->overlap_contexts[i];
+        const int offset = offsets[context->bigram];
+        *correct_before += is_hold_with_offset(estimate, overlap->extra[i], context, 0) == overlap->is_hold[i];
+        *correct_after += is_hold_with_offset(estimate, overlap->extra[i], context, offset) == overlap->is_hold[i];
+        ++*count;
+    }
+}
+
+
+static double to_percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double) part / (double) total : 0.0;
+}
+
+
+static void learn_table(char** corpus_paths, int corpus_count, uint32_t min_samples, uint32_t min_gain,
+                        bigram_table_t* table) {
+    heuristic_samples_t samples = {0};
+    for (int i = 0; i < corpus_count; ++i) {
+        corpus_t corpus;
+        if (!corpus_open(&corpus, corpus_paths[i])) exit(1);
+        add_corpus_samples(&samples, &corpus);
+        corpus_close(&corpus);
+    }
+
+    const sample_set_t* overlap = &samples.overlap;
+    learner_t* learner = calloc(1, sizeof(*learner));
+    int8_t* offsets = malloc(1 << 16);
+    uint16_t* estimates = malloc(MAX(overlap->count, 1) * sizeof(*estimates));
+    if (learner == NULL || offsets == NULL || estimates == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < overlap->count; ++i) {
+        estimates[i] = estimate_min_overlap_for_hold_in_ms((int16_t) overlap->p[i], (uint16_t) overlap->t[i]);
+    }
+    learner->samples = &samples;
+    learner->estimates = estimates;
+
+    // each half with the offsets of the other one
+    uint64_t held_out_before = 0, held_out_after = 0, held_out_count = 0;
+    for (int fold = 0; fold < 2; ++fold) {
+        learn_offsets(learner, fold, min_samples, min_gain, offsets);
+        count_correct(learner, offsets, fold, &held_out_before, &held_out_after, &held_out_count);
+    }
+
+    learn_offsets(learner, ALL_SAMPLES, min_samples, min_gain, offsets);
+    uint64_t before = 0, after = 0, count = 0;
+    count_correct(learner, offsets, ALL_SAMPLES, &before, &after, &count);
+
+    memset(table, 0, sizeof(*table));
+    unsigned pair_count = 0, offset_count = 0;
+    for (size_t bigram = 0; bigram < (1 << 16); ++bigram) {
+        if (learner->counts[bigram] != NULL) ++pair_count;
+        if (offsets[bigram] == 0) continue;
+
+        table->offset_ms[bigram >> 8][bigram & 0xFF] = (int16_t) (offsets[bigram] * HEURISTIC_TAP_HOLD_BIGRAM_UNIT_MS);
+        ++offset_count;
+    }
+
+    printf("%llu overlap samples of %u pairs, %u of which got an offset\n", (unsigned long long) count, pair_count,
+           offset_count);
+    printf("learned from:    %.3f %% -> %.3f %% decided right\n", to_percent(before, count), to_percent(after, count));
+    printf("held out:        %.3f %% -> %.3f %% decided right\n", to_percent(held_out_before, held_out_count),
+           to_percent(held_out_after, held_out_count));
+
+    for (size_t bigram = 0; bigram < (1 << 16); ++bigram) {
+        free(learner->counts[bigram]);
+    }
+    free(estimates);
+    free(offsets);
+    free(learner);
+    free_heuristic_samples(&samples);
+}
+
+
+int main(int argc, char** argv) {
+    uint32_t min_samples = 20;
+    uint32_t min_gain = 2;
+    const char* output_path = NULL;
+    const char* input_path = NULL;
+    const char* write_path = NULL;
+    const char* read_path = NULL;
+    bool should_save = true;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-n") == 0) {
+            should_save = false;
+            continue;
+        }
+        if (i + 1 >= argc) usage(argv[0]);
+
+        const char* value = argv[++i];
+        if (strcmp(argv[i - 1], "-m") == 0) {
+            min_samples = (uint32_t) strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "-g") == 0) {
+            min_gain = (uint32_t) strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "-o") == 0) {
+            output_path = value;
+        } else if (strcmp(argv[i - 1], "-i") == 0) {
+            input_path = value;
+        } else if (strcmp(argv[i - 1], "-w") == 0) {
+            write_path = value;
+        } else if (strcmp(argv[i - 1], "-r") == 0) {
+            read_path = value;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    const int corpus_count = argc - i;
+
+    // exactly one source
+    if ((corpus_count > 0) + (input_path != NULL) + (read_path != NULL) != 1) usage(argv[0]);
+    if (output_path == NULL && write_path == NULL) usage(argv[0]);
+
+    static bigram_table_t table;
+    if (corpus_count > 0) {
+        learn_table(argv + i, corpus_count, min_samples, min_gain, &table);
+    } else if (input_path != NULL) {
+        if (!load_bigram_table(input_path, &table)) return 1;
+    } else {
+        int fd = open_hidraw(read_path);
+        if (fd < 0) return 1;
+        const bool was_read = read_bigram_table(transfer_hidraw, &fd, &table);
+        close(fd);
+        if (!was_read) return 1;
+    }
+
+    if (output_path != NULL && !save_bigram_table(output_path, &table)) return 1;
+
+    if (write_path != NULL) {
+        int fd = open_hidraw(write_path);
+        if (fd < 0) return 1;
+        const bool was_written = write_bigram_table(transfer_hidraw, &fd, &table, should_save);
+        close(fd);
+        if (!was_written) return 1;
+        fprintf(stderr, should_save ? "written and saved\n" : "written (until the next restart)\n");
+    }
+    return 0;
+}
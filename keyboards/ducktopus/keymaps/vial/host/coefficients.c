@@ -0,0 +1,294 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "coefficients.h"
+
+#define COEFFICIENTS_HID_HEADER_SIZE 4
+#define COEFFICIENTS_HID_MAX_VALUES  ((COEFFICIENTS_PACKET_SIZE - COEFFICIENTS_HID_HEADER_SIZE) / 4)
+
+typedef struct {
+    const char* name;
+    uint8_t first;
+    uint8_t count;
+} form_t;
+
+static const form_t forms[] = {
+    {"overlap", 0, OVERLAP_COEFFICIENT_COUNT},
+    {"wrapped", OVERLAP_COEFFICIENT_COUNT, WRAPPED_COEFFICIENT_COUNT},
+    {"two_down", OVERLAP_COEFFICIENT_COUNT + WRAPPED_COEFFICIENT_COUNT, TWO_DOWN_COEFFICIENT_COUNT},
+};
+#define FORM_COUNT (sizeof(forms) / sizeof(forms[0]))
+
+
+// the coefficients are the only floats in it, one form after another
+static float* get_values(heuristic_tap_hold_coefficients_t* set) {
+    return set->overlap;
+}
+
+
+static const float* get_const_values(const heuristic_tap_hold_coefficients_t* set) {
+    return set->overlap;
+}
+
+
+_Static_assert(sizeof(((heuristic_tap_hold_coefficients_t*) 0)->overlap) +
+                       sizeof(((heuristic_tap_hold_coefficients_t*) 0)->wrapped) +
+                       sizeof(((heuristic_tap_hold_coefficients_t*) 0)->two_down) ==
+               HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT * sizeof(float),
+               "the coefficients must be contiguous");
+
+
+void get_default_coefficients(heuristic_tap_hold_coefficients_t* set) {
+    const heuristic_tap_hold_coefficients_t defaults = {
+            .overlap = DEFAULT_OVERLAP_COEFFICIENTS,
+            .wrapped = DEFAULT_WRAPPED_COEFFICIENTS,
+            .two_down = DEFAULT_TWO_DOWN_COEFFICIENTS,
+            .max_overlap_ms = MS_MAX_OVERLAP,
+    };
+    *set = defaults;
+}
+
+
+void get_coefficient_name(uint8_t index, char* name, size_t size) {
+    for (size_t f = 0; f < FORM_COUNT; ++f) {
+        if (index >= forms[f].first && index < forms[f].first + forms[f].count) {
+            snprintf(name, size, "%s c%u", forms[f].name, index - forms[f].first);
+            return;
+        }
+    }
+    snprintf(name, size, "max_overlap");
+}
+
+
+// like find_invalid_value in the firmware
+static bool is_valid(const heuristic_tap_hold_coefficients_t* set, uint8_t* invalid) {
+    const float* values = get_const_values(set);
+    for (uint8_t i = 0; i < HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT; ++i) {
+        if (!(values[i] >= -HEURISTIC_TAP_HOLD_MAX_COEFFICIENT && values[i] <= HEURISTIC_TAP_HOLD_MAX_COEFFICIENT)) {
+            *invalid = i;
+            return false;
+        }
+    }
+    *invalid = HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT;
+    return set->max_overlap_ms >= 1 && set->max_overlap_ms <= MS_MAX_OVERLAP;
+}
+
+
+static bool parse_form(char* values_text, float* values, uint8_t count) {
+    char* rest = values_text;
+    for (uint8_t i = 0; i < count; ++i) {
+        char* end;
+        values[i] = strtof(rest, &end);
+        if (end == rest) return false;
+        rest = end;
+    }
+    return strspn(rest, " \t\r\n") == strlen(rest);
+}
+
+
+bool load_coefficient_file(const char* path, heuristic_tap_hold_coefficients_t* set) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    memset(set, 0, sizeof(*set));
+    bool has_form[FORM_COUNT] = {false};
+    bool has_max_overlap = false;
+
+    char line[1024];
+    unsigned line_number = 0;
+    bool is_ok = true;
+    while (is_ok && fgets(line, sizeof(line), file) != NULL) {
+        ++line_number;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        char name[32];
+        int name_length;
+        if (sscanf(line, "%31s%n", name, &name_length) != 1) continue;
+        char* values_text = line + name_length;
+
+        if (strcmp(name, "max_overlap") == 0) {
+            unsigned max_overlap;
+            char rest;
+            is_ok = sscanf(values_text, "%u %c", &max_overlap, &rest) == 1 && max_overlap <= UINT16_MAX;
+            set->max_overlap_ms = (uint16_t) max_overlap;
+            has_max_overlap = true;
+            continue;
+        }
+
+        size_t f = 0;
+        while (f < FORM_COUNT && strcmp(name, forms[f].name) != 0) ++f;
+        is_ok = f < FORM_COUNT && parse_form(values_text, get_values(set) + forms[f].first, forms[f].count);
+        if (is_ok) has_form[f] = true;
+    }
+    fclose(file);
+
+    if (!is_ok) {
+        fprintf(stderr, "%s:%u: expected a name and its values\n", path, line_number);
+        return false;
+    }
+    for (size_t f = 0; f < FORM_COUNT; ++f) {
+        if (!has_form[f]) {
+            fprintf(stderr, "%s: no %s line\n", path, forms[f].name);
+            return false;
+        }
+    }
+    if (!has_max_overlap) {
+        fprintf(stderr, "%s: no max_overlap line\n", path);
+        return false;
+    }
+
+    uint8_t invalid;
+    if (!is_valid(set, &invalid)) {
+        char value_name[32];
+        get_coefficient_name(invalid, value_name, sizeof(value_name));
+        fprintf(stderr, "%s: %s is out of range (coefficients up to %g, max_overlap 1 to %d)\n", path, value_name,
+                (double) HEURISTIC_TAP_HOLD_MAX_COEFFICIENT, MS_MAX_OVERLAP);
+        return false;
+    }
+    return true;
+}
+
+
+void print_coefficients(FILE* file, const heuristic_tap_hold_coefficients_t* set) {
+    fprintf(file, "# see features/heuristic_tap_hold_kernels.h\n");
+    fprintf(file, "max_overlap %u\n", set->max_overlap_ms);
+    for (size_t f = 0; f < FORM_COUNT; ++f) {
+        fprintf(file, "%s", forms[f].name);
+        for (uint8_t i = 0; i < forms[f].count; ++i) {
+            // enough digits to read back the same float
+            fprintf(file, " %.9g", (double) get_const_values(set)[forms[f].first + i]);
+        }
+        fprintf(file, "\n");
+    }
+}
+
+
+bool save_coefficient_file(const char* path, const heuristic_tap_hold_coefficients_t* set) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    print_coefficients(file, set);
+
+    if (fclose(file) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+
+static bool transfer_command(coefficients_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = HEURISTIC_TAP_HOLD_COEFFICIENTS_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != HEURISTIC_TAP_HOLD_COEFFICIENTS_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "coefficients command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+// the max overlap in use, after checking that the keyboard has the same forms
+static bool read_info(coefficients_transfer_t transfer, void* context, uint16_t* max_overlap_ms) {
+    uint8_t packet[COEFFICIENTS_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, COEFFICIENTS_HID_INFO)) return false;
+
+    if (packet[2] != COEFFICIENTS_HID_VERSION) {
+        fprintf(stderr, "unsupported coefficients protocol version %u\n", packet[2]);
+        return false;
+    }
+    if (packet[3] != OVERLAP_COEFFICIENT_COUNT || packet[4] != WRAPPED_COEFFICIENT_COUNT ||
+        packet[5] != TWO_DOWN_COEFFICIENT_COUNT) {
+        fprintf(stderr, "the keyboard has other forms (%u, %u and %u coefficients)\n", packet[3], packet[4],
+                packet[5]);
+        return false;
+    }
+    const uint16_t limit = (uint16_t) (packet[6] | packet[7] << 8);
+    if (limit != MS_MAX_OVERLAP) {
+        fprintf(stderr, "note: the keyboard was built with MS_MAX_OVERLAP %u instead of %d\n", limit,
+                MS_MAX_OVERLAP);
+    }
+    *max_overlap_ms = (uint16_t) (packet[8] | packet[9] << 8);
+    return true;
+}
+
+
+bool read_coefficients(coefficients_transfer_t transfer, void* context, heuristic_tap_hold_coefficients_t* set) {
+    memset(set, 0, sizeof(*set));
+    if (!read_info(transfer, context, &set->max_overlap_ms)) return false;
+
+    uint8_t first = 0;
+    while (first < HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT) {
+        uint8_t packet[COEFFICIENTS_PACKET_SIZE] = {0};
+        packet[2] = first;
+        if (!transfer_command(transfer, context, packet, COEFFICIENTS_HID_READ)) return false;
+
+        const uint8_t n = packet[3];
+        if (n == 0 || packet[2] != first || n > HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT - first) {
+            fprintf(stderr, "invalid coefficients response\n");
+            return false;
+        }
+        memcpy(get_values(set) + first, packet + COEFFICIENTS_HID_HEADER_SIZE, n * sizeof(float));
+        first += n;
+    }
+    return true;
+}
+
+
+bool write_coefficients(coefficients_transfer_t transfer, void* context, const heuristic_tap_hold_coefficients_t* set,
+                        bool should_save) {
+    uint16_t max_overlap_ms;
+    if (!read_info(transfer, context, &max_overlap_ms)) return false;
+
+    uint8_t first = 0;
+    while (first < HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT) {
+        uint8_t packet[COEFFICIENTS_PACKET_SIZE] = {0};
+        const uint8_t n = MIN(COEFFICIENTS_HID_MAX_VALUES, HEURISTIC_TAP_HOLD_COEFFICIENT_COUNT - first);
+        packet[2] = first;
+        packet[3] = n;
+        memcpy(packet + COEFFICIENTS_HID_HEADER_SIZE, get_const_values(set) + first, n * sizeof(float));
+        if (!transfer_command(transfer, context, packet, COEFFICIENTS_HID_WRITE)) return false;
+
+        if (packet[2] != first || packet[3] != n) {
+            fprintf(stderr, "invalid coefficients response\n");
+            return false;
+        }
+        first += n;
+    }
+
+    uint8_t packet[COEFFICIENTS_PACKET_SIZE] = {0};
+    packet[2] = set->max_overlap_ms & 0xFF;
+    packet[3] = set->max_overlap_ms >> 8;
+    packet[4] = should_save;
+    if (!transfer_command(transfer, context, packet, COEFFICIENTS_HID_APPLY)) return false;
+
+    if (packet[2] != 0) {
+        char name[32];
+        get_coefficient_name(packet[3], name, sizeof(name));
+        fprintf(stderr, "the keyboard rejected the coefficients, %s is out of range\n", name);
+        return false;
+    }
+    return true;
+}
+
+
+bool reset_coefficients(coefficients_transfer_t transfer, void* context, bool should_save) {
+    uint16_t max_overlap_ms;
+    if (!read_info(transfer, context, &max_overlap_ms)) return false;
+
+    uint8_t packet[COEFFICIENTS_PACKET_SIZE] = {0};
+    packet[2] = should_save;
+    return transfer_command(transfer, context, packet, COEFFICIENTS_HID_RESET);
+}
@@ -0,0 +1,48 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Coefficient sets of the heuristics (see
+// features/heuristic_tap_hold_coefficients.h) as files and over the raw HID
+// protocol described there.
+//
+// A coefficient file has one line per form, with its name and all of its
+// coefficients in the order of heuristic_tap_hold_kernels.h, and one with
+// the max overlap. '#' starts a comment:
+//
+//     max_overlap 358
+//     overlap 1386.7545166 -136.1621093 ...
+//     wrapped 1.1125613 558.6079711 ...
+//     two_down -0.0297553 -9.2836914 ...
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_coefficients.h"
+
+#define COEFFICIENTS_PACKET_SIZE 32
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*coefficients_transfer_t)(uint8_t* packet, void* context);
+
+void get_default_coefficients(heuristic_tap_hold_coefficients_t* set);
+
+// Every line must be there. Values are checked like the firmware does.
+bool load_coefficient_file(const char* path, heuristic_tap_hold_coefficients_t* set);
+bool save_coefficient_file(const char* path, const heuristic_tap_hold_coefficients_t* set);
+void print_coefficients(FILE* file, const heuristic_tap_hold_coefficients_t* set);
+
+// e.g. "wrapped c3" or "max_overlap" for an index of the apply response
+void get_coefficient_name(uint8_t index, char* name, size_t size);
+
+// The set the keyboard uses right now.
+bool read_coefficients(coefficients_transfer_t transfer, void* context, heuristic_tap_hold_coefficients_t* set);
+
+// Replaces the set of the keyboard and saves it to the EEPROM, if
+// should_save. The keyboard rejects the whole set, if a value is invalid.
+bool write_coefficients(coefficients_transfer_t transfer, void* context, const heuristic_tap_hold_coefficients_t* set,
+                        bool should_save);
+
+// Goes back to the compiled in defaults.
+bool reset_coefficients(coefficients_transfer_t transfer, void* context, bool should_save);
@@ -0,0 +1,286 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus.h"
+
+static const size_t column_sizes[CORPUS_COLUMN_COUNT] = {
+    [CORPUS_DELTAS] = sizeof(uint32_t),
+    [CORPUS_POSITIONS] = sizeof(uint8_t),
+    [CORPUS_FLAGS] = sizeof(uint8_t),
+    [CORPUS_LABELS] = sizeof(uint8_t),
+    [CORPUS_KEYCODES] = sizeof(uint16_t),
+};
+
+
+static void set_columns(corpus_t* corpus, void* const columns[CORPUS_COLUMN_COUNT]) {
+    corpus->deltas = columns[CORPUS_DELTAS];
+    corpus->positions = columns[CORPUS_POSITIONS];
+    corpus->flags = columns[CORPUS_FLAGS];
+    corpus->labels = columns[CORPUS_LABELS];
+    corpus->keycodes = columns[CORPUS_KEYCODES];
+}
+
+
+// stream files
+//=============================================================================
+static bool load_stream(corpus_t* corpus, FILE* file, const char* path) {
+    size_t capacity = 0;
+    uint64_t prev_time = 0;
+    char line[256];
+    unsigned line_number = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ++line_number;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        unsigned long long time;
+        unsigned long row, col;
+        long keycode;
+        char state, label = '-';
+        const int fields = sscanf(line, "%llu %lu %lu %li %c %c", &time, &row, &col, &keycode, &state, &label);
+        if (fields <= 0) continue;
+
+        if (fields < 5 || row >= 16 || col >= 16 || keycode < 0 || keycode > 0xFFFF ||
+                (state != 'd' && state != 'u') || (fields == 6 && label != 't' && label != 'h') ||
+                time < prev_time || time - prev_time > UINT32_MAX) {
+            fprintf(stderr, "%s:%u: invalid event\n", path, line_number);
+            return false;
+        }
+
+        if (corpus->event_count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            for (int c = 0; c < CORPUS_COLUMN_COUNT; ++c) {
+                corpus->owned[c] = realloc(corpus->owned[c], capacity * column_sizes[c]);
+                if (corpus->owned[c] == NULL) {
+                    fprintf(stderr, "out of memory\n");
+                    return false;
+                }
+            }
+        }
+
+        const uint64_t i = corpus->event_count++;
+        ((uint32_t*) corpus->owned[CORPUS_DELTAS])[i] = (uint32_t) (time - prev_time);
+        ((uint8_t*) corpus->owned[CORPUS_POSITIONS])[i] = CORPUS_POSITION(row, col);
+        ((uint8_t*) corpus->owned[CORPUS_FLAGS])[i] = state == 'd' ? CORPUS_FLAG_PRESSED : 0;
+        ((uint8_t*) corpus->owned[CORPUS_LABELS])[i] =
+                label == 't' ? CORPUS_LABEL_TAP : (label == 'h' ? CORPUS_LABEL_HOLD : CORPUS_LABEL_NONE);
+        ((uint16_t*) corpus->owned[CORPUS_KEYCODES])[i] = (uint16_t) keycode;
+        prev_time = time;
+    }
+
+    set_columns(corpus, corpus->owned);
+    return true;
+}
+
+
+void corpus_print_stream(FILE* file, const corpus_t* corpus) {
+    static const char label_chars[] = {[CORPUS_LABEL_TAP] = 't', [CORPUS_LABEL_HOLD] = 'h'};
+
+    uint64_t time = 0;
+    for (uint64_t i = 0; i < corpus->event_count; ++i) {
+        time += corpus->deltas[i];
+        fprintf(file, "%llu %u %u 0x%04X %c", (unsigned long long) time, CORPUS_ROW(corpus->positions[i]),
+                CORPUS_COL(corpus->positions[i]), corpus->keycodes[i],
+                (corpus->flags[i] & CORPUS_FLAG_PRESSED) ? 'd' : 'u');
+
+        const uint8_t label = corpus->labels[i];
+        if (label == CORPUS_LABEL_TAP || label == CORPUS_LABEL_HOLD) fprintf(file, " %c", label_chars[label]);
+        fprintf(file, "\n");
+    }
+}
+
+
+// corpus files
+//=============================================================================
+static bool map_corpus(corpus_t* corpus, int fd, const char* path) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror(path);
+        return false;
+    }
+    const size_t size = (size_t) info.st_size;
+    if (size < sizeof(corpus_header_t)) {
+        fprintf(stderr, "%s: truncated corpus header\n", path);
+        return false;
+    }
+
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    corpus->mapping = mapping;
+    corpus->mapping_size = size;
+
+    const corpus_header_t* header = mapping;
+    if (header->version != CORPUS_VERSION || header->header_size != sizeof(corpus_header_t)) {
+        fprintf(stderr, "%s: unsupported corpus version %u\n", path, header->version);
+        return false;
+    }
+
+    void* columns[CORPUS_COLUMN_COUNT];
+    for (int c = 0; c < CORPUS_COLUMN_COUNT; ++c) {
+        const uint64_t offset = header->column_offsets[c];
+        if (offset % CORPUS_ALIGNMENT != 0 || offset > size ||
+                header->event_count > (size - offset) / column_sizes[c]) {
+            fprintf(stderr, "%s: column %d is out of bounds\n", path, c);
+            return false;
+        }
+        columns[c] = (uint8_t*) mapping + offset;
+    }
+
+    corpus->event_count = header->event_count;
+    set_columns(corpus, columns);
+
+    // most tools scan the columns front to back
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    return true;
+}
+
+
+bool corpus_open(corpus_t* corpus, const char* path) {
+    memset(corpus, 0, sizeof(*corpus));
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char magic[sizeof(((corpus_header_t*) 0)->magic)] = {0};
+    const bool is_corpus = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                           memcmp(magic, CORPUS_MAGIC, sizeof(magic)) == 0;
+
+    bool is_ok;
+    if (is_corpus) {
+        is_ok = map_corpus(corpus, fileno(file), path);
+    } else {
+        rewind(file);
+        is_ok = load_stream(corpus, file, path);
+    }
+
+    fclose(file);
+    if (!is_ok) corpus_close(corpus);
+    return is_ok;
+}
+
+
+void corpus_close(corpus_t* corpus) {
+    if (corpus->mapping != NULL) munmap(corpus->mapping, corpus->mapping_size);
+    for (int c = 0; c < CORPUS_COLUMN_COUNT; ++c) {
+        free(corpus->owned[c]);
+    }
+    memset(corpus, 0, sizeof(*corpus));
+}
+
+
+// writer
+//=============================================================================
+bool corpus_writer_open(corpus_writer_t* writer, const char* path) {
+    memset(writer, 0, sizeof(*writer));
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    for (int c = 0; c < CORPUS_COLUMN_COUNT; ++c) {
+        writer->columns[c] = tmpfile();
+        if (writer->columns[c] == NULL) {
+            perror("tmpfile");
+            corpus_writer_close(writer);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool corpus_writer_add(corpus_writer_t* writer, uint64_t time, uint8_t position, bool pressed, uint8_t label,
+                       uint16_t keycode) {
+    if (time < writer->prev_time || time - writer->prev_time > UINT32_MAX) {
+        fprintf(stderr, "event %llu: time %llu is out of order\n", (unsigned long long) writer->event_count,
+                (unsigned long long) time);
+        return false;
+    }
+
+    const uint32_t delta = (uint32_t) (time - writer->prev_time);
+    const uint8_t flags = pressed ? CORPUS_FLAG_PRESSED : 0;
+
+    const void* values[CORPUS_COLUMN_COUNT] = {
+        [CORPUS_DELTAS] = &delta,
+        [CORPUS_POSITIONS] = &position,
+        [CORPUS_FLAGS] = &flags,
+        [CORPUS_LABELS] = &label,
+        [CORPUS_KEYCODES] = &keycode,
+    };
+    for (int c = 0; c < CORPUS_COLUMN_COUNT; ++c) {
+        if (fwrite(values[c], column_sizes[c], 1, writer->columns[c]) != 1) {
+            perror("corpus column");
+            return false;
+        }
+    }
+
+    writer->prev_time = time;
+    writer->event_count++;
+    return true;
+}
+
+
+static bool write_padding(FILE* file) {
+    static const uint8_t zeros[CORPUS_ALIGNMENT];
+    const long position = ftell(file);
+    const size_t padding = (CORPUS_ALIGNMENT - (size_t) position % CORPUS_ALIGNMENT) % CORPUS_ALIGNMENT;
+    return position >= 0 && fwrite(zeros, 1, padding, file) == padding;
+}
+
+
+static bool copy_column(FILE* to, FILE* from) {
+    rewind(from);
+
+    char buffer[1 << 16];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), from)) > 0) {
+        if (fwrite(buffer, 1, size, to) != size) return false;
+    }
+    return !ferror(from);
+}
+
+
+bool corpus_writer_close(corpus_writer_t* writer) {
+    bool is_ok = writer->file != NULL;
+
+    corpus_header_t header = {
+        .version = CORPUS_VERSION,
+        .header_size = sizeof(corpus_header_t),
+        .event_count = writer->event_count,
+    };
+    memcpy(header.magic, CORPUS_MAGIC, sizeof(header.magic));
+
+    // the header is written again once the offsets are known
+    is_ok = is_ok && fwrite(&header, sizeof(header), 1, writer->file) == 1;
+    for (int c = 0; c < CORPUS_COLUMN_COUNT && is_ok; ++c) {
+        is_ok = write_padding(writer->file) && writer->columns[c] != NULL;
+        header.column_offsets[c] = (uint64_t) ftell(writer->file);
+        is_ok = is_ok && copy_column(writer->file, writer->columns[c]);
+    }
+    is_ok = is_ok && fseek(writer->file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, writer->file) == 1;
+
+    for (int c = 0; c < CORPUS_COLUMN_COUNT; ++c) {
+        if (writer->columns[c] != NULL) fclose(writer->columns[c]);
+    }
+    if (writer->file != NULL && fclose(writer->file) != 0) is_ok = false;
+    if (!is_ok) perror("corpus");
+
+    memset(writer, 0, sizeof(*writer));
+    return is_ok;
+}
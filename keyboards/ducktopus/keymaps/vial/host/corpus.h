@@ -0,0 +1,105 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// A binary, columnar key event corpus, so large data sets can be replayed and
+// evaluated without parsing text. Every column is one contiguous array, so a
+// tool that only needs some of them only touches those.
+//
+// File layout (little endian):
+//
+//     corpus_header_t
+//     deltas     uint32_t per event  ms since the previous event (the first
+//                                    one is the time of the first event)
+//     positions  uint8_t per event   row << 4 | col
+//     flags      uint8_t per event   CORPUS_FLAG_*
+//     labels     uint8_t per event   CORPUS_LABEL_* (what a tap hold press
+//                                    was meant to be, if known)
+//     keycodes   uint16_t per event  keycode at that position (0 if unknown)
+//
+// Each column starts at the offset given in the header, which is a multiple
+// of CORPUS_ALIGNMENT.
+//
+// Stream files (the text format of build/replay) can be used wherever a corpus
+// is read. Their lines are
+//
+//     <time_ms> <row> <col> <keycode> <d|u> [t|h]
+//
+// where the optional last field is the label.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CORPUS_MAGIC     "HTHCORP\0"
+#define CORPUS_VERSION   1
+#define CORPUS_ALIGNMENT 64
+
+enum {
+    CORPUS_FLAG_PRESSED = 1 << 0,
+};
+
+enum {
+    CORPUS_LABEL_NONE = 0,
+    CORPUS_LABEL_TAP = 1,
+    CORPUS_LABEL_HOLD = 2,
+};
+
+typedef enum {
+    CORPUS_DELTAS,
+    CORPUS_POSITIONS,
+    CORPUS_FLAGS,
+    CORPUS_LABELS,
+    CORPUS_KEYCODES,
+    CORPUS_COLUMN_COUNT
+} corpus_column_t;
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t event_count;
+    uint64_t column_offsets[CORPUS_COLUMN_COUNT];
+} corpus_header_t;
+
+// The columns of a corpus that was opened (memory mapped) or loaded.
+typedef struct {
+    uint64_t        event_count;
+    const uint32_t* deltas;
+    const uint8_t*  positions;
+    const uint8_t*  flags;
+    const uint8_t*  labels;
+    const uint16_t* keycodes;
+
+    // how the columns are owned
+    void*  mapping;
+    size_t mapping_size;
+    void*  owned[CORPUS_COLUMN_COUNT];
+} corpus_t;
+
+#define CORPUS_POSITION(row, col) ((uint8_t) ((row) << 4 | (col)))
+#define CORPUS_ROW(position)      ((position) >> 4)
+#define CORPUS_COL(position)      ((position) & 0xF)
+
+// Opens a corpus file (memory mapped, nothing is copied) or loads a stream
+// file. Returns false (after printing why) on error.
+bool corpus_open(corpus_t* corpus, const char* path);
+void corpus_close(corpus_t* corpus);
+
+// Writes events one at a time, with bounded memory (the columns are spooled to
+// temporary files until corpus_writer_close puts them together).
+typedef struct {
+    FILE*    file;
+    FILE*    columns[CORPUS_COLUMN_COUNT];
+    uint64_t event_count;
+    uint64_t prev_time;
+} corpus_writer_t;
+
+bool corpus_writer_open(corpus_writer_t* writer, const char* path);
+// Times must not decrease.
+bool corpus_writer_add(corpus_writer_t* writer, uint64_t time, uint8_t position, bool pressed, uint8_t label,
+                       uint16_t keycode);
+bool corpus_writer_close(corpus_writer_t* writer);
+
+// Writes the corpus as a stream file.
+void corpus_print_stream(FILE* file, const corpus_t* corpus);
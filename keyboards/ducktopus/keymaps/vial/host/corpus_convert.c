@@ -0,0 +1,82 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Converts stream files (e.g. from hid_capture) into a corpus and back.
+//
+//     corpus_convert typing.txt more.txt typing.corpus    concatenate into a corpus
+//     corpus_convert -d typing.corpus > typing.txt        dump a corpus as a stream
+//
+// Every input continues one second after the previous one ended, like the
+// repetitions of build/replay.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+
+#define MS_BETWEEN_INPUTS 1000
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s INPUT... OUTPUT\n"
+            "       %s -d CORPUS\n"
+            "  -d  write the corpus (or stream) to stdout as a stream file\n",
+            name, name);
+    exit(2);
+}
+
+
+static bool add_input(corpus_writer_t* writer, const char* path, uint64_t* time) {
+    corpus_t corpus;
+    if (!corpus_open(&corpus, path)) return false;
+
+    const uint64_t offset = writer->event_count > 0 ? *time + MS_BETWEEN_INPUTS : 0;
+    uint64_t input_time = 0;
+    bool is_ok = true;
+
+    for (uint64_t i = 0; i < corpus.event_count && is_ok; ++i) {
+        input_time += corpus.deltas[i];
+        *time = offset + input_time;
+        is_ok = corpus_writer_add(writer, *time, corpus.positions[i], corpus.flags[i] & CORPUS_FLAG_PRESSED,
+                                  corpus.labels[i], corpus.keycodes[i]);
+    }
+
+    fprintf(stderr, "%s: %llu events\n", path, (unsigned long long) corpus.event_count);
+    corpus_close(&corpus);
+    return is_ok;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "-d") == 0) {
+        corpus_t corpus;
+        if (!corpus_open(&corpus, argv[2])) return 1;
+        corpus_print_stream(stdout, &corpus);
+        corpus_close(&corpus);
+        return 0;
+    }
+
+    if (argc < 3) usage(argv[0]);
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-') usage(argv[0]);
+    }
+
+    corpus_writer_t writer;
+    if (!corpus_writer_open(&writer, argv[argc - 1])) return 1;
+
+    uint64_t time = 0;
+    bool is_ok = true;
+    for (int i = 1; i < argc - 1 && is_ok; ++i) {
+        is_ok = add_input(&writer, argv[i], &time);
+    }
+
+    const uint64_t event_count = writer.event_count;
+    is_ok = corpus_writer_close(&writer) && is_ok;
+    if (!is_ok) {
+        remove(argv[argc - 1]);
+        return 1;
+    }
+
+    fprintf(stderr, "%s: %llu events\n", argv[argc - 1], (unsigned long long) event_count);
+    return 0;
+}
@@ -0,0 +1,253 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Checks the keycodes resolved for the active layers
+// (features/effective_keymap.h) against the layer lookup of the simulated
+// core, while random layer changes and VIA commands change what they should
+// be, and measures how much faster a lookup in them is.
+//
+//     effective_keymap verify    random layer changes and VIA writes
+//     effective_keymap bench     ns per lookup and per layer change
+//
+// The lookup of the simulated core only reads the keymap on each layer that is
+// on, from the top until it isn't transparent. QMK also converts each keycode
+// into an action on the way (layer_switch_get_layer), which isn't timed here.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dynamic_keymap.h"
+#include "keymap_host.h"
+#include "sim.h"
+#include "via.h"
+#include "features/effective_keymap.h"
+
+#define VERIFY_CHANGES   100000
+#define BENCH_LOOKUPS    (1 << 21)
+#define BENCH_UPDATES    (1 << 16)
+#define BENCH_ROUNDS     5
+#define VIA_PACKET_SIZE  32
+#define KEYMAP_SIZE      (DYNAMIC_KEYMAP_LAYER_COUNT * MATRIX_ROWS * MATRIX_COLS * 2)
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s verify|bench\n", name);
+    exit(2);
+}
+
+
+static double now_in_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, so every run is the same
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+static uint16_t look_up_by_layers(uint8_t row, uint8_t col) {
+    return dynamic_keymap_get_keycode(sim_get_active_layer(row, col), row, col);
+}
+
+
+static uint64_t count_mismatches(void) {
+    uint64_t mismatches = 0;
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            mismatches += get_effective_layer(row, col) != sim_get_active_layer(row, col) ||
+                          get_effective_keycode(row, col) != look_up_by_layers(row, col);
+        }
+    }
+    return mismatches;
+}
+
+
+// a random VIA command that changes the keymap, with many transparent keys
+static void send_random_keymap_command(uint32_t* state) {
+    uint8_t data[VIA_PACKET_SIZE] = {0};
+    const uint32_t kind = next_random(state) % 100;
+
+    if (kind < 70) {
+        const uint16_t keycode = next_random(state) % 2 ? KC_TRNS : (uint16_t) next_random(state);
+        data[0] = id_dynamic_keymap_set_keycode;
+        data[1] = (uint8_t) (next_random(state) % DYNAMIC_KEYMAP_LAYER_COUNT);
+        data[2] = (uint8_t) (next_random(state) % MATRIX_ROWS);
+        data[3] = (uint8_t) (next_random(state) % MATRIX_COLS);
+        data[4] = (uint8_t) (keycode >> 8);
+        data[5] = (uint8_t) keycode;
+    } else if (kind < 95) {
+        // whole keycodes, some of them transparent
+        const uint16_t offset = (uint16_t) (next_random(state) % (KEYMAP_SIZE / 2) * 2);
+        data[0] = id_dynamic_keymap_set_buffer;
+        data[1] = (uint8_t) (offset >> 8);
+        data[2] = (uint8_t) offset;
+        data[3] = (uint8_t) (next_random(state) % 15 * 2);
+        for (uint8_t b = 0; b < data[3]; b += 2) {
+            const uint16_t keycode = next_random(state) % 2 ? KC_TRNS : (uint16_t) next_random(state);
+            data[4 + b] = (uint8_t) (keycode >> 8);
+            data[5 + b] = (uint8_t) keycode;
+        }
+    } else {
+        data[0] = next_random(state) % 2 ? id_dynamic_keymap_reset : id_eeprom_reset;
+    }
+    sim_receive_via_command(data, VIA_PACKET_SIZE);
+}
+
+
+static int verify(void) {
+    uint32_t state = 0x12345678;
+    uint64_t mismatches = count_mismatches();
+    uint64_t counts[3] = {0};
+
+    for (uint32_t i = 0; i < VERIFY_CHANGES; ++i) {
+        const uint32_t kind = next_random(&state) % 100;
+        const uint8_t layer = (uint8_t) (next_random(&state) % DYNAMIC_KEYMAP_LAYER_COUNT);
+
+        // through layer_state_set_user of keymap.c, so with its tri layer and
+        // mod layers
+        if (kind < 40) {
+            layer_on(layer);
+            counts[0]++;
+        } else if (kind < 80) {
+            layer_off(layer);
+            counts[0]++;
+        } else if (kind < 85) {
+            default_layer_set((layer_state_t) 1 << layer);
+            counts[1]++;
+        } else {
+            send_random_keymap_command(&state);
+            counts[2]++;
+        }
+        mismatches += count_mismatches();
+    }
+
+    printf("%llu layer changes, %llu default layer changes and %llu keymap commands: %llu mismatches\n",
+           (unsigned long long) counts[0], (unsigned long long) counts[1], (unsigned long long) counts[2],
+           (unsigned long long) mismatches);
+    return mismatches > 0 ? 1 : 0;
+}
+
+
+typedef uint16_t (*lookup_t)(uint8_t row, uint8_t col);
+
+// what the loop costs without a lookup
+static uint16_t look_up_nothing(uint8_t row, uint8_t col) {
+    return (uint16_t) (row + col);
+}
+
+
+// the fastest of a few rounds, in ns per lookup
+static double bench_lookup(lookup_t lookup, const uint8_t* positions, uint32_t* checksum) {
+    double best = 0.0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        uint32_t sum = 0;
+        const double start = now_in_seconds();
+        for (uint32_t i = 0; i < BENCH_LOOKUPS; ++i) {
+            const uint8_t position = positions[i & 0xFFFF];
+            sum += lookup(position >> 4, position & 0xF);
+        }
+        const double ns = (now_in_seconds() - start) / BENCH_LOOKUPS * 1e9;
+        if (round == 0 || ns < best) best = ns;
+        *checksum = sum;
+    }
+    return best;
+}
+
+
+// switching to the state and back, in ns per update
+static double bench_update(layer_state_t base, layer_state_t state) {
+    double best = 0.0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        const double start = now_in_seconds();
+        for (uint32_t i = 0; i < BENCH_UPDATES; ++i) {
+            update_effective_keymap(state);
+            update_effective_keymap(base);
+        }
+        const double ns = (now_in_seconds() - start) / (2 * BENCH_UPDATES) * 1e9;
+        if (round == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+
+static void print_layers(layer_state_t state) {
+    char names[64] = "";
+    for (uint8_t layer = 0; layer < DYNAMIC_KEYMAP_LAYER_COUNT; ++layer) {
+        if (!(state & ((layer_state_t) 1 << layer))) continue;
+        if (names[0] != '\0') strcat(names, " ");
+        strcat(names, keymap_host_get_layer_name(layer));
+    }
+    printf("%-32s", names);
+}
+
+
+static int bench(void) {
+    // row << 4 | col
+    static uint8_t positions[1 << 16];
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < sizeof(positions); ++i) {
+        const uint8_t row = (uint8_t) (next_random(&state) % MATRIX_ROWS);
+        const uint8_t col = (uint8_t) (next_random(&state) % MATRIX_COLS);
+        positions[i] = (uint8_t) (row << 4 | col);
+    }
+
+    printf("%-32s %8s %9s %10s\n", "layers on", "walk ns", "table ns", "update ns");
+    int result = 0;
+
+    // the default layer alone, then each layer on top of it like MO would,
+    // then all of them (keymap.c turns some of them off again, e.g. ADJU
+    // without SYMB and FUNC, so those are skipped)
+    const layer_state_t base = default_layer_state;
+    for (int8_t layer = -1; layer <= DYNAMIC_KEYMAP_LAYER_COUNT; ++layer) {
+        layer_state_t layers = 0;
+        if (layer == DYNAMIC_KEYMAP_LAYER_COUNT) {
+            layers = (layer_state_t) ((1u << DYNAMIC_KEYMAP_LAYER_COUNT) - 1);
+        } else if (layer >= 0) {
+            layers = (layer_state_t) 1 << layer;
+        }
+        layer_state_set(layers);
+        if (layer >= 0 && (layer_state & ~base) == 0) continue;
+
+        // again for every state, as the clock speed of the CPU may change
+        uint32_t loop_checksum = 0, walk_checksum = 0, table_checksum = 0;
+        const double loop_ns = bench_lookup(look_up_nothing, positions, &loop_checksum);
+        const double walk_ns = bench_lookup(look_up_by_layers, positions, &walk_checksum) - loop_ns;
+        const double table_ns = bench_lookup(get_effective_keycode, positions, &table_checksum) - loop_ns;
+        const double update_ns = bench_update(base | layer_state, base);
+        // the updates left it resolved for base
+        update_effective_keymap(base | layer_state);
+
+        print_layers(base | layer_state);
+        printf(" %8.2f %9.2f %10.1f\n", walk_ns, table_ns, update_ns);
+        if (walk_checksum != table_checksum) {
+            printf("  the lookups differ!\n");
+            result = 1;
+        }
+    }
+    layer_state_set(0);
+
+    printf("(without what the benchmark loop takes per lookup, an update is from the\n"
+           " layers on to the default layer or back)\n");
+    printf("RAM: %u bytes\n", (unsigned) (MATRIX_ROWS * MATRIX_COLS * 3));
+    return result;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc != 2) usage(argv[0]);
+
+    sim_init(false);
+    keymap_host_init();
+
+    if (strcmp(argv[1], "verify") == 0) return verify();
+    if (strcmp(argv[1], "bench") == 0) return bench();
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,284 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Scores the heuristics on labeled corpora (see samples.h) with the batch
+// evaluator, and checks that its kernels decide exactly like the float
+// reference.
+//
+//     evaluate [-k KERNEL] [-c FILE] CORPUS...
+//                                       accuracy, like in features/README.md, of
+//                                       the defaults or a coefficient file
+//     evaluate verify                   every kernel against the reference
+//     evaluate bench                    samples per second of every kernel
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coefficients.h"
+#include "samples.h"
+#include "features/heuristic_tap_hold_kernels.h"
+
+#define BENCH_SAMPLE_COUNT (1 << 22)
+#define BENCH_ROUNDS       10
+
+// p values per batch while verifying, to bound the memory used
+#define VERIFY_P_BATCH 2048
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-k scalar|sse|avx2] [-c COEFFICIENTS] CORPUS...\n"
+            "       %s verify|bench\n",
+            name, name);
+    exit(2);
+}
+
+
+static double now_in_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+static bool is_same_accuracy(const accuracy_t* a, const accuracy_t* b) {
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+
+// verify
+//=============================================================================
+// The samples are labeled with the decision of the reference, so each kernel
+// must be 100 % correct.
+typedef struct {
+    const char* form;
+    uint64_t sample_count;
+    uint64_t mismatches[EVALUATOR_KERNEL_COUNT];
+} verify_result_t;
+
+
+static void check_batch(verify_result_t* result, sample_set_t* samples, int form) {
+    for (evaluator_kernel_t kernel = EVALUATOR_SCALAR; kernel < EVALUATOR_KERNEL_COUNT; ++kernel) {
+        if (!is_evaluator_kernel_supported(kernel)) continue;
+
+        accuracy_t accuracy;
+        if (form == 0) {
+            accuracy = evaluate_overlap(kernel, &default_overlap_coefficients, samples);
+        } else if (form == 1) {
+            accuracy = evaluate_wrapped(kernel, &default_wrapped_coefficients, samples);
+        } else {
+            accuracy = evaluate_two_down(kernel, &default_two_down_coefficients, samples);
+        }
+        result->mismatches[kernel] += accuracy.mod_count - accuracy.mod_correct;
+        result->mismatches[kernel] += accuracy.non_mod_count - accuracy.non_mod_correct;
+    }
+    result->sample_count += samples->count;
+    sample_set_clear(samples);
+}
+
+
+static void print_verify_result(const verify_result_t* result) {
+    printf("%-9s %11llu samples,", result->form, (unsigned long long) result->sample_count);
+    for (evaluator_kernel_t kernel = EVALUATOR_SCALAR; kernel < EVALUATOR_KERNEL_COUNT; ++kernel) {
+        if (is_evaluator_kernel_supported(kernel)) {
+            printf(" %s: %llu", evaluator_kernel_names[kernel], (unsigned long long) result->mismatches[kernel]);
+        }
+    }
+    printf(" mismatches\n");
+}
+
+
+static bool has_mismatches(const verify_result_t* result) {
+    for (evaluator_kernel_t kernel = EVALUATOR_SCALAR; kernel < EVALUATOR_KERNEL_COUNT; ++kernel) {
+        if (result->mismatches[kernel] > 0) return true;
+    }
+    return false;
+}
+
+
+static int verify(void) {
+    sample_set_t samples = {0};
+    verify_result_t overlap = {.form = "overlap"};
+    verify_result_t wrapped = {.form = "wrapped"};
+    verify_result_t two_down = {.form = "two down"};
+
+    // Every input of the overlap and two down heuristics. The wrapped one has
+    // too many (the fixed point check in host/kernels takes minutes), so only
+    // some next_dur values, which include those of its rounding exceptions.
+    static const uint16_t next_durs[] = {0, 1, 10, 37, 120, MS_MAX_OVERLAP};
+
+    for (int32_t p_start = -MS_MAX_DUR; p_start <= MS_MAX_DUR; p_start += VERIFY_P_BATCH) {
+        const int32_t p_end = MIN(MS_MAX_DUR + 1, p_start + VERIFY_P_BATCH);
+
+        for (int32_t p = p_start; p < p_end; ++p) {
+            for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+                // the estimate is the longest overlap that is still a tap
+                const uint16_t estimate = estimate_min_overlap_for_hold_in_ms_float(p, t);
+                sample_set_add(&samples, p, t, estimate, false);
+                sample_set_add(&samples, p, t, estimate + 1, true);
+            }
+        }
+        check_batch(&overlap, &samples, 0);
+
+        for (int32_t p = p_start; p < p_end; ++p) {
+            for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+                for (size_t n = 0; n < sizeof(next_durs) / sizeof(next_durs[0]); ++n) {
+                    sample_set_add(&samples, p, t, next_durs[n], estimate_hold_when_wrapped_float(p, t, next_durs[n]));
+                }
+            }
+        }
+        check_batch(&wrapped, &samples, 1);
+
+        for (int32_t p = p_start; p < p_end; ++p) {
+            for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+                for (int m = 0; m <= 1; ++m) {
+                    sample_set_add(&samples, p, t, m, estimate_hold_when_two_down_float(p, t, m));
+                }
+            }
+        }
+        check_batch(&two_down, &samples, 2);
+    }
+    sample_set_free(&samples);
+
+    print_verify_result(&overlap);
+    print_verify_result(&wrapped);
+    print_verify_result(&two_down);
+    return (has_mismatches(&overlap) || has_mismatches(&wrapped) || has_mismatches(&two_down)) ? 1 : 0;
+}
+
+
+// bench
+//=============================================================================
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, so every run uses the same samples
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+// the same distribution as host/kernels, with random labels
+static void fill_samples(sample_set_t* samples, uint16_t max_extra) {
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < BENCH_SAMPLE_COUNT; ++i) {
+        const uint32_t r = next_random(&state);
+        const int32_t gap = (r & 7) == 0 ? (int32_t) (r >> 16) % MS_MAX_DUR : (int32_t) (r >> 16) % 600 - MS_MAX_OVERLAP;
+        const uint16_t t = (uint16_t) (next_random(&state) % (MS_MAX_OVERLAP + 1));
+        const uint16_t extra = (uint16_t) (next_random(&state) % (max_extra + 1));
+        sample_set_add(samples, (int16_t) gap, t, extra, next_random(&state) & 1);
+    }
+}
+
+
+#define BENCH(form, coefficients, samples) \
+    do { \
+        accuracy_t _first = {0}; \
+        for (evaluator_kernel_t _kernel = EVALUATOR_SCALAR; _kernel < EVALUATOR_KERNEL_COUNT; ++_kernel) { \
+            if (!is_evaluator_kernel_supported(_kernel)) continue; \
+            accuracy_t _accuracy = {0}; \
+            const double _start = now_in_seconds(); \
+            for (int _round = 0; _round < BENCH_ROUNDS; ++_round) { \
+                _accuracy = evaluate_##form(_kernel, coefficients, samples); \
+            } \
+            const double _seconds = now_in_seconds() - _start; \
+            printf("%-9s %-7s %8.1f M samples/sec\n", #form, evaluator_kernel_names[_kernel], \
+                   (double) (samples)->count * BENCH_ROUNDS / _seconds * 1e-6); \
+            if (_kernel == EVALUATOR_SCALAR) { \
+                _first = _accuracy; \
+            } else if (!is_same_accuracy(&_first, &_accuracy)) { \
+                printf("  differs from scalar!\n"); \
+                is_ok = false; \
+            } \
+        } \
+    } while (0)
+
+
+static int bench(void) {
+    bool is_ok = true;
+    sample_set_t samples = {0};
+
+    fill_samples(&samples, MS_MAX_OVERLAP);
+    BENCH(overlap, &default_overlap_coefficients, &samples);
+    BENCH(wrapped, &default_wrapped_coefficients, &samples);
+
+    sample_set_clear(&samples);
+    fill_samples(&samples, 1);
+    BENCH(two_down, &default_two_down_coefficients, &samples);
+
+    sample_set_free(&samples);
+    return is_ok ? 0 : 1;
+}
+
+
+// corpora
+//=============================================================================
+static int score(evaluator_kernel_t kernel, const heuristic_tap_hold_coefficients_t* set, char** paths,
+                 int path_count) {
+    overlap_coefficients_t overlap_coefficients;
+    wrapped_coefficients_t wrapped_coefficients;
+    two_down_coefficients_t two_down_coefficients;
+    memcpy(overlap_coefficients.c, set->overlap, sizeof(overlap_coefficients.c));
+    memcpy(wrapped_coefficients.c, set->wrapped, sizeof(wrapped_coefficients.c));
+    memcpy(two_down_coefficients.c, set->two_down, sizeof(two_down_coefficients.c));
+
+    heuristic_samples_t samples = {0};
+
+    for (int i = 0; i < path_count; ++i) {
+        corpus_t corpus;
+        if (!corpus_open(&corpus, paths[i])) return 1;
+        add_corpus_samples(&samples, &corpus);
+        corpus_close(&corpus);
+    }
+
+    const double start = now_in_seconds();
+    const accuracy_t overlap = evaluate_overlap(kernel, &overlap_coefficients, &samples.overlap);
+    const accuracy_t wrapped = evaluate_wrapped(kernel, &wrapped_coefficients, &samples.wrapped);
+    const accuracy_t two_down = evaluate_two_down(kernel, &two_down_coefficients, &samples.two_down);
+    const double seconds = now_in_seconds() - start;
+
+    print_accuracy(stdout, "**overlap function**", &overlap);
+    printf("\n");
+    print_accuracy(stdout, "**wrap function**", &wrapped);
+    printf("\n");
+    print_accuracy(stdout, "**triple down function**", &two_down);
+
+    const size_t count = samples.overlap.count + samples.wrapped.count + samples.two_down.count;
+    fprintf(stderr, "\n%zu samples in %.3f ms (%s)\n", count, seconds * 1e3, evaluator_kernel_names[kernel]);
+
+    free_heuristic_samples(&samples);
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc == 2 && strcmp(argv[1], "verify") == 0) return verify();
+    if (argc == 2 && strcmp(argv[1], "bench") == 0) return bench();
+
+    evaluator_kernel_t kernel = get_best_evaluator_kernel();
+    heuristic_tap_hold_coefficients_t set;
+    get_default_coefficients(&set);
+    int first_path = 1;
+
+    for (; first_path + 1 < argc && argv[first_path][0] == '-'; first_path += 2) {
+        const char* value = argv[first_path + 1];
+        if (strcmp(argv[first_path], "-k") == 0) {
+            kernel = EVALUATOR_KERNEL_COUNT;
+            for (evaluator_kernel_t k = EVALUATOR_SCALAR; k < EVALUATOR_KERNEL_COUNT; ++k) {
+                if (strcmp(value, evaluator_kernel_names[k]) == 0) kernel = k;
+            }
+            if (kernel == EVALUATOR_KERNEL_COUNT) usage(argv[0]);
+            if (!is_evaluator_kernel_supported(kernel)) {
+                fprintf(stderr, "%s is not supported here\n", value);
+                return 1;
+            }
+        } else if (strcmp(argv[first_path], "-c") == 0) {
+            if (!load_coefficient_file(value, &set)) return 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (first_path >= argc || argv[first_path][0] == '-') usage(argv[0]);
+    return score(kernel, &set, argv + first_path, argc - first_path);
+}
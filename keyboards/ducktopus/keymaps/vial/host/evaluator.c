@@ -0,0 +1,292 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "evaluator.h"
+#include "features/heuristic_tap_hold_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    include <immintrin.h>
+#    define HAS_X86_KERNELS
+#endif
+
+const overlap_coefficients_t default_overlap_coefficients = {DEFAULT_OVERLAP_COEFFICIENTS};
+const wrapped_coefficients_t default_wrapped_coefficients = {DEFAULT_WRAPPED_COEFFICIENTS};
+const two_down_coefficients_t default_two_down_coefficients = {DEFAULT_TWO_DOWN_COEFFICIENTS};
+
+const char* const evaluator_kernel_names[EVALUATOR_KERNEL_COUNT] = {
+    [EVALUATOR_SCALAR] = "scalar",
+    [EVALUATOR_SSE] = "sse",
+    [EVALUATOR_AVX2] = "avx2",
+};
+
+
+// samples
+//=============================================================================
+void sample_set_add(sample_set_t* set, int16_t p, uint16_t t, uint16_t extra, bool is_hold) {
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 4096;
+        set->p = realloc(set->p, set->capacity * sizeof(*set->p));
+        set->t = realloc(set->t, set->capacity * sizeof(*set->t));
+        set->extra = realloc(set->extra, set->capacity * sizeof(*set->extra));
+        set->is_hold = realloc(set->is_hold, set->capacity * sizeof(*set->is_hold));
+        if (set->p == NULL || set->t == NULL || set->extra == NULL || set->is_hold == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    set->p[set->count] = (float) p;
+    set->t[set->count] = (float) t;
+    set->extra[set->count] = (float) extra;
+    set->is_hold[set->count] = is_hold;
+    set->count++;
+}
+
+
+void sample_set_clear(sample_set_t* set) {
+    set->count = 0;
+}
+
+
+void sample_set_free(sample_set_t* set) {
+    free(set->p);
+    free(set->t);
+    free(set->extra);
+    free(set->is_hold);
+    memset(set, 0, sizeof(*set));
+}
+
+
+double get_accuracy_percent(const accuracy_t* accuracy) {
+    const uint64_t count = accuracy->mod_count + accuracy->non_mod_count;
+    return count ? 100.0 * (double) (accuracy->mod_correct + accuracy->non_mod_correct) / (double) count : 0.0;
+}
+
+
+void print_accuracy(FILE* file, const char* form, const accuracy_t* accuracy) {
+    fprintf(file, "%s\n", form);
+    fprintf(file, "* mod: %llu / %llu\n", (unsigned long long) accuracy->mod_correct,
+            (unsigned long long) accuracy->mod_count);
+    fprintf(file, "* non-mod: %llu / %llu\n", (unsigned long long) accuracy->non_mod_correct,
+            (unsigned long long) accuracy->non_mod_count);
+    fprintf(file, "* ~Correct:    %.3f %% (of %llu)\n", get_accuracy_percent(accuracy),
+            (unsigned long long) (accuracy->mod_count + accuracy->non_mod_count));
+}
+
+
+// scalar
+//=============================================================================
+static void add_decision(accuracy_t* accuracy, bool hold, bool is_hold) {
+    if (is_hold) {
+        accuracy->mod_count++;
+        accuracy->mod_correct += hold;
+    } else {
+        accuracy->non_mod_count++;
+        accuracy->non_mod_correct += !hold;
+    }
+}
+
+
+static void evaluate_overlap_scalar(const overlap_coefficients_t* k, const sample_set_t* s, size_t start,
+                                    accuracy_t* accuracy) {
+    const float* c = k->c;
+    for (size_t i = start; i < s->count; ++i) {
+        const float p = s->p[i];
+        const float t = s->t[i];
+
+        const float inner = MAX(c[0], c[1] * p + c[2]) - MAX(p, c[3]) + c[4] * t + c[5];
+        const float guess = ABS(MAX(-p, MAX(c[6], inner)));
+        const uint16_t estimate = MAX(1, (uint16_t) MIN((float) MS_MAX_OVERLAP, guess));
+
+        add_decision(accuracy, s->extra[i] > estimate, s->is_hold[i]);
+    }
+}
+
+
+static void evaluate_wrapped_scalar(const wrapped_coefficients_t* k, const sample_set_t* s, size_t start,
+                                    accuracy_t* accuracy) {
+    const float* c = k->c;
+    for (size_t i = start; i < s->count; ++i) {
+        const float p = s->p[i];
+        const float t = s->t[i];
+        const float n = s->extra[i];
+
+        const float r = SD(1.0f, t);
+        const float d = MAX(c[0] + c[1] * r, MAX(c[2], MAX(c[3], c[4] * p + c[5]) * -p) + SD(c[6], n) + c[7]);
+        const float guess = MAX(p * c[8], c[9]) / (c[10] * r * d);
+
+        add_decision(accuracy, guess > 0.5f || guess < -0.5f, s->is_hold[i]);
+    }
+}
+
+
+static void evaluate_two_down_scalar(const two_down_coefficients_t* k, const sample_set_t* s, size_t start,
+                                     accuracy_t* accuracy) {
+    const float* c = k->c;
+    for (size_t i = start; i < s->count; ++i) {
+        const float p = s->p[i];
+        const float t = s->t[i];
+        const float prev_is_mod = s->extra[i];
+
+        const float guess = (ABS(c[0] * p + c[1]) + (c[2] + prev_is_mod * (c[3] * MAX(-p, c[4]))) * t) /
+                            (MAX(-p, c[5]) * c[6]);
+
+        add_decision(accuracy, guess > 0.5f || guess < -0.5f, s->is_hold[i]);
+    }
+}
+
+
+// SSE and AVX2
+//=============================================================================
+#ifdef HAS_X86_KERNELS
+
+// SSE4.1 for blendv, round and cvtepu8, popcnt for counting the decisions
+#    define VEC                 __m128
+#    define VEC_WIDTH           4
+#    define KERNEL_TARGET       __attribute__((target("sse4.1,popcnt")))
+#    define KERNEL_NAME(name)   name##_sse
+#    define VEC_SET1            _mm_set1_ps
+#    define VEC_LOAD            _mm_loadu_ps
+#    define VEC_ADD             _mm_add_ps
+#    define VEC_SUB             _mm_sub_ps
+#    define VEC_MUL             _mm_mul_ps
+#    define VEC_DIV             _mm_div_ps
+#    define VEC_MAX             _mm_max_ps
+#    define VEC_MIN             _mm_min_ps
+#    define VEC_XOR             _mm_xor_ps
+#    define VEC_ANDNOT          _mm_andnot_ps
+#    define VEC_OR              _mm_or_ps
+#    define VEC_GT              _mm_cmpgt_ps
+#    define VEC_LT              _mm_cmplt_ps
+#    define VEC_EQ              _mm_cmpeq_ps
+#    define VEC_BLEND(a, b, m)  _mm_blendv_ps(a, b, m)
+#    define VEC_TRUNC(a)        _mm_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#    define VEC_MOVEMASK(m)     ((unsigned) _mm_movemask_ps(m))
+#    define VEC_LOAD_BITS(ptr)  ((unsigned) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32( \
+                                    _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load_uint32(ptr))), _mm_setzero_si128()))))
+
+static inline int load_uint32(const uint8_t* ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return (int) value;
+}
+
+#    include "evaluator_simd.h"
+
+#    undef VEC
+#    undef VEC_WIDTH
+#    undef KERNEL_TARGET
+#    undef KERNEL_NAME
+#    undef VEC_SET1
+#    undef VEC_LOAD
+#    undef VEC_ADD
+#    undef VEC_SUB
+#    undef VEC_MUL
+#    undef VEC_DIV
+#    undef VEC_MAX
+#    undef VEC_MIN
+#    undef VEC_XOR
+#    undef VEC_ANDNOT
+#    undef VEC_OR
+#    undef VEC_GT
+#    undef VEC_LT
+#    undef VEC_EQ
+#    undef VEC_BLEND
+#    undef VEC_TRUNC
+#    undef VEC_MOVEMASK
+#    undef VEC_LOAD_BITS
+
+#    define VEC                 __m256
+#    define VEC_WIDTH           8
+#    define KERNEL_TARGET       __attribute__((target("avx2,popcnt")))
+#    define KERNEL_NAME(name)   name##_avx2
+#    define VEC_SET1            _mm256_set1_ps
+#    define VEC_LOAD            _mm256_loadu_ps
+#    define VEC_ADD             _mm256_add_ps
+#    define VEC_SUB             _mm256_sub_ps
+#    define VEC_MUL             _mm256_mul_ps
+#    define VEC_DIV             _mm256_div_ps
+#    define VEC_MAX             _mm256_max_ps
+#    define VEC_MIN             _mm256_min_ps
+#    define VEC_XOR             _mm256_xor_ps
+#    define VEC_ANDNOT          _mm256_andnot_ps
+#    define VEC_OR              _mm256_or_ps
+#    define VEC_GT(a, b)        _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#    define VEC_LT(a, b)        _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#    define VEC_EQ(a, b)        _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+#    define VEC_BLEND(a, b, m)  _mm256_blendv_ps(a, b, m)
+#    define VEC_TRUNC(a)        _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#    define VEC_MOVEMASK(m)     ((unsigned) _mm256_movemask_ps(m))
+#    define VEC_LOAD_BITS(ptr)  ((unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32( \
+                                    _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (ptr))), \
+                                    _mm256_setzero_si256()))))
+
+#    include "evaluator_simd.h"
+
+#endif // HAS_X86_KERNELS
+
+
+// dispatch
+//=============================================================================
+bool is_evaluator_kernel_supported(evaluator_kernel_t kernel) {
+    switch (kernel) {
+        case EVALUATOR_SCALAR:
+            return true;
+#ifdef HAS_X86_KERNELS
+        case EVALUATOR_SSE:
+            return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+        case EVALUATOR_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+        default:
+            return false;
+    }
+}
+
+
+evaluator_kernel_t get_best_evaluator_kernel(void) {
+    evaluator_kernel_t best = EVALUATOR_SCALAR;
+    for (evaluator_kernel_t kernel = EVALUATOR_SCALAR; kernel < EVALUATOR_KERNEL_COUNT; ++kernel) {
+        if (is_evaluator_kernel_supported(kernel)) best = kernel;
+    }
+    return best;
+}
+
+
+#ifdef HAS_X86_KERNELS
+#    define DISPATCH(form, kernel, coefficients, samples, accuracy) \
+        ((kernel) == EVALUATOR_AVX2  ? form##_avx2(coefficients, samples, accuracy) : \
+         (kernel) == EVALUATOR_SSE   ? form##_sse(coefficients, samples, accuracy) : 0)
+#else
+#    define DISPATCH(form, kernel, coefficients, samples, accuracy) 0
+#endif
+
+// unsupported kernels fall back to the scalar one
+#define EVALUATE(form, kernel, coefficients, samples) \
+    do { \
+        accuracy_t _accuracy = {0}; \
+        const size_t _done = is_evaluator_kernel_supported(kernel) ? \
+                DISPATCH(form, kernel, coefficients, samples, &_accuracy) : 0; \
+        form##_scalar(coefficients, samples, _done, &_accuracy); \
+        return _accuracy; \
+    } while (0)
+
+
+accuracy_t evaluate_overlap(evaluator_kernel_t kernel, const overlap_coefficients_t* coefficients,
+                            const sample_set_t* samples) {
+    EVALUATE(evaluate_overlap, kernel, coefficients, samples);
+}
+
+
+accuracy_t evaluate_wrapped(evaluator_kernel_t kernel, const wrapped_coefficients_t* coefficients,
+                            const sample_set_t* samples) {
+    EVALUATE(evaluate_wrapped, kernel, coefficients, samples);
+}
+
+
+accuracy_t evaluate_two_down(evaluator_kernel_t kernel, const two_down_coefficients_t* coefficients,
+                             const sample_set_t* samples) {
+    EVALUATE(evaluate_two_down, kernel, coefficients, samples);
+}
@@ -0,0 +1,90 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Scores the three heuristic forms of heuristic_tap_hold_kernels.c with
+// arbitrary coefficients over many samples at once, e.g. to tune them. The
+// samples are stored as one array per input, so the AVX2 and SSE kernels can
+// evaluate 8 or 4 of them with each instruction. All kernels do the same float
+// operations in the same order as the _float reference, so with the default
+// coefficients their decisions are exactly those of the reference (evaluate
+// verify checks this).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_kernels.h"
+
+// Coefficients, in the order of heuristic_tap_hold_kernels.h, which also
+// describes the three forms.
+typedef struct {
+    float c[OVERLAP_COEFFICIENT_COUNT];
+} overlap_coefficients_t;
+
+typedef struct {
+    float c[WRAPPED_COEFFICIENT_COUNT];
+} wrapped_coefficients_t;
+
+typedef struct {
+    float c[TWO_DOWN_COEFFICIENT_COUNT];
+} two_down_coefficients_t;
+
+// the evolved coefficients the firmware uses
+extern const overlap_coefficients_t default_overlap_coefficients;
+extern const wrapped_coefficients_t default_wrapped_coefficients;
+extern const two_down_coefficients_t default_two_down_coefficients;
+
+
+// Samples of one form. Inputs are whole milliseconds stored as floats, so the
+// kernels don't have to convert them. is_hold is what the key was meant to be
+// (1 for a hold). extra is the overlap, next_dur or prev_is_mod (0 or 1),
+// depending on the form.
+typedef struct {
+    size_t   count;
+    size_t   capacity;
+    float*   p;
+    float*   t;
+    float*   extra;
+    uint8_t* is_hold;
+} sample_set_t;
+
+void sample_set_add(sample_set_t* set, int16_t p, uint16_t t, uint16_t extra, bool is_hold);
+void sample_set_clear(sample_set_t* set);
+void sample_set_free(sample_set_t* set);
+
+
+// Like the README: how many holds (mod) and taps (non-mod) were decided
+// correctly.
+typedef struct {
+    uint64_t mod_correct;
+    uint64_t mod_count;
+    uint64_t non_mod_correct;
+    uint64_t non_mod_count;
+} accuracy_t;
+
+double get_accuracy_percent(const accuracy_t* accuracy);
+void print_accuracy(FILE* file, const char* form, const accuracy_t* accuracy);
+
+
+typedef enum {
+    EVALUATOR_SCALAR,
+    EVALUATOR_SSE,
+    EVALUATOR_AVX2,
+    EVALUATOR_KERNEL_COUNT
+} evaluator_kernel_t;
+
+extern const char* const evaluator_kernel_names[EVALUATOR_KERNEL_COUNT];
+
+// false, if the CPU (or the compiler) doesn't support it
+bool is_evaluator_kernel_supported(evaluator_kernel_t kernel);
+// the widest supported one
+evaluator_kernel_t get_best_evaluator_kernel(void);
+
+accuracy_t evaluate_overlap(evaluator_kernel_t kernel, const overlap_coefficients_t* coefficients,
+                            const sample_set_t* samples);
+accuracy_t evaluate_wrapped(evaluator_kernel_t kernel, const wrapped_coefficients_t* coefficients,
+                            const sample_set_t* samples);
+accuracy_t evaluate_two_down(evaluator_kernel_t kernel, const two_down_coefficients_t* coefficients,
+                             const sample_set_t* samples);
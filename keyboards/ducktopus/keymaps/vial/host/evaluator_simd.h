@@ -0,0 +1,109 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// The vector kernels of evaluator.c. It includes this once per instruction
+// set, after defining VEC (the vector type), VEC_WIDTH, KERNEL_TARGET,
+// KERNEL_NAME and the VEC_ operations. Every line mirrors one of the scalar
+// versions in evaluator.c, which mirror the _float reference.
+//
+// Only whole vectors are evaluated. The kernels return how many samples that
+// was, and the caller does the rest with the scalar version.
+
+#define VEC_NEG(a)       VEC_XOR(a, VEC_SET1(-0.0f))
+#define VEC_ABS(a)       VEC_ANDNOT(VEC_SET1(-0.0f), a)
+#define VEC_SD(x, y)     VEC_BLEND(VEC_DIV(x, y), x, VEC_EQ(y, VEC_SET1(0.0f)))
+#define VEC_ALL_BITS     ((1u << VEC_WIDTH) - 1)
+
+
+static inline void KERNEL_NAME(add_decisions)(accuracy_t* accuracy, unsigned hold_bits, unsigned is_hold_bits) {
+    accuracy->mod_correct += __builtin_popcount(hold_bits & is_hold_bits);
+    accuracy->mod_count += __builtin_popcount(is_hold_bits);
+    accuracy->non_mod_correct += __builtin_popcount(~hold_bits & ~is_hold_bits & VEC_ALL_BITS);
+    accuracy->non_mod_count += VEC_WIDTH - __builtin_popcount(is_hold_bits);
+}
+
+
+KERNEL_TARGET static size_t KERNEL_NAME(evaluate_overlap)(
+        const overlap_coefficients_t* k, const sample_set_t* s, accuracy_t* accuracy) {
+    const VEC c0 = VEC_SET1(k->c[0]), c1 = VEC_SET1(k->c[1]), c2 = VEC_SET1(k->c[2]), c3 = VEC_SET1(k->c[3]);
+    const VEC c4 = VEC_SET1(k->c[4]), c5 = VEC_SET1(k->c[5]), c6 = VEC_SET1(k->c[6]);
+    const VEC max_overlap = VEC_SET1((float) MS_MAX_OVERLAP);
+    const VEC one = VEC_SET1(1.0f);
+
+    const size_t end = s->count - s->count % VEC_WIDTH;
+    for (size_t i = 0; i < end; i += VEC_WIDTH) {
+        const VEC p = VEC_LOAD(s->p + i);
+        const VEC t = VEC_LOAD(s->t + i);
+        const VEC overlap = VEC_LOAD(s->extra + i);
+
+        const VEC inner = VEC_ADD(VEC_ADD(VEC_SUB(VEC_MAX(c0, VEC_ADD(VEC_MUL(c1, p), c2)), VEC_MAX(p, c3)),
+                                          VEC_MUL(c4, t)),
+                                  c5);
+        const VEC guess = VEC_ABS(VEC_MAX(VEC_NEG(p), VEC_MAX(c6, inner)));
+        const VEC estimate = VEC_MAX(one, VEC_TRUNC(VEC_MIN(max_overlap, guess)));
+
+        KERNEL_NAME(add_decisions)(accuracy, VEC_MOVEMASK(VEC_GT(overlap, estimate)), VEC_LOAD_BITS(s->is_hold + i));
+    }
+    return end;
+}
+
+
+KERNEL_TARGET static size_t KERNEL_NAME(evaluate_wrapped)(
+        const wrapped_coefficients_t* k, const sample_set_t* s, accuracy_t* accuracy) {
+    const VEC c0 = VEC_SET1(k->c[0]), c1 = VEC_SET1(k->c[1]), c2 = VEC_SET1(k->c[2]), c3 = VEC_SET1(k->c[3]);
+    const VEC c4 = VEC_SET1(k->c[4]), c5 = VEC_SET1(k->c[5]), c6 = VEC_SET1(k->c[6]), c7 = VEC_SET1(k->c[7]);
+    const VEC c8 = VEC_SET1(k->c[8]), c9 = VEC_SET1(k->c[9]), c10 = VEC_SET1(k->c[10]);
+    const VEC one = VEC_SET1(1.0f);
+    const VEC half = VEC_SET1(0.5f);
+    const VEC minus_half = VEC_SET1(-0.5f);
+
+    const size_t end = s->count - s->count % VEC_WIDTH;
+    for (size_t i = 0; i < end; i += VEC_WIDTH) {
+        const VEC p = VEC_LOAD(s->p + i);
+        const VEC t = VEC_LOAD(s->t + i);
+        const VEC n = VEC_LOAD(s->extra + i);
+
+        const VEC r = VEC_SD(one, t);
+        const VEC d = VEC_MAX(
+                VEC_ADD(c0, VEC_MUL(c1, r)),
+                VEC_ADD(VEC_ADD(VEC_MAX(c2, VEC_MUL(VEC_MAX(c3, VEC_ADD(VEC_MUL(c4, p), c5)), VEC_NEG(p))),
+                                VEC_SD(c6, n)),
+                        c7));
+        const VEC guess = VEC_DIV(VEC_MAX(VEC_MUL(p, c8), c9), VEC_MUL(VEC_MUL(c10, r), d));
+        const VEC hold = VEC_OR(VEC_GT(guess, half), VEC_LT(guess, minus_half));
+
+        KERNEL_NAME(add_decisions)(accuracy, VEC_MOVEMASK(hold), VEC_LOAD_BITS(s->is_hold + i));
+    }
+    return end;
+}
+
+
+KERNEL_TARGET static size_t KERNEL_NAME(evaluate_two_down)(
+        const two_down_coefficients_t* k, const sample_set_t* s, accuracy_t* accuracy) {
+    const VEC c0 = VEC_SET1(k->c[0]), c1 = VEC_SET1(k->c[1]), c2 = VEC_SET1(k->c[2]), c3 = VEC_SET1(k->c[3]);
+    const VEC c4 = VEC_SET1(k->c[4]), c5 = VEC_SET1(k->c[5]), c6 = VEC_SET1(k->c[6]);
+    const VEC half = VEC_SET1(0.5f);
+    const VEC minus_half = VEC_SET1(-0.5f);
+
+    const size_t end = s->count - s->count % VEC_WIDTH;
+    for (size_t i = 0; i < end; i += VEC_WIDTH) {
+        const VEC p = VEC_LOAD(s->p + i);
+        const VEC t = VEC_LOAD(s->t + i);
+        const VEC prev_is_mod = VEC_LOAD(s->extra + i);
+        const VEC minus_p = VEC_NEG(p);
+
+        const VEC numerator = VEC_ADD(
+                VEC_ABS(VEC_ADD(VEC_MUL(c0, p), c1)),
+                VEC_MUL(VEC_ADD(c2, VEC_MUL(prev_is_mod, VEC_MUL(c3, VEC_MAX(minus_p, c4)))), t));
+        const VEC guess = VEC_DIV(numerator, VEC_MUL(VEC_MAX(minus_p, c5), c6));
+        const VEC hold = VEC_OR(VEC_GT(guess, half), VEC_LT(guess, minus_half));
+
+        KERNEL_NAME(add_decisions)(accuracy, VEC_MOVEMASK(hold), VEC_LOAD_BITS(s->is_hold + i));
+    }
+    return end;
+}
+
+
+#undef VEC_NEG
+#undef VEC_ABS
+#undef VEC_SD
+#undef VEC_ALL_BITS
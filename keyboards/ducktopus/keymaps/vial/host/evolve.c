@@ -0,0 +1,547 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Evolves the three heuristics with genetic programming (symbolic regression)
+// on labeled corpora, and writes them as C that replaces the functions in
+// features/heuristic_tap_hold.c.
+//
+//     evolve -s 7 -o evolved.c typing.corpus
+//
+// The population is split into islands that evolve on their own and pass
+// their best trees on to the next island every few generations. Fitness is
+// the ~Correct of evaluate (see samples.h), the smaller tree wins a tie. The
+// current heuristics start out on the first island, so the result is never
+// worse on the training data.
+//
+// Trees are scored in parallel on a work stealing thread pool, and the fitness
+// of every tree is cached, as crossover and elitism keep producing trees that
+// were already scored. Each island has its own random numbers, so the same
+// seed and options always give the same result, with any number of threads.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gp_tree.h"
+#include "samples.h"
+#include "thread_pool.h"
+#include "features/heuristic_tap_hold_kernels.h"
+
+#define TOURNAMENT_SIZE   4
+#define ELITE_COUNT       2
+#define INITIAL_MAX_DEPTH 5
+
+#define FITNESS_CACHE_SIZE       (1 << 18)
+#define FITNESS_CACHE_LOCK_COUNT 64
+
+typedef enum {
+    FORM_OVERLAP,
+    FORM_WRAPPED,
+    FORM_TWO_DOWN,
+    FORM_COUNT
+} form_t;
+
+typedef struct {
+    const char* name;
+    const char* const variable_names[GP_VARIABLE_COUNT];
+    int variable_count;
+    // the current heuristic, see evaluator.h
+    const char* current;
+} form_info_t;
+
+static const form_info_t forms[FORM_COUNT] = {
+    [FORM_OVERLAP] = {
+        .name = "overlap",
+        .variable_names = {"p", "t", "unused"},
+        .variable_count = 2,
+        .current = "(max (neg p) (max 3.0614197"
+                   " (+ (+ (- (max 1386.7545166 (+ (* -136.1621093 p) -315.5284118)) (max p 325.5094909))"
+                   " (* -6.4232006 t)) 302.9532165)))",
+    },
+    [FORM_WRAPPED] = {
+        .name = "wrapped",
+        .variable_names = {"p", "t", "n"},
+        .variable_count = 3,
+        .current = "(/ (max (* p 0.6423792) 23.4521789) (* (* 542.2182617 (/ 1 t))"
+                   " (max (+ 1.1125613 (* 558.6079711 (/ 1 t)))"
+                   " (+ (+ (max 110.8752517 (* (max 1.1125613 (+ (* -5.7630343 p) -184.2279510)) (neg p)))"
+                   " (/ 4170.0205078 n)) -179.2697753))))",
+    },
+    [FORM_TWO_DOWN] = {
+        .name = "two_down",
+        .variable_names = {"p", "t", "m"},
+        .variable_count = 3,
+        .current = "(/ (+ (abs (+ (* -0.0297553 p) -9.2836914))"
+                   " (* (+ 0.2559899 (* m (* 0.0180325 (max (neg p) 17.5247516)))) t))"
+                   " (* (max (neg p) 14.0228700) -9.2638397))",
+    },
+};
+
+typedef struct {
+    uint64_t seed;
+    int generation_count;
+    int island_count;
+    int population_size;
+    int migration_interval;
+    int migrant_count;
+    unsigned worker_count;
+    size_t max_sample_count;
+} options_t;
+
+typedef struct {
+    gp_tree_t tree;
+    uint64_t correct;
+    accuracy_t accuracy;
+} individual_t;
+
+typedef struct {
+    uint64_t hash;
+    accuracy_t accuracy;
+    bool is_used;
+} cache_entry_t;
+
+typedef struct {
+    const options_t* options;
+    form_t form;
+    const sample_set_t* samples;
+
+    individual_t* population;      // island after island
+    individual_t* next_population;
+    gp_random_t* randoms;          // one per island
+
+    cache_entry_t* cache;
+    pthread_mutex_t cache_locks[FITNESS_CACHE_LOCK_COUNT];
+    atomic_ulong cache_hits;
+    atomic_ulong evaluations;
+
+    gp_scratch_t* scratches;       // one per worker
+} evolution_t;
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options] CORPUS...\n"
+            "  -s SEED         random seed (default 1)\n"
+            "  -g GENERATIONS  default 50\n"
+            "  -i ISLANDS      default 8\n"
+            "  -n POPULATION   trees per island (default 256)\n"
+            "  -e INTERVAL     generations between migrations (default 5)\n"
+            "  -j THREADS      default one per CPU\n"
+            "  -m SAMPLES      use at most this many samples per heuristic (every k-th)\n"
+            "  -f FORM         only evolve overlap, wrapped or two_down\n"
+            "  -o OUTPUT       write the C there instead of stdout\n",
+            name);
+    exit(2);
+}
+
+
+// fitness
+//=============================================================================
+static bool decide_hold(form_t form, float guess, float extra) {
+    if (form != FORM_OVERLAP) return guess > 0.5f || guess < -0.5f;
+
+    // like the generated calculate_min_overlap_for_hold_in_ms
+    const float estimate = MIN((float) MS_MAX_OVERLAP, ABS(guess));
+    return extra > (estimate >= 1.0f ? (uint16_t) estimate : 1);
+}
+
+
+static accuracy_t score_tree(const evolution_t* evolution, const gp_tree_t* tree, gp_scratch_t* scratch) {
+    const sample_set_t* samples = evolution->samples;
+    accuracy_t accuracy = {0};
+
+    for (size_t start = 0; start < samples->count; start += GP_BLOCK_SIZE) {
+        const size_t count = MIN(GP_BLOCK_SIZE, samples->count - start);
+        const float* const variables[GP_VARIABLE_COUNT] = {
+            samples->p + start, samples->t + start, samples->extra + start,
+        };
+        const float* guesses = gp_evaluate_block(tree, variables, count, scratch);
+
+        for (size_t i = 0; i < count; ++i) {
+            const bool hold = decide_hold(evolution->form, guesses[i], samples->extra[start + i]);
+            if (samples->is_hold[start + i]) {
+                accuracy.mod_count++;
+                accuracy.mod_correct += hold;
+            } else {
+                accuracy.non_mod_count++;
+                accuracy.non_mod_correct += !hold;
+            }
+        }
+    }
+    return accuracy;
+}
+
+
+static bool look_up_fitness(evolution_t* evolution, uint64_t hash, accuracy_t* accuracy) {
+    const size_t index = hash & (FITNESS_CACHE_SIZE - 1);
+    pthread_mutex_t* lock = &evolution->cache_locks[index % FITNESS_CACHE_LOCK_COUNT];
+
+    pthread_mutex_lock(lock);
+    const cache_entry_t* entry = &evolution->cache[index];
+    const bool is_hit = entry->is_used && entry->hash == hash;
+    if (is_hit) *accuracy = entry->accuracy;
+    pthread_mutex_unlock(lock);
+    return is_hit;
+}
+
+
+static void store_fitness(evolution_t* evolution, uint64_t hash, const accuracy_t* accuracy) {
+    const size_t index = hash & (FITNESS_CACHE_SIZE - 1);
+    pthread_mutex_t* lock = &evolution->cache_locks[index % FITNESS_CACHE_LOCK_COUNT];
+
+    pthread_mutex_lock(lock);
+    evolution->cache[index] = (cache_entry_t){.hash = hash, .accuracy = *accuracy, .is_used = true};
+    pthread_mutex_unlock(lock);
+}
+
+
+static void evaluate_task(void* context, size_t index, unsigned worker) {
+    evolution_t* evolution = context;
+    individual_t* individual = &evolution->population[index];
+
+    const uint64_t hash = gp_hash(&individual->tree);
+    if (look_up_fitness(evolution, hash, &individual->accuracy)) {
+        atomic_fetch_add(&evolution->cache_hits, 1);
+    } else {
+        individual->accuracy = score_tree(evolution, &individual->tree, &evolution->scratches[worker]);
+        store_fitness(evolution, hash, &individual->accuracy);
+    }
+    atomic_fetch_add(&evolution->evaluations, 1);
+    individual->correct = individual->accuracy.mod_correct + individual->accuracy.non_mod_correct;
+}
+
+
+// true, if a is better than b
+static bool is_better(const individual_t* a, const individual_t* b) {
+    if (a->correct != b->correct) return a->correct > b->correct;
+    if (a->tree.size != b->tree.size) return a->tree.size < b->tree.size;
+    // any fixed order, so sorting doesn't depend on where equal trees were
+    return gp_hash(&a->tree) < gp_hash(&b->tree);
+}
+
+
+static int compare_individuals(const void* a, const void* b) {
+    if (is_better(a, b)) return -1;
+    return is_better(b, a) ? 1 : 0;
+}
+
+
+// islands
+//=============================================================================
+static const individual_t* select_by_tournament(const individual_t* island, int size, gp_random_t* random) {
+    const individual_t* best = &island[gp_random_below(random, size)];
+    for (int i = 1; i < TOURNAMENT_SIZE; ++i) {
+        const individual_t* candidate = &island[gp_random_below(random, size)];
+        if (is_better(candidate, best)) best = candidate;
+    }
+    return best;
+}
+
+
+// The island is sorted best first afterwards.
+static void breed_task(void* context, size_t index, unsigned worker) {
+    evolution_t* evolution = context;
+    const int size = evolution->options->population_size;
+    const int variable_count = forms[evolution->form].variable_count;
+    individual_t* island = &evolution->population[index * size];
+    individual_t* next = &evolution->next_population[index * size];
+    gp_random_t* random = &evolution->randoms[index];
+
+    qsort(island, size, sizeof(*island), compare_individuals);
+
+    for (int i = 0; i < size; ++i) {
+        if (i < ELITE_COUNT) {
+            next[i] = island[i];
+            continue;
+        }
+
+        const double kind = gp_random_unit(random);
+        const individual_t* parent = select_by_tournament(island, size, random);
+
+        if (kind < 0.8) {
+            const individual_t* other = select_by_tournament(island, size, random);
+            gp_crossover(&next[i].tree, &parent->tree, &other->tree, random);
+            if (gp_random_below(random, 10) == 0) gp_mutate(&next[i].tree, random, variable_count);
+        } else if (kind < 0.95) {
+            next[i].tree = parent->tree;
+            gp_mutate(&next[i].tree, random, variable_count);
+        } else {
+            next[i].tree = parent->tree;
+        }
+    }
+}
+
+
+// The best of each island replace the last bred trees of the next one (in a
+// ring). breed_task sorted the islands best first.
+static void migrate(evolution_t* evolution) {
+    const int size = evolution->options->population_size;
+    const int island_count = evolution->options->island_count;
+    const int migrant_count = MIN(evolution->options->migrant_count, size - ELITE_COUNT);
+
+    for (int i = 0; i < island_count; ++i) {
+        const individual_t* from = &evolution->population[i * size];
+        individual_t* to = &evolution->next_population[((i + 1) % island_count) * size + size - migrant_count];
+        memcpy(to, from, migrant_count * sizeof(*to));
+    }
+}
+
+
+static void init_population(evolution_t* evolution, const gp_tree_t* current) {
+    const options_t* options = evolution->options;
+    const int variable_count = forms[evolution->form].variable_count;
+
+    for (int island = 0; island < options->island_count; ++island) {
+        gp_random_t* random = &evolution->randoms[island];
+        random->state = options->seed * 0x9E3779B97F4A7C15ull + (uint64_t) evolution->form * 1000003u + island;
+
+        // ramped half and half
+        for (int i = 0; i < options->population_size; ++i) {
+            const int depth = 2 + i % (INITIAL_MAX_DEPTH - 1);
+            gp_random_tree(&evolution->population[island * options->population_size + i].tree, random, depth,
+                           (i / (INITIAL_MAX_DEPTH - 1)) % 2 == 0, variable_count);
+        }
+    }
+    evolution->population[0].tree = *current;
+}
+
+
+static individual_t evolve_form(const options_t* options, thread_pool_t* pool, form_t form,
+                                const sample_set_t* samples, individual_t* current) {
+    const size_t total = (size_t) options->island_count * options->population_size;
+    const unsigned worker_count = thread_pool_get_worker_count(pool);
+
+    evolution_t* evolution = calloc(1, sizeof(*evolution));
+    if (evolution == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    evolution->options = options;
+    evolution->form = form;
+    evolution->samples = samples;
+    evolution->population = calloc(total, sizeof(individual_t));
+    evolution->next_population = calloc(total, sizeof(individual_t));
+    evolution->randoms = calloc(options->island_count, sizeof(gp_random_t));
+    evolution->cache = calloc(FITNESS_CACHE_SIZE, sizeof(cache_entry_t));
+    evolution->scratches = aligned_alloc(64, worker_count * sizeof(gp_scratch_t));
+    if (evolution->population == NULL || evolution->next_population == NULL || evolution->randoms == NULL ||
+            evolution->cache == NULL || evolution->scratches == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < FITNESS_CACHE_LOCK_COUNT; ++i) {
+        pthread_mutex_init(&evolution->cache_locks[i], NULL);
+    }
+
+    current->accuracy = score_tree(evolution, &current->tree, &evolution->scratches[0]);
+    current->correct = current->accuracy.mod_correct + current->accuracy.non_mod_correct;
+    init_population(evolution, &current->tree);
+
+    individual_t best = *current;
+    for (int generation = 0; generation < options->generation_count; ++generation) {
+        thread_pool_run(pool, evaluate_task, evolution, total);
+
+        for (size_t i = 0; i < total; ++i) {
+            if (is_better(&evolution->population[i], &best)) best = evolution->population[i];
+        }
+        fprintf(stderr, "%-8s generation %3d: %.3f %% with %2d nodes (%.0f %% cached)\n", forms[form].name,
+                generation, get_accuracy_percent(&best.accuracy), best.tree.size,
+                100.0 * (double) atomic_load(&evolution->cache_hits) / (double) atomic_load(&evolution->evaluations));
+
+        if (generation + 1 == options->generation_count) break;
+
+        thread_pool_run(pool, breed_task, evolution, options->island_count);
+        if (options->migration_interval > 0 && (generation + 1) % options->migration_interval == 0) {
+            migrate(evolution);
+        }
+
+        individual_t* bred = evolution->next_population;
+        evolution->next_population = evolution->population;
+        evolution->population = bred;
+    }
+
+    for (int i = 0; i < FITNESS_CACHE_LOCK_COUNT; ++i) {
+        pthread_mutex_destroy(&evolution->cache_locks[i]);
+    }
+    free(evolution->scratches);
+    free(evolution->cache);
+    free(evolution->randoms);
+    free(evolution->next_population);
+    free(evolution->population);
+    free(evolution);
+    return best;
+}
+
+
+// output
+//=============================================================================
+static bool uses_variable(const gp_tree_t* tree, uint8_t variable) {
+    for (int i = 0; i < tree->size; ++i) {
+        if (tree->nodes[i].op == GP_VARIABLE && tree->nodes[i].variable == variable) return true;
+    }
+    return false;
+}
+
+
+static void print_function(FILE* file, form_t form, individual_t* best, const individual_t* current) {
+    static const char* const variable_values[FORM_COUNT][GP_VARIABLE_COUNT] = {
+        [FORM_OVERLAP] = {
+            "ms_between_prev_release_and_heuristic_tap_hold_press",
+            "ms_between_heuristic_tap_hold_press_and_next_press",
+        },
+        [FORM_WRAPPED] = {
+            "ms_between_prev_release_and_heuristic_tap_hold_press",
+            "ms_between_heuristic_tap_hold_press_and_next_press",
+            "(uint16_t) timer_elapsed32(ms_next_to_heuristic_tap_hold_press_to_release_timer)",
+        },
+        [FORM_TWO_DOWN] = {
+            "ms_between_prev_release_and_heuristic_tap_hold_press",
+            "ms_between_heuristic_tap_hold_press_and_next_press",
+            "prev_to_heuristic_tap_hold_was_mod",
+        },
+    };
+    static const char* const signatures[FORM_COUNT] = {
+        [FORM_OVERLAP] = "static uint16_t calculate_min_overlap_for_hold_in_ms(void)",
+        [FORM_WRAPPED] = "__attribute__((weak)) bool should_choose_hold_when_next_to_heuristic_tap_hold_is_wrapped(void)",
+        [FORM_TWO_DOWN] = "__attribute__((weak)) bool should_choose_hold_when_two_down_after_heuristic_tap_hold(void)",
+    };
+
+    gp_fold_constants(&best->tree);
+
+    fprintf(file, "\n\n// %.3f %% (of %llu), the current one has %.3f %%\n// ", get_accuracy_percent(&best->accuracy),
+            (unsigned long long) (best->accuracy.mod_count + best->accuracy.non_mod_count),
+            get_accuracy_percent(&current->accuracy));
+    gp_print_sexpr(file, &best->tree, forms[form].variable_names);
+    fprintf(file, "\n%s {\n", signatures[form]);
+
+    for (uint8_t v = 0; v < forms[form].variable_count; ++v) {
+        if (uses_variable(&best->tree, v)) {
+            fprintf(file, "    const float %s = (float) %s;\n", forms[form].variable_names[v], variable_values[form][v]);
+        }
+    }
+    fprintf(file, "\n");
+    gp_print_c(file, &best->tree, forms[form].variable_names, "guess", "    ");
+
+    if (form == FORM_OVERLAP) {
+        fprintf(file, "\n"
+                      "    // NaN (e.g. from inf - inf) is the shortest estimate, like in host/evolve\n"
+                      "    const float estimate = MIN((float) MS_MAX_OVERLAP, ABS(guess));\n"
+                      "    return estimate >= 1.0f ? (uint16_t) estimate : 1;\n");
+    } else {
+        fprintf(file, "\n    return guess > 0.5f || guess < -0.5f;\n");
+    }
+    fprintf(file, "}\n");
+}
+
+
+// every k-th sample, so there are at most max_count
+static void thin_out(sample_set_t* samples, size_t max_count) {
+    if (max_count == 0 || samples->count <= max_count) return;
+
+    const size_t step = (samples->count + max_count - 1) / max_count;
+    size_t count = 0;
+    for (size_t i = 0; i < samples->count; i += step) {
+        samples->p[count] = samples->p[i];
+        samples->t[count] = samples->t[i];
+        samples->extra[count] = samples->extra[i];
+        samples->is_hold[count] = samples->is_hold[i];
+        ++count;
+    }
+    samples->count = count;
+}
+
+
+static int parse_int(const char* text, const char* name, int min) {
+    char* end;
+    const long value = strtol(text, &end, 10);
+    if (*end != '\0' || value < min || value > 1000000) {
+        fprintf(stderr, "invalid %s: %s\n", name, text);
+        exit(2);
+    }
+    return (int) value;
+}
+
+
+int main(int argc, char** argv) {
+    options_t options = {
+        .seed = 1,
+        .generation_count = 50,
+        .island_count = 8,
+        .population_size = 256,
+        .migration_interval = 5,
+        .migrant_count = 4,
+    };
+    const char* output_path = NULL;
+    int only_form = -1;
+    int first_path = argc;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-') {
+            first_path = i;
+            break;
+        }
+        if (i + 1 == argc || argv[i][2] != '\0') usage(argv[0]);
+
+        const char* value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 's': options.seed = strtoull(value, NULL, 10); break;
+            case 'g': options.generation_count = parse_int(value, "generations", 1); break;
+            case 'i': options.island_count = parse_int(value, "islands", 1); break;
+            case 'n': options.population_size = parse_int(value, "population", 2 * ELITE_COUNT); break;
+            case 'e': options.migration_interval = parse_int(value, "interval", 0); break;
+            case 'j': options.worker_count = (unsigned) parse_int(value, "threads", 1); break;
+            case 'm': options.max_sample_count = (size_t) parse_int(value, "samples", 1); break;
+            case 'o': output_path = value; break;
+            case 'f':
+                for (int f = 0; f < FORM_COUNT; ++f) {
+                    if (strcmp(value, forms[f].name) == 0) only_form = f;
+                }
+                if (only_form < 0) usage(argv[0]);
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if (first_path == argc) usage(argv[0]);
+
+    heuristic_samples_t samples = {0};
+    for (int i = first_path; i < argc; ++i) {
+        corpus_t corpus;
+        if (!corpus_open(&corpus, argv[i])) return 1;
+        add_corpus_samples(&samples, &corpus);
+        corpus_close(&corpus);
+    }
+    sample_set_t* sample_sets[FORM_COUNT] = {&samples.overlap, &samples.wrapped, &samples.two_down};
+
+    FILE* output = stdout;
+    if (output_path != NULL && (output = fopen(output_path, "w")) == NULL) {
+        perror(output_path);
+        return 1;
+    }
+
+    fprintf(output, "// Generated by host/evolve -s %llu -g %d -i %d -n %d -e %d", (unsigned long long) options.seed,
+            options.generation_count, options.island_count, options.population_size, options.migration_interval);
+    if (options.max_sample_count > 0) fprintf(output, " -m %zu", options.max_sample_count);
+    fprintf(output, "\n// Replace the functions with the same names in features/heuristic_tap_hold.c.\n");
+
+    thread_pool_t* pool = thread_pool_create(options.worker_count);
+    for (int f = 0; f < FORM_COUNT; ++f) {
+        if (only_form >= 0 && f != only_form) continue;
+
+        thin_out(sample_sets[f], options.max_sample_count);
+        if (sample_sets[f]->count == 0) {
+            fprintf(stderr, "%s: no samples\n", forms[f].name);
+            continue;
+        }
+
+        individual_t current = {0};
+        if (!gp_parse(&current.tree, forms[f].current, forms[f].variable_names)) return 1;
+
+        individual_t best = evolve_form(&options, pool, f, sample_sets[f], &current);
+        print_function(output, f, &best, &current);
+    }
+    thread_pool_destroy(pool);
+
+    if (output != stdout) fclose(output);
+    free_heuristic_samples(&samples);
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// The user hooks exactly as described in features/README.md (Usage 4 and 5,
+// and the optional bigram offsets, runtime coefficients and adaptive biases),
+// so the feature can be replayed on its own, without the rest of keymap.c.
+// With SCAN_PROFILER_ENABLE, they mark the stages of the loop like keymap.c.
+
+#include "quantum.h"
+#include "features/heuristic_tap_hold.h"
+#        ifdef HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS
+#include "features/heuristic_tap_hold_bigrams.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS
+#include "features/heuristic_tap_hold_coefficients.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+#include "features/heuristic_tap_hold_adaptive.h"
+#        endif
+#        ifdef SCAN_PROFILER_ENABLE
+#include "features/scan_profiler.h"
+#        endif
+
+
+void keyboard_post_init_user(void) {
+#        if defined(HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS) && !defined(NO_ACTION_TAPPING)
+    load_heuristic_tap_hold_bigram_offsets();
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS) && !defined(NO_ACTION_TAPPING)
+    load_heuristic_tap_hold_coefficients();
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS) && !defined(NO_ACTION_TAPPING)
+    load_heuristic_tap_hold_adaptive_biases();
+#        endif
+}
+
+
+void matrix_scan_user(void) {
+#        ifdef SCAN_PROFILER_ENABLE
+    end_scan_stage(SCAN_STAGE_MATRIX);
+    begin_scan_stage(SCAN_STAGE_MATRIX_SCAN_USER);
+#        endif
+#        if !defined(NO_ACTION_TAPPING)
+    heuristic_tap_hold_task();
+#        endif // !NO_ACTION_TAPPING
+#        ifdef SCAN_PROFILER_ENABLE
+    end_scan_stage(SCAN_STAGE_MATRIX_SCAN_USER);
+#        endif
+}
+
+
+void housekeeping_task_user(void) {
+#        if defined(HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS) && !defined(NO_ACTION_TAPPING)
+    heuristic_tap_hold_adaptive_task();
+#        endif
+#        ifdef SCAN_PROFILER_ENABLE
+    scan_profiler_task();
+#        endif
+}
+
+
+bool process_record_user(uint16_t keycode, keyrecord_t* record) {
+#        if !defined(NO_ACTION_TAPPING)
+    if (!process_heuristic_tap_hold(keycode, record)) {
+        return false;
+    }
+#        endif // !NO_ACTION_TAPPING
+
+    return true;
+}
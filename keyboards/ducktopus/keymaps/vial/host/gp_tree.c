@@ -0,0 +1,537 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gp_tree.h"
+#include "features/heuristic_tap_hold_kernels.h"
+
+static const char* const op_names[GP_OP_COUNT] = {
+    [GP_NEG] = "neg", [GP_ABS] = "abs", [GP_ADD] = "+", [GP_SUB] = "-",
+    [GP_MUL] = "*", [GP_DIV] = "/", [GP_MAX] = "max", [GP_MIN] = "min",
+};
+
+static const uint8_t unary_ops[] = {GP_NEG, GP_ABS};
+static const uint8_t binary_ops[] = {GP_ADD, GP_SUB, GP_MUL, GP_DIV, GP_MAX, GP_MIN};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
+
+// how often subtree mutation retries until the result fits
+#define MAX_SPLICE_TRIES 8
+
+
+// random
+//=============================================================================
+uint64_t gp_random_next(gp_random_t* random) {
+    uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+uint32_t gp_random_below(gp_random_t* random, uint32_t bound) {
+    return (uint32_t) ((gp_random_next(random) >> 32) * bound >> 32);
+}
+
+
+double gp_random_unit(gp_random_t* random) {
+    return (double) (gp_random_next(random) >> 11) * 0x1.0p-53;
+}
+
+
+// Like the evolved constants, between 0.01 and 5000 in magnitude.
+static float random_constant(gp_random_t* random) {
+    const float magnitude = (float) pow(10.0, gp_random_unit(random) * 5.7 - 2.0);
+    return (gp_random_next(random) & 1) ? -magnitude : magnitude;
+}
+
+
+// structure
+//=============================================================================
+int gp_get_arity(uint8_t op) {
+    switch (op) {
+        case GP_CONSTANT:
+        case GP_VARIABLE:
+            return 0;
+        case GP_NEG:
+        case GP_ABS:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+
+int gp_get_subtree_end(const gp_tree_t* tree, int index) {
+    int open = 1;
+    while (open > 0) {
+        open += gp_get_arity(tree->nodes[index++].op) - 1;
+    }
+    return index;
+}
+
+
+static int get_depth_at(const gp_tree_t* tree, int* index) {
+    const int arity = gp_get_arity(tree->nodes[(*index)++].op);
+    int depth = 0;
+    for (int i = 0; i < arity; ++i) {
+        // not in MAX, which would evaluate it twice
+        const int child_depth = 1 + get_depth_at(tree, index);
+        depth = MAX(depth, child_depth);
+    }
+    return depth;
+}
+
+
+int gp_get_depth(const gp_tree_t* tree) {
+    int index = 0;
+    return get_depth_at(tree, &index);
+}
+
+
+uint64_t gp_hash(const gp_tree_t* tree) {
+    // FNV-1a
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int i = 0; i < tree->size; ++i) {
+        uint32_t value_bits;
+        memcpy(&value_bits, &tree->nodes[i].value, sizeof(value_bits));
+        const uint64_t word = (uint64_t) tree->nodes[i].op | (uint64_t) tree->nodes[i].variable << 8 |
+                              (uint64_t) value_bits << 16;
+        for (int b = 0; b < 6; ++b) {
+            hash = (hash ^ ((word >> (b * 8)) & 0xFF)) * 0x100000001B3ull;
+        }
+    }
+    return hash;
+}
+
+
+// variation
+//=============================================================================
+static gp_node_t random_leaf(gp_random_t* random, int variable_count) {
+    if (gp_random_next(random) & 1) {
+        return (gp_node_t){.op = GP_VARIABLE, .variable = (uint8_t) gp_random_below(random, variable_count)};
+    }
+    return (gp_node_t){.op = GP_CONSTANT, .value = random_constant(random)};
+}
+
+
+static void add_random_node(gp_tree_t* tree, gp_random_t* random, int depth_left, bool is_full, int variable_count) {
+    const bool is_leaf = depth_left == 0 || (!is_full && gp_random_below(random, 10) < 3);
+    if (is_leaf) {
+        tree->nodes[tree->size++] = random_leaf(random, variable_count);
+        return;
+    }
+
+    // a quarter of the operations are unary, like in the evolved heuristics
+    const bool is_unary = gp_random_below(random, 4) == 0;
+    const uint8_t op = is_unary ? unary_ops[gp_random_below(random, COUNT_OF(unary_ops))]
+                                : binary_ops[gp_random_below(random, COUNT_OF(binary_ops))];
+    tree->nodes[tree->size++] = (gp_node_t){.op = op};
+
+    for (int i = 0; i < gp_get_arity(op); ++i) {
+        add_random_node(tree, random, depth_left - 1, is_full, variable_count);
+    }
+}
+
+
+void gp_random_tree(gp_tree_t* tree, gp_random_t* random, int max_depth, bool is_full, int variable_count) {
+    // a full binary tree of depth 5 has 63 nodes
+    if (max_depth > 5) max_depth = 5;
+    tree->size = 0;
+    add_random_node(tree, random, max_depth, is_full, variable_count);
+}
+
+
+// Replaces nodes [start, end) of base with the given ones. Returns false if the result would be too large.
+static bool splice(gp_tree_t* out, const gp_tree_t* base, int start, int end, const gp_node_t* nodes, int count) {
+    const int size = base->size - (end - start) + count;
+    if (size > GP_MAX_NODES) return false;
+
+    gp_tree_t result;
+    result.size = (uint8_t) size;
+    memcpy(result.nodes, base->nodes, start * sizeof(gp_node_t));
+    memcpy(result.nodes + start, nodes, count * sizeof(gp_node_t));
+    memcpy(result.nodes + start + count, base->nodes + end, (base->size - end) * sizeof(gp_node_t));
+
+    if (gp_get_depth(&result) > GP_MAX_DEPTH) return false;
+    *out = result;
+    return true;
+}
+
+
+// Like Koza, operations are picked 90 % of the time, so crossover doesn't
+// mostly swap leaves.
+static int pick_node(const gp_tree_t* tree, gp_random_t* random) {
+    const bool want_operation = gp_random_below(random, 10) < 9;
+    for (int tries = 0; tries < 8; ++tries) {
+        const int index = (int) gp_random_below(random, tree->size);
+        if ((gp_get_arity(tree->nodes[index].op) > 0) == want_operation) return index;
+    }
+    return (int) gp_random_below(random, tree->size);
+}
+
+
+bool gp_crossover(gp_tree_t* child, const gp_tree_t* a, const gp_tree_t* b, gp_random_t* random) {
+    for (int tries = 0; tries < MAX_SPLICE_TRIES; ++tries) {
+        const int a_start = pick_node(a, random);
+        const int b_start = pick_node(b, random);
+        const int b_end = gp_get_subtree_end(b, b_start);
+
+        if (splice(child, a, a_start, gp_get_subtree_end(a, a_start), b->nodes + b_start, b_end - b_start)) {
+            return true;
+        }
+    }
+    *child = *a;
+    return false;
+}
+
+
+static void mutate_point(gp_tree_t* tree, gp_random_t* random, int variable_count) {
+    gp_node_t* node = &tree->nodes[gp_random_below(random, tree->size)];
+    switch (gp_get_arity(node->op)) {
+        case 0:
+            *node = random_leaf(random, variable_count);
+            break;
+        case 1:
+            node->op = unary_ops[gp_random_below(random, COUNT_OF(unary_ops))];
+            break;
+        default:
+            node->op = binary_ops[gp_random_below(random, COUNT_OF(binary_ops))];
+            break;
+    }
+}
+
+
+// Multiplies a constant by up to +-10 %, which tunes a good tree without
+// changing its shape.
+static bool nudge_constant(gp_tree_t* tree, gp_random_t* random) {
+    int constant_count = 0;
+    for (int i = 0; i < tree->size; ++i) {
+        constant_count += tree->nodes[i].op == GP_CONSTANT;
+    }
+    if (constant_count == 0) return false;
+
+    int which = (int) gp_random_below(random, constant_count);
+    for (int i = 0; i < tree->size; ++i) {
+        if (tree->nodes[i].op == GP_CONSTANT && which-- == 0) {
+            tree->nodes[i].value *= (float) (1.0 + (gp_random_unit(random) - 0.5) * 0.2);
+            break;
+        }
+    }
+    return true;
+}
+
+
+void gp_mutate(gp_tree_t* tree, gp_random_t* random, int variable_count) {
+    const uint32_t kind = gp_random_below(random, 10);
+
+    if (kind < 4) {
+        for (int tries = 0; tries < MAX_SPLICE_TRIES; ++tries) {
+            gp_tree_t subtree;
+            gp_random_tree(&subtree, random, 3, false, variable_count);
+
+            const int start = (int) gp_random_below(random, tree->size);
+            if (splice(tree, tree, start, gp_get_subtree_end(tree, start), subtree.nodes, subtree.size)) return;
+        }
+    }
+
+    if (kind >= 7 && nudge_constant(tree, random)) return;
+    mutate_point(tree, random, variable_count);
+}
+
+
+// evaluation
+//=============================================================================
+#define FOR_EACH_SAMPLE(expression) \
+    for (size_t i = 0; i < count; ++i) { \
+        out[i] = (expression); \
+    }
+
+// The result of a node at depth d is kept in a slot <= d, so a tree never
+// needs more than GP_MAX_DEPTH + 1.
+static const float* evaluate_node(const gp_tree_t* tree, int* index, const float* const* variables, size_t count,
+                                  gp_scratch_t* scratch, int slot) {
+    const gp_node_t node = tree->nodes[(*index)++];
+    float* out = scratch->slots[slot];
+
+    if (node.op == GP_VARIABLE) return variables[node.variable];
+    if (node.op == GP_CONSTANT) {
+        FOR_EACH_SAMPLE(node.value);
+        return out;
+    }
+
+    const float* a = evaluate_node(tree, index, variables, count, scratch, slot);
+    if (node.op == GP_NEG) {
+        FOR_EACH_SAMPLE(-a[i]);
+        return out;
+    }
+    if (node.op == GP_ABS) {
+        FOR_EACH_SAMPLE(ABS(a[i]));
+        return out;
+    }
+
+    const float* b = evaluate_node(tree, index, variables, count, scratch, slot + 1);
+    switch (node.op) {
+        case GP_ADD:
+            FOR_EACH_SAMPLE(a[i] + b[i]);
+            break;
+        case GP_SUB:
+            FOR_EACH_SAMPLE(a[i] - b[i]);
+            break;
+        case GP_MUL:
+            FOR_EACH_SAMPLE(a[i] * b[i]);
+            break;
+        case GP_DIV:
+            FOR_EACH_SAMPLE(SD(a[i], b[i]));
+            break;
+        case GP_MAX:
+            FOR_EACH_SAMPLE(MAX(a[i], b[i]));
+            break;
+        default:
+            FOR_EACH_SAMPLE(MIN(a[i], b[i]));
+            break;
+    }
+    return out;
+}
+
+
+const float* gp_evaluate_block(const gp_tree_t* tree, const float* const variables[GP_VARIABLE_COUNT],
+                               size_t count, gp_scratch_t* scratch) {
+    int index = 0;
+    return evaluate_node(tree, &index, variables, count, scratch, 0);
+}
+
+
+void gp_fold_constants(gp_tree_t* tree) {
+    static gp_scratch_t scratch;
+    const float* const no_variables[GP_VARIABLE_COUNT] = {NULL};
+
+    for (int i = 0; i < tree->size; ++i) {
+        const int end = gp_get_subtree_end(tree, i);
+        if (end - i == 1) continue;
+
+        bool has_variable = false;
+        for (int j = i; j < end; ++j) {
+            has_variable |= tree->nodes[j].op == GP_VARIABLE;
+        }
+        if (has_variable) continue;
+
+        gp_tree_t subtree = {.size = (uint8_t) (end - i)};
+        memcpy(subtree.nodes, tree->nodes + i, subtree.size * sizeof(gp_node_t));
+        const gp_node_t constant = {.op = GP_CONSTANT, .value = *gp_evaluate_block(&subtree, no_variables, 1, &scratch)};
+
+        // can't fail, as the tree only gets smaller
+        splice(tree, tree, i, end, &constant, 1);
+    }
+}
+
+
+// text
+//=============================================================================
+typedef struct {
+    const char* text;
+    const char* const* names;
+    gp_tree_t* tree;
+} parser_t;
+
+
+static void skip_space(parser_t* parser) {
+    while (isspace((unsigned char) *parser->text)) ++parser->text;
+}
+
+
+static bool parse_error(const parser_t* parser, const char* message) {
+    fprintf(stderr, "%s at \"%.20s\"\n", message, parser->text);
+    return false;
+}
+
+
+static bool add_node(parser_t* parser, gp_node_t node) {
+    if (parser->tree->size == GP_MAX_NODES) return parse_error(parser, "too many nodes");
+    parser->tree->nodes[parser->tree->size++] = node;
+    return true;
+}
+
+
+static bool parse_expression(parser_t* parser) {
+    skip_space(parser);
+
+    if (*parser->text != '(') {
+        char* end;
+        const float value = strtof(parser->text, &end);
+        if (end != parser->text) {
+            parser->text = end;
+            return add_node(parser, (gp_node_t){.op = GP_CONSTANT, .value = value});
+        }
+
+        for (uint8_t v = 0; v < GP_VARIABLE_COUNT; ++v) {
+            const size_t length = strlen(parser->names[v]);
+            if (strncmp(parser->text, parser->names[v], length) == 0 && !isalnum((unsigned char) parser->text[length])) {
+                parser->text += length;
+                return add_node(parser, (gp_node_t){.op = GP_VARIABLE, .variable = v});
+            }
+        }
+        return parse_error(parser, "expected a number or variable");
+    }
+
+    ++parser->text;
+    skip_space(parser);
+    const size_t length = strcspn(parser->text, " \t\r\n()");
+
+    uint8_t op = GP_OP_COUNT;
+    for (uint8_t o = GP_NEG; o < GP_OP_COUNT; ++o) {
+        if (strlen(op_names[o]) == length && strncmp(parser->text, op_names[o], length) == 0) op = o;
+    }
+    if (op == GP_OP_COUNT) return parse_error(parser, "unknown operation");
+    parser->text += length;
+
+    const int index = parser->tree->size;
+    if (!add_node(parser, (gp_node_t){.op = op})) return false;
+
+    int argument_count = 0;
+    while (skip_space(parser), *parser->text != ')') {
+        if (*parser->text == '\0') return parse_error(parser, "missing )");
+        if (!parse_expression(parser)) return false;
+        ++argument_count;
+    }
+    ++parser->text;
+
+    // (- x) is neg
+    if (op == GP_SUB && argument_count == 1) parser->tree->nodes[index].op = op = GP_NEG;
+    if (argument_count != gp_get_arity(op)) return parse_error(parser, "wrong number of arguments");
+    return true;
+}
+
+
+bool gp_parse(gp_tree_t* tree, const char* text, const char* const names[GP_VARIABLE_COUNT]) {
+    parser_t parser = {.text = text, .names = names, .tree = tree};
+    tree->size = 0;
+
+    if (!parse_expression(&parser)) return false;
+    skip_space(&parser);
+    if (*parser.text != '\0') return parse_error(&parser, "unexpected text");
+    if (gp_get_depth(tree) > GP_MAX_DEPTH) return parse_error(&parser, "too deep");
+    return true;
+}
+
+
+// shortest text that reads back as the same float
+static void format_constant(char* out, size_t size, float value) {
+    for (int precision = 6; precision <= 9; ++precision) {
+        snprintf(out, size, "%.*g", precision, value);
+        if (strtof(out, NULL) == value) break;
+    }
+}
+
+
+static int print_sexpr_at(FILE* file, const gp_tree_t* tree, int index, const char* const* names) {
+    const gp_node_t* node = &tree->nodes[index++];
+    if (node->op == GP_VARIABLE) {
+        fprintf(file, "%s", names[node->variable]);
+        return index;
+    }
+    if (node->op == GP_CONSTANT) {
+        char constant[32];
+        format_constant(constant, sizeof(constant), node->value);
+        fprintf(file, "%s", constant);
+        return index;
+    }
+
+    fprintf(file, "(%s", op_names[node->op]);
+    for (int i = 0; i < gp_get_arity(node->op); ++i) {
+        fprintf(file, " ");
+        index = print_sexpr_at(file, tree, index, names);
+    }
+    fprintf(file, ")");
+    return index;
+}
+
+
+void gp_print_sexpr(FILE* file, const gp_tree_t* tree, const char* const names[GP_VARIABLE_COUNT]) {
+    print_sexpr_at(file, tree, 0, names);
+}
+
+
+typedef struct {
+    FILE* file;
+    const char* const* names;
+    const char* result_name;
+    const char* indent;
+    int value_count;
+} c_printer_t;
+
+
+// the C literal of a float, e.g. 3.0f
+static void format_c_constant(char* out, size_t size, float value) {
+    format_constant(out, size, value);
+    if (strpbrk(out, ".e") == NULL) strncat(out, ".0", size - strlen(out) - 1);
+    strncat(out, "f", size - strlen(out) - 1);
+}
+
+
+// Writes the name of the value of the subtree at index to name.
+static int print_c_at(c_printer_t* printer, const gp_tree_t* tree, int index, char* name, size_t name_size) {
+    const gp_node_t* node = &tree->nodes[index++];
+    const bool is_root = index == 1;
+
+    if (node->op == GP_VARIABLE || node->op == GP_CONSTANT) {
+        if (node->op == GP_VARIABLE) {
+            snprintf(name, name_size, "%s", printer->names[node->variable]);
+        } else {
+            format_c_constant(name, name_size, node->value);
+        }
+        if (is_root) fprintf(printer->file, "%sconst float %s = %s;\n", printer->indent, printer->result_name, name);
+        return index;
+    }
+
+    char a[32], b[32];
+    index = print_c_at(printer, tree, index, a, sizeof(a));
+    if (gp_get_arity(node->op) == 2) index = print_c_at(printer, tree, index, b, sizeof(b));
+
+    if (is_root) {
+        snprintf(name, name_size, "%s", printer->result_name);
+    } else {
+        snprintf(name, name_size, "v%d", printer->value_count++);
+    }
+    fprintf(printer->file, "%sconst float %s = ", printer->indent, name);
+
+    switch (node->op) {
+        case GP_NEG:
+            fprintf(printer->file, a[0] == '-' ? "-(%s)" : "-%s", a);
+            break;
+        case GP_ABS:
+            fprintf(printer->file, "ABS(%s)", a);
+            break;
+        case GP_ADD:
+            fprintf(printer->file, "%s + %s", a, b);
+            break;
+        case GP_SUB:
+            fprintf(printer->file, "%s - %s", a, b);
+            break;
+        case GP_MUL:
+            fprintf(printer->file, "%s * %s", a, b);
+            break;
+        case GP_DIV:
+            fprintf(printer->file, "SD(%s, %s)", a, b);
+            break;
+        case GP_MAX:
+            fprintf(printer->file, "MAX(%s, %s)", a, b);
+            break;
+        default:
+            fprintf(printer->file, "MIN(%s, %s)", a, b);
+            break;
+    }
+    fprintf(printer->file, ";\n");
+    return index;
+}
+
+
+void gp_print_c(FILE* file, const gp_tree_t* tree, const char* const names[GP_VARIABLE_COUNT],
+                const char* result_name, const char* indent) {
+    c_printer_t printer = {.file = file, .names = names, .result_name = result_name, .indent = indent};
+    char name[32];
+    print_c_at(&printer, tree, 0, name, sizeof(name));
+}
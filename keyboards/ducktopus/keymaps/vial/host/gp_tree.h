@@ -0,0 +1,99 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Expression trees for the genetic programming in host/evolve. A tree is a
+// fixed size array of nodes in prefix order, so it can be copied and hashed
+// as a whole. The operations are those the evolved heuristics use, with the
+// semantics of the macros in heuristic_tap_hold_kernels.h (SD for division),
+// and everything is evaluated in float like on the keyboard. So a tree printed
+// as C makes exactly the decisions it was scored with.
+//
+// As text (for reading in the current heuristics), a tree is an s-expression:
+//
+//     (max (neg p) (max 3.0614197 (+ (* -6.4232006 t) 302.9532165)))
+//
+// with the operations + - * / max min abs neg (or - with one argument).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define GP_MAX_NODES      63
+#define GP_MAX_DEPTH      12
+#define GP_VARIABLE_COUNT 3
+
+// samples are evaluated in blocks of this many, so the intermediate results stay in the cache
+#define GP_BLOCK_SIZE     256
+
+typedef enum {
+    GP_CONSTANT,
+    GP_VARIABLE,
+    GP_NEG,
+    GP_ABS,
+    GP_ADD,
+    GP_SUB,
+    GP_MUL,
+    GP_DIV,
+    GP_MAX,
+    GP_MIN,
+    GP_OP_COUNT
+} gp_op_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t variable;
+    float value;
+} gp_node_t;
+
+typedef struct {
+    uint8_t size;
+    gp_node_t nodes[GP_MAX_NODES];
+} gp_tree_t;
+
+// splitmix64, so the same seed always evolves the same trees
+typedef struct {
+    uint64_t state;
+} gp_random_t;
+
+uint64_t gp_random_next(gp_random_t* random);
+// 0 <= result < bound
+uint32_t gp_random_below(gp_random_t* random, uint32_t bound);
+// 0 <= result < 1
+double gp_random_unit(gp_random_t* random);
+
+int gp_get_arity(uint8_t op);
+// the index after the subtree starting at index
+int gp_get_subtree_end(const gp_tree_t* tree, int index);
+// 0 for a single node
+int gp_get_depth(const gp_tree_t* tree);
+uint64_t gp_hash(const gp_tree_t* tree);
+
+// Full trees have every leaf at max_depth (at most 5), grown ones stop at
+// random.
+void gp_random_tree(gp_tree_t* tree, gp_random_t* random, int max_depth, bool is_full, int variable_count);
+// Replaces a random subtree of a with a random subtree of b. Returns false
+// (and copies a) if no fitting pair was found.
+bool gp_crossover(gp_tree_t* child, const gp_tree_t* a, const gp_tree_t* b, gp_random_t* random);
+// Replaces a subtree, changes an operation or variable or nudges a constant.
+void gp_mutate(gp_tree_t* tree, gp_random_t* random, int variable_count);
+
+typedef struct {
+    float slots[GP_MAX_DEPTH + 1][GP_BLOCK_SIZE];
+} gp_scratch_t;
+
+// Evaluates up to GP_BLOCK_SIZE samples. The result is valid until the
+// scratch is used again (or points into variables).
+const float* gp_evaluate_block(const gp_tree_t* tree, const float* const variables[GP_VARIABLE_COUNT],
+                               size_t count, gp_scratch_t* scratch);
+// Replaces subtrees without variables by their value (like a compiler would),
+// which doesn't change any result. Not thread safe.
+void gp_fold_constants(gp_tree_t* tree);
+
+// Returns false (after printing why) if the text isn't a valid tree.
+bool gp_parse(gp_tree_t* tree, const char* text, const char* const names[GP_VARIABLE_COUNT]);
+void gp_print_sexpr(FILE* file, const gp_tree_t* tree, const char* const names[GP_VARIABLE_COUNT]);
+// One "const float vN = ...;" line per operation, the last one is result_name.
+void gp_print_c(FILE* file, const gp_tree_t* tree, const char* const names[GP_VARIABLE_COUNT],
+                const char* result_name, const char* indent);
@@ -0,0 +1,89 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "handler_stats.h"
+
+
+static bool transfer_command(handler_stats_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = RECORD_HANDLER_STATS_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != RECORD_HANDLER_STATS_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "handler stats command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+static uint32_t read_u32(const uint8_t* in) {
+    return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t) in[3] << 24;
+}
+
+
+bool read_handler_stats(handler_stats_transfer_t transfer, void* context, handler_stats_t* stats) {
+    uint8_t packet[HANDLER_STATS_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, RECORD_HANDLER_STATS_HID_INFO)) return false;
+
+    if (packet[2] != RECORD_HANDLER_STATS_HID_VERSION) {
+        fprintf(stderr, "unsupported handler stats protocol version %u\n", packet[2]);
+        return false;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->handler_count = MIN(packet[3], RECORD_HANDLERS_MAX);
+
+    for (uint8_t handler = 0; handler < stats->handler_count; ++handler) {
+        memset(packet, 0, sizeof(packet));
+        packet[2] = handler;
+        if (!transfer_command(transfer, context, packet, RECORD_HANDLER_STATS_HID_READ)) return false;
+        if (packet[2] != handler) {
+            fprintf(stderr, "invalid handler stats response for handler %u\n", handler);
+            return false;
+        }
+
+        handler_stats_entry_t* entry = &stats->handlers[handler];
+        entry->stats.calls = read_u32(packet + 4);
+        entry->stats.skips = read_u32(packet + 8);
+        entry->stats.cycles = read_u32(packet + 12) | (uint64_t) read_u32(packet + 16) << 32;
+        entry->stats.max_cycles = read_u32(packet + 20);
+        memcpy(entry->name, packet + 24, 8);
+        entry->name[8] = '\0';
+    }
+    return true;
+}
+
+
+bool reset_handler_stats(handler_stats_transfer_t transfer, void* context) {
+    uint8_t packet[HANDLER_STATS_PACKET_SIZE] = {0};
+    return transfer_command(transfer, context, packet, RECORD_HANDLER_STATS_HID_RESET);
+}
+
+
+void print_handler_stats(FILE* file, const handler_stats_t* stats, const char* cycles_name) {
+    uint64_t total_cycles = 0;
+    for (uint8_t handler = 0; handler < stats->handler_count; ++handler) {
+        total_cycles += stats->handlers[handler].stats.cycles;
+    }
+
+    char per_call[32];
+    snprintf(per_call, sizeof(per_call), "%s per call", cycles_name);
+    const int per_call_width = (int) strlen(per_call);
+
+    fprintf(file, "%-8s %10s %10s %*s %10s %8s\n", "handler", "calls", "skipped", per_call_width, per_call, "max",
+            "of all");
+    for (uint8_t handler = 0; handler < stats->handler_count; ++handler) {
+        const record_handler_stats_t* handler_stats = &stats->handlers[handler].stats;
+        const uint64_t events = (uint64_t) handler_stats->calls + handler_stats->skips;
+
+        fprintf(file, "%-8s %10lu %9.2f%% %*.1f %10lu %7.2f%%\n", stats->handlers[handler].name,
+                (unsigned long) handler_stats->calls,
+                events ? 100.0 * (double) handler_stats->skips / (double) events : 0.0,
+                per_call_width,
+                handler_stats->calls ? (double) handler_stats->cycles / handler_stats->calls : 0.0,
+                (unsigned long) handler_stats->max_cycles,
+                total_cycles ? 100.0 * (double) handler_stats->cycles / (double) total_cycles : 0.0);
+    }
+}
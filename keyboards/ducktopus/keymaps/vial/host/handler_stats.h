@@ -0,0 +1,30 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the stats of the process_record handlers over the raw HID protocol
+// described in features/record_handlers.h and prints them per handler.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "features/record_handlers.h"
+
+#define HANDLER_STATS_PACKET_SIZE 32
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*handler_stats_transfer_t)(uint8_t* packet, void* context);
+
+typedef struct {
+    char name[9];
+    record_handler_stats_t stats;
+} handler_stats_entry_t;
+
+typedef struct {
+    uint8_t handler_count;
+    handler_stats_entry_t handlers[RECORD_HANDLERS_MAX];
+} handler_stats_t;
+
+bool read_handler_stats(handler_stats_transfer_t transfer, void* context, handler_stats_t* stats);
+bool reset_handler_stats(handler_stats_transfer_t transfer, void* context);
+// cycles_name is what a cycle is, e.g. "cycles" or "TSC ticks"
+void print_handler_stats(FILE* file, const handler_stats_t* stats, const char* cycles_name);
@@ -0,0 +1,62 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the biases the keyboard learned from corrections over raw HID (Linux
+// hidraw), see features/heuristic_tap_hold_adaptive.h.
+//
+//     hid_adaptive /dev/hidrawN        print them
+//     hid_adaptive -s /dev/hidrawN     and save them to the EEPROM now
+//     hid_adaptive -x /dev/hidrawN     back to no bias
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "adaptive.h"
+#include "hidraw.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-s | -x [-n]] HIDRAW\n"
+            "  -s  save the biases to the EEPROM now, instead of with the next batch\n"
+            "  -x  reset the biases and counts after printing them\n"
+            "  -n  don't save the reset, so the saved biases are back after a restart\n",
+            name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    bool should_save_now = false;
+    bool should_reset = false;
+    bool should_save = true;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0) {
+            should_save_now = true;
+        } else if (strcmp(argv[i], "-x") == 0) {
+            should_reset = true;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            should_save = false;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL || (should_save_now && should_reset) || (!should_save && !should_reset)) usage(argv[0]);
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    adaptive_biases_t biases;
+    bool is_ok = read_adaptive_biases(transfer_hidraw, &fd, &biases);
+    if (is_ok) print_adaptive_biases(stdout, &biases);
+
+    if (is_ok && should_save_now) is_ok = save_adaptive_biases(transfer_hidraw, &fd);
+    if (is_ok && should_reset) is_ok = reset_adaptive_biases(transfer_hidraw, &fd, should_save);
+
+    close(fd);
+    return is_ok ? 0 : 1;
+}
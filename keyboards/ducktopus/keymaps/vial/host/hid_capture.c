@@ -0,0 +1,232 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Turns the keystroke capture of the keyboard on or off and drains what it
+// recorded over raw HID into the stream format that build/replay reads
+// (Linux hidraw).
+//
+//     hid_capture -s on /dev/hidrawN                 start capturing
+//     hid_capture -k keymap.txt -o typing.txt /dev/hidrawN
+//
+// The firmware doesn't record keycodes. They are looked up by position in the
+// keymap file (lines of "<row> <col> <keycode>", '#' starts a comment), and
+// are 0 for positions that aren't in it. When the output file exists, the
+// events are appended and their times continue where it ended.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hidraw.h"
+#include "features/keystroke_capture.h"
+
+typedef bool (*transfer_t)(uint8_t* packet, void* context);
+
+static uint16_t keycode_at[16][16];
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-s on|off] [-k KEYMAP] [-o OUTPUT] HIDRAW\n"
+            "  -s on|off  turn capturing on or off (then nothing is drained)\n"
+            "  -k KEYMAP  keycode per position (\"<row> <col> <keycode>\" per line)\n"
+            "  -o OUTPUT  append the events to this stream file (default stdout)\n",
+            name);
+    exit(2);
+}
+
+
+static void load_keymap(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    char line[256];
+    unsigned line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ++line_number;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        unsigned long row, col;
+        long keycode;
+        const int fields = sscanf(line, "%lu %lu %li", &row, &col, &keycode);
+        if (fields <= 0) continue;
+
+        if (fields != 3 || row >= 16 || col >= 16 || keycode < 0 || keycode > 0xFFFF) {
+            fprintf(stderr, "%s:%u: invalid keymap entry\n", path, line_number);
+            exit(1);
+        }
+        keycode_at[row][col] = (uint16_t) keycode;
+    }
+    fclose(file);
+}
+
+
+// the time of the last event in an existing stream file, so appended events continue from there
+static uint64_t read_last_time(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return 0;
+
+    uint64_t last_time = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long long time;
+        if (line[0] != '#' && sscanf(line, "%llu", &time) == 1) last_time = time;
+    }
+    fclose(file);
+    return last_time;
+}
+
+
+static bool transfer_command(transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    packet[0] = KEYSTROKE_CAPTURE_HID_ID;
+    packet[1] = command;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[1] != command) {
+        fprintf(stderr, "capture command %u failed (response %02x)\n", command, packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+static bool set_capturing(transfer_t transfer, void* context, bool enable) {
+    uint8_t packet[RAW_HID_PACKET_SIZE] = {0};
+    packet[2] = enable;
+    if (!transfer_command(transfer, context, packet, CAPTURE_HID_SET)) return false;
+
+    fprintf(stderr, "capturing is %s\n", packet[2] ? "on" : "off");
+    return true;
+}
+
+
+typedef struct {
+    FILE* output;
+    uint64_t time;
+
+    // an event can be split over two packets
+    bool has_position;
+    bool is_gap;
+    uint8_t position;
+    uint32_t varint;
+    uint8_t varint_shift;
+
+    unsigned long event_count;
+    unsigned long dropped_count;
+} decoder_t;
+
+
+static void decode_byte(decoder_t* decoder, uint8_t byte) {
+    if (!decoder->has_position) {
+        decoder->has_position = true;
+        decoder->is_gap = byte == CAPTURE_GAP_MARKER;
+        decoder->position = byte;
+        decoder->varint = 0;
+        decoder->varint_shift = 0;
+        return;
+    }
+
+    if (decoder->varint_shift < 32) decoder->varint |= (uint32_t) (byte & 0x7F) << decoder->varint_shift;
+    decoder->varint_shift += 7;
+    if (byte & 0x80) return;
+
+    decoder->has_position = false;
+
+    if (decoder->is_gap) {
+        fprintf(decoder->output, "# %u events were dropped here, as the buffer was full\n", decoder->varint);
+        decoder->dropped_count += decoder->varint;
+        return;
+    }
+
+    const uint8_t row = decoder->position >> 4;
+    const uint8_t col = decoder->position & 0xF;
+    decoder->time += decoder->varint >> 1;
+
+    fprintf(decoder->output, "%llu %u %u 0x%04X %c\n", (unsigned long long) decoder->time, row, col,
+            keycode_at[row][col], (decoder->varint & 1) ? 'd' : 'u');
+    decoder->event_count++;
+}
+
+
+static bool drain_capture(transfer_t transfer, void* context, decoder_t* decoder) {
+    uint8_t packet[RAW_HID_PACKET_SIZE];
+
+    memset(packet, 0, sizeof(packet));
+    if (!transfer_command(transfer, context, packet, CAPTURE_HID_INFO)) return false;
+    if (packet[2] != CAPTURE_HID_VERSION) {
+        fprintf(stderr, "unsupported capture protocol version %u\n", packet[2]);
+        return false;
+    }
+    const unsigned long total_dropped = packet[8] | packet[9] << 8 | (unsigned long) (packet[10] | packet[11] << 8) << 16;
+    fprintf(stderr, "capturing is %s, %u of %u bytes used, %lu events dropped in total\n",
+            packet[3] ? "on" : "off", packet[6] | packet[7] << 8, packet[4] | packet[5] << 8, total_dropped);
+
+    while (true) {
+        memset(packet, 0, sizeof(packet));
+        if (!transfer_command(transfer, context, packet, CAPTURE_HID_DRAIN)) return false;
+
+        const uint8_t n = packet[2];
+        if (n == 0) break;
+        for (uint8_t i = 0; i < n; ++i) {
+            decode_byte(decoder, packet[3 + i]);
+        }
+    }
+
+    // only happens if the buffer ended in the middle of an event, which the firmware never does
+    if (decoder->has_position) fprintf(stderr, "the last event was incomplete\n");
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+    const char* set_to = NULL;
+    const char* output_path = NULL;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            set_to = argv[++i];
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            load_keymap(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) usage(argv[0]);
+    if (set_to != NULL && strcmp(set_to, "on") != 0 && strcmp(set_to, "off") != 0) usage(argv[0]);
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    if (set_to != NULL) {
+        const bool is_ok = set_capturing(transfer_hidraw, &fd, strcmp(set_to, "on") == 0);
+        close(fd);
+        return is_ok ? 0 : 1;
+    }
+
+    decoder_t decoder = {.output = stdout};
+    if (output_path != NULL) {
+        decoder.time = read_last_time(output_path);
+        decoder.output = fopen(output_path, "a");
+        if (decoder.output == NULL) {
+            perror(output_path);
+            return 1;
+        }
+    }
+
+    const bool is_ok = drain_capture(transfer_hidraw, &fd, &decoder);
+    fprintf(stderr, "%lu events drained, %lu dropped\n", decoder.event_count, decoder.dropped_count);
+
+    if (decoder.output != stdout) fclose(decoder.output);
+    close(fd);
+    return is_ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads or replaces the coefficients of the heuristics the keyboard uses over
+// raw HID (Linux hidraw), see features/heuristic_tap_hold_coefficients.h.
+//
+//     hid_coefficients /dev/hidrawN                   print the set in use
+//     hid_coefficients -w tuned.txt /dev/hidrawN      write and save it
+//     hid_coefficients -d /dev/hidrawN                back to the defaults
+//     hid_coefficients -p > defaults.txt              the defaults, to start from
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "coefficients.h"
+#include "hidraw.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-w FILE | -d] [-n] HIDRAW\n"
+            "       %s -p\n"
+            "  -w FILE  replace the coefficients with those of the file\n"
+            "  -d       go back to the compiled in defaults\n"
+            "  -n       don't save them to the EEPROM, so they are gone after a restart\n"
+            "  -p       print the defaults of this build\n",
+            name, name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    const char* write_path = NULL;
+    bool should_reset = false;
+    bool should_save = true;
+    const char* path = NULL;
+
+    if (argc == 2 && strcmp(argv[1], "-p") == 0) {
+        heuristic_tap_hold_coefficients_t defaults;
+        get_default_coefficients(&defaults);
+        print_coefficients(stdout, &defaults);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            write_path = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0) {
+            should_reset = true;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            should_save = false;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL || (write_path != NULL && should_reset)) usage(argv[0]);
+
+    // before touching the keyboard, so a bad file changes nothing
+    heuristic_tap_hold_coefficients_t set;
+    if (write_path != NULL && !load_coefficient_file(write_path, &set)) return 1;
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    bool is_ok;
+    if (write_path != NULL) {
+        is_ok = write_coefficients(transfer_hidraw, &fd, &set, should_save);
+    } else if (should_reset) {
+        is_ok = reset_coefficients(transfer_hidraw, &fd, should_save);
+    } else {
+        is_ok = read_coefficients(transfer_hidraw, &fd, &set);
+        if (is_ok) print_coefficients(stdout, &set);
+    }
+    close(fd);
+
+    if (is_ok && (write_path != NULL || should_reset)) {
+        fprintf(stderr, should_save ? "written and saved\n" : "written (until the next restart)\n");
+    }
+    return is_ok ? 0 : 1;
+}
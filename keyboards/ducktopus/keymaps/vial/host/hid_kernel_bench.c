@@ -0,0 +1,31 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Times the float, fixed point and table versions of the heuristics on the
+// keyboard over raw HID and prints the cycles per call (Linux hidraw). The
+// keyboard has to be built with HEURISTIC_TAP_HOLD_KERNEL_BENCH.
+//
+//     hid_kernel_bench /dev/hidrawN
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hidraw.h"
+#include "kernel_bench.h"
+
+
+int main(int argc, char** argv) {
+    if (argc != 2 || argv[1][0] == '-') {
+        fprintf(stderr, "usage: %s HIDRAW\n", argv[0]);
+        return 2;
+    }
+
+    int fd = open_hidraw(argv[1]);
+    if (fd < 0) return 1;
+
+    kernel_bench_t bench;
+    if (!run_kernel_bench(transfer_hidraw, &fd, &bench)) return 1;
+    print_kernel_bench(stdout, &bench, "cycles");
+
+    close(fd);
+    return 0;
+}
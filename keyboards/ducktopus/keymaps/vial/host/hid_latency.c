@@ -0,0 +1,51 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the decision latency histograms from the keyboard over raw HID and
+// prints p50/p95/p99 per decision path (Linux hidraw).
+//
+//     hid_latency [-x] /dev/hidrawN
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hidraw.h"
+#include "latency.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-x] HIDRAW\n"
+            "  -x  reset the histograms after reading them\n",
+            name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    bool should_reset = false;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-x") == 0) {
+            should_reset = true;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) usage(argv[0]);
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    static latency_histograms_t histograms;
+    if (!read_latency_histograms(transfer_hidraw, &fd, &histograms)) return 1;
+    print_latency_percentiles(stdout, &histograms);
+
+    if (should_reset && !reset_latency_histograms(transfer_hidraw, &fd)) return 1;
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the call counters and cycles of the process_record handlers of
+// keymap.c from the keyboard over raw HID and prints them (Linux hidraw).
+// The keyboard has to be built with RECORD_HANDLER_STATS.
+//
+//     hid_record_handlers [-x] /dev/hidrawN
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "handler_stats.h"
+#include "hidraw.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-x] HIDRAW\n"
+            "  -x  reset the counters after reading them\n",
+            name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    bool should_reset = false;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-x") == 0) {
+            should_reset = true;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) usage(argv[0]);
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    handler_stats_t stats;
+    if (!read_handler_stats(transfer_hidraw, &fd, &stats)) return 1;
+    print_handler_stats(stdout, &stats, "cycles");
+
+    if (should_reset && !reset_handler_stats(transfer_hidraw, &fd)) return 1;
+
+    close(fd);
+    return 0;
+}
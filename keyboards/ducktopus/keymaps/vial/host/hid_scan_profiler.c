@@ -0,0 +1,52 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads how long the stages of the scan loop take from the keyboard over raw
+// HID and prints them with the scan rate (Linux hidraw). The keyboard has to
+// be built with SCAN_PROFILER_ENABLE.
+//
+//     hid_scan_profiler [-x] /dev/hidrawN
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hidraw.h"
+#include "scan_profile.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-x] HIDRAW\n"
+            "  -x  reset the stats after reading them\n",
+            name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    bool should_reset = false;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-x") == 0) {
+            should_reset = true;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) usage(argv[0]);
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    scan_profile_t profile;
+    if (!read_scan_profile(transfer_hidraw, &fd, &profile)) return 1;
+    print_scan_profile(stdout, &profile);
+
+    if (should_reset && !reset_scan_profile(transfer_hidraw, &fd)) return 1;
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the shadow mode counters from the keyboard over raw HID and prints
+// how often the candidate heuristic agreed with the live one, per decision
+// path (Linux hidraw).
+//
+//     hid_shadow [-x] /dev/hidrawN
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hidraw.h"
+#include "shadow.h"
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-x] HIDRAW\n"
+            "  -x  reset the counters after reading them\n",
+            name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    bool should_reset = false;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-x") == 0) {
+            should_reset = true;
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) usage(argv[0]);
+
+    int fd = open_hidraw(path);
+    if (fd < 0) return 1;
+
+    shadow_comparison_t comparison;
+    if (!read_shadow_comparison(transfer_hidraw, &fd, &comparison)) return 1;
+    print_shadow_comparison(stdout, &comparison);
+
+    if (should_reset && !reset_shadow_comparison(transfer_hidraw, &fd)) return 1;
+
+    close(fd);
+    return 0;
+}
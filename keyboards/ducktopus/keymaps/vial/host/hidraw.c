@@ -0,0 +1,57 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hidraw.h"
+
+#define MS_RESPONSE_TIMEOUT 1000
+
+
+int open_hidraw(const char* path) {
+    const int fd = open(path, O_RDWR);
+    if (fd < 0) perror(path);
+    return fd;
+}
+
+
+bool transfer_hidraw(uint8_t* packet, void* context) {
+    const int fd = *(const int*) context;
+
+    // the first byte is the report id, which raw HID doesn't use
+    uint8_t report[RAW_HID_PACKET_SIZE + 1] = {0};
+    memcpy(report + 1, packet, RAW_HID_PACKET_SIZE);
+    if (write(fd, report, sizeof(report)) != (ssize_t) sizeof(report)) {
+        perror("write");
+        return false;
+    }
+
+    // skip anything that isn't the response to our command
+    while (true) {
+        struct pollfd poll_fd = {.fd = fd, .events = POLLIN};
+        const int ready = poll(&poll_fd, 1, MS_RESPONSE_TIMEOUT);
+        if (ready <= 0) {
+            fprintf(stderr, ready == 0 ? "no response from the keyboard\n" : "poll: %s\n", strerror(errno));
+            return false;
+        }
+
+        uint8_t response[RAW_HID_PACKET_SIZE];
+        const ssize_t size = read(fd, response, sizeof(response));
+        if (size != (ssize_t) sizeof(response)) {
+            if (size < 0) {
+                perror("read");
+            } else {
+                fprintf(stderr, "unexpected report size %zd\n", size);
+            }
+            return false;
+        }
+        if (response[0] == packet[0]) {
+            memcpy(packet, response, RAW_HID_PACKET_SIZE);
+            return true;
+        }
+    }
+}
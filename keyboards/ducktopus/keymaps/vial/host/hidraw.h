@@ -0,0 +1,19 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Raw HID packets to and from the keyboard over Linux hidraw. The raw HID
+// interface is the one with usage page 0xFF60 (the one Vial uses).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RAW_HID_PACKET_SIZE 32
+
+// Returns the file descriptor, or -1 (after printing why).
+int open_hidraw(const char* path);
+
+// Sends the packet and overwrites it with the response (the first packet
+// that starts with the same command id). context points to the descriptor.
+// Returns false on error.
+bool transfer_hidraw(uint8_t* packet, void* context);
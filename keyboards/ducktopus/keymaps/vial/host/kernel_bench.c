@@ -0,0 +1,80 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "kernel_bench.h"
+
+
+static bool transfer_command(kernel_bench_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = HEURISTIC_TAP_HOLD_KERNEL_BENCH_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != HEURISTIC_TAP_HOLD_KERNEL_BENCH_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "kernel bench command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+static uint32_t read_u32(const uint8_t* in) {
+    return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t) in[3] << 24;
+}
+
+
+bool run_kernel_bench(kernel_bench_transfer_t transfer, void* context, kernel_bench_t* bench) {
+    uint8_t packet[KERNEL_BENCH_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, KERNEL_BENCH_HID_INFO)) return false;
+
+    if (packet[2] != KERNEL_BENCH_HID_VERSION) {
+        fprintf(stderr, "unsupported kernel bench protocol version %u\n", packet[2]);
+        return false;
+    }
+
+    memset(bench, 0, sizeof(*bench));
+    bench->kernel_count = MIN(packet[3], KERNEL_BENCH_KERNEL_COUNT);
+
+    for (uint8_t kernel = 0; kernel < bench->kernel_count; ++kernel) {
+        memset(packet, 0, sizeof(packet));
+        packet[2] = kernel;
+        if (!transfer_command(transfer, context, packet, KERNEL_BENCH_HID_RUN)) return false;
+        if (packet[2] != kernel) {
+            fprintf(stderr, "invalid kernel bench response for kernel %u\n", kernel);
+            return false;
+        }
+
+        kernel_bench_result_t* result = &bench->kernels[kernel];
+        result->calls = read_u32(packet + 4);
+        result->cycles = read_u32(packet + 8) | (uint64_t) read_u32(packet + 12) << 32;
+        result->max_cycles = read_u32(packet + 16);
+        memcpy(result->name, packet + 24, 8);
+        result->name[8] = '\0';
+    }
+    return true;
+}
+
+
+static double get_cycles_per_call(const kernel_bench_result_t* result) {
+    return result->calls ? (double) result->cycles / result->calls : 0.0;
+}
+
+
+void print_kernel_bench(FILE* file, const kernel_bench_t* bench, const char* cycles_name) {
+    if (bench->kernel_count == 0) return;
+
+    // the first kernel calls nothing
+    const double overhead = get_cycles_per_call(&bench->kernels[KERNEL_BENCH_NONE]);
+
+    char per_call[32];
+    snprintf(per_call, sizeof(per_call), "%s per call", cycles_name);
+    const int per_call_width = (int) strlen(per_call);
+
+    fprintf(file, "%-8s %8s %*s %10s\n", "kernel", "calls", per_call_width, per_call, "max");
+    for (uint8_t kernel = 1; kernel < bench->kernel_count; ++kernel) {
+        const kernel_bench_result_t* result = &bench->kernels[kernel];
+        fprintf(file, "%-8s %8lu %*.1f %10lu\n", result->name, (unsigned long) result->calls, per_call_width,
+                get_cycles_per_call(result) - overhead, (unsigned long) result->max_cycles);
+    }
+    fprintf(file, "(without the %.1f %s a call of nothing takes)\n", overhead, cycles_name);
+}
@@ -0,0 +1,31 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Runs the kernel bench of features/heuristic_tap_hold_kernel_bench.h over
+// its raw HID protocol and prints the cycles per call of every kernel.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_kernel_bench.h"
+
+#define KERNEL_BENCH_PACKET_SIZE 32
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*kernel_bench_transfer_t)(uint8_t* packet, void* context);
+
+typedef struct {
+    char name[9];
+    uint32_t calls;
+    uint64_t cycles;
+    uint32_t max_cycles;
+} kernel_bench_result_t;
+
+typedef struct {
+    uint8_t kernel_count;
+    kernel_bench_result_t kernels[KERNEL_BENCH_KERNEL_COUNT];
+} kernel_bench_t;
+
+bool run_kernel_bench(kernel_bench_transfer_t transfer, void* context, kernel_bench_t* bench);
+// cycles_name is what a cycle is, e.g. "cycles" or "TSC ticks"
+void print_kernel_bench(FILE* file, const kernel_bench_t* bench, const char* cycles_name);
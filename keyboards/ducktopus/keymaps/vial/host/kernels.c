@@ -0,0 +1,332 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Checks that the fixed point heuristics make the same decisions as the float
+// reference, except where float rounding decides (the guess in double is within
+// BOUNDARY_TOLERANCE of the boundary), that the _with versions with the
+// default coefficients make exactly the same ones and that the overlap table
+// stays within its error bound, for every input the state machine can
+// produce. And compares how long they take per call.
+//
+//     kernels verify
+//     kernels bench     also runs the kernel bench of the keyboard (see
+//                       features/heuristic_tap_hold_kernel_bench.h) here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <x86intrin.h>
+#    define HAS_CYCLE_COUNTER
+#endif
+
+#include "kernel_bench.h"
+#include "features/cycle_counter.h"
+#include "features/heuristic_tap_hold_kernels.h"
+#include "features/heuristic_tap_hold_overlap_table.h"
+
+// relative, many times the rounding error of the few float operations
+#define BOUNDARY_TOLERANCE 1e-6
+
+#define BENCH_INPUT_COUNT (1 << 20)
+#define BENCH_ROUNDS      20
+
+static const float overlap_coefficients[] = DEFAULT_OVERLAP_COEFFICIENTS;
+static const float wrapped_coefficients[] = DEFAULT_WRAPPED_COEFFICIENTS;
+static const float two_down_coefficients[] = DEFAULT_TWO_DOWN_COEFFICIENTS;
+
+// of the _with versions, checked in the same loops
+static unsigned long coefficient_mismatches;
+
+// fixed point decisions that differ from the float ones, but only at the boundary
+static unsigned long boundary_mismatches;
+
+
+// The float reference in double, with the same constants, to tell how close to
+// the boundary (+-0.5) a guess is. Returns the relative distance.
+static double get_wrapped_boundary_distance(int32_t p, uint16_t t, uint16_t n) {
+    const double r = t == 0 ? 1.0 : 1.0 / t;
+    const double inner = MAX((double) 1.1125613f, (double) -5.7630343f * p - (double) 184.2279510f);
+    const double d = MAX((double) 1.1125613f + (double) 558.6079711f * r,
+                         MAX((double) 110.8752517f, inner * -p) +
+                             (n == 0 ? (double) 4170.0205078f : (double) 4170.0205078f / n) - (double) 179.2697753f);
+    const double guess = MAX(p * (double) 0.6423792f, (double) 23.4521789f) / ((double) 542.2182617f * r * d);
+    return ABS(ABS(guess) - 0.5) / 0.5;
+}
+
+
+static double get_two_down_boundary_distance(int32_t p, uint16_t t, int m) {
+    const double guess = (ABS((double) -0.0297553f * p - (double) 9.2836914f) +
+                          ((double) 0.2559899f + m * ((double) 0.0180325f * MAX(-p, (double) 17.5247516f))) * t) /
+                         (MAX(-p, (double) 14.0228700f) * (double) -9.2638397f);
+    return ABS(ABS(guess) - 0.5) / 0.5;
+}
+
+
+static unsigned long check_overlap(void) {
+    unsigned long mismatches = 0;
+    for (int32_t p = -MS_MAX_DUR; p <= MS_MAX_DUR; ++p) {
+        for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+            const uint16_t expected = estimate_min_overlap_for_hold_in_ms_float(p, t);
+            const uint16_t actual = estimate_min_overlap_for_hold_in_ms_fixed(p, t);
+            if (expected != actual) {
+                printf("overlap: p=%d t=%u float=%u fixed=%u\n", p, t, expected, actual);
+                ++mismatches;
+            }
+            if (estimate_min_overlap_for_hold_in_ms_with(overlap_coefficients, p, t) != expected) {
+                printf("overlap with coefficients: p=%d t=%u\n", p, t);
+                ++coefficient_mismatches;
+            }
+        }
+    }
+    return mismatches;
+}
+
+
+static unsigned long check_overlap_table(void) {
+    unsigned long mismatches = 0;
+    for (int32_t p = -MS_MAX_DUR; p <= MS_MAX_DUR; ++p) {
+        for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+            const uint16_t expected = estimate_min_overlap_for_hold_in_ms_float(p, t);
+            const uint16_t actual = estimate_min_overlap_for_hold_in_ms_table(p, t);
+            if (ABS(actual - expected) > OVERLAP_TABLE_MAX_ERROR) {
+                printf("overlap table: p=%d t=%u float=%u table=%u\n", p, t, expected, actual);
+                ++mismatches;
+            }
+        }
+    }
+    return mismatches;
+}
+
+
+// prints the decisions at the boundary, too
+static unsigned long check_wrapped(void) {
+    unsigned long mismatches = 0;
+    for (int32_t p = -MS_MAX_DUR; p <= MS_MAX_DUR; ++p) {
+        for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+            for (uint16_t n = 0; n <= MS_MAX_OVERLAP; ++n) {
+                const bool expected = estimate_hold_when_wrapped_float(p, t, n);
+                if (expected != estimate_hold_when_wrapped_fixed(p, t, n)) {
+                    const double distance = get_wrapped_boundary_distance(p, t, n);
+                    printf("wrapped: p=%d t=%u n=%u float %s, %.1e from the boundary\n", p, t, n,
+                           expected ? "hold" : "tap", distance);
+                    if (distance <= BOUNDARY_TOLERANCE) {
+                        ++boundary_mismatches;
+                    } else {
+                        ++mismatches;
+                    }
+                }
+                if (estimate_hold_when_wrapped_with(wrapped_coefficients, p, t, n) != expected) {
+                    printf("wrapped with coefficients: p=%d t=%u n=%u\n", p, t, n);
+                    ++coefficient_mismatches;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+
+static unsigned long check_two_down(void) {
+    unsigned long mismatches = 0;
+    for (int32_t p = -MS_MAX_DUR; p <= MS_MAX_DUR; ++p) {
+        for (uint16_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+            for (int m = 0; m <= 1; ++m) {
+                const bool expected = estimate_hold_when_two_down_float(p, t, m);
+                if (expected != estimate_hold_when_two_down_fixed(p, t, m)) {
+                    const double distance = get_two_down_boundary_distance(p, t, m);
+                    printf("two down: p=%d t=%u m=%d float %s, %.1e from the boundary\n", p, t, m,
+                           expected ? "hold" : "tap", distance);
+                    if (distance <= BOUNDARY_TOLERANCE) {
+                        ++boundary_mismatches;
+                    } else {
+                        ++mismatches;
+                    }
+                }
+                if (estimate_hold_when_two_down_with(two_down_coefficients, p, t, m) != expected) {
+                    printf("two down with coefficients: p=%d t=%u m=%d\n", p, t, m);
+                    ++coefficient_mismatches;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+
+static int verify(void) {
+    printf("domain: %d <= prev_up_th_down_dur <= %d, 0 <= th_down_next_down_dur, next_dur <= %d\n",
+           -MS_MAX_DUR, MS_MAX_DUR, MS_MAX_OVERLAP);
+
+    const unsigned long overlap = check_overlap();
+    printf("overlap:  %lu mismatches\n", overlap);
+
+    const unsigned long overlap_table = check_overlap_table();
+    printf("overlap table: %lu off by more than %d ms\n", overlap_table, OVERLAP_TABLE_MAX_ERROR);
+
+    const unsigned long two_down = check_two_down();
+    printf("two down: %lu mismatches\n", two_down);
+
+    const unsigned long wrapped = check_wrapped();
+    printf("wrapped:  %lu mismatches\n", wrapped);
+
+    printf("decided by float rounding: %lu (within %.0e of the boundary, not counted above)\n",
+           boundary_mismatches, BOUNDARY_TOLERANCE);
+
+    printf("default coefficients: %lu mismatches\n", coefficient_mismatches);
+
+    return (overlap || overlap_table || two_down || wrapped || coefficient_mismatches) ? 1 : 0;
+}
+
+
+// bench
+//=============================================================================
+typedef struct {
+    int16_t p;
+    uint16_t t;
+    uint16_t n;
+    bool m;
+} kernel_input_t;
+
+static kernel_input_t* inputs;
+static volatile uint32_t sink;
+
+// of the last BENCH
+static double bench_ns;
+static double bench_cycles;
+
+
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, so every run uses the same inputs
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+// Same distribution as the state machine produces while typing: mostly short
+// gaps between the previous release and the tap hold press, sometimes long.
+static void fill_inputs(void) {
+    inputs = malloc(BENCH_INPUT_COUNT * sizeof(*inputs));
+    if (inputs == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < BENCH_INPUT_COUNT; ++i) {
+        const uint32_t r = next_random(&state);
+        const int32_t gap = (r & 7) == 0 ? (int32_t) (r >> 16) % MS_MAX_DUR : (int32_t) (r >> 16) % 600 - MS_MAX_OVERLAP;
+        inputs[i] = (kernel_input_t){
+            .p = (int16_t) gap,
+            .t = (uint16_t) (next_random(&state) % (MS_MAX_OVERLAP + 1)),
+            .n = (uint16_t) (next_random(&state) % (MS_MAX_OVERLAP + 1)),
+            .m = next_random(&state) & 1,
+        };
+    }
+}
+
+
+static double now_in_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+
+static uint64_t read_cycles(void) {
+#        ifdef HAS_CYCLE_COUNTER
+    return __rdtsc();
+#        else
+    return 0;
+#        endif
+}
+
+
+// for features/cycle_counter.h
+uint32_t read_cycle_counter(void) {
+#        ifdef HAS_CYCLE_COUNTER
+    return (uint32_t) __rdtsc();
+#        else
+    return (uint32_t) now_in_ns();
+#        endif
+}
+
+
+static bool transfer_to_kernel_bench(uint8_t* packet, void* context) {
+    return process_heuristic_tap_hold_kernel_bench_command(packet, KERNEL_BENCH_PACKET_SIZE);
+}
+
+
+#define BENCH(name, call) \
+    do { \
+        uint32_t _sum = 0; \
+        const double _start_ns = now_in_ns(); \
+        const uint64_t _start_cycles = read_cycles(); \
+        for (int _round = 0; _round < BENCH_ROUNDS; ++_round) { \
+            for (size_t i = 0; i < BENCH_INPUT_COUNT; ++i) { \
+                const kernel_input_t* in = &inputs[i]; \
+                _sum += (uint32_t) (call); \
+            } \
+        } \
+        const double _calls = (double) BENCH_INPUT_COUNT * BENCH_ROUNDS; \
+        bench_ns = (now_in_ns() - _start_ns) / _calls; \
+        bench_cycles = (double) (read_cycles() - _start_cycles) / _calls; \
+        sink += _sum; \
+        printf("%-28s %7.2f ns/call %8.1f cycles/call\n", name, bench_ns, bench_cycles); \
+    } while (0)
+
+
+// the data the look up reads, without the overlap_table_t itself
+static size_t overlap_table_bytes(void) {
+    const size_t p_count = overlap_table.p_count;
+    const size_t t_count = overlap_table.t_count;
+    return p_count * sizeof(overlap_table.p_knots[0]) + (p_count - 1) * sizeof(overlap_table.p_shifts[0]) +
+           t_count * sizeof(overlap_table.t_knots[0]) + (t_count - 1) * sizeof(overlap_table.t_shifts[0]) +
+           p_count * t_count * sizeof(overlap_table.inners_q3[0]);
+}
+
+
+static int bench(void) {
+    fill_inputs();
+
+#        ifndef HAS_CYCLE_COUNTER
+    printf("(no cycle counter on this host, cycles are 0)\n");
+#        endif
+
+    BENCH("overlap float", estimate_min_overlap_for_hold_in_ms_float(in->p, in->t));
+    const double float_cycles = bench_cycles;
+    BENCH("overlap fixed", estimate_min_overlap_for_hold_in_ms_fixed(in->p, in->t));
+    const double fixed_cycles = bench_cycles;
+    BENCH("overlap table", estimate_min_overlap_for_hold_in_ms_table(in->p, in->t));
+    printf("  table: %zu bytes of flash, cycles/call saved: %.1f vs float, %.1f vs fixed\n",
+           overlap_table_bytes(), float_cycles - bench_cycles, fixed_cycles - bench_cycles);
+    BENCH("wrapped float", estimate_hold_when_wrapped_float(in->p, in->t, in->n));
+    BENCH("wrapped fixed", estimate_hold_when_wrapped_fixed(in->p, in->t, in->n));
+    BENCH("two down float", estimate_hold_when_two_down_float(in->p, in->t, in->m));
+    BENCH("two down fixed", estimate_hold_when_two_down_fixed(in->p, in->t, in->m));
+
+    // what hid_kernel_bench runs on the keyboard, each call timed on its own
+    kernel_bench_t kernel_bench;
+    if (!run_kernel_bench(transfer_to_kernel_bench, NULL, &kernel_bench)) return 1;
+    printf("\nlike on the keyboard:\n");
+#        ifdef HAS_CYCLE_COUNTER
+    print_kernel_bench(stdout, &kernel_bench, "TSC ticks");
+#        else
+    print_kernel_bench(stdout, &kernel_bench, "ns");
+#        endif
+
+    free(inputs);
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc == 2 && strcmp(argv[1], "verify") == 0) return verify();
+    if (argc == 2 && strcmp(argv[1], "bench") == 0) return bench();
+
+    fprintf(stderr, "usage: %s verify|bench\n", argv[0]);
+    return 2;
+}
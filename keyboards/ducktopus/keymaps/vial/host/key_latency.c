@@ -0,0 +1,471 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Models the latency from the physical press of a key until the host sees
+// what it did, by replaying corpora through keymap.c as it is (all of
+// process_record_user, see keymap_host.c) on the simulated core:
+//
+//     debounce     DEBOUNCE, the key has to be stable that long (sym_defer_g)
+//     serial hop   keys of the half without USB, which the master reads over
+//                  serial once per scan
+//     keyboard     from the matrix to the first report or layer change of the
+//                  press: the heuristic waiting for the overlap estimate or
+//                  the timeout, TAP_CODE_DELAY and everything else on the way
+//     USB polling  the report waits for the next poll of the host
+//
+// Only the keyboard part is simulated (one scan per ms), the rest are fixed
+// delays in whole ms, like the simulated clock. The keycodes of the corpora
+// are not used, the keymap decides what a key is. Latencies are broken down by
+// the layer a key was looked up on (e.g. GAME versus MAIN) and by key.
+//
+//     build/key_latency -o latency.tsv typing.corpus
+//     build/key_latency -b latency.tsv typing.corpus    exits with 3 if it got slower
+
+#include <stdio.h>
+
+#include "corpus.h"
+#include "handler_stats.h"
+#include "keymap_host.h"
+#include "scan_profile.h"
+#include "sim.h"
+#include "features/heuristic_tap_hold.h"
+
+// like quantum/debounce.h
+#if !defined(DEBOUNCE)
+#    define DEBOUNCE 5
+#endif
+
+// like tmk_core/protocol/usb_descriptor.h
+#if !defined(USB_POLLING_INTERVAL_MS)
+#    define USB_POLLING_INTERVAL_MS 1
+#endif
+
+// more than MS_MAX_OVERLAP, so every pending decision is made at the end
+#define MS_SETTLE_AFTER_LAST_EVENT 1100
+
+#define MAX_LINE 256
+
+// what read_cycle_counter of sim.c counts
+#if defined(__x86_64__) || defined(__i386__)
+#    define HOST_CYCLES_NAME "TSC ticks"
+#else
+#    define HOST_CYCLES_NAME "ns"
+#endif
+
+typedef struct {
+    uint32_t* ms;
+    size_t count;
+    size_t capacity;
+    uint64_t sum_ms;
+    uint64_t keyboard_sum_ms;
+} latencies_t;
+
+// one line of the report
+typedef struct {
+    const char* scope; // all, layer or key
+    const char* layer;
+    int row;           // -1 unless it is a key
+    int col;
+    uint16_t keycode;
+    uint64_t presses;
+    uint32_t p50_ms;
+    uint32_t p99_ms;
+    uint32_t max_ms;
+    double mean_ms;
+    double keyboard_mean_ms;
+} result_t;
+
+static uint32_t debounce_ms = DEBOUNCE;
+static uint32_t serial_hop_ms = 1;
+static bool is_master_left = true;
+static uint32_t usb_poll_ms = USB_POLLING_INTERVAL_MS;
+
+// presses that reached the matrix, but haven't had an effect yet
+static bool is_pending_at[MATRIX_ROWS][MATRIX_COLS];
+
+static latencies_t all_latencies;
+static latencies_t layer_latencies[MAX_LAYER];
+static latencies_t key_latencies[MAX_LAYER][MATRIX_ROWS][MATRIX_COLS];
+static uint16_t keycode_at[MAX_LAYER][MATRIX_ROWS][MATRIX_COLS];
+
+static uint64_t press_count;
+static uint64_t no_effect_count;
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-d MS] [-s MS] [-m left|right] [-u MS] [-k] [-p] [-t] [-o REPORT] [-b BASELINE] [-t MS] CORPUS...\n"
+            "  -d MS        debounce time (default %d)\n"
+            "  -s MS        serial hop of the half without USB (default 1)\n"
+            "  -m HALF      the half with USB (default left)\n"
+            "  -u MS        USB polling interval (default %d)\n"
+            "  -k           also print every key\n"
+            "  -p           also print the calls and cycles of the process_record handlers\n"
+            "  -t           also print how long the stages of the scan loop took\n"
+            "  -o REPORT    write every result there, tab separated\n"
+            "  -b BASELINE  compare to such a report, exit with 3 if a p50 or p99 got worse\n"
+            "  -t MS        how much worse is still fine (default 0)\n",
+            name, DEBOUNCE, USB_POLLING_INTERVAL_MS);
+    exit(2);
+}
+
+
+static uint32_t get_serial_hop_ms(uint8_t row) {
+    // like is_on_left_hand
+    const bool is_left = row < MATRIX_ROWS / 2;
+    return is_left == is_master_left ? 0 : serial_hop_ms;
+}
+
+
+static void add_latency(latencies_t* latencies, uint32_t ms, uint32_t keyboard_ms) {
+    if (latencies->count == latencies->capacity) {
+        latencies->capacity = latencies->capacity ? latencies->capacity * 2 : 64;
+        latencies->ms = realloc(latencies->ms, latencies->capacity * sizeof(*latencies->ms));
+        if (latencies->ms == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    latencies->ms[latencies->count++] = ms;
+    latencies->sum_ms += ms;
+    latencies->keyboard_sum_ms += keyboard_ms;
+}
+
+
+static void on_effect(const keyrecord_t* record, uint16_t keycode, uint32_t ms_since_press) {
+    const keypos_t key = record->event.key;
+    if (!is_pending_at[key.row][key.col]) return;
+    is_pending_at[key.row][key.col] = false;
+
+    const uint32_t usb_wait_ms = usb_poll_ms ? usb_poll_ms - sim_now() % usb_poll_ms : 0;
+    const uint32_t ms = debounce_ms + get_serial_hop_ms(key.row) + ms_since_press + usb_wait_ms;
+
+    const uint8_t layer = sim_get_source_layer(key.row, key.col);
+    add_latency(&all_latencies, ms, ms_since_press);
+    add_latency(&layer_latencies[layer], ms, ms_since_press);
+    add_latency(&key_latencies[layer][key.row][key.col], ms, ms_since_press);
+    keycode_at[layer][key.row][key.col] = keycode;
+}
+
+
+static void feed_event(const corpus_t* corpus, uint64_t i) {
+    const uint8_t row = CORPUS_ROW(corpus->positions[i]);
+    const uint8_t col = CORPUS_COL(corpus->positions[i]);
+    const bool pressed = corpus->flags[i] & CORPUS_FLAG_PRESSED;
+
+    if (pressed) {
+        press_count++;
+        no_effect_count += is_pending_at[row][col];
+        is_pending_at[row][col] = true;
+    }
+    sim_key_event(row, col, pressed);
+}
+
+
+// the next event from index i on that is on the given side of the serial hop
+static uint64_t find_next_on_side(const corpus_t* corpus, uint64_t i, bool is_hop) {
+    while (i < corpus->event_count && (get_serial_hop_ms(CORPUS_ROW(corpus->positions[i])) > 0) != is_hop) ++i;
+    return i;
+}
+
+
+// The keys of the other half reach the master later, so the events of both
+// halves are merged by when they get there.
+static void replay(const char* path, uint32_t* offset) {
+    corpus_t corpus;
+    if (!corpus_open(&corpus, path)) exit(1);
+
+    uint32_t* times = malloc((corpus.event_count + 1) * sizeof(*times));
+    if (times == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    const uint32_t start = corpus.event_count > 0 ? corpus.deltas[0] : 0;
+    uint32_t time = 0;
+    for (uint64_t i = 0; i < corpus.event_count; ++i) {
+        time += corpus.deltas[i];
+        const uint8_t row = CORPUS_ROW(corpus.positions[i]);
+        const uint8_t col = CORPUS_COL(corpus.positions[i]);
+        if (row >= MATRIX_ROWS || col >= MATRIX_COLS) {
+            fprintf(stderr, "%s: event %llu is outside of the matrix\n", path, (unsigned long long) i);
+            exit(1);
+        }
+        times[i] = *offset + time - start + debounce_ms + get_serial_hop_ms(row);
+    }
+
+    uint64_t direct = find_next_on_side(&corpus, 0, false);
+    uint64_t hop = find_next_on_side(&corpus, 0, true);
+    while (direct < corpus.event_count || hop < corpus.event_count) {
+        const bool is_hop_next = direct >= corpus.event_count ||
+                (hop < corpus.event_count && (times[hop] < times[direct] || (times[hop] == times[direct] && hop < direct)));
+        const uint64_t i = is_hop_next ? hop : direct;
+
+        sim_run_until(times[i]);
+        feed_event(&corpus, i);
+
+        if (is_hop_next) {
+            hop = find_next_on_side(&corpus, hop + 1, true);
+        } else {
+            direct = find_next_on_side(&corpus, direct + 1, false);
+        }
+    }
+
+    sim_run_until(sim_now() + MS_SETTLE_AFTER_LAST_EVENT);
+    *offset = sim_now();
+    free(times);
+    corpus_close(&corpus);
+}
+
+
+static int compare_ms(const void* a, const void* b) {
+    const uint32_t x = *(const uint32_t*) a;
+    const uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+static result_t get_result(latencies_t* latencies, const char* scope, const char* layer, int row, int col,
+                           uint16_t keycode) {
+    qsort(latencies->ms, latencies->count, sizeof(*latencies->ms), compare_ms);
+
+    const size_t last = latencies->count - 1;
+    const double count = (double) latencies->count;
+    return (result_t){
+        .scope = scope, .layer = layer, .row = row, .col = col, .keycode = keycode,
+        .presses = latencies->count,
+        .p50_ms = latencies->ms[MIN(last, (size_t) (0.5 * count))],
+        .p99_ms = latencies->ms[MIN(last, (size_t) (0.99 * count))],
+        .max_ms = latencies->ms[last],
+        .mean_ms = (double) latencies->sum_ms / count,
+        .keyboard_mean_ms = (double) latencies->keyboard_sum_ms / count,
+    };
+}
+
+
+// all presses first, then every layer and then every key of it
+static size_t collect_results(result_t* results) {
+    size_t count = 0;
+    if (all_latencies.count > 0) results[count++] = get_result(&all_latencies, "all", "-", -1, -1, KC_NO);
+
+    for (uint8_t layer = 0; layer < MAX_LAYER; ++layer) {
+        if (layer_latencies[layer].count == 0) continue;
+
+        const char* name = keymap_host_get_layer_name(layer);
+        results[count++] = get_result(&layer_latencies[layer], "layer", name, -1, -1, KC_NO);
+        for (int row = 0; row < MATRIX_ROWS; ++row) {
+            for (int col = 0; col < MATRIX_COLS; ++col) {
+                latencies_t* latencies = &key_latencies[layer][row][col];
+                if (latencies->count == 0) continue;
+                results[count++] = get_result(latencies, "key", name, row, col, keycode_at[layer][row][col]);
+            }
+        }
+    }
+    return count;
+}
+
+
+static void print_results(FILE* file, const result_t* results, size_t count, bool is_tab_separated,
+                          bool should_print_keys) {
+    if (is_tab_separated) {
+        fprintf(file, "scope\tlayer\trow\tcol\tkeycode\tpresses\tp50_ms\tp99_ms\tmean_ms\tkeyboard_mean_ms\tmax_ms\n");
+    } else {
+        fprintf(file, "layer  row  col  keycode    presses  p50  p99  mean ms  keyboard ms  max\n");
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const result_t* result = &results[i];
+        const bool is_key = result->row >= 0;
+        if (is_key && !should_print_keys) continue;
+
+        if (is_tab_separated) {
+            if (is_key) {
+                fprintf(file, "%s\t%s\t%d\t%d\t0x%04x", result->scope, result->layer, result->row, result->col,
+                        result->keycode);
+            } else {
+                fprintf(file, "%s\t%s\t-\t-\t-", result->scope, result->layer);
+            }
+            fprintf(file, "\t%llu\t%u\t%u\t%.3f\t%.3f\t%u\n", (unsigned long long) result->presses, result->p50_ms,
+                    result->p99_ms, result->mean_ms, result->keyboard_mean_ms, result->max_ms);
+            continue;
+        }
+
+        if (is_key) {
+            fprintf(file, "%-5s  %3d  %3d   0x%04x", result->layer, result->row, result->col, result->keycode);
+        } else {
+            fprintf(file, "%s%-5s      -        -", i > 0 && should_print_keys ? "\n" : "",
+                    strcmp(result->scope, "all") == 0 ? "all" : result->layer);
+        }
+        fprintf(file, "  %9llu  %3u  %3u  %7.3f  %11.3f  %3u\n", (unsigned long long) result->presses,
+                result->p50_ms, result->p99_ms, result->mean_ms, result->keyboard_mean_ms, result->max_ms);
+    }
+}
+
+
+static const result_t* find_result(const result_t* results, size_t count, const char* scope, const char* layer,
+                                   int row, int col) {
+    for (size_t i = 0; i < count; ++i) {
+        const result_t* result = &results[i];
+        if (strcmp(result->scope, scope) == 0 && strcmp(result->layer, layer) == 0 && result->row == row &&
+            result->col == col) {
+            return result;
+        }
+    }
+    return NULL;
+}
+
+
+// Returns how many lines of the baseline got a worse p50 or p99 (by more than
+// tolerance_ms), or -1 if it can't be read. The model is deterministic, so
+// every difference is because of a change.
+static int compare_to_baseline(const char* path, const result_t* results, size_t count, uint32_t tolerance_ms) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char scope[16], layer[16], row[8], col[8];
+        unsigned p50_ms, p99_ms;
+        if (sscanf(line, "%15s %15s %7s %7s %*s %*u %u %u", scope, layer, row, col, &p50_ms, &p99_ms) != 6) {
+            continue; // the header
+        }
+
+        const int row_index = strcmp(row, "-") == 0 ? -1 : atoi(row);
+        const int col_index = strcmp(col, "-") == 0 ? -1 : atoi(col);
+        const result_t* result = find_result(results, count, scope, layer, row_index, col_index);
+        if (result == NULL) continue;
+
+        if (result->p50_ms > p50_ms + tolerance_ms || result->p99_ms > p99_ms + tolerance_ms) {
+            printf("slower: %s %s %s %s  p50 %u -> %u ms  p99 %u -> %u ms\n", scope, layer, row, col, p50_ms,
+                   result->p50_ms, p99_ms, result->p99_ms);
+            regressions++;
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+
+// the commands go through via_command_kb of keymap.c, like raw HID
+static bool transfer_to_keymap(uint8_t* packet, void* context) {
+    // every raw HID packet has 32 bytes
+    sim_receive_via_command(packet, 32);
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+    const char* report_path = NULL;
+    const char* baseline_path = NULL;
+    uint32_t tolerance_ms = 0;
+    bool should_print_keys = false;
+    bool should_print_handlers = false;
+    bool should_print_scan_profile = false;
+
+    int first_path = 1;
+    for (; first_path < argc && argv[first_path][0] == '-'; ++first_path) {
+        const char* option = argv[first_path];
+        if (strcmp(option, "-k") == 0) {
+            should_print_keys = true;
+            continue;
+        }
+        if (strcmp(option, "-p") == 0) {
+            should_print_handlers = true;
+            continue;
+        }
+        if (strcmp(option, "-t") == 0) {
+            should_print_scan_profile = true;
+            continue;
+        }
+        if (first_path + 1 >= argc) usage(argv[0]);
+
+        const char* value = argv[++first_path];
+        if (strcmp(option, "-d") == 0) {
+            debounce_ms = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "-s") == 0) {
+            serial_hop_ms = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "-m") == 0 && (strcmp(value, "left") == 0 || strcmp(value, "right") == 0)) {
+            is_master_left = strcmp(value, "left") == 0;
+        } else if (strcmp(option, "-u") == 0) {
+            usb_poll_ms = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "-o") == 0) {
+            report_path = value;
+        } else if (strcmp(option, "-b") == 0) {
+            baseline_path = value;
+        } else if (strcmp(option, "-t") == 0) {
+            tolerance_ms = strtoul(value, NULL, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (first_path >= argc) usage(argv[0]);
+
+    sim_init(false);
+    sim_set_effect_callback(on_effect);
+    keymap_host_init();
+
+    uint32_t offset = 1;
+    for (int i = first_path; i < argc; ++i) {
+        replay(argv[i], &offset);
+    }
+    for (int row = 0; row < MATRIX_ROWS; ++row) {
+        for (int col = 0; col < MATRIX_COLS; ++col) {
+            no_effect_count += is_pending_at[row][col];
+        }
+    }
+
+    // at most one per layer and key, and all
+    result_t* results = malloc((1 + MAX_LAYER * (1 + MATRIX_ROWS * MATRIX_COLS)) * sizeof(*results));
+    if (results == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    const size_t count = collect_results(results);
+
+    printf("%llu presses, %llu without an effect on the host\n", (unsigned long long) press_count,
+           (unsigned long long) no_effect_count);
+    printf("debounce %u ms, serial hop %u ms (%s half), USB polling %u ms, TAP_CODE_DELAY %d ms, "
+           "MS_MAX_OVERLAP %d ms\n\n",
+           debounce_ms, serial_hop_ms, is_master_left ? "right" : "left", usb_poll_ms, TAP_CODE_DELAY,
+           MS_MAX_OVERLAP);
+    print_results(stdout, results, count, false, should_print_keys);
+
+    if (should_print_handlers) {
+        handler_stats_t stats;
+        if (!read_handler_stats(transfer_to_keymap, NULL, &stats)) return 1;
+        printf("\n");
+        print_handler_stats(stdout, &stats, HOST_CYCLES_NAME);
+    }
+
+    if (should_print_scan_profile) {
+        scan_profile_t profile;
+        if (!read_scan_profile(transfer_to_keymap, NULL, &profile)) return 1;
+        printf("\n");
+        print_scan_profile(stdout, &profile);
+    }
+
+    if (report_path != NULL) {
+        FILE* report = fopen(report_path, "w");
+        if (report == NULL) {
+            perror(report_path);
+            return 1;
+        }
+        print_results(report, results, count, true, true);
+        fclose(report);
+    }
+
+    int status = 0;
+    if (baseline_path != NULL) {
+        const int regressions = compare_to_baseline(baseline_path, results, count, tolerance_ms);
+        if (regressions < 0) return 1;
+
+        printf("\n%d result%s slower than %s\n", regressions, regressions == 1 ? " is" : "s are", baseline_path);
+        if (regressions > 0) status = 3;
+    }
+
+    free(results);
+    return status;
+}
@@ -0,0 +1,165 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Checks the keycode classes of features/keycode_classes.h against the checks
+// the process_record hooks of keymap.c did themselves before, for every
+// keycode, and measures how long classifying a key event takes either way.
+//
+//     keycode_classes verify             all 65536 keycodes
+//     keycode_classes bench [CORPUS]     ns per key event, with the keycodes of
+//                                        the corpus (or random ones)
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "corpus.h"
+#include "features/keycode_classes.h"
+
+#define BENCH_EVENTS  (1 << 24)
+#define BENCH_ROUNDS  5
+#define EVENT_COUNT   (1 << 16)
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s verify|bench [CORPUS]\n", name);
+    exit(2);
+}
+
+
+static double now_in_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, so every run is the same
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+// what keymap.c checked before
+static bool is_layer_switch_keycode(uint16_t keycode) {
+    switch (keycode) {
+        case QK_LAYER_TAP ... QK_LAYER_TAP_MAX:
+        case QK_LAYER_MOD ... QK_LAYER_MOD_MAX:
+        case QK_TO ... QK_TO_MAX:
+        case QK_MOMENTARY ... QK_MOMENTARY_MAX:
+        case QK_DEF_LAYER ... QK_DEF_LAYER_MAX:
+        case QK_TOGGLE_LAYER ... QK_TOGGLE_LAYER_MAX:
+        case QK_ONE_SHOT_LAYER ... QK_ONE_SHOT_LAYER_MAX:
+        case QK_LAYER_TAP_TOGGLE ... QK_LAYER_TAP_TOGGLE_MAX:
+            return true;
+    }
+    return false;
+}
+
+
+static uint16_t get_tap_keycode_of(uint16_t keycode) {
+    if (IS_QK_MOD_TAP(keycode)) return QK_MOD_TAP_GET_TAP_KEYCODE(keycode);
+    if (IS_QK_LAYER_TAP(keycode)) return QK_LAYER_TAP_GET_TAP_KEYCODE(keycode);
+    return keycode;
+}
+
+
+static uint8_t classify_by_ranges(uint16_t keycode) {
+    const uint16_t tap_keycode = get_tap_keycode_of(keycode);
+    uint8_t classes = 0;
+    if (IS_QK_MOD_TAP(keycode) || IS_QK_LAYER_TAP(keycode)) classes |= KEYCODE_CLASS_TAP_HOLD;
+    if (is_layer_switch_keycode(keycode)) classes |= KEYCODE_CLASS_LAYER_SWITCH;
+    if (keycode == LALT(KC_TAB) || keycode == LSA(KC_TAB)) classes |= KEYCODE_CLASS_ALT_TAB;
+    if (tap_keycode == KC_SPACE) classes |= KEYCODE_CLASS_SPACE;
+    return classes;
+}
+
+
+static int verify(void) {
+    uint32_t mismatches = 0;
+    uint32_t counts[8] = {0};
+    for (uint32_t keycode = 0; keycode <= 0xFFFF; ++keycode) {
+        const uint8_t expected = classify_by_ranges((uint16_t) keycode);
+        const uint8_t classes = get_keycode_classes((uint16_t) keycode);
+        if (classes != expected) {
+            if (mismatches < 10) printf("0x%04X: 0x%02X instead of 0x%02X\n", keycode, classes, expected);
+            mismatches++;
+        }
+        for (uint8_t bit = 0; bit < 8; ++bit) counts[bit] += (classes >> bit) & 1;
+    }
+
+    printf("tap hold %u, layer switch %u, alt tab %u, space %u keycodes: %u mismatches\n",
+           counts[0], counts[1], counts[2], counts[3], mismatches);
+    return mismatches > 0 ? 1 : 0;
+}
+
+
+typedef uint8_t (*classify_t)(uint16_t keycode);
+
+// what the loop costs without classifying
+static uint8_t classify_nothing(uint16_t keycode) {
+    return (uint8_t) keycode;
+}
+
+
+// the fastest of a few rounds, in ns per key event
+static double bench_classify(classify_t classify, const uint16_t* keycodes, uint32_t* checksum) {
+    // through a volatile, so the compiler can't inline (or vectorize) one of
+    // them and not the others
+    classify_t volatile called = classify;
+    double best = 0.0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        uint32_t sum = 0;
+        const double start = now_in_seconds();
+        for (uint32_t i = 0; i < BENCH_EVENTS; ++i) {
+            sum += called(keycodes[i & (EVENT_COUNT - 1)]);
+        }
+        const double ns = (now_in_seconds() - start) / BENCH_EVENTS * 1e9;
+        if (round == 0 || ns < best) best = ns;
+        *checksum = sum;
+    }
+    return best;
+}
+
+
+static int bench(const char* path) {
+    static uint16_t keycodes[EVENT_COUNT];
+    if (path != NULL) {
+        corpus_t corpus;
+        if (!corpus_open(&corpus, path)) return 1;
+        if (corpus.event_count == 0) {
+            fprintf(stderr, "%s has no events\n", path);
+            return 1;
+        }
+        for (size_t i = 0; i < EVENT_COUNT; ++i) keycodes[i] = corpus.keycodes[i % corpus.event_count];
+        corpus_close(&corpus);
+    } else {
+        uint32_t state = 0x12345678;
+        for (size_t i = 0; i < EVENT_COUNT; ++i) keycodes[i] = (uint16_t) next_random(&state);
+    }
+
+    uint32_t loop_checksum = 0, ranges_checksum = 0, table_checksum = 0;
+    const double loop_ns = bench_classify(classify_nothing, keycodes, &loop_checksum);
+    const double ranges_ns = bench_classify(classify_by_ranges, keycodes, &ranges_checksum) - loop_ns;
+    const double table_ns = bench_classify(get_keycode_classes, keycodes, &table_checksum) - loop_ns;
+
+    printf("keycodes:             %s\n", path != NULL ? path : "random");
+    printf("by ranges:            %6.2f ns per key event\n", ranges_ns);
+    printf("get_keycode_classes:  %6.2f ns per key event (%.1fx as fast)\n", table_ns, ranges_ns / table_ns);
+    printf("(without the %.2f ns the benchmark loop takes per key event)\n", loop_ns);
+    if (ranges_checksum != table_checksum) {
+        printf("  the classes differ!\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc == 2 && strcmp(argv[1], "verify") == 0) return verify();
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "bench") == 0) return bench(argc == 3 ? argv[2] : NULL);
+    usage(argv[0]);
+    return 2;
+}
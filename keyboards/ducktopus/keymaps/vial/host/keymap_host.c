@@ -0,0 +1,27 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Builds keymap.c as it is, with all of process_record_user, for the
+// simulated core. Like QMK's keymap_introspection.c, it includes keymap.c, so
+// it can see how many layers keymaps has.
+
+#include "keymap_host.h"
+#include "sim.h"
+
+#include "keymap.c"
+
+static const char* const layer_names[] = {
+    [LAYER_GAME] = "GAME", [LAYER_GFUN] = "GFUN", [LAYER_MAIN] = "MAIN", [LAYER_SYMB] = "SYMB",
+    [LAYER_FUNC] = "FUNC", [LAYER_ADJU] = "ADJU", [LAYER_LMOD] = "LMOD", [LAYER_RMOD] = "RMOD",
+};
+
+
+void keymap_host_init(void) {
+    sim_set_keymap(keymaps, sizeof(keymaps) / sizeof(keymaps[0]));
+    keyboard_post_init_user();
+}
+
+
+const char* keymap_host_get_layer_name(uint8_t layer) {
+    const size_t count = sizeof(layer_names) / sizeof(layer_names[0]);
+    return layer < count && layer_names[layer] != NULL ? layer_names[layer] : "?";
+}
@@ -0,0 +1,15 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// keymap.c, built for the host (see keymap_host.c).
+
+#pragma once
+
+#include <stdint.h>
+
+// Hand the keymaps of keymap.c to the simulated core and run
+// keyboard_post_init_user, like the keyboard does after it booted. Call it
+// after sim_init.
+void keymap_host_init(void);
+
+// the name of one of the layers of keymap.c (e.g. "MAIN" for LAYER_MAIN)
+const char* keymap_host_get_layer_name(uint8_t layer);
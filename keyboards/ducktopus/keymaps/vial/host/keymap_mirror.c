@@ -0,0 +1,176 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Checks the RAM mirror of the dynamic keymap (features/keymap_mirror.h)
+// against the simulated EEPROM while random VIA commands change it, and
+// measures how much faster a lookup in it is.
+//
+//     keymap_mirror verify    random VIA writes and resets, mirror vs EEPROM
+//     keymap_mirror bench     ns per lookup of both
+//
+// The simulated EEPROM is plain RAM, so the bench only shows what two EEPROM
+// reads (with their address math and bounds checks) cost compared to an array
+// index. On the keyboard, each EEPROM read also goes through QMK's EEPROM
+// driver (wear leveling on the RP2040), so the difference is larger there.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dynamic_keymap.h"
+#include "keymap_host.h"
+#include "sim.h"
+#include "via.h"
+#include "features/keymap_mirror.h"
+
+#define VERIFY_COMMANDS  100000
+#define BENCH_LOOKUPS    (1 << 24)
+#define BENCH_ROUNDS     5
+#define VIA_PACKET_SIZE  32
+#define KEYMAP_SIZE      ((uint16_t) KEYMAP_MIRROR_SIZE)
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s verify|bench\n", name);
+    exit(2);
+}
+
+
+static double now_in_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, so every run is the same
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+static uint64_t count_mismatches(void) {
+    uint64_t mismatches = 0;
+    for (uint8_t layer = 0; layer < DYNAMIC_KEYMAP_LAYER_COUNT; ++layer) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+            for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+                mismatches += keymap_mirror_get_keycode(layer, row, col) != dynamic_keymap_get_keycode(layer, row, col);
+            }
+        }
+    }
+    return mismatches;
+}
+
+
+static int verify(void) {
+    uint32_t state = 0x12345678;
+    uint64_t mismatches = count_mismatches();
+    uint64_t counts[3] = {0};
+
+    for (uint32_t i = 0; i < VERIFY_COMMANDS; ++i) {
+        uint8_t data[VIA_PACKET_SIZE] = {0};
+        const uint32_t r = next_random(&state);
+        const uint32_t kind = r % 100;
+
+        if (kind < 60) {
+            // some out of range, which VIA ignores
+            data[0] = id_dynamic_keymap_set_keycode;
+            data[1] = (uint8_t) (next_random(&state) % (DYNAMIC_KEYMAP_LAYER_COUNT + 1));
+            data[2] = (uint8_t) (next_random(&state) % (MATRIX_ROWS + 1));
+            data[3] = (uint8_t) (next_random(&state) % (MATRIX_COLS + 1));
+            data[4] = (uint8_t) next_random(&state);
+            data[5] = (uint8_t) next_random(&state);
+            counts[0]++;
+        } else if (kind < 99) {
+            // odd offsets and past the end, too
+            const uint16_t offset = (uint16_t) (next_random(&state) % (KEYMAP_SIZE + 8));
+            data[0] = id_dynamic_keymap_set_buffer;
+            data[1] = (uint8_t) (offset >> 8);
+            data[2] = (uint8_t) offset;
+            data[3] = (uint8_t) (next_random(&state) % 29);
+            for (uint8_t b = 0; b < data[3]; ++b) data[4 + b] = (uint8_t) next_random(&state);
+            counts[1]++;
+        } else {
+            data[0] = (r >> 8) & 1 ? id_dynamic_keymap_reset : id_eeprom_reset;
+            counts[2]++;
+        }
+
+        sim_receive_via_command(data, VIA_PACKET_SIZE);
+        mismatches += count_mismatches();
+    }
+
+    printf("%llu set keycode, %llu set buffer and %llu reset commands: %llu mismatches\n",
+           (unsigned long long) counts[0], (unsigned long long) counts[1], (unsigned long long) counts[2],
+           (unsigned long long) mismatches);
+    return mismatches > 0 ? 1 : 0;
+}
+
+
+typedef uint16_t (*lookup_t)(uint8_t layer, uint8_t row, uint8_t col);
+
+// what the loop costs without a lookup
+static uint16_t look_up_nothing(uint8_t layer, uint8_t row, uint8_t col) {
+    return (uint16_t) (layer + row + col);
+}
+
+
+// the fastest of a few rounds, in ns per lookup
+static double bench_lookup(lookup_t lookup, const uint16_t* positions, uint32_t* checksum) {
+    double best = 0.0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        uint32_t sum = 0;
+        const double start = now_in_seconds();
+        for (uint32_t i = 0; i < BENCH_LOOKUPS; ++i) {
+            const uint16_t position = positions[i & 0xFFFF];
+            sum += lookup(position >> 8, (position >> 4) & 0xF, position & 0xF);
+        }
+        const double ns = (now_in_seconds() - start) / BENCH_LOOKUPS * 1e9;
+        if (round == 0 || ns < best) best = ns;
+        *checksum = sum;
+    }
+    return best;
+}
+
+
+static int bench(void) {
+    // layer << 8 | row << 4 | col
+    static uint16_t positions[1 << 16];
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i) {
+        const uint8_t layer = (uint8_t) (next_random(&state) % DYNAMIC_KEYMAP_LAYER_COUNT);
+        const uint8_t row = (uint8_t) (next_random(&state) % MATRIX_ROWS);
+        const uint8_t col = (uint8_t) (next_random(&state) % MATRIX_COLS);
+        positions[i] = (uint16_t) (layer << 8 | row << 4 | col);
+    }
+
+    uint32_t loop_checksum = 0, eeprom_checksum = 0, mirror_checksum = 0;
+    const double loop_ns = bench_lookup(look_up_nothing, positions, &loop_checksum);
+    const double eeprom_ns = bench_lookup(dynamic_keymap_get_keycode, positions, &eeprom_checksum) - loop_ns;
+    const double mirror_ns = bench_lookup(keymap_mirror_get_keycode, positions, &mirror_checksum) - loop_ns;
+
+    printf("RAM:                        %u bytes (%u layers of %u keys)\n", (unsigned) KEYMAP_MIRROR_SIZE,
+           DYNAMIC_KEYMAP_LAYER_COUNT, MATRIX_ROWS * MATRIX_COLS);
+    printf("dynamic_keymap_get_keycode: %6.2f ns per lookup (simulated EEPROM)\n", eeprom_ns);
+    printf("keymap_mirror_get_keycode:  %6.2f ns per lookup (%.1fx as fast)\n", mirror_ns, eeprom_ns / mirror_ns);
+    printf("(without the %.2f ns the benchmark loop takes per lookup)\n", loop_ns);
+    if (eeprom_checksum != mirror_checksum) {
+        printf("  the lookups differ!\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc != 2) usage(argv[0]);
+
+    sim_init(false);
+    keymap_host_init();
+
+    if (strcmp(argv[1], "verify") == 0) return verify();
+    if (strcmp(argv[1], "bench") == 0) return bench();
+    usage(argv[0]);
+    return 2;
+}
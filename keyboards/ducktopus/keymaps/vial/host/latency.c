@@ -0,0 +1,120 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "latency.h"
+
+
+static const char* const path_names[] = {
+    [DECIDED_BY_OVERLAP] = "overlap",
+    [DECIDED_BY_WRAP] = "wrap",
+    [DECIDED_BY_TWO_DOWN] = "two down",
+    [DECIDED_BY_TIMEOUT] = "timeout",
+    [DECIDED_BY_SAME_SIDE] = "same side",
+    [DECIDED_BY_CONFIDENCE] = "confidence",
+};
+
+
+const char* get_decision_path_name(uint8_t path, char* unknown_name, size_t size) {
+    if (path < sizeof(path_names) / sizeof(path_names[0])) return path_names[path];
+
+    snprintf(unknown_name, size, "path %u", path);
+    return unknown_name;
+}
+
+
+static bool transfer_command(latency_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = HEURISTIC_TAP_HOLD_LATENCY_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != HEURISTIC_TAP_HOLD_LATENCY_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "latency command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+bool read_latency_histograms(latency_transfer_t transfer, void* context, latency_histograms_t* histograms) {
+    uint8_t packet[LATENCY_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, LATENCY_HID_INFO)) return false;
+
+    if (packet[2] != LATENCY_HID_VERSION) {
+        fprintf(stderr, "unsupported latency protocol version %u\n", packet[2]);
+        return false;
+    }
+
+    memset(histograms, 0, sizeof(*histograms));
+    histograms->path_count = MIN(packet[3], LATENCY_MAX_PATHS);
+    histograms->bucket_count = packet[4];
+    histograms->bucket_ms = packet[5];
+
+    for (uint8_t path = 0; path < histograms->path_count; ++path) {
+        uint8_t bucket = 0;
+        while (bucket < histograms->bucket_count) {
+            memset(packet, 0, sizeof(packet));
+            packet[2] = path;
+            packet[3] = bucket;
+            if (!transfer_command(transfer, context, packet, LATENCY_HID_READ)) return false;
+
+            const uint8_t n = packet[4];
+            if (n == 0 || packet[2] != path || packet[3] != bucket) {
+                fprintf(stderr, "invalid latency response for path %u\n", path);
+                return false;
+            }
+            for (uint8_t i = 0; i < n && bucket < histograms->bucket_count; ++i, ++bucket) {
+                histograms->counts[path][bucket] = packet[5 + 2 * i] | (packet[6 + 2 * i] << 8);
+            }
+        }
+    }
+    return true;
+}
+
+
+bool reset_latency_histograms(latency_transfer_t transfer, void* context) {
+    uint8_t packet[LATENCY_PACKET_SIZE] = {0};
+    return transfer_command(transfer, context, packet, LATENCY_HID_RESET);
+}
+
+
+// upper bound (in ms) of the bucket that contains the given fraction of counts
+static void print_percentile(FILE* file, const latency_histograms_t* histograms, uint8_t path, uint64_t total,
+                             double fraction) {
+    const uint64_t needed = (uint64_t) (fraction * (double) total + 0.999999);
+    uint64_t sum = 0;
+    for (uint8_t bucket = 0; bucket < histograms->bucket_count; ++bucket) {
+        sum += histograms->counts[path][bucket];
+        if (sum < needed) continue;
+
+        if (bucket + 1 == histograms->bucket_count) {
+            // the last bucket has no upper bound
+            fprintf(file, " %6s%u", ">", bucket * histograms->bucket_ms);
+        } else {
+            fprintf(file, " %7u", (bucket + 1) * histograms->bucket_ms);
+        }
+        return;
+    }
+}
+
+
+void print_latency_percentiles(FILE* file, const latency_histograms_t* histograms) {
+    fprintf(file, "decision path      keys     p50     p95     p99  (ms, bucket upper bounds)\n");
+
+    for (uint8_t path = 0; path < histograms->path_count; ++path) {
+        uint64_t total = 0;
+        for (uint8_t bucket = 0; bucket < histograms->bucket_count; ++bucket) {
+            total += histograms->counts[path][bucket];
+        }
+
+        char unknown_name[16];
+        const char* name = get_decision_path_name(path, unknown_name, sizeof(unknown_name));
+        fprintf(file, "%-13s %9llu", name, (unsigned long long) total);
+        if (total > 0) {
+            print_percentile(file, histograms, path, total, 0.50);
+            print_percentile(file, histograms, path, total, 0.95);
+            print_percentile(file, histograms, path, total, 0.99);
+        }
+        fprintf(file, "\n");
+    }
+}
@@ -0,0 +1,31 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the decision latency histograms over the raw HID protocol described
+// in features/heuristic_tap_hold_latency.h and prints their percentiles.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_latency.h"
+
+#define LATENCY_PACKET_SIZE 32
+#define LATENCY_MAX_PATHS   16
+#define LATENCY_MAX_BUCKETS 255
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*latency_transfer_t)(uint8_t* packet, void* context);
+
+typedef struct {
+    uint8_t  path_count;
+    uint8_t  bucket_count;
+    uint8_t  bucket_ms;
+    uint32_t counts[LATENCY_MAX_PATHS][LATENCY_MAX_BUCKETS];
+} latency_histograms_t;
+
+bool read_latency_histograms(latency_transfer_t transfer, void* context, latency_histograms_t* histograms);
+bool reset_latency_histograms(latency_transfer_t transfer, void* context);
+void print_latency_percentiles(FILE* file, const latency_histograms_t* histograms);
+
+// e.g. "two down", or "path 7" (in unknown_name) for one this build doesn't know
+const char* get_decision_path_name(uint8_t path, char* unknown_name, size_t size);
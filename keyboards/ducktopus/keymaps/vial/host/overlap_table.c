@@ -0,0 +1,306 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Generates features/heuristic_tap_hold_overlap_table.h, the table version of
+// the overlap estimate (see features/heuristic_tap_hold_kernels.h).
+//
+//     overlap_table [-e max_error_ms] [-o OUTPUT]
+//
+// Starting with one cell that covers every input where the result still
+// changes, the cell with the largest error is split in half (along
+// prev_up_th_down_dur or th_down_next_down_dur, whichever helps more) until no
+// input is off by more than max_error_ms. Then every input the state machine
+// can produce is checked once more and the flash cost is reported.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "features/heuristic_tap_hold_kernels.h"
+
+#define MAX_KNOTS 255
+
+#define INPUT_COUNT ((2ULL * MS_MAX_DUR + 1) * (MS_MAX_OVERLAP + 1))
+
+// the stored values are int16_t in Q3
+#define MAX_INNER_Q3 INT16_MAX
+
+
+typedef struct {
+    int32_t knots[MAX_KNOTS];
+    uint8_t count;
+} axis_t;
+
+typedef struct {
+    uint32_t max_error;
+    uint64_t error_sum;
+    uint64_t off_count;
+    int32_t worst_p;
+    int32_t worst_t;
+} table_error_t;
+
+static axis_t p_axis;
+static axis_t t_axis;
+
+static int16_t p_knots[MAX_KNOTS];
+static uint8_t p_shifts[MAX_KNOTS];
+static int16_t t_knots[MAX_KNOTS];
+static uint8_t t_shifts[MAX_KNOTS];
+static int16_t inners_q3[MAX_KNOTS * MAX_KNOTS];
+
+static overlap_table_t table = {
+    .p_knots = p_knots,
+    .p_shifts = p_shifts,
+    .t_knots = t_knots,
+    .t_shifts = t_shifts,
+    .inners_q3 = inners_q3,
+};
+
+
+static uint8_t log2_of(int32_t power_of_two) {
+    uint8_t shift = 0;
+    while ((1 << shift) < power_of_two) ++shift;
+    return shift;
+}
+
+
+static void fill_axis(const axis_t* axis, int16_t* knots, uint8_t* shifts) {
+    for (uint8_t i = 0; i < axis->count; ++i) {
+        knots[i] = (int16_t) axis->knots[i];
+        if (i + 1 < axis->count) shifts[i] = log2_of(axis->knots[i + 1] - axis->knots[i]);
+    }
+}
+
+
+static void build_table(void) {
+    fill_axis(&p_axis, p_knots, p_shifts);
+    fill_axis(&t_axis, t_knots, t_shifts);
+    table.p_count = p_axis.count;
+    table.t_count = t_axis.count;
+
+    for (uint8_t i = 0; i < p_axis.count; ++i) {
+        for (uint8_t j = 0; j < t_axis.count; ++j) {
+            const float inner = estimate_min_overlap_for_hold_inner_float(
+                    (int16_t) p_axis.knots[i], (uint16_t) t_axis.knots[j]);
+            const float inner_q3 = MIN((float) MAX_INNER_Q3, MAX((float) -MAX_INNER_Q3, inner * 8.0f));
+            inners_q3[i * t_axis.count + j] = (int16_t) lroundf(inner_q3);
+        }
+    }
+}
+
+
+static table_error_t measure_error(int32_t p_first, int32_t p_last) {
+    table_error_t error = {0};
+    for (int32_t p = p_first; p <= p_last; ++p) {
+        for (int32_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+            const int32_t expected = estimate_min_overlap_for_hold_in_ms_float((int16_t) p, (uint16_t) t);
+            const int32_t actual = look_up_min_overlap_for_hold_in_ms(&table, (int16_t) p, (uint16_t) t);
+            const uint32_t diff = (uint32_t) ABS(actual - expected);
+
+            error.error_sum += diff;
+            if (diff > 0) error.off_count++;
+            if (diff > error.max_error) {
+                error.max_error = diff;
+                error.worst_p = p;
+                error.worst_t = t;
+            }
+        }
+    }
+    return error;
+}
+
+
+static bool does_change_with_p(int32_t p, int32_t other_p) {
+    for (int32_t t = 0; t <= MS_MAX_OVERLAP; ++t) {
+        if (estimate_min_overlap_for_hold_in_ms_float((int16_t) p, (uint16_t) t) !=
+                estimate_min_overlap_for_hold_in_ms_float((int16_t) other_p, (uint16_t) t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Inserts the middle of the interval that contains x (as the look up picks
+// it). Returns false, if the interval can't be split any further.
+static bool split_interval(axis_t* axis, int32_t x) {
+    uint8_t i = 0;
+    while (i + 2 < axis->count && axis->knots[i + 1] <= x) ++i;
+
+    const int32_t width = axis->knots[i + 1] - axis->knots[i];
+    if (width < 2 || axis->count == MAX_KNOTS) return false;
+
+    memmove(&axis->knots[i + 2], &axis->knots[i + 1], (axis->count - i - 1) * sizeof(axis->knots[0]));
+    axis->knots[i + 1] = axis->knots[i] + width / 2;
+    axis->count++;
+    return true;
+}
+
+
+static bool is_better(const table_error_t* a, const table_error_t* b) {
+    return a->error_sum < b->error_sum || (a->error_sum == b->error_sum && a->max_error < b->max_error);
+}
+
+
+static void init_axis(axis_t* axis, int32_t first, int32_t last) {
+    int32_t width = 1;
+    while (first + width < last) width *= 2;
+
+    axis->knots[0] = first;
+    axis->knots[1] = first + width;
+    axis->count = 2;
+}
+
+
+static void write_table(FILE* out, uint32_t max_error, const table_error_t* error, size_t data_bytes) {
+    fprintf(out,
+            "// Copyright 2024 Joschua Gandert (@CreamyCookie)\n"
+            "//\n"
+            "// Generated by host/overlap_table (make overlap-table MAX_ERROR=%u), do not edit.\n"
+            "//\n"
+            "// %u x %u knots, %zu bytes. Compared to the formula, the result is off by\n"
+            "// at most %u ms for %llu of the %llu inputs the state machine can produce.\n"
+            "\n"
+            "#pragma once\n"
+            "\n"
+            "#define OVERLAP_TABLE_MAX_ERROR %u\n"
+            "\n",
+            max_error, table.p_count, table.t_count, data_bytes, error->max_error,
+            (unsigned long long) error->off_count, INPUT_COUNT, max_error);
+
+    fprintf(out, "static const int16_t overlap_table_p_knots[] = {");
+    for (uint8_t i = 0; i < table.p_count; ++i) fprintf(out, "%s%d", i ? ", " : "", table.p_knots[i]);
+    fprintf(out, "};\nstatic const uint8_t overlap_table_p_shifts[] = {");
+    for (uint8_t i = 0; i + 1 < table.p_count; ++i) fprintf(out, "%s%u", i ? ", " : "", table.p_shifts[i]);
+    fprintf(out, "};\n\nstatic const int16_t overlap_table_t_knots[] = {");
+    for (uint8_t j = 0; j < table.t_count; ++j) fprintf(out, "%s%d", j ? ", " : "", table.t_knots[j]);
+    fprintf(out, "};\nstatic const uint8_t overlap_table_t_shifts[] = {");
+    for (uint8_t j = 0; j + 1 < table.t_count; ++j) fprintf(out, "%s%u", j ? ", " : "", table.t_shifts[j]);
+    fprintf(out, "};\n\n// inner * 8, one row per p knot\nstatic const int16_t overlap_table_inners_q3[] = {\n");
+    for (uint8_t i = 0; i < table.p_count; ++i) {
+        fprintf(out, "   ");
+        for (uint8_t j = 0; j < table.t_count; ++j) {
+            fprintf(out, " %6d,", table.inners_q3[i * table.t_count + j]);
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out,
+            "};\n"
+            "\n"
+            "static const overlap_table_t overlap_table = {\n"
+            "    .p_knots = overlap_table_p_knots,\n"
+            "    .p_shifts = overlap_table_p_shifts,\n"
+            "    .t_knots = overlap_table_t_knots,\n"
+            "    .t_shifts = overlap_table_t_shifts,\n"
+            "    .inners_q3 = overlap_table_inners_q3,\n"
+            "    .p_count = %u,\n"
+            "    .t_count = %u,\n"
+            "};\n",
+            table.p_count, table.t_count);
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-e max_error_ms] [-o OUTPUT]\n"
+            "  -e max_error_ms  largest allowed difference to the formula (default 1)\n"
+            "  -o OUTPUT        where to write the table (default stdout)\n",
+            name);
+    exit(2);
+}
+
+
+int main(int argc, char** argv) {
+    uint32_t max_error = 1;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            max_error = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    // below p_first and above p_last, the result doesn't depend on p
+    int32_t p_first = -MS_MAX_DUR;
+    while (p_first < MS_MAX_DUR && !does_change_with_p(p_first + 1, -MS_MAX_DUR)) ++p_first;
+    int32_t p_last = MS_MAX_DUR;
+    while (p_last > p_first && !does_change_with_p(p_last - 1, MS_MAX_DUR)) --p_last;
+
+    init_axis(&p_axis, p_first, p_last);
+    init_axis(&t_axis, 0, MS_MAX_OVERLAP);
+    if (p_axis.knots[1] > MS_MAX_DUR) {
+        fprintf(stderr, "the result changes between %d and %d, which is too wide\n", p_first, p_last);
+        return 1;
+    }
+    const int32_t p_last_knot = p_axis.knots[1];
+
+    build_table();
+    table_error_t error = measure_error(p_first, p_last_knot);
+
+    while (error.max_error > max_error) {
+        const axis_t p_axis_before = p_axis;
+        const axis_t t_axis_before = t_axis;
+
+        table_error_t p_error = {.error_sum = UINT64_MAX};
+        if (split_interval(&p_axis, error.worst_p)) {
+            build_table();
+            p_error = measure_error(p_first, p_last_knot);
+            p_axis = p_axis_before;
+        }
+
+        table_error_t t_error = {.error_sum = UINT64_MAX};
+        axis_t t_axis_split = t_axis;
+        if (split_interval(&t_axis_split, error.worst_t)) {
+            t_axis = t_axis_split;
+            build_table();
+            t_error = measure_error(p_first, p_last_knot);
+            t_axis = t_axis_before;
+        }
+
+        if (p_error.error_sum == UINT64_MAX && t_error.error_sum == UINT64_MAX) {
+            fprintf(stderr, "can't get below %u ms (p=%d t=%d)\n", error.max_error, error.worst_p, error.worst_t);
+            return 1;
+        }
+
+        if (is_better(&p_error, &t_error)) {
+            split_interval(&p_axis, error.worst_p);
+        } else {
+            t_axis = t_axis_split;
+        }
+        build_table();
+        error = measure_error(p_first, p_last_knot);
+    }
+
+    // outside of the knots, the look up clamps the inputs
+    error = measure_error(-MS_MAX_DUR, MS_MAX_DUR);
+    if (error.max_error > max_error) {
+        fprintf(stderr, "off by %u ms at p=%d t=%d\n", error.max_error, error.worst_p, error.worst_t);
+        return 1;
+    }
+
+    const size_t data_bytes = table.p_count * sizeof(int16_t) + (table.p_count - 1) * sizeof(uint8_t) +
+                              table.t_count * sizeof(int16_t) + (table.t_count - 1) * sizeof(uint8_t) +
+                              table.p_count * table.t_count * sizeof(int16_t);
+
+    FILE* out = stdout;
+    if (path != NULL) {
+        out = fopen(path, "w");
+        if (out == NULL) {
+            perror(path);
+            return 1;
+        }
+    }
+    write_table(out, max_error, &error, data_bytes);
+    if (out != stdout) fclose(out);
+
+    fprintf(stderr, "result changes with p in [%d, %d]\n", p_first, p_last);
+    fprintf(stderr, "%u x %u knots, %zu bytes of flash (plus the look up code, see kernels bench for the cycles)\n",
+            table.p_count, table.t_count, data_bytes);
+    fprintf(stderr, "off by at most %u ms for %llu of %llu inputs (by %.4f ms on average)\n", error.max_error,
+            (unsigned long long) error.off_count, INPUT_COUNT, (double) error.error_sum / (double) INPUT_COUNT);
+    return 0;
+}
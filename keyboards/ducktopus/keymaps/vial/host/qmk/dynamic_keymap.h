@@ -0,0 +1,20 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Stand-in for QMK's dynamic_keymap.h. Like QMK's, the simulated dynamic
+// keymap is stored in the (simulated) EEPROM, one big endian keycode per
+// layer, row and column, and every lookup reads it from there. sim_set_keymap
+// fills it with the keymap keymap.c was compiled with, as it is right after
+// flashing.
+
+#pragma once
+
+#include <stdint.h>
+
+// after the user datablock (see eeprom.h)
+#define DYNAMIC_KEYMAP_EEPROM_ADDR 1024
+
+uint8_t dynamic_keymap_get_layer_count(void);
+uint16_t dynamic_keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t column);
+void dynamic_keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode);
+void dynamic_keymap_reset(void);
+void dynamic_keymap_set_buffer(uint16_t offset, uint16_t size, uint8_t *data);
@@ -0,0 +1,15 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Stand-in for QMK's eeprom.h. sim.c keeps SIM_EEPROM_SIZE bytes in RAM, all
+// zero at first (like after flashing), and addresses are offsets into them.
+
+#pragma once
+
+#include <stdint.h>
+
+#define SIM_EEPROM_SIZE 4096
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_read_block(void *buf, const void *addr, uint32_t len);
+void eeprom_update_block(const void *buf, void *addr, uint32_t len);
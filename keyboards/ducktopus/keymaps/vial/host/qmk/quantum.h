@@ -0,0 +1,315 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Minimal stand-in for QMK's quantum.h, so the heuristic tap hold code (and
+// keymap.c, see keymap_host.c) can be compiled and run on the host. Only what
+// they and the simulated core in sim.c use is declared here. Keycode values
+// match QMK's keycodes.h.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGMEM
+
+// like quantum/util.h
+#if !defined(MIN)
+#    define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+#if !defined(MAX)
+#    define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+
+// keycodes
+//=============================================================================
+#define QK_BASIC                0x0000
+#define QK_BASIC_MAX            0x00FF
+#define QK_MODS                 0x0100
+#define QK_MODS_MAX             0x1FFF
+#define QK_MOD_TAP              0x2000
+#define QK_MOD_TAP_MAX          0x3FFF
+#define QK_LAYER_TAP            0x4000
+#define QK_LAYER_TAP_MAX        0x4FFF
+#define QK_LAYER_MOD            0x5000
+#define QK_LAYER_MOD_MAX        0x51FF
+#define QK_TO                   0x5200
+#define QK_TO_MAX               0x521F
+#define QK_MOMENTARY            0x5220
+#define QK_MOMENTARY_MAX        0x523F
+#define QK_DEF_LAYER            0x5240
+#define QK_DEF_LAYER_MAX        0x525F
+#define QK_TOGGLE_LAYER         0x5260
+#define QK_TOGGLE_LAYER_MAX     0x527F
+#define QK_ONE_SHOT_LAYER       0x5280
+#define QK_ONE_SHOT_LAYER_MAX   0x529F
+#define QK_ONE_SHOT_MOD         0x52A0
+#define QK_ONE_SHOT_MOD_MAX     0x52BF
+#define QK_LAYER_TAP_TOGGLE     0x52C0
+#define QK_LAYER_TAP_TOGGLE_MAX 0x52DF
+#define QK_TAP_DANCE            0x5700
+#define QK_TAP_DANCE_MAX        0x57FF
+#define QK_BOOTLOADER           0x7C00
+
+#define IS_QK_BASIC(kc)           ((kc) >= QK_BASIC && (kc) <= QK_BASIC_MAX)
+#define IS_QK_MODS(kc)            ((kc) >= QK_MODS && (kc) <= QK_MODS_MAX)
+#define IS_QK_MOD_TAP(kc)         ((kc) >= QK_MOD_TAP && (kc) <= QK_MOD_TAP_MAX)
+#define IS_QK_LAYER_TAP(kc)       ((kc) >= QK_LAYER_TAP && (kc) <= QK_LAYER_TAP_MAX)
+#define IS_QK_TAP_DANCE(kc)       ((kc) >= QK_TAP_DANCE && (kc) <= QK_TAP_DANCE_MAX)
+
+#define QK_MODS_GET_MODS(kc)                  (((kc) >> 8) & 0x1F)
+#define QK_MODS_GET_BASIC_KEYCODE(kc)         ((kc) & 0xFF)
+#define QK_MOD_TAP_GET_MODS(kc)               (((kc) >> 8) & 0x1F)
+#define QK_MOD_TAP_GET_TAP_KEYCODE(kc)        ((kc) & 0xFF)
+#define QK_LAYER_TAP_GET_LAYER(kc)            (((kc) >> 8) & 0xF)
+#define QK_LAYER_TAP_GET_TAP_KEYCODE(kc)      ((kc) & 0xFF)
+#define QK_MOMENTARY_GET_LAYER(kc)            ((kc) & 0x1F)
+#define QK_DEF_LAYER_GET_LAYER(kc)            ((kc) & 0x1F)
+
+#define IS_QK_MOMENTARY(kc)       ((kc) >= QK_MOMENTARY && (kc) <= QK_MOMENTARY_MAX)
+#define IS_QK_DEF_LAYER(kc)       ((kc) >= QK_DEF_LAYER && (kc) <= QK_DEF_LAYER_MAX)
+#define IS_INTERNAL_KEYCODE(kc)   ((kc) >= KC_NO && (kc) <= KC_TRNS)
+
+enum qk_keycode_defines {
+    KC_NO   = 0x0000,
+    KC_TRNS = 0x0001,
+    KC_A    = 0x0004,
+    KC_B, KC_C, KC_D, KC_E, KC_F, KC_G, KC_H, KC_I, KC_J, KC_K, KC_L, KC_M,
+    KC_N, KC_O, KC_P, KC_Q, KC_R, KC_S, KC_T, KC_U, KC_V, KC_W, KC_X, KC_Y,
+    KC_Z,
+    KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9, KC_0,
+    KC_ENTER, KC_ESCAPE, KC_BACKSPACE, KC_TAB, KC_SPACE, KC_MINUS, KC_EQUAL,
+    KC_LEFT_BRACKET, KC_RIGHT_BRACKET, KC_BACKSLASH, KC_NONUS_HASH,
+    KC_SEMICOLON, KC_QUOTE, KC_GRAVE, KC_COMMA, KC_DOT, KC_SLASH, KC_CAPS_LOCK,
+    KC_F1, KC_F2, KC_F3, KC_F4, KC_F5, KC_F6, KC_F7, KC_F8, KC_F9, KC_F10,
+    KC_F11, KC_F12,
+    KC_PRINT_SCREEN, KC_SCROLL_LOCK, KC_PAUSE, KC_INSERT, KC_HOME, KC_PAGE_UP,
+    KC_DELETE, KC_END, KC_PAGE_DOWN, KC_RIGHT, KC_LEFT, KC_DOWN, KC_UP,
+    KC_NONUS_BACKSLASH = 0x0064,
+    KC_F24             = 0x0073,
+    KC_AUDIO_MUTE      = 0x00A8,
+    KC_AUDIO_VOL_UP, KC_AUDIO_VOL_DOWN, KC_MEDIA_NEXT_TRACK, KC_MEDIA_PREV_TRACK,
+    KC_MEDIA_STOP, KC_MEDIA_PLAY_PAUSE,
+    KC_MS_UP           = 0x00CD,
+    KC_MS_DOWN, KC_MS_LEFT, KC_MS_RIGHT,
+    KC_MS_BTN1, KC_MS_BTN2, KC_MS_BTN3, KC_MS_BTN4, KC_MS_BTN5, KC_MS_BTN6,
+    KC_MS_BTN7, KC_MS_BTN8, KC_MS_WH_UP, KC_MS_WH_DOWN, KC_MS_WH_LEFT,
+    KC_MS_WH_RIGHT,
+    KC_LEFT_CTRL       = 0x00E0,
+    KC_LEFT_SHIFT, KC_LEFT_ALT, KC_LEFT_GUI,
+    KC_RIGHT_CTRL, KC_RIGHT_SHIFT, KC_RIGHT_ALT, KC_RIGHT_GUI,
+};
+
+#define KC_ENT  KC_ENTER
+#define KC_ESC  KC_ESCAPE
+#define KC_BSPC KC_BACKSPACE
+#define KC_SPC  KC_SPACE
+#define KC_MINS KC_MINUS
+#define KC_EQL  KC_EQUAL
+#define KC_COMM KC_COMMA
+#define KC_LBRC KC_LEFT_BRACKET
+#define KC_RBRC KC_RIGHT_BRACKET
+#define KC_NUHS KC_NONUS_HASH
+#define KC_SCLN KC_SEMICOLON
+#define KC_QUOT KC_QUOTE
+#define KC_GRV  KC_GRAVE
+#define KC_SLSH KC_SLASH
+#define KC_NUBS KC_NONUS_BACKSLASH
+#define KC_DEL  KC_DELETE
+#define KC_PGUP KC_PAGE_UP
+#define KC_PGDN KC_PAGE_DOWN
+#define KC_MUTE KC_AUDIO_MUTE
+#define KC_VOLU KC_AUDIO_VOL_UP
+#define KC_VOLD KC_AUDIO_VOL_DOWN
+#define KC_MNXT KC_MEDIA_NEXT_TRACK
+#define KC_MPRV KC_MEDIA_PREV_TRACK
+#define KC_MPLY KC_MEDIA_PLAY_PAUSE
+#define KC_BTN1 KC_MS_BTN1
+#define KC_BTN2 KC_MS_BTN2
+#define KC_BTN3 KC_MS_BTN3
+#define KC_WH_U KC_MS_WH_UP
+#define KC_WH_D KC_MS_WH_DOWN
+#define QK_BOOT QK_BOOTLOADER
+#define KC_LCTL KC_LEFT_CTRL
+#define KC_LSFT KC_LEFT_SHIFT
+#define KC_LALT KC_LEFT_ALT
+#define KC_LGUI KC_LEFT_GUI
+#define KC_RCTL KC_RIGHT_CTRL
+#define KC_RSFT KC_RIGHT_SHIFT
+#define KC_RALT KC_RIGHT_ALT
+#define KC_RGUI KC_RIGHT_GUI
+
+#define IS_MODIFIER_KEYCODE(kc) ((kc) >= KC_LEFT_CTRL && (kc) <= KC_RIGHT_GUI)
+
+// 5-bit packed mods, as used inside QK_MODS and QK_MOD_TAP keycodes
+enum mods_5bit {
+    MOD_LCTL = 0x01,
+    MOD_LSFT = 0x02,
+    MOD_LALT = 0x04,
+    MOD_LGUI = 0x08,
+    MOD_RCTL = 0x11,
+    MOD_RSFT = 0x12,
+    MOD_RALT = 0x14,
+    MOD_RGUI = 0x18,
+};
+
+// 8-bit HID mods, as used in the keyboard report
+#define MOD_BIT(code) (1 << ((code) & 0x07))
+
+#define LCTL(kc) (QK_MODS | (MOD_LCTL << 8) | (kc))
+#define LSFT(kc) (QK_MODS | (MOD_LSFT << 8) | (kc))
+#define LALT(kc) (QK_MODS | (MOD_LALT << 8) | (kc))
+#define LGUI(kc) (QK_MODS | (MOD_LGUI << 8) | (kc))
+#define RCTL(kc) (QK_MODS | ((MOD_RCTL & 0x1F) << 8) | (kc))
+#define RSFT(kc) (QK_MODS | ((MOD_RSFT & 0x1F) << 8) | (kc))
+#define RALT(kc) (QK_MODS | ((MOD_RALT & 0x1F) << 8) | (kc))
+#define RGUI(kc) (QK_MODS | ((MOD_RGUI & 0x1F) << 8) | (kc))
+#define LSA(kc)  (QK_MODS | ((MOD_LSFT | MOD_LALT) << 8) | (kc))
+#define C(kc)    LCTL(kc)
+#define S(kc)    LSFT(kc)
+
+#define MT(mod, kc) (QK_MOD_TAP | (((mod) & 0x1F) << 8) | ((kc) & 0xFF))
+#define LT(layer, kc) (QK_LAYER_TAP | (((layer) & 0xF) << 8) | ((kc) & 0xFF))
+#define MO(layer) (QK_MOMENTARY | ((layer) & 0x1F))
+#define DF(layer) (QK_DEF_LAYER | ((layer) & 0x1F))
+#define LCTL_T(kc) MT(MOD_LCTL, kc)
+#define LSFT_T(kc) MT(MOD_LSFT, kc)
+#define LALT_T(kc) MT(MOD_LALT, kc)
+#define LGUI_T(kc) MT(MOD_LGUI, kc)
+#define RCTL_T(kc) MT(MOD_RCTL, kc)
+#define RSFT_T(kc) MT(MOD_RSFT, kc)
+#define RALT_T(kc) MT(MOD_RALT, kc)
+#define RGUI_T(kc) MT(MOD_RGUI, kc)
+#define LCA_T(kc)  MT(MOD_LCTL | MOD_LALT, kc)
+#define C_S_T(kc)  MT(MOD_LCTL | MOD_LSFT, kc)
+
+// keyrecord
+//=============================================================================
+typedef struct {
+    uint8_t col;
+    uint8_t row;
+} keypos_t;
+
+typedef enum keyevent_type_t {
+    TICK_EVENT  = 0,
+    KEY_EVENT   = 1,
+    COMBO_EVENT = 4,
+} keyevent_type_t;
+
+typedef struct {
+    keypos_t        key;
+    uint16_t        time;
+    keyevent_type_t type;
+    bool            pressed;
+} keyevent_t;
+
+typedef struct {
+    bool    interrupted : 1;
+    bool    reserved2 : 1;
+    bool    reserved1 : 1;
+    bool    reserved0 : 1;
+    uint8_t count : 4;
+} tap_t;
+
+typedef struct {
+    keyevent_t event;
+    tap_t      tap;
+} keyrecord_t;
+
+#define IS_KEYEVENT(event) ((event).type == KEY_EVENT)
+
+// like quantum/eeconfig.h, where the user datablock starts (see eeprom.h)
+#define EECONFIG_USER_DATABLOCK ((uint8_t *) 64)
+
+// like quantum/action.h
+#if !defined(TAP_CODE_DELAY)
+#    define TAP_CODE_DELAY 0
+#endif
+
+// core functions (implemented by the simulated core in sim.c)
+//=============================================================================
+uint16_t timer_read(void);
+uint32_t timer_read32(void);
+uint16_t timer_elapsed(uint16_t last);
+uint32_t timer_elapsed32(uint32_t last);
+void     wait_ms(uint16_t ms);
+
+// like quantum/timer.h
+#define TIMER_DIFF_32(a, b) (uint32_t)((a) - (b))
+#define timer_expired32(current, future) ((uint32_t)(current - future) < UINT32_MAX / 2)
+
+void process_record(keyrecord_t *record);
+void send_keyboard_report(void);
+
+// like quantum/action_layer.h, with the default LAYER_STATE_16BIT
+typedef uint16_t layer_state_t;
+#define MAX_LAYER 16
+
+extern layer_state_t layer_state;
+extern layer_state_t default_layer_state;
+
+void          layer_state_set(layer_state_t state);
+bool          layer_state_is(uint8_t layer);
+bool          layer_state_cmp(layer_state_t state, uint8_t layer);
+void          layer_on(uint8_t layer);
+void          layer_off(uint8_t layer);
+void          default_layer_set(layer_state_t state);
+uint8_t       get_highest_layer(layer_state_t state);
+layer_state_t update_tri_layer_state(layer_state_t state, uint8_t layer1, uint8_t layer2, uint8_t layer3);
+#define IS_LAYER_ON(layer)  layer_state_is(layer)
+#define IS_LAYER_OFF(layer) !layer_state_is(layer)
+
+uint8_t get_mods(void);
+void    add_mods(uint8_t mods);
+void    del_mods(uint8_t mods);
+void    set_mods(uint8_t mods);
+void    clear_mods(void);
+void    register_mods(uint8_t mods);
+void    unregister_mods(uint8_t mods);
+
+void register_code(uint8_t code);
+void unregister_code(uint8_t code);
+void tap_code(uint8_t code);
+void register_code16(uint16_t code);
+void unregister_code16(uint16_t code);
+void tap_code16(uint16_t code);
+
+uint8_t get_oneshot_mods(void);
+void    set_oneshot_mods(uint8_t mods);
+void    clear_oneshot_mods(void);
+
+bool is_caps_word_on(void);
+bool is_keyboard_master(void);
+bool is_keyboard_left(void);
+
+extern bool debug_enable;
+extern bool debug_matrix;
+extern bool debug_keyboard;
+extern bool debug_mouse;
+
+// like quantum/pointing_device/pointing_device.h, without MOUSE_EXTENDED_REPORT
+typedef int8_t mouse_xy_report_t;
+
+typedef struct {
+    uint8_t           buttons;
+    mouse_xy_report_t x;
+    mouse_xy_report_t y;
+    int8_t            v;
+    int8_t            h;
+} report_mouse_t;
+
+#define XY_REPORT_MIN INT8_MIN
+#define XY_REPORT_MAX INT8_MAX
+
+// user hooks (implemented by the code under test, sim.c has defaults for the
+// ones feature_user.c doesn't have)
+bool          pre_process_record_user(uint16_t keycode, keyrecord_t *record);
+bool          process_record_user(uint16_t keycode, keyrecord_t *record);
+void          matrix_scan_user(void);
+void          housekeeping_task_user(void);
+report_mouse_t pointing_device_task_user(report_mouse_t mouse_report);
+layer_state_t layer_state_set_user(layer_state_t state);
+layer_state_t default_layer_state_set_user(layer_state_t state);
+void          keyboard_post_init_user(void);
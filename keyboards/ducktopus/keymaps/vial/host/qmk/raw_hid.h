@@ -0,0 +1,9 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Stand-in for QMK's raw_hid.h (sim.c drops what is sent).
+
+#pragma once
+
+#include <stdint.h>
+
+void raw_hid_send(uint8_t *data, uint8_t length);
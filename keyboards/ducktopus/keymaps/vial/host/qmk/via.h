@@ -0,0 +1,20 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Stand-in for QMK's via.h, the command ids that change the dynamic keymap.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum via_command_id {
+    id_dynamic_keymap_get_keycode = 0x04,
+    id_dynamic_keymap_set_keycode = 0x05,
+    id_dynamic_keymap_reset = 0x06,
+    id_eeprom_reset = 0x0A,
+    id_dynamic_keymap_get_buffer = 0x12,
+    id_dynamic_keymap_set_buffer = 0x13,
+};
+
+// called by raw_hid_receive before it handles a command itself
+bool via_command_kb(uint8_t *data, uint8_t length);
@@ -0,0 +1,400 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Replays a recorded key event stream through the heuristic tap hold code on
+// the host and reports what the keyboard would have sent.
+//
+// Reads a corpus (see corpus.h) or a stream file, one event per line ('#'
+// starts a comment):
+//
+//     <time_ms> <row> <col> <keycode> <d|u> [t|h]
+//
+// Times must not decrease. The keycode can be given in hex (0x2108). The
+// optional last field says whether a tap hold press was meant as a tap or a
+// hold (only -c uses it).
+//
+// With -c, the stream is replayed twice: first as the overlap heuristic always
+// waits, then as it decides early when it is that confident (see
+// should_decide_overlap_early). It prints what that costs in accuracy and
+// saves in latency; everything else is about the second time.
+//
+// With -b, the bigram offsets of the table file (see bigram.h) are written into
+// the feature first, like bigram_table -w does to the keyboard, and with -k
+// the coefficients of the file (see coefficients.h), like hid_coefficients -w.
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "bigram.h"
+#include "coefficients.h"
+#include "corpus.h"
+#include "sim.h"
+#include "adaptive.h"
+#include "latency.h"
+#include "scan_profile.h"
+#include "shadow.h"
+#include "features/heuristic_tap_hold_rhythm.h"
+
+// more than MS_MAX_OVERLAP, so every pending decision is made at the end
+#define MS_SETTLE_AFTER_LAST_EVENT 1000
+
+// above 100 it always waits
+#define NEVER_DECIDE_EARLY 101
+
+// what happened to the last press of each key
+typedef struct {
+    uint8_t label;
+    bool is_pending;
+    bool was_sent;
+    bool chose_tap;
+    uint32_t latency_ms;
+} press_t;
+
+typedef struct {
+    uint64_t presses;
+    uint64_t latency_sum_ms; // from the physical press until it reaches the QMK core
+    uint64_t labeled;
+    uint64_t mispredicted;
+    uint64_t overlap_waits;  // calls to should_decide_overlap_early
+    uint64_t early_taps;
+    uint64_t early_holds;
+} pass_t;
+
+
+static corpus_t corpus;
+
+static int early_confidence = NEVER_DECIDE_EARLY;
+static press_t press_at[MATRIX_ROWS][MATRIX_COLS];
+static pass_t pass;
+
+
+bool should_decide_overlap_early(int8_t confidence) {
+    pass.overlap_waits++;
+    if (ABS(confidence) < early_confidence) return false;
+
+    if (confidence > 0) {
+        pass.early_holds++;
+    } else {
+        pass.early_taps++;
+    }
+    return true;
+}
+
+
+static void on_press_sent(const keyrecord_t* record, uint16_t keycode, uint32_t ms_since_press) {
+    press_t* press = &press_at[record->event.key.row][record->event.key.col];
+    press->was_sent = true;
+    press->chose_tap = record->tap.count > 0;
+    press->latency_ms = ms_since_press;
+}
+
+
+// like sweep_point.c, a labeled press is mispredicted if what it was decided
+// as last isn't its label (or it was never sent)
+static void finish_press(press_t* press) {
+    if (!press->is_pending) return;
+    press->is_pending = false;
+
+    if (press->was_sent) {
+        pass.presses++;
+        pass.latency_sum_ms += press->latency_ms;
+    }
+
+    if (press->label == CORPUS_LABEL_NONE) return;
+    pass.labeled++;
+    const bool chose_tap = press->was_sent && press->chose_tap;
+    const bool chose_hold = press->was_sent && !press->chose_tap;
+    pass.mispredicted += !(press->label == CORPUS_LABEL_TAP ? chose_tap : chose_hold);
+}
+
+
+static void finish_presses(void) {
+    for (int row = 0; row < MATRIX_ROWS; ++row) {
+        for (int col = 0; col < MATRIX_COLS; ++col) {
+            finish_press(&press_at[row][col]);
+        }
+    }
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-n repeat] [-r] [-l] [-s] [-a] [-t] [-c percent] [-b table] [-k coefficients] STREAM|CORPUS\n"
+            "  -n repeat  replay the stream this many times (default 1)\n"
+            "  -r         print every keyboard report sent to the host\n"
+            "  -l         print the decision latency percentiles (read like over raw HID)\n"
+            "  -s         print the shadow mode counters (read like over raw HID)\n"
+            "  -a         print the biases learned from corrections (read like over raw HID)\n"
+            "  -t         print how long the stages of the scan loop took (read like over raw HID)\n"
+            "  -c percent compare to deciding early with this much confidence\n"
+            "  -b table   use the bigram offsets of this table file\n"
+            "  -k file    use the coefficients of this file\n",
+            name);
+    exit(2);
+}
+
+
+// checks that the events fit the simulated matrix and returns the time of the last one
+static uint64_t check_events(const char* path) {
+    uint64_t time = 0;
+    for (uint64_t i = 0; i < corpus.event_count; ++i) {
+        time += corpus.deltas[i];
+        if (CORPUS_ROW(corpus.positions[i]) >= MATRIX_ROWS || CORPUS_COL(corpus.positions[i]) >= MATRIX_COLS) {
+            fprintf(stderr, "%s: event %llu is outside of the matrix\n", path, (unsigned long long) i);
+            exit(1);
+        }
+    }
+    if (time > UINT32_MAX / 2) {
+        fprintf(stderr, "%s: the events span too much time\n", path);
+        exit(1);
+    }
+    return time;
+}
+
+
+static bool transfer_to_feature(uint8_t* packet, void* context) {
+    return process_heuristic_tap_hold_latency_command(packet, LATENCY_PACKET_SIZE);
+}
+
+
+static bool transfer_shadow_to_feature(uint8_t* packet, void* context) {
+    return process_heuristic_tap_hold_shadow_command(packet, SHADOW_PACKET_SIZE);
+}
+
+
+static bool transfer_adaptive_to_feature(uint8_t* packet, void* context) {
+    return process_heuristic_tap_hold_adaptive_command(packet, ADAPTIVE_PACKET_SIZE);
+}
+
+
+static bool transfer_scan_profile_to_feature(uint8_t* packet, void* context) {
+    return process_scan_profiler_command(packet, SCAN_PROFILE_PACKET_SIZE);
+}
+
+
+static bool transfer_bigrams_to_feature(uint8_t* packet, void* context) {
+    return process_heuristic_tap_hold_bigram_command(packet, BIGRAM_PACKET_SIZE);
+}
+
+
+static bool transfer_coefficients_to_feature(uint8_t* packet, void* context) {
+    return process_heuristic_tap_hold_coefficients_command(packet, COEFFICIENTS_PACKET_SIZE);
+}
+
+
+// Replays the stream repeat times, each one second after the previous one
+// ended, and returns when the last one ended.
+static uint32_t replay(uint32_t offset, unsigned long repeat, uint32_t stream_start, uint32_t stream_duration) {
+    for (unsigned long r = 0; r < repeat; ++r) {
+        uint32_t time = 0;
+        for (uint64_t i = 0; i < corpus.event_count; ++i) {
+            time += corpus.deltas[i];
+            sim_run_until(time - stream_start + offset);
+
+            const uint8_t row = CORPUS_ROW(corpus.positions[i]);
+            const uint8_t col = CORPUS_COL(corpus.positions[i]);
+            const bool pressed = corpus.flags[i] & CORPUS_FLAG_PRESSED;
+            if (pressed) {
+                press_t* press = &press_at[row][col];
+                finish_press(press);
+                *press = (press_t){.label = corpus.labels[i], .is_pending = true};
+                sim_set_keycode(row, col, corpus.keycodes[i]);
+            }
+            sim_key_event(row, col, pressed);
+        }
+        offset += stream_duration;
+    }
+    sim_run_until(sim_now() + MS_SETTLE_AFTER_LAST_EVENT);
+    finish_presses();
+    return offset;
+}
+
+
+static double get_mispredicted_percent(const pass_t* result) {
+    return result->labeled ? 100.0 * (double) result->mispredicted / (double) result->labeled : 0.0;
+}
+
+
+static double get_mean_latency_ms(const pass_t* result) {
+    return result->presses ? (double) result->latency_sum_ms / (double) result->presses : 0.0;
+}
+
+
+static void print_early_decisions(const pass_t* waiting, const pass_t* early) {
+    printf("\nearly decisions with %d %% confidence, compared to always waiting\n", early_confidence);
+    printf("decided early:   %llu of %llu overlap waits (%llu tap, %llu hold)\n",
+           (unsigned long long) (early->early_taps + early->early_holds), (unsigned long long) early->overlap_waits,
+           (unsigned long long) early->early_taps, (unsigned long long) early->early_holds);
+    printf("mispredicted:    %.3f %% -> %.3f %% of %llu labeled tap hold presses (%+lld)\n",
+           get_mispredicted_percent(waiting), get_mispredicted_percent(early), (unsigned long long) early->labeled,
+           (long long) early->mispredicted - (long long) waiting->mispredicted);
+    printf("mean latency:    %.3f -> %.3f ms (of every press, until it reaches the QMK core)\n",
+           get_mean_latency_ms(waiting), get_mean_latency_ms(early));
+}
+
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+
+int main(int argc, char** argv) {
+    unsigned long repeat = 1;
+    bool should_print_reports = false;
+    bool should_print_latency = false;
+    bool should_print_shadow = false;
+    bool should_print_biases = false;
+    bool should_print_scan_profile = false;
+    bool should_compare_early = false;
+    const char* path = NULL;
+    const char* bigram_path = NULL;
+    const char* coefficients_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repeat = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            should_print_reports = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            should_print_latency = true;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            should_print_shadow = true;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            should_print_biases = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            should_print_scan_profile = true;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            early_confidence = (int) strtol(argv[++i], NULL, 10);
+            if (early_confidence < 0 || early_confidence > 100) usage(argv[0]);
+            should_compare_early = true;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            bigram_path = argv[++i];
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            coefficients_path = argv[++i];
+        } else if (argv[i][0] == '-' || path != NULL) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL || repeat == 0) usage(argv[0]);
+
+    if (!corpus_open(&corpus, path)) return 1;
+    if (corpus.event_count == 0) {
+        fprintf(stderr, "%s: no events\n", path);
+        return 1;
+    }
+
+    sim_init(should_print_reports);
+    sim_set_press_callback(on_press_sent);
+    keyboard_post_init_user();
+
+    if (bigram_path != NULL) {
+        static bigram_table_t table;
+        if (!load_bigram_table(bigram_path, &table)) return 1;
+        if (!write_bigram_table(transfer_bigrams_to_feature, NULL, &table, false)) return 1;
+    }
+    if (coefficients_path != NULL) {
+        heuristic_tap_hold_coefficients_t set;
+        if (!load_coefficient_file(coefficients_path, &set)) return 1;
+        if (!write_coefficients(transfer_coefficients_to_feature, NULL, &set, false)) return 1;
+    }
+
+    const uint32_t stream_start = corpus.deltas[0];
+    const uint32_t stream_duration = (uint32_t) check_events(path) - stream_start + 1000;
+    uint32_t offset = 1;
+
+    pass_t waiting = {0};
+    if (should_compare_early) {
+        const int confidence = early_confidence;
+        early_confidence = NEVER_DECIDE_EARLY;
+        replay(offset, repeat, stream_start, stream_duration);
+        waiting = pass;
+
+        // this long after the last release, nothing of it matters anymore
+        offset = sim_now() + MS_MAX_DUR + 1;
+        early_confidence = confidence;
+        pass = (pass_t){0};
+        sim_reset_stats();
+        reset_latency_histograms(transfer_to_feature, NULL);
+        reset_shadow_comparison(transfer_shadow_to_feature, NULL);
+        reset_scan_profile(transfer_scan_profile_to_feature, NULL);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replay(offset, repeat, stream_start, stream_duration);
+    const double wall_seconds = seconds_since(&start);
+
+    if (should_print_reports) {
+        size_t count;
+        const sim_report_entry_t* reports = sim_get_reports(&count);
+        for (size_t i = 0; i < count; ++i) {
+            sim_print_report(stdout, &reports[i]);
+        }
+        printf("\n");
+    }
+
+    const sim_stats_t* stats = sim_get_stats();
+    printf("events:          %llu\n", (unsigned long long) stats->events);
+    printf("virtual time:    %u ms\n", sim_now());
+    printf("matrix scans:    %llu\n", (unsigned long long) stats->scans);
+    printf("reports:         %llu sent, %llu changed\n",
+           (unsigned long long) stats->reports_sent, (unsigned long long) stats->reports_changed);
+    printf("decisions:       %llu tap, %llu hold (%llu sent in matrix_scan_user)\n",
+           (unsigned long long) stats->tap_decisions, (unsigned long long) stats->hold_decisions,
+           (unsigned long long) stats->decided_in_task);
+    printf("forced taps:     %llu\n", (unsigned long long) stats->forced_taps);
+    if (pass.labeled > 0 && !should_compare_early) {
+        printf("mispredicted:    %.3f %% of %llu labeled tap hold presses\n", get_mispredicted_percent(&pass),
+               (unsigned long long) pass.labeled);
+    }
+    // one scan per millisecond, so every blocked millisecond is a missed scan
+    printf("blocked scans:   %llu (in %llu waits)\n",
+           (unsigned long long) stats->blocked_ms, (unsigned long long) stats->blocked_waits);
+    printf("wall time:       %.3f s\n", wall_seconds);
+    printf("events/sec:      %.0f\n", (double) stats->events / wall_seconds);
+    printf("scans/sec:       %.0f\n", (double) stats->scans / wall_seconds);
+
+    // at the end, so only of the last TYPING_RHYTHM_WINDOW presses and releases
+    const typing_rhythm_t rhythm = get_typing_rhythm();
+    printf("press interval:  %u ms mean, %.1f ms sd, %u ms average (of %u)\n", rhythm.interval_mean_ms,
+           sqrt((double) rhythm.interval_variance), rhythm.interval_ema_ms, rhythm.interval_count);
+    printf("hold duration:   %u ms mean, %.1f ms sd (of %u)\n", rhythm.hold_mean_ms,
+           sqrt((double) rhythm.hold_variance), rhythm.hold_count);
+
+    if (should_compare_early) print_early_decisions(&waiting, &pass);
+
+    if (should_print_latency) {
+        static latency_histograms_t histograms;
+        if (!read_latency_histograms(transfer_to_feature, NULL, &histograms)) return 1;
+        printf("\n");
+        print_latency_percentiles(stdout, &histograms);
+    }
+
+    if (should_print_shadow) {
+        shadow_comparison_t comparison;
+        if (!read_shadow_comparison(transfer_shadow_to_feature, NULL, &comparison)) return 1;
+        printf("\n");
+        print_shadow_comparison(stdout, &comparison);
+    }
+
+    if (should_print_biases) {
+        adaptive_biases_t biases;
+        if (!read_adaptive_biases(transfer_adaptive_to_feature, NULL, &biases)) return 1;
+        printf("\n");
+        print_adaptive_biases(stdout, &biases);
+    }
+
+    if (should_print_scan_profile) {
+        scan_profile_t profile;
+        if (!read_scan_profile(transfer_scan_profile_to_feature, NULL, &profile)) return 1;
+        printf("\n");
+        print_scan_profile(stdout, &profile);
+    }
+
+    corpus_close(&corpus);
+    return 0;
+}
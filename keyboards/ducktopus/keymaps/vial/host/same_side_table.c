@@ -0,0 +1,391 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Trains the same side model (see features/heuristic_tap_hold_same_side.h)
+// on labeled corpora and generates its table.
+//
+//     same_side_table [-m MIN] [-g GAIN] [-o OUTPUT] CORPUS...
+//
+// The same side samples (see samples.h) are counted in a fixed grid of cells.
+// A cell with enough samples decides what is right for most of them (hold or
+// tap, tap if equal), unless waiting for the overlap heuristics, like for a
+// next key on the other side, is right for at least -g samples more. Then it
+// is UNDECIDED. Cells with too few samples choose tap, like before. Rows and
+// columns equal to the one before are merged, so without training data, the
+// table is a single cell.
+//
+// It prints the accuracy like features/README.md, of the compiled in table and
+// the trained one, and when the holds (e.g. same hand shortcuts) are decided.
+// Accuracy on the samples it learned from is optimistic, so it also prints it
+// for two halves of the samples, each with the table learned from the other
+// half.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+#include "samples.h"
+#include "features/heuristic_tap_hold_kernels.h"
+#include "features/heuristic_tap_hold_same_side.h"
+
+// where the cells start, at most 255 of each
+static const int16_t grid_p_knots[] = {-MS_MAX_DUR, -50, 0, 25, 50, 75, 100, 150, 200, 300, 500, 1000};
+static const uint16_t grid_t_knots[] = {0, 25, 50, 75, 100, 125, 150, 200, 250, 300};
+
+#define GRID_P_COUNT ((uint8_t) (sizeof(grid_p_knots) / sizeof(grid_p_knots[0])))
+#define GRID_T_COUNT ((uint8_t) (sizeof(grid_t_knots) / sizeof(grid_t_knots[0])))
+
+// samples of the fold are left out while learning and used to evaluate
+#define ALL_SAMPLES -1
+
+typedef struct {
+    uint32_t hold_count;
+    uint32_t tap_count;
+    uint32_t overlap_correct; // if the overlap heuristics decide
+} cell_counts_t;
+
+typedef struct {
+    const sample_set_t* samples;
+    // of the overlap heuristics, by sample
+    bool* overlap_is_hold;
+    uint16_t* overlap_latencies;
+    cell_counts_t counts[GRID_P_COUNT * GRID_T_COUNT];
+} learner_t;
+
+// a table with room for the whole grid
+typedef struct {
+    int16_t p_knots[GRID_P_COUNT];
+    uint16_t t_knots[GRID_T_COUNT];
+    uint8_t decisions[GRID_P_COUNT * GRID_T_COUNT];
+    same_side_table_t table;
+} table_storage_t;
+
+typedef struct {
+    accuracy_t accuracy;
+    // ms after the next press, of the holds decided as hold
+    uint16_t* hold_latencies;
+    size_t hold_latency_count;
+    uint64_t waiting_tap_count;
+    uint64_t tap_wait_sum;
+} report_t;
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-m MIN] [-g GAIN] [-o OUTPUT] CORPUS...\n"
+            "  -m MIN     only cells with at least this many samples are trained (default 20)\n"
+            "  -g GAIN    and only wait for the overlap heuristics if that's right for this\n"
+            "             many more of them (default 2)\n"
+            "  -o OUTPUT  where to write the table (default: only print the accuracy)\n",
+            name);
+    exit(2);
+}
+
+
+static void* allocate(size_t size) {
+    void* memory = calloc(1, MAX(size, 1));
+    if (memory == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
+
+
+static uint8_t find_cell(const int16_t* knots, uint8_t count, int32_t x) {
+    uint8_t i = 0;
+    while (i + 1 < count && knots[i + 1] <= x) ++i;
+    return i;
+}
+
+
+static uint8_t find_t_cell(uint16_t t) {
+    uint8_t j = 0;
+    while (j + 1 < GRID_T_COUNT && grid_t_knots[j + 1] <= t) ++j;
+    return j;
+}
+
+
+static bool is_in_fold(size_t sample, int fold) {
+    return fold == ALL_SAMPLES || (int) (sample % 2) == fold;
+}
+
+
+static void count_cells(learner_t* learner, int left_out_fold) {
+    memset(learner->counts, 0, sizeof(learner->counts));
+
+    const sample_set_t* samples = learner->samples;
+    for (size_t i = 0; i < samples->count; ++i) {
+        if (left_out_fold != ALL_SAMPLES && is_in_fold(i, left_out_fold)) continue;
+
+        const uint8_t p_cell = find_cell(grid_p_knots, GRID_P_COUNT, (int32_t) samples->p[i]);
+        cell_counts_t* counts = &learner->counts[p_cell * GRID_T_COUNT + find_t_cell((uint16_t) samples->t[i])];
+        const bool is_hold = samples->is_hold[i];
+        counts->hold_count += is_hold;
+        counts->tap_count += !is_hold;
+        counts->overlap_correct += learner->overlap_is_hold[i] == is_hold;
+    }
+}
+
+
+static uint8_t choose_decision(const cell_counts_t* counts, uint32_t min_samples, uint32_t min_gain) {
+    if (counts->hold_count + counts->tap_count < min_samples) return CHOSE_TAP;
+
+    const bool is_hold = counts->hold_count > counts->tap_count;
+    const uint32_t correct = is_hold ? counts->hold_count : counts->tap_count;
+    if (counts->overlap_correct >= correct + min_gain) return UNDECIDED;
+    return is_hold ? CHOSE_HOLD : CHOSE_TAP;
+}
+
+
+static void learn_table(learner_t* learner, int left_out_fold, uint32_t min_samples, uint32_t min_gain,
+                        table_storage_t* storage) {
+    count_cells(learner, left_out_fold);
+
+    uint8_t grid[GRID_P_COUNT * GRID_T_COUNT];
+    for (size_t cell = 0; cell < sizeof(grid); ++cell) {
+        grid[cell] = choose_decision(&learner->counts[cell], min_samples, min_gain);
+    }
+
+    // the columns and then the rows, which stay different if they were
+    bool keeps_t[GRID_T_COUNT];
+    uint8_t t_count = 0;
+    for (uint8_t j = 0; j < GRID_T_COUNT; ++j) {
+        keeps_t[j] = j == 0;
+        for (uint8_t i = 0; i < GRID_P_COUNT && !keeps_t[j]; ++i) {
+            keeps_t[j] = grid[i * GRID_T_COUNT + j] != grid[i * GRID_T_COUNT + j - 1];
+        }
+        if (keeps_t[j]) storage->t_knots[t_count++] = grid_t_knots[j];
+    }
+
+    uint8_t p_count = 0;
+    for (uint8_t i = 0; i < GRID_P_COUNT; ++i) {
+        uint8_t row[GRID_T_COUNT];
+        uint8_t n = 0;
+        for (uint8_t j = 0; j < GRID_T_COUNT; ++j) {
+            if (keeps_t[j]) row[n++] = grid[i * GRID_T_COUNT + j];
+        }
+        if (i > 0 && memcmp(row, &storage->decisions[(p_count - 1) * t_count], t_count) == 0) continue;
+
+        storage->p_knots[p_count] = grid_p_knots[i];
+        memcpy(&storage->decisions[p_count * t_count], row, t_count);
+        ++p_count;
+    }
+
+    storage->table = (same_side_table_t){
+            .p_knots = storage->p_knots,
+            .t_knots = storage->t_knots,
+            .decisions = storage->decisions,
+            .p_count = p_count,
+            .t_count = t_count,
+    };
+}
+
+
+// the compiled in table, if table is NULL
+static void evaluate_table(const learner_t* learner, const same_side_table_t* table, int fold, report_t* report) {
+    const sample_set_t* samples = learner->samples;
+    for (size_t i = 0; i < samples->count; ++i) {
+        if (!is_in_fold(i, fold)) continue;
+
+        const int16_t p = (int16_t) samples->p[i];
+        const uint16_t t = (uint16_t) samples->t[i];
+        const tap_hold_decision_options decision =
+                table == NULL ? estimate_same_side_decision(p, t) : look_up_same_side_decision(table, p, t);
+        const bool is_hold = samples->is_hold[i];
+        const bool hold = decision == UNDECIDED ? learner->overlap_is_hold[i] : decision == CHOSE_HOLD;
+        const uint16_t latency = decision == UNDECIDED ? learner->overlap_latencies[i] : 0;
+
+        if (is_hold) {
+            report->accuracy.mod_count++;
+            report->accuracy.mod_correct += hold;
+            if (hold && report->hold_latencies != NULL) report->hold_latencies[report->hold_latency_count++] = latency;
+        } else {
+            report->accuracy.non_mod_count++;
+            report->accuracy.non_mod_correct += !hold;
+            report->waiting_tap_count += decision == UNDECIDED;
+            report->tap_wait_sum += latency;
+        }
+    }
+}
+
+
+static int compare_latencies(const void* a, const void* b) {
+    return (int) *(const uint16_t*) a - (int) *(const uint16_t*) b;
+}
+
+
+static void print_latencies(const char* name, report_t* report) {
+    uint64_t sum = 0;
+    size_t right_away = 0;
+    for (size_t i = 0; i < report->hold_latency_count; ++i) {
+        sum += report->hold_latencies[i];
+        right_away += report->hold_latencies[i] == 0;
+    }
+    qsort(report->hold_latencies, report->hold_latency_count, sizeof(uint16_t), compare_latencies);
+
+    const size_t count = report->hold_latency_count;
+    printf("%-12s %6llu %11zu %11zu %7.1f ms %7u ms %9llu %7.1f ms\n", name,
+           (unsigned long long) report->accuracy.mod_count, count, right_away,
+           count ? (double) sum / (double) count : 0.0, count ? report->hold_latencies[(count - 1) * 95 / 100] : 0,
+           (unsigned long long) report->waiting_tap_count,
+           report->waiting_tap_count ? (double) report->tap_wait_sum / (double) report->waiting_tap_count : 0.0);
+}
+
+
+static double to_percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double) part / (double) total : 0.0;
+}
+
+
+static void count_decisions(const same_side_table_t* table, unsigned* counts) {
+    for (uint16_t cell = 0; cell < table->p_count * table->t_count; ++cell) {
+        counts[table->decisions[cell]]++;
+    }
+}
+
+
+static void write_table(FILE* out, const same_side_table_t* table, size_t sample_count) {
+    const size_t data_bytes = table->p_count * sizeof(int16_t) + table->t_count * sizeof(uint16_t) +
+                              table->p_count * table->t_count;
+    fprintf(out,
+            "// Copyright 2024 Joschua Gandert (@CreamyCookie)\n"
+            "//\n"
+            "// Generated by host/same_side_table (make same-side-table), do not edit.\n"
+            "//\n"
+            "// %u x %u knots, %zu bytes, trained on %zu same side samples.\n"
+            "\n"
+            "#pragma once\n"
+            "\n",
+            table->p_count, table->t_count, data_bytes, sample_count);
+
+    fprintf(out, "static const int16_t same_side_table_p_knots[] = {");
+    for (uint8_t i = 0; i < table->p_count; ++i) fprintf(out, "%s%d", i ? ", " : "", table->p_knots[i]);
+    fprintf(out, "};\nstatic const uint16_t same_side_table_t_knots[] = {");
+    for (uint8_t j = 0; j < table->t_count; ++j) fprintf(out, "%s%u", j ? ", " : "", table->t_knots[j]);
+    fprintf(out, "};\n\n// one row per p knot: 0 undecided, 1 tap, 2 hold\n"
+                 "static const uint8_t same_side_table_decisions[] = {\n");
+    for (uint8_t i = 0; i < table->p_count; ++i) {
+        fprintf(out, "   ");
+        for (uint8_t j = 0; j < table->t_count; ++j) fprintf(out, " %u,", table->decisions[i * table->t_count + j]);
+        fprintf(out, "\n");
+    }
+    fprintf(out,
+            "};\n"
+            "\n"
+            "static const same_side_table_t same_side_table = {\n"
+            "    .p_knots = same_side_table_p_knots,\n"
+            "    .t_knots = same_side_table_t_knots,\n"
+            "    .decisions = same_side_table_decisions,\n"
+            "    .p_count = %u,\n"
+            "    .t_count = %u,\n"
+            "};\n",
+            table->p_count, table->t_count);
+}
+
+
+int main(int argc, char** argv) {
+    uint32_t min_samples = 20;
+    uint32_t min_gain = 2;
+    const char* output_path = NULL;
+
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        const char* value = argv[i + 1];
+        if (strcmp(argv[i], "-m") == 0) {
+            min_samples = (uint32_t) strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "-g") == 0) {
+            min_gain = (uint32_t) strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            output_path = value;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (i >= argc || argv[i][0] == '-') usage(argv[0]);
+
+    heuristic_samples_t samples = {0};
+    for (; i < argc; ++i) {
+        corpus_t corpus;
+        if (!corpus_open(&corpus, argv[i])) return 1;
+        add_corpus_samples(&samples, &corpus);
+        corpus_close(&corpus);
+    }
+
+    // what the overlap heuristics decide, and when (see samples.h), if the
+    // model leaves it to them
+    const sample_set_t* same_side = &samples.same_side;
+    const size_t count = same_side->count;
+    learner_t* learner = allocate(sizeof(*learner));
+    learner->samples = same_side;
+    learner->overlap_is_hold = allocate(count * sizeof(bool));
+    learner->overlap_latencies = allocate(count * sizeof(uint16_t));
+    for (size_t s = 0; s < count; ++s) {
+        const uint16_t estimate =
+                estimate_min_overlap_for_hold_in_ms((int16_t) same_side->p[s], (uint16_t) same_side->t[s]);
+        const uint16_t overlap = (uint16_t) same_side->extra[s];
+        learner->overlap_is_hold[s] = overlap > estimate || samples.same_side_contexts[s].fallback_is_hold;
+        learner->overlap_latencies[s] = MIN(overlap, estimate + 1);
+    }
+
+    // each half with the table of the other one
+    report_t held_out_before = {0}, held_out_after = {0};
+    for (int fold = 0; fold < 2; ++fold) {
+        table_storage_t half;
+        learn_table(learner, fold, min_samples, min_gain, &half);
+        evaluate_table(learner, NULL, fold, &held_out_before);
+        evaluate_table(learner, &half.table, fold, &held_out_after);
+    }
+
+    table_storage_t trained;
+    learn_table(learner, ALL_SAMPLES, min_samples, min_gain, &trained);
+    report_t before = {.hold_latencies = allocate(count * sizeof(uint16_t))};
+    report_t after = {.hold_latencies = allocate(count * sizeof(uint16_t))};
+    evaluate_table(learner, NULL, ALL_SAMPLES, &before);
+    evaluate_table(learner, &trained.table, ALL_SAMPLES, &after);
+
+    unsigned cell_count = 0;
+    for (size_t cell = 0; cell < GRID_P_COUNT * GRID_T_COUNT; ++cell) {
+        cell_count += learner->counts[cell].hold_count + learner->counts[cell].tap_count >= min_samples;
+    }
+    unsigned decisions[3] = {0};
+    count_decisions(&trained.table, decisions);
+    printf("%zu same side samples, %u of %u cells with enough of them\n", count, cell_count,
+           GRID_P_COUNT * GRID_T_COUNT);
+    printf("trained: %u x %u knots, %u cells undecided, %u tap, %u hold\n\n", trained.table.p_count,
+           trained.table.t_count, decisions[UNDECIDED], decisions[CHOSE_TAP], decisions[CHOSE_HOLD]);
+
+    print_accuracy(stdout, "**same side function** (compiled in)", &before.accuracy);
+    printf("\n");
+    print_accuracy(stdout, "**same side function** (trained)", &after.accuracy);
+
+    printf("\nheld out:    %.3f %% -> %.3f %% decided right\n\n",
+           to_percent(held_out_before.accuracy.mod_correct + held_out_before.accuracy.non_mod_correct,
+                      held_out_before.accuracy.mod_count + held_out_before.accuracy.non_mod_count),
+           to_percent(held_out_after.accuracy.mod_correct + held_out_after.accuracy.non_mod_correct,
+                      held_out_after.accuracy.mod_count + held_out_after.accuracy.non_mod_count));
+
+    printf("table         holds  held right  right away  mean wait  95th pct.  taps wait  mean wait\n");
+    print_latencies("compiled in", &before);
+    print_latencies("trained", &after);
+    printf("(waits are ms after the next press, until the overlap heuristics decided)\n");
+
+    int result = 0;
+    if (output_path != NULL) {
+        FILE* out = fopen(output_path, "w");
+        if (out == NULL) {
+            perror(output_path);
+            result = 1;
+        } else {
+            write_table(out, &trained.table, count);
+            fclose(out);
+        }
+    }
+
+    free(before.hold_latencies);
+    free(after.hold_latencies);
+    free(learner->overlap_is_hold);
+    free(learner->overlap_latencies);
+    free(learner);
+    free_heuristic_samples(&samples);
+    return result;
+}
@@ -0,0 +1,180 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <stdlib.h>
+
+#include "quantum.h"
+#include "samples.h"
+#include "features/heuristic_tap_hold_kernels.h"
+
+#define POSITION_COUNT 256
+
+typedef struct {
+    const corpus_t* corpus;
+    uint64_t* times;
+
+    // of the last press at each position
+    uint16_t keycode_at[POSITION_COUNT];
+    uint8_t label_at[POSITION_COUNT];
+} walk_t;
+
+
+static bool is_left(uint8_t position) {
+    return CORPUS_ROW(position) < MATRIX_ROWS / 2;
+}
+
+
+// like prev_was_mod in the state machine
+static bool was_mod(const walk_t* walk, uint8_t position) {
+    return walk->label_at[position] == CORPUS_LABEL_HOLD || IS_MODIFIER_KEYCODE(walk->keycode_at[position]);
+}
+
+
+static uint16_t to_uint16(uint64_t ms) {
+    return (uint16_t) MIN(ms, UINT16_MAX);
+}
+
+
+static void add_overlap_sample(heuristic_samples_t* samples, bool is_same_side, int16_t p, uint16_t t,
+                               uint16_t overlap, bool is_hold, uint8_t th_position, uint8_t next_position,
+                               bool fallback_is_hold) {
+    sample_set_t* set = is_same_side ? &samples->same_side : &samples->overlap;
+    overlap_context_t** contexts = is_same_side ? &samples->same_side_contexts : &samples->overlap_contexts;
+
+    const size_t capacity = set->capacity;
+    sample_set_add(set, p, t, overlap, is_hold);
+
+    if (set->capacity != capacity || *contexts == NULL) {
+        *contexts = realloc(*contexts, set->capacity * sizeof(**contexts));
+        if (*contexts == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    (*contexts)[set->count - 1] = (overlap_context_t){
+            .bigram = (uint16_t) (th_position << 8 | next_position),
+            .fallback_is_hold = fallback_is_hold,
+    };
+}
+
+
+static void add_tap_hold_samples(heuristic_samples_t* samples, const walk_t* walk, uint64_t th, int16_t p,
+                                 bool prev_is_mod) {
+    const corpus_t* corpus = walk->corpus;
+    const uint64_t* times = walk->times;
+    const uint8_t th_position = corpus->positions[th];
+    const bool is_hold = corpus->labels[th] == CORPUS_LABEL_HOLD;
+
+    uint64_t next = th;
+    uint16_t t = 0;
+    bool is_same_side = false;
+
+    for (uint64_t i = th + 1; i < corpus->event_count; ++i) {
+        const uint8_t position = corpus->positions[i];
+        const bool pressed = corpus->flags[i] & CORPUS_FLAG_PRESSED;
+        const uint64_t since_th = times[i] - times[th];
+
+        if (next == th) {
+            if (since_th > MS_MAX_OVERLAP) return;
+
+            if (pressed) {
+                is_same_side = is_left(position) == is_left(th_position);
+                next = i;
+                t = (uint16_t) since_th;
+            } else if (position == th_position) {
+                // released without another key
+                return;
+            } else {
+                // pressed before the tap hold key and released now
+                p = (int16_t) -MIN(MS_MAX_DUR, since_th);
+                prev_is_mod = was_mod(walk, position);
+            }
+            continue;
+        }
+
+        const uint64_t overlap_end = MIN(times[i], times[th] + MS_MAX_OVERLAP + 1);
+        const uint16_t overlap = to_uint16(overlap_end - times[next]);
+
+        const uint8_t next_position = corpus->positions[next];
+        if (since_th > MS_MAX_OVERLAP) {
+            add_overlap_sample(samples, is_same_side, p, t, overlap, is_hold, th_position, next_position, true);
+            return;
+        }
+
+        if (pressed) {
+            const bool fallback_is_hold = estimate_hold_when_two_down(p, t, prev_is_mod);
+            add_overlap_sample(samples, is_same_side, p, t, overlap, is_hold, th_position, next_position,
+                               fallback_is_hold);
+            if (!is_same_side) sample_set_add(&samples->two_down, p, t, prev_is_mod, is_hold);
+            return;
+        }
+
+        if (position == th_position) {
+            add_overlap_sample(samples, is_same_side, p, t, overlap, is_hold, th_position, next_position, false);
+            return;
+        }
+
+        if (position == next_position) {
+            const bool fallback_is_hold = estimate_hold_when_wrapped(p, t, overlap);
+            add_overlap_sample(samples, is_same_side, p, t, overlap, is_hold, th_position, next_position,
+                               fallback_is_hold);
+            if (!is_same_side) sample_set_add(&samples->wrapped, p, t, overlap, is_hold);
+            return;
+        }
+    }
+}
+
+
+void add_corpus_samples(heuristic_samples_t* samples, const corpus_t* corpus) {
+    walk_t* walk = calloc(1, sizeof(*walk));
+    uint64_t* times = malloc(MAX(corpus->event_count, 1) * sizeof(*times));
+    if (walk == NULL || times == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    uint64_t time = 0;
+    for (uint64_t i = 0; i < corpus->event_count; ++i) {
+        time += corpus->deltas[i];
+        times[i] = time;
+    }
+    walk->corpus = corpus;
+    walk->times = times;
+
+    // like after the keyboard was plugged in
+    bool has_released = false;
+    uint64_t last_release_time = 0;
+    bool last_release_was_mod = false;
+
+    for (uint64_t i = 0; i < corpus->event_count; ++i) {
+        const uint8_t position = corpus->positions[i];
+
+        if (!(corpus->flags[i] & CORPUS_FLAG_PRESSED)) {
+            has_released = true;
+            last_release_time = times[i];
+            last_release_was_mod = was_mod(walk, position);
+            continue;
+        }
+
+        walk->keycode_at[position] = corpus->keycodes[i];
+        walk->label_at[position] = corpus->labels[i];
+        if (corpus->labels[i] == CORPUS_LABEL_NONE) continue;
+
+        const int16_t p = has_released ? (int16_t) MIN(MS_MAX_DUR, times[i] - last_release_time) : MS_MAX_DUR;
+        add_tap_hold_samples(samples, walk, i, p, has_released && last_release_was_mod);
+    }
+
+    free(times);
+    free(walk);
+}
+
+
+void free_heuristic_samples(heuristic_samples_t* samples) {
+    sample_set_free(&samples->overlap);
+    sample_set_free(&samples->wrapped);
+    sample_set_free(&samples->two_down);
+    sample_set_free(&samples->same_side);
+    free(samples->overlap_contexts);
+    free(samples->same_side_contexts);
+    samples->overlap_contexts = NULL;
+    samples->same_side_contexts = NULL;
+}
@@ -0,0 +1,46 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Extracts samples for the three heuristics from the labeled tap hold presses
+// of a corpus, roughly like the state machine would see them:
+//
+// * p is the time between the last release and the tap hold press (negative,
+//   if a key pressed before it was released in the meantime), t the time until
+//   the next key was pressed. Presses without a next key within
+//   MS_MAX_OVERLAP are skipped.
+// * The overlap lasts until the tap hold key is released, the next key is
+//   released, a third key is pressed or MS_MAX_OVERLAP ran out. Every such
+//   press is an overlap sample.
+// * If the next key was released first, it's also a wrapped sample, and if a
+//   third key was pressed first, a two down sample.
+// * If the next key is on the same hand, the sample goes into same_side
+//   instead (only in the overlap form), so the overlap heuristics aren't
+//   scored on presses they never decide by default.
+//
+// For every overlap (and same side) sample, overlap_contexts (and
+// same_side_contexts) has the corpus positions of the
+// tap hold key and the next key (tap hold << 8 | next), and what the press is
+// decided as if the overlap stays below the estimate: by the two down or
+// wrapped heuristic (of heuristic_tap_hold_kernels.h), as a tap if the tap
+// hold key is released, or as a hold when MS_MAX_OVERLAP runs out.
+
+#pragma once
+
+#include "corpus.h"
+#include "evaluator.h"
+
+typedef struct {
+    uint16_t bigram;
+    bool fallback_is_hold;
+} overlap_context_t;
+
+typedef struct {
+    sample_set_t overlap;
+    sample_set_t wrapped;
+    sample_set_t two_down;
+    sample_set_t same_side;
+    overlap_context_t* overlap_contexts;
+    overlap_context_t* same_side_contexts;
+} heuristic_samples_t;
+
+void add_corpus_samples(heuristic_samples_t* samples, const corpus_t* corpus);
+void free_heuristic_samples(heuristic_samples_t* samples);
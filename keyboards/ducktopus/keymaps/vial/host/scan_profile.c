@@ -0,0 +1,128 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "scan_profile.h"
+
+
+static bool transfer_command(scan_profile_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = SCAN_PROFILER_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != SCAN_PROFILER_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "scan profiler command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+static uint32_t read_u32(const uint8_t* in) {
+    return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t) in[3] << 24;
+}
+
+
+static bool read_histogram(scan_profile_transfer_t transfer, void* context, uint8_t stage, uint32_t* histogram) {
+    for (uint8_t first = 0; first < SCAN_PROFILER_BUCKETS; first += SCAN_PROFILER_BUCKETS_PER_PACKET) {
+        uint8_t packet[SCAN_PROFILE_PACKET_SIZE] = {0};
+        packet[2] = stage;
+        packet[3] = first;
+        if (!transfer_command(transfer, context, packet, SCAN_PROFILER_HID_HISTOGRAM)) return false;
+        if (packet[2] != stage || packet[3] != first) {
+            fprintf(stderr, "invalid scan profiler histogram response for stage %u\n", stage);
+            return false;
+        }
+
+        for (uint8_t i = 0; i < SCAN_PROFILER_BUCKETS_PER_PACKET && first + i < SCAN_PROFILER_BUCKETS; ++i) {
+            histogram[first + i] = read_u32(packet + 4 + 4 * i);
+        }
+    }
+    return true;
+}
+
+
+bool read_scan_profile(scan_profile_transfer_t transfer, void* context, scan_profile_t* profile) {
+    uint8_t packet[SCAN_PROFILE_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, SCAN_PROFILER_HID_INFO)) return false;
+
+    if (packet[2] != SCAN_PROFILER_HID_VERSION || packet[4] != SCAN_PROFILER_BUCKETS) {
+        fprintf(stderr, "unsupported scan profiler protocol version %u (with %u buckets)\n", packet[2], packet[4]);
+        return false;
+    }
+
+    memset(profile, 0, sizeof(*profile));
+    profile->stage_count = MIN(packet[3], SCAN_STAGE_COUNT);
+
+    for (uint8_t stage = 0; stage < profile->stage_count; ++stage) {
+        memset(packet, 0, sizeof(packet));
+        packet[2] = stage;
+        if (!transfer_command(transfer, context, packet, SCAN_PROFILER_HID_READ)) return false;
+        if (packet[2] != stage) {
+            fprintf(stderr, "invalid scan profiler response for stage %u\n", stage);
+            return false;
+        }
+
+        scan_profile_stage_t* entry = &profile->stages[stage];
+        entry->stats.count = read_u32(packet + 4);
+        entry->stats.min_us = read_u32(packet + 8);
+        entry->stats.max_us = read_u32(packet + 12);
+        entry->stats.sum_us = read_u32(packet + 16) | (uint64_t) read_u32(packet + 20) << 32;
+        memcpy(entry->name, packet + 24, 8);
+        entry->name[8] = '\0';
+
+        if (!read_histogram(transfer, context, stage, entry->stats.histogram)) return false;
+    }
+    return true;
+}
+
+
+bool reset_scan_profile(scan_profile_transfer_t transfer, void* context) {
+    uint8_t packet[SCAN_PROFILE_PACKET_SIZE] = {0};
+    return transfer_command(transfer, context, packet, SCAN_PROFILER_HID_RESET);
+}
+
+
+// the share of every bucket that isn't empty
+static void print_histogram(FILE* file, const scan_stage_stats_t* stats) {
+    for (uint8_t bucket = 0; bucket < SCAN_PROFILER_BUCKETS; ++bucket) {
+        const uint32_t count = stats->histogram[bucket];
+        if (count == 0) continue;
+
+        const unsigned long low = bucket == 0 ? 0 : 1ul << (bucket - 1);
+        const unsigned long high = bucket == 0 ? 0 : (1ul << bucket) - 1;
+        if (bucket == SCAN_PROFILER_BUCKETS - 1) {
+            fprintf(file, "  %lu+", low);
+        } else if (low == high) {
+            fprintf(file, "  %lu", low);
+        } else {
+            fprintf(file, "  %lu-%lu", low, high);
+        }
+
+        const double percent = 100.0 * count / stats->count;
+        if (percent < 0.01) {
+            fprintf(file, ":<0.01%%");
+        } else {
+            fprintf(file, ":%.2f%%", percent);
+        }
+    }
+    fprintf(file, "\n");
+}
+
+
+void print_scan_profile(FILE* file, const scan_profile_t* profile) {
+    fprintf(file, "%-8s %10s %8s %10s %8s  histogram (us:share)\n", "stage", "count", "min us", "mean us", "max us");
+    for (uint8_t stage = 0; stage < profile->stage_count; ++stage) {
+        const scan_stage_stats_t* stats = &profile->stages[stage].stats;
+        fprintf(file, "%-8s %10lu %8lu %10.2f %8lu", profile->stages[stage].name, (unsigned long) stats->count,
+                (unsigned long) stats->min_us, stats->count ? (double) stats->sum_us / stats->count : 0.0,
+                (unsigned long) stats->max_us);
+        print_histogram(file, stats);
+    }
+
+    // the last stage is the whole loop
+    if (profile->stage_count == SCAN_STAGE_COUNT) {
+        const scan_stage_stats_t* loop = &profile->stages[SCAN_STAGE_LOOP].stats;
+        fprintf(file, "scan rate: %.1f per second\n", loop->sum_us ? loop->count * 1e6 / loop->sum_us : 0.0);
+    }
+}
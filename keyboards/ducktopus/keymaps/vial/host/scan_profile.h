@@ -0,0 +1,29 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the stats of the scan loop profiler over the raw HID protocol
+// described in features/scan_profiler.h and prints them per stage.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "features/scan_profiler.h"
+
+#define SCAN_PROFILE_PACKET_SIZE 32
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*scan_profile_transfer_t)(uint8_t* packet, void* context);
+
+typedef struct {
+    char name[9];
+    scan_stage_stats_t stats;
+} scan_profile_stage_t;
+
+typedef struct {
+    uint8_t stage_count;
+    scan_profile_stage_t stages[SCAN_STAGE_COUNT];
+} scan_profile_t;
+
+bool read_scan_profile(scan_profile_transfer_t transfer, void* context, scan_profile_t* profile);
+bool reset_scan_profile(scan_profile_transfer_t transfer, void* context);
+void print_scan_profile(FILE* file, const scan_profile_t* profile);
@@ -0,0 +1,87 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <string.h>
+
+#include "latency.h"
+#include "shadow.h"
+
+
+static bool transfer_command(shadow_transfer_t transfer, void* context, uint8_t* packet, uint8_t command) {
+    const uint8_t sent_command = packet[1] = command;
+    packet[0] = HEURISTIC_TAP_HOLD_SHADOW_HID_ID;
+
+    if (!transfer(packet, context)) return false;
+    if (packet[0] != HEURISTIC_TAP_HOLD_SHADOW_HID_ID || packet[1] != sent_command) {
+        fprintf(stderr, "shadow command %u failed (response %02x %02x)\n", command, packet[0], packet[1]);
+        return false;
+    }
+    return true;
+}
+
+
+bool read_shadow_comparison(shadow_transfer_t transfer, void* context, shadow_comparison_t* comparison) {
+    uint8_t packet[SHADOW_PACKET_SIZE] = {0};
+    if (!transfer_command(transfer, context, packet, SHADOW_HID_INFO)) return false;
+
+    if (packet[2] != SHADOW_HID_VERSION) {
+        fprintf(stderr, "unsupported shadow protocol version %u\n", packet[2]);
+        return false;
+    }
+
+    memset(comparison, 0, sizeof(*comparison));
+    comparison->path_count = MIN(packet[3], SHADOW_MAX_PATHS);
+    comparison->backspace_ms = (uint16_t) (packet[5] | packet[6] << 8);
+
+    for (uint8_t path = 0; path < comparison->path_count; ++path) {
+        memset(packet, 0, sizeof(packet));
+        packet[2] = path;
+        if (!transfer_command(transfer, context, packet, SHADOW_HID_READ)) return false;
+
+        // a newer keyboard may count more, which are left out
+        const uint8_t n = MIN(packet[3], SHADOW_COUNT_FIELDS);
+        if (packet[2] != path || n < SHADOW_COUNT_FIELDS) {
+            fprintf(stderr, "invalid shadow response for path %u\n", path);
+            return false;
+        }
+
+        uint32_t values[SHADOW_COUNT_FIELDS];
+        for (uint8_t i = 0; i < n; ++i) {
+            const uint8_t* in = packet + 4 + 4 * i;
+            values[i] = in[0] | in[1] << 8 | in[2] << 16 | (uint32_t) in[3] << 24;
+        }
+        memcpy(&comparison->counts[path], values, sizeof(values));
+    }
+    return true;
+}
+
+
+bool reset_shadow_comparison(shadow_transfer_t transfer, void* context) {
+    uint8_t packet[SHADOW_PACKET_SIZE] = {0};
+    return transfer_command(transfer, context, packet, SHADOW_HID_RESET);
+}
+
+
+static double get_percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double) part / (double) total : 0.0;
+}
+
+
+void print_shadow_comparison(FILE* file, const shadow_comparison_t* comparison) {
+    fprintf(file, "decision path  compared   agreed  shadow hold    live hold   backspaced  (shadow hold)\n");
+
+    for (uint8_t path = 0; path < comparison->path_count; ++path) {
+        const shadow_counts_t* counts = &comparison->counts[path];
+        const uint64_t compared =
+                (uint64_t) counts->agreed + counts->only_shadow_held + counts->only_live_held;
+
+        char unknown_name[16];
+        const char* name = get_decision_path_name(path, unknown_name, sizeof(unknown_name));
+        fprintf(file, "%-13s %9llu %7.2f%% %11lu %12lu %12lu %14lu\n", name, (unsigned long long) compared,
+                get_percent(counts->agreed, compared), (unsigned long) counts->only_shadow_held,
+                (unsigned long) counts->only_live_held, (unsigned long) counts->backspaced,
+                (unsigned long) counts->backspaced_shadow_held);
+    }
+    fprintf(file, "(shadow hold: the live heuristic chose tap, the candidate hold; live hold: the other way around;\n"
+                  " backspaced: taps followed by Backspace within %u ms, of which the candidate would have held)\n",
+            comparison->backspace_ms);
+}
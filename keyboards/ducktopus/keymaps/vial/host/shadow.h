@@ -0,0 +1,26 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Reads the shadow mode counters over the raw HID protocol described in
+// features/heuristic_tap_hold_shadow.h and prints them per decision path.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "features/heuristic_tap_hold_shadow.h"
+
+#define SHADOW_PACKET_SIZE 32
+#define SHADOW_MAX_PATHS   16
+
+// Sends the packet and overwrites it with the response. Returns false on error.
+typedef bool (*shadow_transfer_t)(uint8_t* packet, void* context);
+
+typedef struct {
+    uint8_t path_count;
+    uint16_t backspace_ms;
+    shadow_counts_t counts[SHADOW_MAX_PATHS];
+} shadow_comparison_t;
+
+bool read_shadow_comparison(shadow_transfer_t transfer, void* context, shadow_comparison_t* comparison);
+bool reset_shadow_comparison(shadow_transfer_t transfer, void* context);
+void print_shadow_comparison(FILE* file, const shadow_comparison_t* comparison);
@@ -0,0 +1,715 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <x86intrin.h>
+#    define HAS_CYCLE_COUNTER
+#endif
+
+#include "sim.h"
+#include "dynamic_keymap.h"
+#include "eeprom.h"
+#include "raw_hid.h"
+#include "via.h"
+#include "features/heuristic_tap_hold.h"
+
+static uint32_t now_ms = 0;
+static uint64_t scan_started_ns = 0;
+static bool is_in_matrix_scan = false;
+static bool is_matrix_event = false;
+static uint16_t matrix_press_keycode = KC_NO;
+
+static uint16_t keycode_at[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t press_time_at[MATRIX_ROWS][MATRIX_COLS];
+
+static const uint16_t (*keymap)[MATRIX_ROWS][MATRIX_COLS] = NULL;
+static uint8_t keymap_layer_count = 0;
+static uint8_t source_layer_at[MATRIX_ROWS][MATRIX_COLS];
+
+layer_state_t layer_state = 0;
+layer_state_t default_layer_state = 0;
+
+static uint8_t oneshot_mods = 0;
+
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+
+bool debug_enable = false;
+bool debug_matrix = false;
+bool debug_keyboard = false;
+bool debug_mouse = false;
+
+// the records process_record is in the middle of, the innermost last
+#define MAX_RECORD_DEPTH 16
+
+typedef struct {
+    const keyrecord_t* record;
+    uint16_t keycode;
+} processing_t;
+
+static processing_t processing[MAX_RECORD_DEPTH];
+static uint8_t processing_depth = 0;
+
+static sim_press_callback_t press_callback = NULL;
+static sim_effect_callback_t effect_callback = NULL;
+
+static sim_report_t report;
+static sim_report_t last_sent_report;
+
+static sim_stats_t stats;
+
+static bool log_reports = false;
+static sim_report_entry_t* report_log = NULL;
+static size_t report_log_count = 0;
+static size_t report_log_capacity = 0;
+
+
+void sim_init(bool should_log_reports) {
+    now_ms = 0;
+    is_in_matrix_scan = false;
+    is_matrix_event = false;
+    matrix_press_keycode = KC_NO;
+
+    memset(keycode_at, 0, sizeof(keycode_at));
+    memset(press_time_at, 0, sizeof(press_time_at));
+    memset(source_layer_at, 0, sizeof(source_layer_at));
+    layer_state = 0;
+    default_layer_state = 0;
+    oneshot_mods = 0;
+    processing_depth = 0;
+
+    report = (sim_report_t){0};
+    last_sent_report = (sim_report_t){0};
+    stats = (sim_stats_t){0};
+
+    log_reports = should_log_reports;
+    report_log_count = 0;
+}
+
+
+void sim_set_press_callback(sim_press_callback_t callback) {
+    press_callback = callback;
+}
+
+
+void sim_set_effect_callback(sim_effect_callback_t callback) {
+    effect_callback = callback;
+}
+
+
+void sim_set_keycode(uint8_t row, uint8_t col, uint16_t keycode) {
+    keycode_at[row][col] = keycode;
+}
+
+
+void sim_set_keymap(const uint16_t (*keymaps)[MATRIX_ROWS][MATRIX_COLS], uint8_t layer_count) {
+    keymap = keymaps;
+    keymap_layer_count = MIN(layer_count, DYNAMIC_KEYMAP_LAYER_COUNT);
+    dynamic_keymap_reset();
+}
+
+
+uint8_t sim_get_source_layer(uint8_t row, uint8_t col) {
+    return source_layer_at[row][col];
+}
+
+
+uint32_t sim_now(void) {
+    return now_ms;
+}
+
+
+void sim_reset_stats(void) {
+    stats = (sim_stats_t){0};
+    report_log_count = 0;
+}
+
+
+const sim_stats_t* sim_get_stats(void) {
+    return &stats;
+}
+
+
+const sim_report_entry_t* sim_get_reports(size_t* count) {
+    *count = report_log_count;
+    return report_log;
+}
+
+
+void sim_print_report(FILE* out, const sim_report_entry_t* entry) {
+    fprintf(out, "%10u  mods=%02x  keys=", entry->time, entry->report.mods);
+    bool is_empty = true;
+    for (int code = 0; code < SIM_REPORT_KEY_BYTES * 8; ++code) {
+        if (entry->report.keys[code / 8] & (1 << (code % 8))) {
+            fprintf(out, is_empty ? "%02x" : ",%02x", code);
+            is_empty = false;
+        }
+    }
+    fprintf(out, is_empty ? "-\n" : "\n");
+}
+
+
+static void log_report(void) {
+    if (report_log_count == report_log_capacity) {
+        report_log_capacity = report_log_capacity ? report_log_capacity * 2 : 1024;
+        report_log = realloc(report_log, report_log_capacity * sizeof(*report_log));
+        if (report_log == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    report_log[report_log_count++] = (sim_report_entry_t){.time = now_ms, .report = report};
+}
+
+
+// timer
+//=============================================================================
+uint16_t timer_read(void) {
+    return (uint16_t) now_ms;
+}
+
+uint32_t timer_read32(void) {
+    return now_ms;
+}
+
+uint16_t timer_elapsed(uint16_t last) {
+    return (uint16_t) (timer_read() - last);
+}
+
+uint32_t timer_elapsed32(uint32_t last) {
+    return now_ms - last;
+}
+
+// the firmware stalls here, so the clock moves, but no matrix scan happens
+void wait_ms(uint16_t ms) {
+    now_ms += ms;
+    stats.blocked_waits++;
+    stats.blocked_ms += ms;
+}
+
+
+static uint64_t read_host_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+
+// The virtual clock with how long the host has spent in the scan of this
+// millisecond on top (at most 999 us), so every loop takes a millisecond (or
+// more, if it waited), and the stages in it what they took on the host.
+uint32_t read_scan_profiler_us(void) {
+    const uint64_t us_in_scan = (read_host_ns() - scan_started_ns) / 1000;
+    return now_ms * 1000 + (uint32_t) MIN(us_in_scan, 999);
+}
+
+
+// One loop of QMK per millisecond: housekeeping_task_user ends the one of the
+// last millisecond (with the key events fed after its scan) first.
+void sim_run_until(uint32_t time_ms) {
+    while (now_ms < time_ms) {
+        now_ms++;
+        stats.scans++;
+        scan_started_ns = read_host_ns();
+
+        housekeeping_task_user();
+
+        is_in_matrix_scan = true;
+        matrix_scan_user();
+        is_in_matrix_scan = false;
+
+        pointing_device_task_user((report_mouse_t){0});
+    }
+}
+
+
+// The host sees that something changed, which is the effect of the innermost
+// record that is being processed, if it is a press.
+static void notify_effect(void) {
+    if (effect_callback == NULL || processing_depth == 0 || processing_depth > MAX_RECORD_DEPTH) return;
+
+    const processing_t* innermost = &processing[processing_depth - 1];
+    if (!innermost->record->event.pressed) return;
+
+    const keypos_t key = innermost->record->event.key;
+    effect_callback(innermost->record, innermost->keycode, now_ms - press_time_at[key.row][key.col]);
+}
+
+
+// report
+//=============================================================================
+void send_keyboard_report(void) {
+    stats.reports_sent++;
+    if (memcmp(&report, &last_sent_report, sizeof(report)) == 0) return;
+
+    last_sent_report = report;
+    stats.reports_changed++;
+    if (log_reports) log_report();
+    notify_effect();
+}
+
+
+uint8_t get_mods(void) {
+    return report.mods;
+}
+
+void add_mods(uint8_t mods) {
+    report.mods |= mods;
+}
+
+void del_mods(uint8_t mods) {
+    report.mods &= ~mods;
+}
+
+void set_mods(uint8_t mods) {
+    report.mods = mods;
+}
+
+void clear_mods(void) {
+    report.mods = 0;
+}
+
+uint8_t get_oneshot_mods(void) {
+    return oneshot_mods;
+}
+
+void set_oneshot_mods(uint8_t mods) {
+    oneshot_mods = mods;
+}
+
+void clear_oneshot_mods(void) {
+    oneshot_mods = 0;
+}
+
+void register_mods(uint8_t mods) {
+    add_mods(mods);
+    send_keyboard_report();
+}
+
+void unregister_mods(uint8_t mods) {
+    del_mods(mods);
+    send_keyboard_report();
+}
+
+
+static uint8_t mods_5bit_to_8bit(uint8_t mods) {
+    return (mods & 0x10) ? (uint8_t) ((mods & 0x0F) << 4) : (mods & 0x0F);
+}
+
+
+void register_code(uint8_t code) {
+    if (IS_MODIFIER_KEYCODE(code)) {
+        add_mods(MOD_BIT(code));
+    } else if (code > KC_TRNS) {
+        report.keys[code / 8] |= (uint8_t) (1 << (code % 8));
+    }
+    send_keyboard_report();
+}
+
+void unregister_code(uint8_t code) {
+    if (IS_MODIFIER_KEYCODE(code)) {
+        del_mods(MOD_BIT(code));
+    } else if (code > KC_TRNS) {
+        report.keys[code / 8] &= (uint8_t) ~(1 << (code % 8));
+    }
+    send_keyboard_report();
+}
+
+void tap_code(uint8_t code) {
+    tap_code16(code);
+}
+
+void register_code16(uint16_t code) {
+    if (IS_QK_MODS(code)) {
+        register_mods(mods_5bit_to_8bit(QK_MODS_GET_MODS(code)));
+    }
+    register_code(QK_MODS_GET_BASIC_KEYCODE(code));
+}
+
+void unregister_code16(uint16_t code) {
+    unregister_code(QK_MODS_GET_BASIC_KEYCODE(code));
+    if (IS_QK_MODS(code)) {
+        unregister_mods(mods_5bit_to_8bit(QK_MODS_GET_MODS(code)));
+    }
+}
+
+void tap_code16(uint16_t code) {
+    register_code16(code);
+#        if TAP_CODE_DELAY > 0
+    wait_ms(TAP_CODE_DELAY);
+#        endif
+    unregister_code16(code);
+}
+
+
+#define IS_TAP_HOLD_KEYCODE(kc) (IS_QK_MOD_TAP(kc) || IS_QK_LAYER_TAP(kc))
+
+
+// layers
+//=============================================================================
+__attribute__((weak)) layer_state_t layer_state_set_user(layer_state_t state) {
+    return state;
+}
+
+
+void layer_state_set(layer_state_t state) {
+    state = layer_state_set_user(state);
+    if (state == layer_state) return;
+
+    layer_state = state;
+    notify_effect();
+}
+
+
+// like QMK, no layer on means layer 0 is
+bool layer_state_cmp(layer_state_t state, uint8_t layer) {
+    if (!state) return layer == 0;
+    return (state & ((layer_state_t) 1 << layer)) != 0;
+}
+
+bool layer_state_is(uint8_t layer) {
+    return layer_state_cmp(layer_state, layer);
+}
+
+void layer_on(uint8_t layer) {
+    layer_state_set(layer_state | ((layer_state_t) 1 << layer));
+}
+
+void layer_off(uint8_t layer) {
+    layer_state_set(layer_state & ~((layer_state_t) 1 << layer));
+}
+
+__attribute__((weak)) layer_state_t default_layer_state_set_user(layer_state_t state) {
+    return state;
+}
+
+
+void default_layer_set(layer_state_t state) {
+    state = default_layer_state_set_user(state);
+    if (state == default_layer_state) return;
+
+    default_layer_state = state;
+    notify_effect();
+}
+
+uint8_t get_highest_layer(layer_state_t state) {
+    for (uint8_t layer = MAX_LAYER - 1; layer > 0; --layer) {
+        if (state & ((layer_state_t) 1 << layer)) return layer;
+    }
+    return 0;
+}
+
+layer_state_t update_tri_layer_state(layer_state_t state, uint8_t layer1, uint8_t layer2, uint8_t layer3) {
+    const layer_state_t mask12 = ((layer_state_t) 1 << layer1) | ((layer_state_t) 1 << layer2);
+    const layer_state_t mask3 = (layer_state_t) 1 << layer3;
+    return (state & mask12) == mask12 ? (state | mask3) : (state & ~mask3);
+}
+
+
+// The highest active layer where the key isn't transparent, like
+// layer_switch_get_layer.
+static uint8_t get_active_layer_at(keypos_t key) {
+    const layer_state_t layers = layer_state | default_layer_state;
+    for (int layer = keymap_layer_count - 1; layer >= 0; --layer) {
+        if ((layers & ((layer_state_t) 1 << layer)) &&
+                dynamic_keymap_get_keycode(layer, key.row, key.col) != KC_TRNS) {
+            return layer;
+        }
+    }
+    return 0;
+}
+
+
+uint8_t sim_get_active_layer(uint8_t row, uint8_t col) {
+    return get_active_layer_at((keypos_t){.row = row, .col = col});
+}
+
+
+// Like get_record_keycode: a press is looked up on the layers that are on now
+// and a release on the layer its press was (the source layer cache).
+static uint16_t get_record_keycode(const keyrecord_t* record, bool update_layer_cache) {
+    const keypos_t key = record->event.key;
+    if (keymap == NULL) return keycode_at[key.row][key.col];
+
+    if (record->event.pressed) {
+        const uint8_t layer = get_active_layer_at(key);
+        if (!update_layer_cache) return dynamic_keymap_get_keycode(layer, key.row, key.col);
+        source_layer_at[key.row][key.col] = layer;
+    }
+    return dynamic_keymap_get_keycode(source_layer_at[key.row][key.col], key.row, key.col);
+}
+
+
+// dynamic keymap
+//=============================================================================
+#define DYNAMIC_KEYMAP_SIZE (DYNAMIC_KEYMAP_LAYER_COUNT * MATRIX_ROWS * MATRIX_COLS * 2)
+
+_Static_assert(DYNAMIC_KEYMAP_EEPROM_ADDR + DYNAMIC_KEYMAP_SIZE <= SIM_EEPROM_SIZE,
+               "the dynamic keymap doesn't fit into the simulated EEPROM");
+
+static uint8_t* get_dynamic_keymap_address(uint8_t layer, uint8_t row, uint8_t column) {
+    return (uint8_t*) (uintptr_t) (DYNAMIC_KEYMAP_EEPROM_ADDR + ((layer * MATRIX_ROWS + row) * MATRIX_COLS + column) * 2);
+}
+
+
+uint8_t dynamic_keymap_get_layer_count(void) {
+    return DYNAMIC_KEYMAP_LAYER_COUNT;
+}
+
+
+uint16_t dynamic_keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t column) {
+    if (keymap == NULL || layer >= DYNAMIC_KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return KC_NO;
+    }
+    // like QMK, one EEPROM read per byte
+    const uint8_t* address = get_dynamic_keymap_address(layer, row, column);
+    return (uint16_t) (eeprom_read_byte(address) << 8 | eeprom_read_byte(address + 1));
+}
+
+
+void dynamic_keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode) {
+    if (layer >= DYNAMIC_KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || column >= MATRIX_COLS) return;
+    uint8_t* address = get_dynamic_keymap_address(layer, row, column);
+    eeprom_update_byte(address, (uint8_t) (keycode >> 8));
+    eeprom_update_byte(address + 1, (uint8_t) keycode);
+}
+
+
+// layers keymap.c doesn't have are transparent, like in QMK
+void dynamic_keymap_reset(void) {
+    for (uint8_t layer = 0; layer < DYNAMIC_KEYMAP_LAYER_COUNT; ++layer) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+            for (uint8_t column = 0; column < MATRIX_COLS; ++column) {
+                const bool has_layer = keymap != NULL && layer < keymap_layer_count;
+                dynamic_keymap_set_keycode(layer, row, column, has_layer ? keymap[layer][row][column] : KC_TRNS);
+            }
+        }
+    }
+}
+
+
+void dynamic_keymap_set_buffer(uint16_t offset, uint16_t size, uint8_t* data) {
+    for (uint16_t i = 0; i < size; ++i) {
+        if (offset + i < DYNAMIC_KEYMAP_SIZE) {
+            eeprom_update_byte((uint8_t*) (uintptr_t) (DYNAMIC_KEYMAP_EEPROM_ADDR + offset + i), data[i]);
+        }
+    }
+}
+
+
+// VIA
+//=============================================================================
+__attribute__((weak)) bool via_command_kb(uint8_t* data, uint8_t length) {
+    return false;
+}
+
+
+void sim_receive_via_command(uint8_t* data, uint8_t length) {
+    if (via_command_kb(data, length) || length < 1) return;
+
+    switch (data[0]) {
+        case id_dynamic_keymap_set_keycode:
+            if (length < 6) return;
+            dynamic_keymap_set_keycode(data[1], data[2], data[3], (uint16_t) (data[4] << 8 | data[5]));
+            break;
+        case id_dynamic_keymap_set_buffer:
+            // VIA only writes what fits into the packet
+            if (length < 4) return;
+            dynamic_keymap_set_buffer((uint16_t) (data[1] << 8 | data[2]), MIN(data[3], length - 4), data + 4);
+            break;
+        case id_dynamic_keymap_reset:
+        case id_eeprom_reset:
+            dynamic_keymap_reset();
+            break;
+    }
+}
+
+
+// action
+//=============================================================================
+
+
+static void count_decision(uint16_t keycode, keyrecord_t* record) {
+    if (!record->event.pressed || !IS_TAP_HOLD_KEYCODE(keycode)) return;
+
+    // the heuristic tap hold key is sent later, so only a key that was
+    // pressed while the queue was full is sent as tap right away
+    if (keycode == matrix_press_keycode && record->tap.count > 0) {
+        stats.forced_taps++;
+        return;
+    }
+
+    if (record->tap.count > 0) {
+        stats.tap_decisions++;
+    } else {
+        stats.hold_decisions++;
+    }
+    if (is_in_matrix_scan) stats.decided_in_task++;
+}
+
+
+// Roughly what process_action does for the keycodes we care about. With
+// TAPPING_TERM 0, tap.count is only non-zero when the heuristic sets it.
+static void process_action(uint16_t keycode, keyrecord_t* record) {
+    const bool is_pressed = record->event.pressed;
+
+    if (IS_QK_MOD_TAP(keycode)) {
+        if (record->tap.count == 0) {
+            const uint8_t mods = mods_5bit_to_8bit(QK_MOD_TAP_GET_MODS(keycode));
+            if (is_pressed) {
+                register_mods(mods);
+            } else {
+                unregister_mods(mods);
+            }
+            return;
+        }
+        keycode = QK_MOD_TAP_GET_TAP_KEYCODE(keycode);
+    } else if (IS_QK_LAYER_TAP(keycode)) {
+        if (record->tap.count == 0) {
+            if (is_pressed) {
+                layer_on(QK_LAYER_TAP_GET_LAYER(keycode));
+            } else {
+                layer_off(QK_LAYER_TAP_GET_LAYER(keycode));
+            }
+            return;
+        }
+        keycode = QK_LAYER_TAP_GET_TAP_KEYCODE(keycode);
+    } else if (IS_QK_MOMENTARY(keycode)) {
+        if (is_pressed) {
+            layer_on(QK_MOMENTARY_GET_LAYER(keycode));
+        } else {
+            layer_off(QK_MOMENTARY_GET_LAYER(keycode));
+        }
+        return;
+    } else if (IS_QK_DEF_LAYER(keycode)) {
+        if (is_pressed) default_layer_set((layer_state_t) 1 << QK_DEF_LAYER_GET_LAYER(keycode));
+        return;
+    } else if (keycode > QK_MODS_MAX) {
+        return;
+    }
+
+    if (is_pressed) {
+        register_code16(keycode);
+    } else {
+        unregister_code16(keycode);
+    }
+}
+
+
+static void process_record_handler(uint16_t keycode, keyrecord_t* record) {
+    if (!process_record_user(keycode, record)) return;
+
+    if (press_callback != NULL && record->event.pressed) {
+        const keypos_t key = record->event.key;
+        press_callback(record, keycode, now_ms - press_time_at[key.row][key.col]);
+    }
+    process_action(keycode, record);
+}
+
+
+void process_record(keyrecord_t* record) {
+    const uint16_t keycode = get_record_keycode(record, true);
+
+    if (!is_matrix_event) {
+        // the record was sent again by the heuristic tap hold code
+        count_decision(keycode, record);
+    }
+    is_matrix_event = false;
+
+    if (processing_depth < MAX_RECORD_DEPTH) {
+        processing[processing_depth] = (processing_t){.record = record, .keycode = keycode};
+    }
+    processing_depth++;
+    process_record_handler(keycode, record);
+    processing_depth--;
+}
+
+
+__attribute__((weak)) void housekeeping_task_user(void) {}
+
+// the sim has no pointing device, so it's called without movement
+__attribute__((weak)) report_mouse_t pointing_device_task_user(report_mouse_t mouse_report) {
+    return mouse_report;
+}
+
+
+__attribute__((weak)) bool pre_process_record_user(uint16_t keycode, keyrecord_t* record) {
+    return true;
+}
+
+
+void sim_key_event(uint8_t row, uint8_t col, bool pressed) {
+    keyrecord_t record = {
+        .event = {
+            .key = {.col = col, .row = row},
+            .time = (uint16_t) (now_ms | 1),
+            .type = KEY_EVENT,
+            .pressed = pressed,
+        },
+    };
+
+    stats.events++;
+    if (pressed) press_time_at[row][col] = now_ms;
+    if (!pre_process_record_user(get_record_keycode(&record, false), &record)) return;
+
+    is_matrix_event = true;
+    matrix_press_keycode = pressed ? get_record_keycode(&record, false) : KC_NO;
+    process_record(&record);
+    matrix_press_keycode = KC_NO;
+}
+
+
+// what keymap.c needs from the rest of QMK
+//=============================================================================
+// the keymap has no key that turns it on
+bool is_caps_word_on(void) {
+    return false;
+}
+
+bool is_keyboard_master(void) {
+    return true;
+}
+
+bool is_keyboard_left(void) {
+    return true;
+}
+
+void raw_hid_send(uint8_t* data, uint8_t length) {}
+
+// what features/cycle_counter.h counts on the host, the TSC (or ns)
+uint32_t read_cycle_counter(void) {
+#        ifdef HAS_CYCLE_COUNTER
+    return (uint32_t) __rdtsc();
+#        else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000000000ull + now.tv_nsec);
+#        endif
+}
+
+
+// keeps what was saved for the whole run, like the EEPROM across restarts
+static uint8_t* get_eeprom_bytes(const void* addr, uint32_t len) {
+    const uintptr_t offset = (uintptr_t) addr;
+    if (offset > SIM_EEPROM_SIZE || len > SIM_EEPROM_SIZE - offset) {
+        fprintf(stderr, "EEPROM access of %u bytes at %lu is out of bounds\n", len, (unsigned long) offset);
+        exit(1);
+    }
+    return eeprom + offset;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* addr) {
+    return *get_eeprom_bytes(addr, 1);
+}
+
+void eeprom_update_byte(uint8_t* addr, uint8_t value) {
+    *get_eeprom_bytes(addr, 1) = value;
+}
+
+void eeprom_read_block(void* buf, const void* addr, uint32_t len) {
+    memcpy(buf, get_eeprom_bytes(addr, len), len);
+}
+
+void eeprom_update_block(const void* buf, void* addr, uint32_t len) {
+    memcpy(get_eeprom_bytes(addr, len), buf, len);
+}
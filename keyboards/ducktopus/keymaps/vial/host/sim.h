@@ -0,0 +1,94 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// A tiny simulated QMK core for the host. It drives a virtual millisecond
+// clock, resolves key actions and layers the way QMK does with TAPPING_TERM 0
+// and records every keyboard report that would have been sent to the host.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "quantum.h"
+
+#define SIM_REPORT_KEY_BYTES 32
+
+typedef struct {
+    uint8_t mods;
+    uint8_t keys[SIM_REPORT_KEY_BYTES]; // one bit per basic keycode
+} sim_report_t;
+
+typedef struct {
+    uint32_t     time;
+    sim_report_t report;
+} sim_report_entry_t;
+
+typedef struct {
+    uint64_t events;
+    uint64_t scans;
+
+    uint64_t reports_sent;    // calls to send_keyboard_report
+    uint64_t reports_changed; // ... which actually changed the report
+
+    uint64_t tap_decisions;
+    uint64_t hold_decisions;
+    uint64_t decided_in_task; // decisions sent in matrix_scan_user
+    uint64_t forced_taps;     // tap holds that became taps, as the queue was full
+                              // (a tap decision, if it waited for a delay)
+
+    uint64_t blocked_waits;   // calls to wait_ms
+    uint64_t blocked_ms;      // virtual time spent inside wait_ms
+} sim_stats_t;
+
+// Called when a key press reaches the simulated QMK core (after the heuristic
+// let it through), with the virtual time since the key was physically
+// pressed. A heuristic tap hold key can get there more than once (e.g. as
+// instant hold and then as tap), the last time is what it was decided as.
+typedef void (*sim_press_callback_t)(const keyrecord_t *record, uint16_t keycode, uint32_t ms_since_press);
+
+// Called when the host sees something change while a key press is processed:
+// a keyboard report that differs from the last one, or other active layers.
+// That's the press's effect, so it may come before the press reaches the core
+// (e.g. a mod that is held) or never (e.g. KC_NO).
+typedef void (*sim_effect_callback_t)(const keyrecord_t *record, uint16_t keycode, uint32_t ms_since_press);
+
+void sim_init(bool log_reports);
+void sim_set_press_callback(sim_press_callback_t callback);
+void sim_set_effect_callback(sim_effect_callback_t callback);
+
+// By default, the keymap is a single layer that is filled in from the event
+// stream.
+void sim_set_keycode(uint8_t row, uint8_t col, uint16_t keycode);
+
+// Or it is a compiled one, like keymaps of keymap.c (see keymap_host.c). Then
+// keycodes are looked up on the active layers like QMK does: transparent keys
+// fall through, and a release uses the layer its press was looked up on.
+// It stays set across sim_init.
+void sim_set_keymap(const uint16_t (*keymaps)[MATRIX_ROWS][MATRIX_COLS], uint8_t layer_count);
+
+// the layer the last press of the key was looked up on
+uint8_t sim_get_source_layer(uint8_t row, uint8_t col);
+
+// the layer a press of the key would be looked up on now
+uint8_t sim_get_active_layer(uint8_t row, uint8_t col);
+
+// A VIA command from the host, like raw_hid_receive of VIA: via_command_kb
+// first and then VIA itself (only the commands that change the keymap).
+void sim_receive_via_command(uint8_t* data, uint8_t length);
+
+uint32_t sim_now(void);
+
+// Advance the virtual clock one millisecond at a time, running one loop
+// (housekeeping_task_user, matrix_scan_user and pointing_device_task_user) per
+// millisecond, until it reaches time_ms.
+void sim_run_until(uint32_t time_ms);
+
+// Feed a physical key event at the current virtual time.
+void sim_key_event(uint8_t row, uint8_t col, bool pressed);
+
+// Forget the stats and logged reports so far (e.g. after a warm up).
+void sim_reset_stats(void);
+
+const sim_stats_t        *sim_get_stats(void);
+const sim_report_entry_t *sim_get_reports(size_t *count);
+
+void sim_print_report(FILE *out, const sim_report_entry_t *entry);
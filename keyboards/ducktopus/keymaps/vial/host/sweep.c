@@ -0,0 +1,285 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Sweeps MS_MAX_OVERLAP, TAP_CODE_DELAY and the policies of the
+// should_hold_instantly and should_choose_tap_when_pressed_very_long_without_another_key
+// hooks over labeled corpora, and prints which settings are on the Pareto
+// front of misprediction rate versus the latency a key press gets on its way
+// to the host.
+//
+//     make -j sweep CORPUS=typing.corpus SWEEP_MAX_OVERLAPS="300 358 400" SWEEP_TAP_CODE_DELAYS="0 5 10"
+//
+// Both settings are compile time constants, so each point of the grid is its
+// own build of sweep_point.c (with the real state machine, see sweep_config.h).
+// The feature keeps its state in globals, so every combination runs in its own
+// process, as many at a time as there are CPUs.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_LINE 256
+
+typedef struct {
+    const char* point;
+    const char* hold_instantly;
+    const char* very_long;
+
+    pid_t pid;
+    int pipe_fd;
+    bool is_done;
+
+    int max_overlap;
+    int tap_code_delay;
+    unsigned long long labeled;
+    unsigned long long mispredicted;
+    unsigned long long presses;
+    double mean_ms;
+    unsigned p50_ms;
+    unsigned p99_ms;
+    unsigned long long blocked_ms;
+    bool is_on_front;
+} job_t;
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-j JOBS] [-i POLICIES] [-l POLICIES] [-o REPORT] POINT... -- CORPUS...\n"
+            "  POINT        a build of sweep_point.c (build/sweep/point_<max overlap>_<tap code delay>)\n"
+            "  -j JOBS      how many run at once (default one per CPU)\n"
+            "  -i POLICIES  should_hold_instantly policies (default never,keymap)\n"
+            "  -l POLICIES  very long press policies (default hold,repeat,keymap)\n"
+            "  -o REPORT    also write every result there, tab separated\n",
+            name);
+    exit(2);
+}
+
+
+static size_t split_list(char* list, const char** items, size_t max_count) {
+    size_t count = 0;
+    for (char* item = strtok(list, ","); item != NULL && count < max_count; item = strtok(NULL, ",")) {
+        items[count++] = item;
+    }
+    return count;
+}
+
+
+static double get_misprediction_percent(const job_t* job) {
+    return job->labeled ? 100.0 * (double) job->mispredicted / (double) job->labeled : 0.0;
+}
+
+
+static void start_job(job_t* job, char** corpus_paths, int corpus_count) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+
+        const char** args = calloc(corpus_count + 6, sizeof(*args));
+        if (args == NULL) _exit(1);
+        int count = 0;
+        args[count++] = job->point;
+        args[count++] = "-i";
+        args[count++] = job->hold_instantly;
+        args[count++] = "-l";
+        args[count++] = job->very_long;
+        for (int i = 0; i < corpus_count; ++i) {
+            args[count++] = corpus_paths[i];
+        }
+        execv(job->point, (char* const*) args);
+        perror(job->point);
+        _exit(1);
+    }
+
+    close(fds[1]);
+    job->pid = pid;
+    job->pipe_fd = fds[0];
+}
+
+
+// The output is one short line, which fits into the pipe, so it can be read
+// once the point exited.
+static void finish_job(job_t* job, int status) {
+    char line[MAX_LINE];
+    const ssize_t length = read(job->pipe_fd, line, sizeof(line) - 1);
+    close(job->pipe_fd);
+    line[length > 0 ? length : 0] = '\0';
+
+    char hold_instantly[32], very_long[32];
+    const bool is_valid = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+            sscanf(line, "%d %d %31s %31s %llu %llu %llu %lf %u %u %llu", &job->max_overlap,
+                   &job->tap_code_delay, hold_instantly, very_long, &job->labeled, &job->mispredicted,
+                   &job->presses, &job->mean_ms, &job->p50_ms, &job->p99_ms, &job->blocked_ms) == 11;
+    if (!is_valid) {
+        fprintf(stderr, "%s -i %s -l %s failed\n", job->point, job->hold_instantly, job->very_long);
+        exit(1);
+    }
+    job->is_done = true;
+}
+
+
+static void run_jobs(job_t* jobs, size_t job_count, long max_running, char** corpus_paths, int corpus_count) {
+    size_t next = 0;
+    size_t done = 0;
+    long running = 0;
+
+    while (done < job_count) {
+        while (next < job_count && running < max_running) {
+            start_job(&jobs[next++], corpus_paths, corpus_count);
+            ++running;
+        }
+
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            exit(1);
+        }
+        for (size_t i = 0; i < next; ++i) {
+            if (jobs[i].pid == pid && !jobs[i].is_done) {
+                finish_job(&jobs[i], status);
+                --running;
+                ++done;
+                fprintf(stderr, "\r%zu / %zu", done, job_count);
+                break;
+            }
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+
+static int compare_by_latency(const void* a, const void* b) {
+    const job_t* x = a;
+    const job_t* y = b;
+    if (x->mean_ms != y->mean_ms) return x->mean_ms < y->mean_ms ? -1 : 1;
+
+    const double x_percent = get_misprediction_percent(x);
+    const double y_percent = get_misprediction_percent(y);
+    if (x_percent != y_percent) return x_percent < y_percent ? -1 : 1;
+    return 0;
+}
+
+
+// Sorted by latency, a result is on the front if it mispredicts less than
+// every faster one.
+static void mark_pareto_front(job_t* jobs, size_t job_count) {
+    qsort(jobs, job_count, sizeof(*jobs), compare_by_latency);
+
+    double best_percent = 101.0;
+    for (size_t i = 0; i < job_count; ++i) {
+        const double percent = get_misprediction_percent(&jobs[i]);
+        jobs[i].is_on_front = percent < best_percent;
+        if (jobs[i].is_on_front) best_percent = percent;
+    }
+}
+
+
+static void print_results(FILE* file, const job_t* jobs, size_t job_count, bool is_tab_separated) {
+    if (is_tab_separated) {
+        fprintf(file, "max_overlap\ttap_code_delay\thold_instantly\tvery_long\tlabeled\tmispredicted\t"
+                      "presses\tmean_ms\tp50_ms\tp99_ms\tblocked_ms\tpareto\n");
+    } else {
+        fprintf(file, "overlap  delay  instantly  very long  mispredicted   mean ms  p50  p99  blocked ms\n");
+    }
+
+    for (size_t i = 0; i < job_count; ++i) {
+        const job_t* job = &jobs[i];
+        if (is_tab_separated) {
+            fprintf(file, "%d\t%d\t%s\t%s\t%llu\t%llu\t%llu\t%.3f\t%u\t%u\t%llu\t%d\n", job->max_overlap,
+                    job->tap_code_delay, job->hold_instantly, job->very_long, job->labeled, job->mispredicted,
+                    job->presses, job->mean_ms, job->p50_ms, job->p99_ms, job->blocked_ms, job->is_on_front);
+        } else {
+            fprintf(file, "%7d  %5d  %-9s  %-9s  %10.3f %%  %8.3f  %3u  %3u  %10llu%s\n", job->max_overlap,
+                    job->tap_code_delay, job->hold_instantly, job->very_long, get_misprediction_percent(job),
+                    job->mean_ms, job->p50_ms, job->p99_ms, job->blocked_ms, job->is_on_front ? "  *" : "");
+        }
+    }
+}
+
+
+int main(int argc, char** argv) {
+    long max_running = sysconf(_SC_NPROCESSORS_ONLN);
+    char default_hold_instantly[] = "never,keymap";
+    char default_very_long[] = "hold,repeat,keymap";
+    char* hold_instantly_list = default_hold_instantly;
+    char* very_long_list = default_very_long;
+    const char* report_path = NULL;
+
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-' && strcmp(argv[i], "--") != 0; i += 2) {
+        if (strcmp(argv[i], "-j") == 0) {
+            max_running = strtol(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            hold_instantly_list = argv[i + 1];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            very_long_list = argv[i + 1];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            report_path = argv[i + 1];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    const int first_point = i;
+    while (i < argc && strcmp(argv[i], "--") != 0) ++i;
+    const int point_count = i - first_point;
+    const int corpus_count = argc - i - 1;
+    if (point_count == 0 || corpus_count <= 0 || max_running <= 0) usage(argv[0]);
+
+    const char* hold_instantly[8];
+    const char* very_long[8];
+    const size_t hold_instantly_count = split_list(hold_instantly_list, hold_instantly, 8);
+    const size_t very_long_count = split_list(very_long_list, very_long, 8);
+
+    const size_t job_count = point_count * hold_instantly_count * very_long_count;
+    job_t* jobs = calloc(job_count, sizeof(*jobs));
+    if (jobs == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    size_t count = 0;
+    for (int p = 0; p < point_count; ++p) {
+        for (size_t h = 0; h < hold_instantly_count; ++h) {
+            for (size_t v = 0; v < very_long_count; ++v) {
+                jobs[count++] = (job_t){
+                    .point = argv[first_point + p], .hold_instantly = hold_instantly[h], .very_long = very_long[v],
+                };
+            }
+        }
+    }
+
+    run_jobs(jobs, job_count, max_running, argv + argc - corpus_count, corpus_count);
+    mark_pareto_front(jobs, job_count);
+
+    printf("%llu labeled tap hold presses, %llu presses (* is on the Pareto front)\n\n",
+           jobs[0].labeled, jobs[0].presses);
+    print_results(stdout, jobs, job_count, false);
+
+    if (report_path != NULL) {
+        FILE* report = fopen(report_path, "w");
+        if (report == NULL) {
+            perror(report_path);
+            return 1;
+        }
+        print_results(report, jobs, job_count, true);
+        fclose(report);
+    }
+
+    free(jobs);
+    return 0;
+}
@@ -0,0 +1,14 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// Included after the keyboard and keymap config.h by the builds of
+// sweep_point.c, so each one has the settings of its grid point (see the
+// sweep target in the Makefile). Both are compile time constants on the
+// keyboard, so there is one build per point.
+
+#pragma once
+
+#undef TAP_CODE_DELAY
+#define TAP_CODE_DELAY SWEEP_TAP_CODE_DELAY
+
+#undef MS_MAX_OVERLAP
+#define MS_MAX_OVERLAP SWEEP_MAX_OVERLAP
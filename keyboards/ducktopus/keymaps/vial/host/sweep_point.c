@@ -0,0 +1,214 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// One grid point of the sweep (see sweep.c): replays labeled corpora through
+// the heuristic tap hold code, built with this point's MS_MAX_OVERLAP and
+// TAP_CODE_DELAY (sweep_config.h), and prints one line:
+//
+//     <max overlap> <tap code delay> <hold instantly> <very long> <labeled>
+//     <mispredicted> <presses> <mean ms> <p50 ms> <p99 ms> <blocked scans>
+//
+// A labeled tap hold press is mispredicted if what it was decided as last
+// isn't its label. The latency is from the physical press of a key until it
+// reaches the QMK core, for every press.
+
+#include <stdio.h>
+
+#include "corpus.h"
+#include "sim.h"
+#include "features/heuristic_tap_hold.h"
+
+// more than MS_MAX_OVERLAP, so every pending decision is made at the end
+#define MS_SETTLE_AFTER_LAST_EVENT 1100
+
+// latencies of this many ms or more share the last bucket
+#define LATENCY_BUCKET_COUNT 1024
+
+// like keymap.c
+#define LAYER_GFUN 1
+#define LAYER_SYMB 3
+
+typedef enum {
+    HOLD_INSTANTLY_NEVER,  // the default of the feature
+    HOLD_INSTANTLY_KEYMAP, // escape with alt or the game function layer, like keymap.c
+    HOLD_INSTANTLY_POLICY_COUNT
+} hold_instantly_policy_t;
+
+typedef enum {
+    VERY_LONG_HOLD,   // always hold
+    VERY_LONG_REPEAT, // tap, if the previous press was the same key and a tap (the default of the feature)
+    VERY_LONG_KEYMAP, // like keymap.c: backspace taps, unless the symbol layer is on, enter repeats
+    VERY_LONG_POLICY_COUNT
+} very_long_policy_t;
+
+static const char* const hold_instantly_names[HOLD_INSTANTLY_POLICY_COUNT] = {"never", "keymap"};
+static const char* const very_long_names[VERY_LONG_POLICY_COUNT] = {"hold", "repeat", "keymap"};
+
+static hold_instantly_policy_t hold_instantly_policy = HOLD_INSTANTLY_NEVER;
+static very_long_policy_t very_long_policy = VERY_LONG_REPEAT;
+
+// what happened to the last press of each key
+typedef struct {
+    uint8_t label;
+    bool is_pending;
+    bool was_sent;
+    bool chose_tap;
+    uint32_t latency_ms;
+} press_t;
+
+static press_t press_at[MATRIX_ROWS][MATRIX_COLS];
+
+static uint64_t latency_counts[LATENCY_BUCKET_COUNT];
+static uint64_t latency_sum_ms;
+static uint64_t press_count;
+static uint64_t labeled_count;
+static uint64_t mispredicted_count;
+
+
+bool should_hold_instantly(void) {
+    if (hold_instantly_policy == HOLD_INSTANTLY_NEVER) return false;
+
+    const uint16_t keycode = get_heuristic_tap_hold_keycode();
+    return keycode == LALT_T(KC_ESC) || keycode == LT(LAYER_GFUN, KC_ESC);
+}
+
+
+bool should_choose_tap_when_pressed_very_long_without_another_key(void) {
+    switch (very_long_policy) {
+        case VERY_LONG_HOLD:
+            return false;
+        case VERY_LONG_REPEAT:
+            return prev_chose_tap_and_was_same_tap_hold();
+        default:
+            switch (get_tap_keycode(get_heuristic_tap_hold_keycode())) {
+                case KC_BSPC:
+                    return !IS_LAYER_ON(LAYER_SYMB);
+                case KC_ENTER:
+                    return prev_chose_tap_and_was_same_tap_hold();
+            }
+            return false;
+    }
+}
+
+
+static void on_press_sent(const keyrecord_t* record, uint16_t keycode, uint32_t ms_since_press) {
+    press_t* press = &press_at[record->event.key.row][record->event.key.col];
+    press->was_sent = true;
+    press->chose_tap = record->tap.count > 0;
+    press->latency_ms = ms_since_press;
+}
+
+
+static void finish_press(press_t* press) {
+    if (!press->is_pending) return;
+    press->is_pending = false;
+
+    if (press->was_sent) {
+        latency_counts[MIN(press->latency_ms, LATENCY_BUCKET_COUNT - 1)]++;
+        latency_sum_ms += press->latency_ms;
+        press_count++;
+    }
+
+    if (press->label == CORPUS_LABEL_NONE) return;
+    labeled_count++;
+    // never sent counts as wrong, too
+    const bool chose_tap = press->was_sent && press->chose_tap;
+    const bool chose_hold = press->was_sent && !press->chose_tap;
+    mispredicted_count += !(press->label == CORPUS_LABEL_TAP ? chose_tap : chose_hold);
+}
+
+
+static uint32_t get_latency_percentile(double fraction) {
+    const uint64_t rank = (uint64_t) (fraction * (double) press_count);
+    uint64_t seen = 0;
+    for (uint32_t ms = 0; ms < LATENCY_BUCKET_COUNT; ++ms) {
+        seen += latency_counts[ms];
+        if (seen > rank) return ms;
+    }
+    return LATENCY_BUCKET_COUNT - 1;
+}
+
+
+static int find_name(const char* const* names, int count, const char* name) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-i never|keymap] [-l hold|repeat|keymap] CORPUS...\n", name);
+    exit(2);
+}
+
+
+static void replay(const char* path, uint32_t* offset) {
+    corpus_t corpus;
+    if (!corpus_open(&corpus, path)) exit(1);
+
+    const uint32_t start = corpus.event_count > 0 ? corpus.deltas[0] : 0;
+    uint32_t time = 0;
+    for (uint64_t i = 0; i < corpus.event_count; ++i) {
+        time += corpus.deltas[i];
+        const uint8_t row = CORPUS_ROW(corpus.positions[i]);
+        const uint8_t col = CORPUS_COL(corpus.positions[i]);
+        if (row >= MATRIX_ROWS || col >= MATRIX_COLS) {
+            fprintf(stderr, "%s: event %llu is outside of the matrix\n", path, (unsigned long long) i);
+            exit(1);
+        }
+        sim_run_until(*offset + time - start);
+
+        const bool pressed = corpus.flags[i] & CORPUS_FLAG_PRESSED;
+        if (pressed) {
+            press_t* press = &press_at[row][col];
+            finish_press(press);
+            *press = (press_t){.label = corpus.labels[i], .is_pending = true};
+            sim_set_keycode(row, col, corpus.keycodes[i]);
+        }
+        sim_key_event(row, col, pressed);
+    }
+
+    sim_run_until(sim_now() + MS_SETTLE_AFTER_LAST_EVENT);
+    *offset = sim_now();
+    corpus_close(&corpus);
+}
+
+
+int main(int argc, char** argv) {
+    int first_path = 1;
+    for (; first_path + 1 < argc && argv[first_path][0] == '-'; first_path += 2) {
+        const char* value = argv[first_path + 1];
+        int policy = -1;
+        if (strcmp(argv[first_path], "-i") == 0) {
+            policy = find_name(hold_instantly_names, HOLD_INSTANTLY_POLICY_COUNT, value);
+            hold_instantly_policy = (hold_instantly_policy_t) policy;
+        } else if (strcmp(argv[first_path], "-l") == 0) {
+            policy = find_name(very_long_names, VERY_LONG_POLICY_COUNT, value);
+            very_long_policy = (very_long_policy_t) policy;
+        }
+        if (policy < 0) usage(argv[0]);
+    }
+    if (first_path >= argc) usage(argv[0]);
+
+    sim_init(false);
+    sim_set_press_callback(on_press_sent);
+    keyboard_post_init_user();
+
+    uint32_t offset = 1;
+    for (int i = first_path; i < argc; ++i) {
+        replay(argv[i], &offset);
+    }
+    for (int row = 0; row < MATRIX_ROWS; ++row) {
+        for (int col = 0; col < MATRIX_COLS; ++col) {
+            finish_press(&press_at[row][col]);
+        }
+    }
+
+    printf("%d %d %s %s %llu %llu %llu %.3f %u %u %llu\n", MS_MAX_OVERLAP, TAP_CODE_DELAY,
+           hold_instantly_names[hold_instantly_policy], very_long_names[very_long_policy],
+           (unsigned long long) labeled_count, (unsigned long long) mispredicted_count,
+           (unsigned long long) press_count, press_count ? (double) latency_sum_ms / (double) press_count : 0.0,
+           get_latency_percentile(0.5), get_latency_percentile(0.99),
+           (unsigned long long) sim_get_stats()->blocked_ms);
+    return 0;
+}
@@ -0,0 +1,211 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+// The indices a worker has left. It takes them from the front, thieves take
+// from the back.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} __attribute__((aligned(64))) pool_range_t;
+
+struct thread_pool {
+    unsigned worker_count;
+    pthread_t* threads;
+    pool_range_t* ranges;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t run_count;
+    unsigned busy_count;
+    bool should_stop;
+
+    pool_task_t task;
+    void* context;
+};
+
+typedef struct {
+    thread_pool_t* pool;
+    unsigned worker;
+} worker_start_t;
+
+
+unsigned get_cpu_count(void) {
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned) count : 1;
+}
+
+
+static bool take_own(pool_range_t* range, size_t* index) {
+    pthread_mutex_lock(&range->lock);
+    const bool has_index = range->next < range->end;
+    if (has_index) *index = range->next++;
+    pthread_mutex_unlock(&range->lock);
+    return has_index;
+}
+
+
+static bool steal(thread_pool_t* pool, unsigned thief) {
+    for (unsigned i = 1; i < pool->worker_count; ++i) {
+        pool_range_t* victim = &pool->ranges[(thief + i) % pool->worker_count];
+
+        pthread_mutex_lock(&victim->lock);
+        const size_t left = victim->end - victim->next;
+        const size_t end = victim->end;
+        // the victim keeps the first (smaller) half, as it's already on it
+        const size_t start = victim->end - (left + 1) / 2;
+        if (left > 0) victim->end = start;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (left == 0) continue;
+
+        // nobody steals from an empty range, so this doesn't race
+        pool_range_t* own = &pool->ranges[thief];
+        pthread_mutex_lock(&own->lock);
+        own->next = start;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+    return false;
+}
+
+
+static void work(thread_pool_t* pool, unsigned worker) {
+    pool_range_t* own = &pool->ranges[worker];
+    size_t index;
+
+    do {
+        while (take_own(own, &index)) {
+            pool->task(pool->context, index, worker);
+        }
+    } while (steal(pool, worker));
+}
+
+
+static void* run_worker(void* argument) {
+    const worker_start_t start = *(worker_start_t*) argument;
+    free(argument);
+    thread_pool_t* pool = start.pool;
+
+    uint64_t seen_run_count = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->should_stop && pool->run_count == seen_run_count) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        seen_run_count = pool->run_count;
+        const bool should_stop = pool->should_stop;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (should_stop) return NULL;
+
+        work(pool, start.worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy_count == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+
+thread_pool_t* thread_pool_create(unsigned worker_count) {
+    thread_pool_t* pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    pool->worker_count = worker_count ? worker_count : get_cpu_count();
+    pool->threads = calloc(pool->worker_count, sizeof(*pool->threads));
+    pool->ranges = aligned_alloc(64, pool->worker_count * sizeof(*pool->ranges));
+    if (pool->threads == NULL || pool->ranges == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (unsigned w = 0; w < pool->worker_count; ++w) {
+        pthread_mutex_init(&pool->ranges[w].lock, NULL);
+        pool->ranges[w].next = pool->ranges[w].end = 0;
+    }
+
+    // worker 0 is the thread calling thread_pool_run
+    for (unsigned w = 1; w < pool->worker_count; ++w) {
+        worker_start_t* start = malloc(sizeof(*start));
+        if (start == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        *start = (worker_start_t){.pool = pool, .worker = w};
+        if (pthread_create(&pool->threads[w], NULL, run_worker, start) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+
+unsigned thread_pool_get_worker_count(const thread_pool_t* pool) {
+    return pool->worker_count;
+}
+
+
+void thread_pool_run(thread_pool_t* pool, pool_task_t task, void* context, size_t count) {
+    // workers are idle here, so the ranges can be set without their locks
+    for (unsigned w = 0; w < pool->worker_count; ++w) {
+        pool->ranges[w].next = count * w / pool->worker_count;
+        pool->ranges[w].end = count * (w + 1) / pool->worker_count;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->busy_count = pool->worker_count - 1;
+    pool->run_count++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy_count > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+void thread_pool_destroy(thread_pool_t* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->should_stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned w = 1; w < pool->worker_count; ++w) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    for (unsigned w = 0; w < pool->worker_count; ++w) {
+        pthread_mutex_destroy(&pool->ranges[w].lock);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->ranges);
+    free(pool->threads);
+    free(pool);
+}
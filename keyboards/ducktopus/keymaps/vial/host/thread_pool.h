@@ -0,0 +1,28 @@
+// Copyright 2024 Joschua Gandert (@CreamyCookie)
+//
+// A work stealing thread pool for the host tools. thread_pool_run calls the
+// task once for every index. Each worker starts with an equal share of the
+// indices and takes them in order. When it runs out, it steals the upper half
+// of what another worker has left, so a few slow tasks don't leave the other
+// cores idle.
+//
+// Tasks must not depend on which worker runs them or in which order (the
+// worker index is only for scratch memory), so the results are the same for
+// any number of workers.
+
+#pragma once
+
+#include <stddef.h>
+
+typedef void (*pool_task_t)(void* context, size_t index, unsigned worker);
+
+typedef struct thread_pool thread_pool_t;
+
+// 0 workers means one per CPU. The calling thread is one of them.
+thread_pool_t* thread_pool_create(unsigned worker_count);
+unsigned thread_pool_get_worker_count(const thread_pool_t* pool);
+// Returns once every task has run.
+void thread_pool_run(thread_pool_t* pool, pool_task_t task, void* context, size_t count);
+void thread_pool_destroy(thread_pool_t* pool);
+
+unsigned get_cpu_count(void);
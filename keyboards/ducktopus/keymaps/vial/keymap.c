@@ -3,9 +3,45 @@
 #include QMK_KEYBOARD_H
 #include "ducktopus.h"
 #include "features/heuristic_tap_hold.h"
+#include "features/keycode_classes.h"
+#include "features/record_handlers.h"
+#        ifdef HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS
+#include "features/heuristic_tap_hold_latency.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_KERNEL_BENCH
+#include "features/heuristic_tap_hold_kernel_bench.h"
+#        endif
+#        ifdef SCAN_PROFILER_ENABLE
+#include "features/scan_profiler.h"
+#        endif
+#        ifdef KEYSTROKE_CAPTURE_ENABLE
+#include "features/keystroke_capture.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS
+#include "features/heuristic_tap_hold_bigrams.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS
+#include "features/heuristic_tap_hold_coefficients.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_SHADOW
+#include "features/heuristic_tap_hold_shadow.h"
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS
+#include "features/heuristic_tap_hold_adaptive.h"
+#        endif
+#        ifdef EFFECTIVE_KEYMAP_ENABLE
+#include "features/effective_keymap.h"
+#        endif
+
+#        ifdef VIA_ENABLE
+#include "raw_hid.h"
+#        endif
 
 #        ifdef VIAL_ENABLE
 #include "dynamic_keymap.h"
+#        ifdef KEYMAP_MIRROR_ENABLE
+#include "features/keymap_mirror.h"
+#        endif
 #        else
 #include "keymap_introspection.h"
 #        endif
@@ -358,7 +394,9 @@ static uint16_t get_keycode_same_pos_in_layer(keyrecord_t* record, uint8_t layer
         // thanks to u/pgetreuer for his help here
         const keypos_t pos = record->event.key;
 
-#        ifdef VIAL_ENABLE
+#        if defined(VIAL_ENABLE) && defined(KEYMAP_MIRROR_ENABLE)
+        return keymap_mirror_get_keycode(layer, pos.row, pos.col);
+#        elif defined(VIAL_ENABLE)
         return dynamic_keymap_get_keycode(layer, pos.row, pos.col);
 #        else
         return keycode_at_keymap_location(layer, pos.row, pos.col);
@@ -368,6 +406,21 @@ static uint16_t get_keycode_same_pos_in_layer(keyrecord_t* record, uint8_t layer
 
 
 
+// the handlers of process_record_user, in the order they are called
+enum record_handler_index {
+#        if !defined(NO_ACTION_TAPPING)
+    HANDLER_HEURISTIC_TAP_HOLD,
+#        endif
+    HANDLER_ALT_TAB,
+    HANDLER_MOD_LAYER,
+#        ifdef CAPS_WORD_ENABLE
+    HANDLER_CAPS_WORD_SPACE,
+#        endif
+};
+
+
+
+
 //=============================================================================
 // Alt Tab
 
@@ -377,13 +430,18 @@ static uint16_t get_keycode_same_pos_in_layer(keyrecord_t* record, uint8_t layer
 static bool alt_tab_was_started = false;
 
 
-bool process_alt_tab(uint16_t keycode, keyrecord_t* record) {
-    const bool is_alt_tab_key = keycode == LALT(KC_TAB) || keycode == LSA(KC_TAB);
+static void set_alt_tab_started(bool is_started) {
+    alt_tab_was_started = is_started;
+    // any other key ends it
+    set_record_handler_wants_every_event(HANDLER_ALT_TAB, is_started);
+}
+
 
-    if (!is_alt_tab_key) {
+bool process_alt_tab(uint16_t keycode, uint8_t classes, keyrecord_t* record) {
+    if (!(classes & KEYCODE_CLASS_ALT_TAB)) {
         if (alt_tab_was_started && keycode != KC_BTN1) {
             unregister_mods(MOD_BIT(KC_LALT));
-            alt_tab_was_started = false;
+            set_alt_tab_started(false);
         }
         return true;
     }
@@ -395,7 +453,7 @@ bool process_alt_tab(uint16_t keycode, keyrecord_t* record) {
     if (!alt_tab_was_started) {
         register_mods(MOD_BIT(KC_LALT));
         send_keyboard_report();
-        alt_tab_was_started = true;
+        set_alt_tab_started(true);
     }
 
     if (record->event.pressed) {
@@ -409,81 +467,163 @@ bool process_alt_tab(uint16_t keycode, keyrecord_t* record) {
 }
 
 
-static bool is_layer_switch_keycode(uint16_t keycode) {
-    switch (keycode) {
-        case QK_LAYER_TAP ... QK_LAYER_TAP_MAX:
-        case QK_LAYER_MOD ... QK_LAYER_MOD_MAX:
-        case QK_TO ... QK_TO_MAX:
-        case QK_MOMENTARY ... QK_MOMENTARY_MAX:
-        case QK_DEF_LAYER ... QK_DEF_LAYER_MAX:
-        case QK_TOGGLE_LAYER ... QK_TOGGLE_LAYER_MAX:
-        case QK_ONE_SHOT_LAYER ... QK_ONE_SHOT_LAYER_MAX:
-        case QK_LAYER_TAP_TOGGLE ... QK_LAYER_TAP_TOGGLE_MAX:
-            return true;
-    }
-    return false;
-}
-
-
-static bool will_switch_layer(uint16_t keycode, keyrecord_t* record) {
+static bool will_switch_layer(uint8_t classes, keyrecord_t* record) {
     // if pressed layer switch key and (not LT or a held LT)
-    return record->event.pressed && is_layer_switch_keycode(keycode) &&
-           (!IS_QK_LAYER_TAP(keycode) || record->tap.count == 0);
+    return record->event.pressed && (classes & KEYCODE_CLASS_LAYER_SWITCH) &&
+           (!(classes & KEYCODE_CLASS_TAP_HOLD) || record->tap.count == 0);
 }
 
 
-void process_layer_change_so_same_side_with_mod_layer(uint16_t keycode, keyrecord_t* record) {
-    if (will_switch_layer(keycode, record)) {
+bool process_layer_change_so_same_side_with_mod_layer(uint16_t keycode, uint8_t classes, keyrecord_t* record) {
+    if (will_switch_layer(classes, record)) {
         cur_mod_layer = is_on_left_hand(record) ? LAYER_LMOD : LAYER_RMOD;
     } else {
         cur_mod_layer = 0;
     }
+    // any other key turns it off again
+    set_record_handler_wants_every_event(HANDLER_MOD_LAYER, cur_mod_layer != 0);
+    return true;
 }
 
 
-bool process_space_to_underscore_for_caps_words(uint16_t keycode, keyrecord_t* record) {
-    if (!is_caps_word_on() || !record->event.pressed) return true;
-
-    const uint16_t tap_keycode = get_tap_keycode(keycode);
-    if (tap_keycode != KC_SPACE) return true;
+bool process_space_to_underscore_for_caps_words(uint16_t keycode, uint8_t classes, keyrecord_t* record) {
+    if (!(classes & KEYCODE_CLASS_SPACE) || !record->event.pressed || !is_caps_word_on()) return true;
 
     // is a held tap hold
-    if (tap_keycode != keycode && record->tap.count == 0) return true;
+    if ((classes & KEYCODE_CLASS_TAP_HOLD) && record->tap.count == 0) return true;
 
     tap_code16(D_UNDS);
     return false;
 }
 
 
-bool process_record_user(uint16_t keycode, keyrecord_t* record) {
-#        if !defined(NO_ACTION_TAPPING)
-    if (!process_heuristic_tap_hold(keycode, record)) {
-        return false;
-    }
-#        endif // !NO_ACTION_TAPPING
+#        ifdef KEYSTROKE_CAPTURE_ENABLE
+// only sees physical key events, not the ones the heuristic sends again
+bool pre_process_record_user(uint16_t keycode, keyrecord_t* record) {
+    if (IS_KEYEVENT(record->event)) capture_keystroke(record);
+    return true;
+}
+#        endif
 
-    if (!process_alt_tab(keycode, record)) {
-        return false;
-    }
 
-    process_layer_change_so_same_side_with_mod_layer(keycode, record);
+#        if !defined(NO_ACTION_TAPPING)
+static bool process_heuristic_tap_hold_with_classes(uint16_t keycode, uint8_t classes, keyrecord_t* record) {
+    return process_heuristic_tap_hold(keycode, record);
+}
+#        endif
 
+
+// each is only called for the events and keycode classes it cares about
+static const record_handler_t record_handlers[] = {
+#        if !defined(NO_ACTION_TAPPING)
+    [HANDLER_HEURISTIC_TAP_HOLD] = {process_heuristic_tap_hold_with_classes, RECORD_EVENT_ANY, 0, "taphold"},
+#        endif
+    [HANDLER_ALT_TAB]   = {process_alt_tab, RECORD_EVENT_ANY, KEYCODE_CLASS_ALT_TAB, "alt_tab"},
+    [HANDLER_MOD_LAYER] = {process_layer_change_so_same_side_with_mod_layer, RECORD_EVENT_ANY,
+                           KEYCODE_CLASS_LAYER_SWITCH, "modlayer"},
 #        ifdef CAPS_WORD_ENABLE
-    if (!process_space_to_underscore_for_caps_words(keycode, record)) {
-        return false;
-    }
+    [HANDLER_CAPS_WORD_SPACE] = {process_space_to_underscore_for_caps_words, RECORD_EVENT_PRESS,
+                                 KEYCODE_CLASS_SPACE, "capsword"},
 #        endif
+};
+
 
+bool process_record_user(uint16_t keycode, keyrecord_t* record) {
     // true = the key press should continue to be processed as normal
-    return true;
+    return process_record_handlers(keycode, record);
 }
 
 
 void matrix_scan_user(void) {
+#        ifdef SCAN_PROFILER_ENABLE
+    end_scan_stage(SCAN_STAGE_MATRIX);
+    begin_scan_stage(SCAN_STAGE_MATRIX_SCAN_USER);
+#        endif
 #        if !defined(NO_ACTION_TAPPING)
     heuristic_tap_hold_task();
 #        endif // !NO_ACTION_TAPPING
+#        ifdef SCAN_PROFILER_ENABLE
+    end_scan_stage(SCAN_STAGE_MATRIX_SCAN_USER);
+#        endif
+}
+
+
+void housekeeping_task_user(void) {
+#        if defined(HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS) && !defined(NO_ACTION_TAPPING)
+    heuristic_tap_hold_adaptive_task();
+#        endif
+#        ifdef SCAN_PROFILER_ENABLE
+    scan_profiler_task();
+#        endif
+}
+
+
+#        ifdef VIA_ENABLE
+// raw HID commands that VIA and Vial don't know
+bool via_command_kb(uint8_t* data, uint8_t length) {
+#        if defined(VIAL_ENABLE) && defined(KEYMAP_MIRROR_ENABLE)
+    update_keymap_mirror_before_via_command(data, length);
+#        endif
+#        ifdef EFFECTIVE_KEYMAP_ENABLE
+    update_effective_keymap_before_via_command(data, length);
+#        endif
+#        ifdef RECORD_HANDLER_STATS
+    if (process_record_handler_stats_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        ifdef SCAN_PROFILER_ENABLE
+    if (process_scan_profiler_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_LATENCY_HISTOGRAMS) && !defined(NO_ACTION_TAPPING)
+    if (process_heuristic_tap_hold_latency_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        ifdef HEURISTIC_TAP_HOLD_KERNEL_BENCH
+    if (process_heuristic_tap_hold_kernel_bench_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        ifdef KEYSTROKE_CAPTURE_ENABLE
+    if (process_keystroke_capture_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS) && !defined(NO_ACTION_TAPPING)
+    if (process_heuristic_tap_hold_bigram_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS) && !defined(NO_ACTION_TAPPING)
+    if (process_heuristic_tap_hold_coefficients_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_SHADOW) && !defined(NO_ACTION_TAPPING)
+    if (process_heuristic_tap_hold_shadow_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS) && !defined(NO_ACTION_TAPPING)
+    if (process_heuristic_tap_hold_adaptive_command(data, length)) {
+        raw_hid_send(data, length);
+        return true;
+    }
+#        endif
+    return false;
 }
+#        endif // VIA_ENABLE
 
 
 tap_hold_decision_options choose_when_next_to_heuristic_tap_hold_on_same_side(
@@ -501,7 +641,12 @@ tap_hold_decision_options choose_when_next_to_heuristic_tap_hold_on_same_side(
         }
     }
 
+#        ifdef HEURISTIC_TAP_HOLD_SAME_SIDE_MODEL
+    // e.g. a same hand Ctrl shortcut, if the trained model knows it
+    return choose_by_same_side_model();
+#        else
     return CHOSE_TAP;
+#        endif
 }
 
 
@@ -691,9 +836,15 @@ static void pointing_device_task_trackball(report_mouse_t* mouse_report) {
 
 
 report_mouse_t pointing_device_task_user(report_mouse_t mouse_report) {
+#        ifdef SCAN_PROFILER_ENABLE
+    begin_scan_stage(SCAN_STAGE_POINTING_DEVICE_USER);
+#        endif
     if (is_keyboard_master()) {
         pointing_device_task_trackball(&mouse_report);
     }
+#        ifdef SCAN_PROFILER_ENABLE
+    end_scan_stage(SCAN_STAGE_POINTING_DEVICE_USER);
+#        endif
     return mouse_report;
 }
 
@@ -720,13 +871,36 @@ layer_state_t layer_state_set_user(layer_state_t state) {
 
     if (!layer_state_cmp(state, LAYER_FUNC) && alt_tab_was_started) {
        unregister_mods(MOD_BIT(KC_LALT));
-       alt_tab_was_started = false;
+       set_alt_tab_started(false);
     }
+#        ifdef EFFECTIVE_KEYMAP_ENABLE
+    update_effective_keymap(state | default_layer_state);
+#        endif
     return state;
 }
 
+#        ifdef EFFECTIVE_KEYMAP_ENABLE
+layer_state_t default_layer_state_set_user(layer_state_t state) {
+    update_effective_keymap(state | layer_state);
+    return state;
+}
+#        endif
+
 void keyboard_post_init_user(void) {
     default_layer_set(1UL << LAYER_MAIN);
+    register_record_handlers(record_handlers, sizeof(record_handlers) / sizeof(record_handlers[0]));
+#        if defined(VIAL_ENABLE) && defined(KEYMAP_MIRROR_ENABLE)
+    load_keymap_mirror();
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_BIGRAM_OFFSETS) && !defined(NO_ACTION_TAPPING)
+    load_heuristic_tap_hold_bigram_offsets();
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_RUNTIME_COEFFICIENTS) && !defined(NO_ACTION_TAPPING)
+    load_heuristic_tap_hold_coefficients();
+#        endif
+#        if defined(HEURISTIC_TAP_HOLD_ADAPTIVE_BIAS) && !defined(NO_ACTION_TAPPING)
+    load_heuristic_tap_hold_adaptive_biases();
+#        endif
     //pointing_device_set_cpi(TRACKBALL_NORMAL_DPI);
 #ifdef CONSOLE_ENABLE
     debug_enable=true;
@@ -2,3 +2,20 @@ VIA_ENABLE = yes
 VIAL_ENABLE = yes
 VIAL_INSECURE = yes
 SRC += features/heuristic_tap_hold.c
+SRC += features/keycode_classes.c
+SRC += features/record_handlers.c
+SRC += features/cycle_counter.c
+SRC += features/scan_profiler.c
+SRC += features/heuristic_tap_hold_kernels.c
+SRC += features/heuristic_tap_hold_kernel_bench.c
+SRC += features/heuristic_tap_hold_latency.c
+SRC += features/keystroke_capture.c
+SRC += features/heuristic_tap_hold_rhythm.c
+SRC += features/eeprom_block.c
+SRC += features/heuristic_tap_hold_bigrams.c
+SRC += features/heuristic_tap_hold_coefficients.c
+SRC += features/heuristic_tap_hold_shadow.c
+SRC += features/heuristic_tap_hold_adaptive.c
+SRC += features/heuristic_tap_hold_same_side.c
+SRC += features/keymap_mirror.c
+SRC += features/effective_keymap.c